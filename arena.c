@@ -0,0 +1,77 @@
+/*
+    One block of memory for all the DSP state, allocated at startup and never freed
+    while running. It is touched page by page and locked when the OS allows it, so the
+    audio thread never takes a page fault on memory it sees for the first time, like
+    the voices of the first big chord.
+    Each module has a xxx_footprint function that mirrors its init, the sum sizes the arena.
+*/
+#include "platform.h"
+#include <assert.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+#define ARENA_ALIGNMENT 64 // cache line, enough for any vector
+#define ARENA_PAGE_SIZE 4096
+
+typedef struct {
+    Uint8 *base;
+    size_t size;
+    size_t reserved; // size rounded up to whole pages, what was allocated and locked
+    size_t used;
+    bool locked; // mlock succeeded, the pages stay resident
+} Arena;
+
+size_t arena_align(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+}
+
+// base is NULL when the memory cannot be had, locked tells whether it could be locked. The caller decides
+// what to do about either
+Arena arena_init(size_t size) {
+    const size_t reserved = SDL_max((size + ARENA_PAGE_SIZE - 1) & ~(size_t) (ARENA_PAGE_SIZE - 1), ARENA_PAGE_SIZE);
+    Arena arena = {.base = reserved >= size ? SDL_aligned_alloc(ARENA_PAGE_SIZE, reserved) : NULL, .size = size, .reserved = reserved};
+    if (arena.base == NULL) {
+        arena.size = 0;
+        arena.reserved = 0;
+        return arena;
+    }
+    // prefault: writing every page makes the OS back it now instead of on first use
+    SDL_memset(arena.base, 0, reserved);
+#if defined(__unix__) || defined(__APPLE__)
+    // can fail with a low RLIMIT_MEMLOCK, the memory is still prefaulted
+    arena.locked = mlock(arena.base, reserved) == 0;
+#endif
+    return arena;
+}
+
+void arena_free(Arena *arena) {
+    if (arena->base == NULL) return;
+#if defined(__unix__) || defined(__APPLE__)
+    if (arena->locked) {
+        munlock(arena->base, arena->reserved);
+    }
+#endif
+    SDL_aligned_free(arena->base);
+    arena->base = NULL;
+    arena->size = 0;
+    arena->reserved = 0;
+    arena->used = 0;
+}
+
+// zeroed memory, not from the audio thread, running out means a footprint function is wrong
+void *arena_alloc(Arena *arena, size_t size) {
+    const size_t aligned = arena_align(size);
+    assert(arena->base != NULL && arena->used + aligned <= arena->size);
+    void *memory = arena->base + arena->used;
+    arena->used += aligned;
+    return memory;
+}
+
+void arena_report(const Arena *arena) {
+    SDL_Log(
+        "Engine memory: %zu KiB used of %zu KiB, %s",
+        arena->used / 1024, arena->size / 1024,
+        arena->locked ? "locked" : "prefaulted but not locked (check ulimit -l)"
+    );
+}
@@ -0,0 +1,229 @@
+/*
+    Patch banks. A bank file is a header and a SynthPatch per program, all little endian,
+    so it is memory-mapped and used in place: selecting a program is a copy of one record
+    handed to the engine, there is no parsing. Records only hold fixed-width fields,
+    unknown enum values load as the defaults and reserved bytes leave room to grow without
+    changing the layout. A layout change bumps PATCH_BANK_VERSION, a bank written on a big
+    endian machine reads as the wrong version and is refused.
+    The text form is for editing and diffing, patch_bank_import_text turns it into a bank.
+
+        # comment
+        patch Warm pad
+        wave 2
+        pulse_width 0.5
+        unison 4 0.3 0.8         count, detune, spread
+        filter 1 1200 0.4        mode, cutoff, resonance
+        env1 0.01 0.2 0.8 0.3    attack, decay, sustain, release
+        env2 0.5 1 0 0.5
+        volume 1
+        control_rate 32
+        oversampling 2           1, 2 or 4
+        mod 1 6 0 0.5            source, via, destination, amount, one line per slot
+        end
+*/
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include <stdio.h>
+#include "synth.h"
+
+#define PATCH_BANK_MAGIC "LSPB"
+#define PATCH_BANK_VERSION 1
+#define PATCH_BANK_PROGRAMS_MAX 16384
+
+typedef struct {
+    char magic[4];
+    Uint32 version;
+    Uint32 count;
+    Uint32 record_size; // checked against sizeof(SynthPatch)
+} PatchBankHeader;
+
+SDL_COMPILE_TIME_ASSERT(patch_bank_header_size, sizeof(PatchBankHeader) == 16);
+SDL_COMPILE_TIME_ASSERT(patch_record_size, sizeof(SynthPatch) == 384);
+
+typedef struct {
+    const SynthPatch *records; // count of them, inside the mapping
+    int count;
+    MappedFile file;
+} PatchBank;
+
+void patch_bank_close(PatchBank *bank) {
+    mapped_file_close(&bank->file);
+    *bank = (PatchBank){0};
+}
+
+// an empty bank when the file is missing or not a valid bank
+PatchBank patch_bank_open(const char *path) {
+    PatchBank bank = {.file = mapped_file_open(path)};
+    if (bank.file.data == NULL) {
+        SDL_Log("Patch bank %s: cannot read", path);
+        return bank;
+    }
+
+    const PatchBankHeader *header = (const PatchBankHeader *) bank.file.data;
+    if (bank.file.size < sizeof(PatchBankHeader) || SDL_memcmp(header->magic, PATCH_BANK_MAGIC, 4) != 0) {
+        SDL_Log("Patch bank %s: not a patch bank", path);
+    } else if (header->version != PATCH_BANK_VERSION || header->record_size != sizeof(SynthPatch)) {
+        SDL_Log("Patch bank %s: version %u is not supported, expected %d", path, (unsigned) header->version, PATCH_BANK_VERSION);
+    } else if (header->count > PATCH_BANK_PROGRAMS_MAX || bank.file.size < sizeof(PatchBankHeader) + header->count * sizeof(SynthPatch)) {
+        SDL_Log("Patch bank %s: truncated", path);
+    } else {
+        bank.records = (const SynthPatch *) (header + 1);
+        bank.count = (int) header->count;
+        return bank;
+    }
+    patch_bank_close(&bank);
+    return bank;
+}
+
+// NULL when the bank has no such program
+const SynthPatch *patch_bank_get(const PatchBank *bank, int program) {
+    if (program < 0 || program >= bank->count) return NULL;
+    return &bank->records[program];
+}
+
+bool patch_bank_write(const char *path, const SynthPatch *records, int count) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) return false;
+    PatchBankHeader header = {.version = PATCH_BANK_VERSION, .count = (Uint32) count, .record_size = sizeof(SynthPatch)};
+    SDL_memcpy(header.magic, PATCH_BANK_MAGIC, 4);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && (count == 0 || fwrite(records, sizeof(SynthPatch), (size_t) count, file) == (size_t) count);
+    return fclose(file) == 0 && ok;
+}
+
+// replaces or appends the program, filling the gap with the default patch, and maps the file again
+bool patch_bank_store(PatchBank *bank, const char *path, int program, const SynthPatch *record) {
+    assert(program >= 0 && program < PATCH_BANK_PROGRAMS_MAX);
+    const int count = SDL_max(bank->count, program + 1);
+    SynthPatch *records = SDL_malloc(count * sizeof(SynthPatch));
+    if (records == NULL) return false;
+    for (int i = 0; i < count; i++) {
+        records[i] = i < bank->count ? bank->records[i] : synth_patch_init();
+    }
+    records[program] = *record;
+    patch_bank_close(bank);
+    const bool ok = patch_bank_write(path, records, count);
+    SDL_free(records);
+    *bank = patch_bank_open(path);
+    return ok;
+}
+
+bool patch_bank_export_text(const PatchBank *bank, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) return false;
+    fprintf(file, "# patch bank, %d programs\n", bank->count);
+    for (int i = 0; i < bank->count; i++) {
+        const SynthPatch *r = &bank->records[i];
+        fprintf(file, "\n# program %d\npatch %s\n", i, r->name);
+        fprintf(file, "wave %u\n", (unsigned) r->wave_type);
+        fprintf(file, "pulse_width %g\n", r->pulse_width);
+        fprintf(file, "unison %u %g %g\n", (unsigned) r->unison, r->unison_detune, r->unison_spread);
+        fprintf(file, "filter %u %g %g\n", (unsigned) r->filter_mode, r->cutoff, r->resonance);
+        fprintf(file, "env1 %g %g %g %g\n", r->env1[0], r->env1[1], r->env1[2], r->env1[3]);
+        fprintf(file, "env2 %g %g %g %g\n", r->env2[0], r->env2[1], r->env2[2], r->env2[3]);
+        fprintf(file, "volume %g\n", r->volume);
+        fprintf(file, "control_rate %u\n", (unsigned) r->control_rate);
+        fprintf(file, "oversampling %u\n", (unsigned) r->oversampling);
+        for (int s = 0; s < SYNTH_MOD_SLOTS; s++) {
+            const SynthModSlot *slot = &r->slots[s];
+            if (slot->source == SYNTH_MOD_SRC_NONE) continue;
+            fprintf(file, "mod %u %u %u %g\n", (unsigned) slot->source, (unsigned) slot->via, (unsigned) slot->destination, slot->amount);
+        }
+        fprintf(file, "end\n");
+    }
+    return fclose(file) == 0;
+}
+
+// returns the number of programs written to bank_path, -1 when a file could not be used
+int patch_bank_import_text(const char *text_path, const char *bank_path) {
+    FILE *file = fopen(text_path, "r");
+    if (file == NULL) return -1;
+    SynthPatch *records = SDL_malloc(PATCH_BANK_PROGRAMS_MAX * sizeof(SynthPatch));
+    if (records == NULL) {
+        fclose(file);
+        return -1;
+    }
+    int count = 0;
+    int slot = 0;
+    SynthPatch *r = NULL;
+    char line[256];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        size_t length = SDL_strlen(line);
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) line[--length] = '\0';
+        if (SDL_strncmp(line, "patch ", 6) == 0) {
+            if (count == PATCH_BANK_PROGRAMS_MAX) break;
+            r = &records[count++];
+            *r = synth_patch_init();
+            SDL_strlcpy(r->name, line + 6, sizeof(r->name));
+            SDL_memset(r->slots, 0, sizeof(r->slots));
+            slot = 0;
+            continue;
+        }
+        if (r == NULL || line[0] == '#' || line[0] == '\0') continue;
+
+        // parsed into locals, a line that does not parse leaves the record as it was
+        unsigned a;
+        unsigned b;
+        unsigned c;
+        float x;
+        float y;
+        float z;
+        float w;
+        bool ok = true;
+        if (SDL_strncmp(line, "wave ", 5) == 0) {
+            ok = sscanf(line + 5, "%u", &a) == 1;
+            if (ok) r->wave_type = a;
+        } else if (SDL_strncmp(line, "pulse_width ", 12) == 0) {
+            ok = sscanf(line + 12, "%f", &x) == 1;
+            if (ok) r->pulse_width = x;
+        } else if (SDL_strncmp(line, "unison ", 7) == 0) {
+            ok = sscanf(line + 7, "%u %f %f", &a, &x, &y) == 3;
+            if (ok) {
+                r->unison = a;
+                r->unison_detune = x;
+                r->unison_spread = y;
+            }
+        } else if (SDL_strncmp(line, "filter ", 7) == 0) {
+            ok = sscanf(line + 7, "%u %f %f", &a, &x, &y) == 3;
+            if (ok) {
+                r->filter_mode = a;
+                r->cutoff = x;
+                r->resonance = y;
+            }
+        } else if (SDL_strncmp(line, "env1 ", 5) == 0 || SDL_strncmp(line, "env2 ", 5) == 0) {
+            ok = sscanf(line + 5, "%f %f %f %f", &x, &y, &z, &w) == 4;
+            float *env = line[3] == '1' ? r->env1 : r->env2;
+            if (ok) {
+                env[0] = x;
+                env[1] = y;
+                env[2] = z;
+                env[3] = w;
+            }
+        } else if (SDL_strncmp(line, "volume ", 7) == 0) {
+            ok = sscanf(line + 7, "%f", &x) == 1;
+            if (ok) r->volume = x;
+        } else if (SDL_strncmp(line, "control_rate ", 13) == 0) {
+            ok = sscanf(line + 13, "%u", &a) == 1;
+            if (ok) r->control_rate = a;
+        } else if (SDL_strncmp(line, "oversampling ", 13) == 0) {
+            ok = sscanf(line + 13, "%u", &a) == 1;
+            if (ok) r->oversampling = a;
+        } else if (SDL_strncmp(line, "mod ", 4) == 0) {
+            ok = sscanf(line + 4, "%u %u %u %f", &a, &b, &c, &x) == 4 && slot < SYNTH_MOD_SLOTS;
+            if (ok) r->slots[slot++] = (SynthModSlot){a, b, c, x};
+        } else if (SDL_strcmp(line, "end") == 0) {
+            r = NULL;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            SDL_Log("%s:%d: ignored \"%s\"", text_path, line_number, line);
+        }
+    }
+    fclose(file);
+    const bool written = patch_bank_write(bank_path, records, count);
+    SDL_free(records);
+    return written ? count : -1;
+}
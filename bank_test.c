@@ -0,0 +1,174 @@
+#include "greatest.h"
+#include "synth.c"
+#include "mapped_file.c"
+#include "bank.c"
+
+#define TEST_SAMPLE_RATE 44100.0f
+#define TEST_BANK "bank_test.bank"
+#define TEST_TEXT "bank_test.txt"
+
+Patch test_patch(void) {
+    Patch patch = patch_init(TEST_SAMPLE_RATE);
+    patch.oscillator.wave_type = WAVE_SAW;
+    patch.oscillator.unison = 4;
+    patch.oscillator.unison_detune = 0.25f;
+    filter_set_mode(&patch.filter, FILTER_MODE_LADDER);
+    filter_set_cutoff(&patch.filter, 1200.0f);
+    filter_set_resonance(&patch.filter, 0.5f);
+    patch.env1 = envelope_init(0.05f, 0.3f, 0.6f, 1.5f);
+    patch.volume = 0.75f;
+    patch.oversampling = 4;
+    mod_matrix_set_slot(&patch.mod_matrix, 0, MOD_SRC_LFO1, MOD_SRC_MOD_WHEEL, MOD_DST_PITCH, 0.5f);
+    mod_matrix_set_slot(&patch.mod_matrix, 3, MOD_SRC_ENV2, MOD_SRC_NONE, MOD_DST_CUTOFF, 3.0f);
+    mod_matrix_compile(&patch.mod_matrix);
+    return patch;
+}
+
+static enum greatest_test_res check_patch(const Patch *expected, const Patch *loaded) {
+    ASSERT_EQ(expected->oscillator.wave_type, loaded->oscillator.wave_type);
+    ASSERT_EQ(expected->oscillator.unison, loaded->oscillator.unison);
+    ASSERT_IN_RANGE(expected->oscillator.unison_detune, loaded->oscillator.unison_detune, 1e-6f);
+    ASSERT_EQ(expected->filter.mode, loaded->filter.mode);
+    ASSERT_IN_RANGE(expected->filter.cutoff, loaded->filter.cutoff, 1e-3f);
+    ASSERT_IN_RANGE(expected->filter.resonance, loaded->filter.resonance, 1e-6f);
+    ASSERT_IN_RANGE(expected->env1.release, loaded->env1.release, 1e-6f);
+    ASSERT_IN_RANGE(expected->volume, loaded->volume, 1e-6f);
+    ASSERT_EQ(expected->oversampling, loaded->oversampling);
+    ASSERT_EQ(expected->mod_matrix.n_routes, loaded->mod_matrix.n_routes);
+    for (int i = 0; i < expected->mod_matrix.n_routes; i++) {
+        ASSERT_EQ(expected->mod_matrix.routes[i].source, loaded->mod_matrix.routes[i].source);
+        ASSERT_EQ(expected->mod_matrix.routes[i].destination, loaded->mod_matrix.routes[i].destination);
+        ASSERT_IN_RANGE(expected->mod_matrix.routes[i].amount, loaded->mod_matrix.routes[i].amount, 1e-6f);
+    }
+    PASS();
+}
+
+TEST bank_round_trip(void) {
+    const Patch patch = test_patch();
+    const Patch init = patch_init(TEST_SAMPLE_RATE);
+    const SynthPatch records[3] = {
+        patch_to_synth(&init, "Init"),
+        patch_to_synth(&patch, "Saw lead"),
+        patch_to_synth(&init, "A name longer than thirty one characters"),
+    };
+    ASSERT(patch_bank_write(TEST_BANK, records, 3));
+
+    PatchBank bank = patch_bank_open(TEST_BANK);
+    ASSERT_EQ(3, bank.count);
+    ASSERT_STR_EQ("Saw lead", patch_bank_get(&bank, 1)->name);
+    ASSERT_EQ(SYNTH_PATCH_NAME_MAX - 1, (int) SDL_strlen(patch_bank_get(&bank, 2)->name));
+    ASSERT_EQ(NULL, patch_bank_get(&bank, 3));
+    const Patch loaded = patch_from_synth(patch_bank_get(&bank, 1), TEST_SAMPLE_RATE);
+    CHECK_CALL(check_patch(&patch, &loaded));
+
+    // storing past the end fills the gap with init patches
+    const SynthPatch stored = patch_to_synth(&patch, "Stored");
+    ASSERT(patch_bank_store(&bank, TEST_BANK, 5, &stored));
+    ASSERT_EQ(6, bank.count);
+    ASSERT_STR_EQ("Init", patch_bank_get(&bank, 4)->name);
+    ASSERT_STR_EQ("Stored", patch_bank_get(&bank, 5)->name);
+    patch_bank_close(&bank);
+    remove(TEST_BANK);
+    PASS();
+}
+
+TEST bank_text_round_trip(void) {
+    const Patch patch = test_patch();
+    const SynthPatch record = patch_to_synth(&patch, "Saw lead");
+    ASSERT(patch_bank_write(TEST_BANK, &record, 1));
+    PatchBank bank = patch_bank_open(TEST_BANK);
+    ASSERT(patch_bank_export_text(&bank, TEST_TEXT));
+    patch_bank_close(&bank);
+    remove(TEST_BANK);
+
+    ASSERT_EQ(1, patch_bank_import_text(TEST_TEXT, TEST_BANK));
+    bank = patch_bank_open(TEST_BANK);
+    ASSERT_EQ(1, bank.count);
+    ASSERT_STR_EQ("Saw lead", patch_bank_get(&bank, 0)->name);
+    const Patch loaded = patch_from_synth(patch_bank_get(&bank, 0), TEST_SAMPLE_RATE);
+    CHECK_CALL(check_patch(&patch, &loaded));
+    patch_bank_close(&bank);
+    remove(TEST_BANK);
+    remove(TEST_TEXT);
+    PASS();
+}
+
+TEST bank_text_bad_lines_keep_the_record(void) {
+    // every line is malformed, the program keeps the values of the init patch
+    FILE *file = fopen(TEST_TEXT, "w");
+    ASSERT(file != NULL);
+    fputs("patch Broken\nwave x\nunison 4 0.3 x\nfilter 1 abc\nenv1 0.1 0.2\nvolume\noversampling two\nend\n", file);
+    fclose(file);
+    ASSERT_EQ(1, patch_bank_import_text(TEST_TEXT, TEST_BANK));
+    PatchBank bank = patch_bank_open(TEST_BANK);
+    ASSERT_EQ(1, bank.count);
+    const SynthPatch *loaded = patch_bank_get(&bank, 0);
+    const Patch init = patch_init(TEST_SAMPLE_RATE);
+    const SynthPatch expected = patch_to_synth(&init, "Broken");
+    ASSERT_EQ(expected.wave_type, loaded->wave_type);
+    ASSERT_EQ(expected.unison, loaded->unison);
+    ASSERT_EQ(expected.unison_detune, loaded->unison_detune);
+    ASSERT_EQ(expected.filter_mode, loaded->filter_mode);
+    ASSERT_EQ(expected.cutoff, loaded->cutoff);
+    ASSERT_MEM_EQ(expected.env1, loaded->env1, sizeof(expected.env1));
+    ASSERT_EQ(expected.volume, loaded->volume);
+    ASSERT_EQ(expected.oversampling, loaded->oversampling);
+    patch_bank_close(&bank);
+    remove(TEST_BANK);
+    remove(TEST_TEXT);
+    PASS();
+}
+
+TEST bank_rejects_bad_files(void) {
+    PatchBank bank = patch_bank_open("bank_test_missing.bank");
+    ASSERT_EQ(0, bank.count);
+
+    // a header that promises more records than the file has
+    const Patch init = patch_init(TEST_SAMPLE_RATE);
+    const SynthPatch record = patch_to_synth(&init, "Init");
+    ASSERT(patch_bank_write(TEST_BANK, &record, 1));
+    FILE *file = fopen(TEST_BANK, "r+b");
+    const Uint32 count = 2;
+    fseek(file, 8, SEEK_SET);
+    fwrite(&count, sizeof(count), 1, file);
+    fclose(file);
+    bank = patch_bank_open(TEST_BANK);
+    ASSERT_EQ(0, bank.count);
+    remove(TEST_BANK);
+    PASS();
+}
+
+TEST bank_out_of_range_values_load_as_defaults(void) {
+    const Patch init = patch_init(TEST_SAMPLE_RATE);
+    SynthPatch record = patch_to_synth(&init, "Broken");
+    record.wave_type = 99;
+    record.filter_mode = 1000;
+    record.unison = 0;
+    record.control_rate = 0;
+    record.oversampling = 3;
+    record.slots[0] = (SynthModSlot){MOD_SRC_COUNT, MOD_SRC_NONE, MOD_DST_PITCH, 1.0f};
+    const Patch loaded = patch_from_synth(&record, TEST_SAMPLE_RATE);
+    ASSERT_EQ(init.oscillator.wave_type, loaded.oscillator.wave_type);
+    ASSERT_EQ(init.filter.mode, loaded.filter.mode);
+    ASSERT_EQ(1, loaded.oscillator.unison);
+    ASSERT_EQ(MOD_CONTROL_RATE_DEFAULT, loaded.mod_matrix.control_rate);
+    ASSERT_EQ(1, loaded.oversampling);
+    ASSERT_EQ(0, loaded.mod_matrix.n_routes);
+    PASS();
+}
+
+SUITE(bank_suite) {
+    RUN_TEST(bank_round_trip);
+    RUN_TEST(bank_text_round_trip);
+    RUN_TEST(bank_text_bad_lines_keep_the_record);
+    RUN_TEST(bank_rejects_bad_files);
+    RUN_TEST(bank_out_of_range_values_load_as_defaults);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(bank_suite);
+    GREATEST_MAIN_END();
+}
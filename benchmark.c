@@ -0,0 +1,100 @@
+/*
+    Benchmark material: a few patches that cover the expensive paths of the engine and a part
+    played on each, a chord every bar, an arpeggio over it, a mod wheel sweep and channel
+    pressure. Everything is deterministic so runs of different builds render the same work.
+    main --benchmark renders every case offline through libsynth and reports how many times
+    faster than real time it runs. make pgo trains the profile on the same material.
+*/
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include "synth.h"
+
+#define BENCHMARK_BARS 16
+#define BENCHMARK_CHORDS 4 // the progression, repeated
+#define BENCHMARK_STEPS_PER_BAR 16 // sixteenth notes
+#define BENCHMARK_STEP_SECONDS 0.125f // 120 bpm
+#define BENCHMARK_EVENTS_MAX 2048
+
+typedef struct {
+    const char *name;
+    SynthWave wave;
+    int unison;
+    SynthFilterMode filter_mode;
+    float cutoff;
+    float resonance;
+    int polyphony;
+    int oversampling;
+    bool chorus;
+    bool delay;
+    bool reverb;
+} BenchmarkCase;
+
+const BenchmarkCase benchmark_cases[] = {
+    {"saw unison ladder", SYNTH_WAVE_SAW, 8, SYNTH_FILTER_LADDER, 1500.0f, 0.6f, SYNTH_POLYPHONY_DEFAULT, 1, true, false, true},
+    {"mono square svf 2x", SYNTH_WAVE_SQUARE, 1, SYNTH_FILTER_SVF_LOWPASS, 3000.0f, 0.3f, 1, 2, false, true, false},
+    {"sine pad 4x", SYNTH_WAVE_SINE, 4, SYNTH_FILTER_LOWPASS, 4000.0f, 0.0f, SYNTH_POLYPHONY_DEFAULT, 4, false, false, true},
+};
+
+const int benchmark_chords[BENCHMARK_CHORDS][4] = {
+    {48, 55, 60, 63},
+    {44, 51, 56, 60},
+    {41, 48, 53, 56},
+    {43, 50, 55, 59},
+};
+
+// the sound of a case, polyphony and effects are set on the engine
+SynthPatch benchmark_patch(const BenchmarkCase *bench) {
+    SynthPatch patch = synth_patch_init();
+    SDL_strlcpy(patch.name, bench->name, sizeof(patch.name));
+    patch.wave_type = bench->wave;
+    patch.unison = (Uint32) bench->unison;
+    patch.filter_mode = bench->filter_mode;
+    patch.cutoff = bench->cutoff;
+    patch.resonance = bench->resonance;
+    const float env2[4] = {0.01f, 0.2f, 0.3f, 0.3f};
+    SDL_memcpy(patch.env2, env2, sizeof(env2));
+    patch.slots[0] = (SynthModSlot){SYNTH_MOD_SRC_ENV2, SYNTH_MOD_SRC_NONE, SYNTH_MOD_DST_CUTOFF, 2.0f};
+    patch.slots[1] = (SynthModSlot){SYNTH_MOD_SRC_LFO1, SYNTH_MOD_SRC_MOD_WHEEL, SYNTH_MOD_DST_PITCH, 0.5f};
+    patch.slots[2] = (SynthModSlot){SYNTH_MOD_SRC_LFO2, SYNTH_MOD_SRC_NONE, SYNTH_MOD_DST_PULSE_WIDTH, 0.3f};
+    patch.slots[3] = (SynthModSlot){SYNTH_MOD_SRC_AFTERTOUCH, SYNTH_MOD_SRC_NONE, SYNTH_MOD_DST_CUTOFF, 1.0f};
+    patch.volume = 0.2f;
+    patch.oversampling = (Uint32) bench->oversampling;
+    return patch;
+}
+
+void benchmark_push(MidiEvent *events, int *count, Uint64 frame, int status, int data1, int data2) {
+    assert(*count < BENCHMARK_EVENTS_MAX);
+    events[(*count)++] = (MidiEvent){.frame = frame, .message = midi_message(status, data1, data2)};
+}
+
+// the part, in frame order from frame 0, all notes are released at the end. Returns the event count
+int benchmark_part(MidiEvent *events, float sample_rate) {
+    const int steps = BENCHMARK_BARS * BENCHMARK_STEPS_PER_BAR;
+    const double step_frames = BENCHMARK_STEP_SECONDS * sample_rate;
+    int count = 0;
+    int arpeggio_note = -1;
+    for (int step = 0; step <= steps; step++) {
+        const Uint64 frame = (Uint64) (step * step_frames);
+        const int bar = step / BENCHMARK_STEPS_PER_BAR;
+        if (arpeggio_note >= 0) {
+            benchmark_push(events, &count, frame, 0x90, arpeggio_note, 0);
+        }
+        if (step % BENCHMARK_STEPS_PER_BAR == 0) {
+            for (int n = 0; step > 0 && n < 4; n++) {
+                benchmark_push(events, &count, frame, 0x90, benchmark_chords[(bar - 1) % BENCHMARK_CHORDS][n], 0);
+            }
+            for (int n = 0; bar < BENCHMARK_BARS && n < 4; n++) {
+                benchmark_push(events, &count, frame, 0x90, benchmark_chords[bar % BENCHMARK_CHORDS][n], 80);
+            }
+        }
+        if (step == steps) break;
+
+        // up and down the chord an octave higher, the wheel rises over the part and the pressure over each bar
+        const int up_down[] = {0, 1, 2, 3, 2, 1};
+        arpeggio_note = benchmark_chords[bar % BENCHMARK_CHORDS][up_down[step % 6]] + 12;
+        benchmark_push(events, &count, frame, 0x90, arpeggio_note, 100);
+        benchmark_push(events, &count, frame, 0xB0, 1, 127 * step / steps);
+        benchmark_push(events, &count, frame, 0xD0, 127 * (step % BENCHMARK_STEPS_PER_BAR) / BENCHMARK_STEPS_PER_BAR, 0);
+    }
+    return count;
+}
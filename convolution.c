@@ -0,0 +1,456 @@
+/*
+    Convolution with a long impulse response (reverb or cabinet) using uniformly
+    partitioned overlap-save in two stages:
+    - the head of the response, in CONVOLUTION_HEAD_BLOCK partitions, is computed in the
+      audio callback, which gives the latency of the effect
+    - the rest, in CONVOLUTION_TAIL_BLOCK partitions, is computed by a worker thread.
+      The head is two tail blocks long so the worker has a whole tail block of time
+      to deliver, the audio thread only copies samples in and out.
+    Left and right are transformed together as the real and imaginary parts of one
+    complex fft, a different response per channel only costs one more product per bin.
+*/
+#include "platform.h"
+#include <assert.h>
+
+#define CONVOLUTION_HEAD_BLOCK 128
+#define CONVOLUTION_TAIL_BLOCK 1024
+#define CONVOLUTION_HEAD_LENGTH (2 * CONVOLUTION_TAIL_BLOCK)
+#define CONVOLUTION_TAIL_SLOTS 4 // tail blocks in flight between the audio thread and the worker
+#define CONVOLUTION_MAX_SECONDS 10.0f
+
+// called on the worker thread as it starts, the owner gives it its scheduling. A NULL function leaves it as it is
+typedef struct {
+    void (*function)(void *userdata);
+    void *userdata;
+} WorkerSetup;
+
+float *convolution_alloc(Arena *arena, int count) {
+    return arena_alloc(arena, count * sizeof(float));
+}
+
+/*
+    One uniformly partitioned convolution, the fft size is twice the block.
+    With X the spectrum of left + i * right and HL, HR the ones of the responses,
+    Y = X * (HL + HR) / 2 + conj(X[N - k]) * (HL - HR) / 2 is the spectrum of
+    left * hl + i * right * hr.
+*/
+typedef struct {
+    int block;
+    int size; // fft size
+    int partitions;
+    bool stereo; // left and right responses differ
+    Fft fft;
+    // per partition spectra, partitions * size each
+    float *a_re; // (HL + HR) / 2
+    float *a_im;
+    float *b_re; // (HL - HR) / 2
+    float *b_im;
+    // frequency domain delay line of input spectra, X and conj(X[N - k])
+    float *x_re;
+    float *x_im;
+    float *xr_re;
+    float *xr_im;
+    int newest; // partition slot of the last input spectrum
+    // the last two input blocks
+    float *window_left;
+    float *window_right;
+    // fft scratch and the accumulated output spectrum
+    float *work_re;
+    float *work_im;
+    float *acc_re;
+    float *acc_im;
+} PartitionedConvolution;
+
+size_t partitioned_convolution_footprint(int length, int block) {
+    const int size = 2 * block;
+    const int partitions = (length + block - 1) / block;
+    return fft_footprint(size) + 8 * arena_align(partitions * size * sizeof(float)) + 6 * arena_align(size * sizeof(float));
+}
+
+PartitionedConvolution partitioned_convolution_init(Arena *arena, const float *left, const float *right, int length, int block) {
+    const int size = 2 * block;
+    const int partitions = (length + block - 1) / block;
+    PartitionedConvolution pc = {
+        .block = block,
+        .size = size,
+        .partitions = partitions,
+        .stereo = left != right,
+        .fft = fft_init(arena, size),
+        .a_re = convolution_alloc(arena, partitions * size),
+        .a_im = convolution_alloc(arena, partitions * size),
+        .b_re = convolution_alloc(arena, partitions * size),
+        .b_im = convolution_alloc(arena, partitions * size),
+        .x_re = convolution_alloc(arena, partitions * size),
+        .x_im = convolution_alloc(arena, partitions * size),
+        .xr_re = convolution_alloc(arena, partitions * size),
+        .xr_im = convolution_alloc(arena, partitions * size),
+        .window_left = convolution_alloc(arena, size),
+        .window_right = convolution_alloc(arena, size),
+        .work_re = convolution_alloc(arena, size),
+        .work_im = convolution_alloc(arena, size),
+        .acc_re = convolution_alloc(arena, size),
+        .acc_im = convolution_alloc(arena, size),
+    };
+
+    for (int p = 0; p < partitions; p++) {
+        const int count = SDL_min(block, length - p * block);
+        SDL_memset(pc.work_re, 0, size * sizeof(float));
+        SDL_memset(pc.work_im, 0, size * sizeof(float));
+        SDL_memcpy(pc.work_re, left + p * block, count * sizeof(float));
+        SDL_memcpy(pc.work_im, right + p * block, count * sizeof(float));
+        fft_forward(&pc.fft, pc.work_re, pc.work_im);
+
+        float *a_re = pc.a_re + p * size;
+        float *a_im = pc.a_im + p * size;
+        float *b_re = pc.b_re + p * size;
+        float *b_im = pc.b_im + p * size;
+        for (int k = 0; k < size; k++) {
+            // split Z = HL + i * HR with conj(Z[N - k])
+            const int m = (size - k) & (size - 1);
+            const float zr = pc.work_re[k];
+            const float zi = pc.work_im[k];
+            const float cr = pc.work_re[m];
+            const float ci = -pc.work_im[m];
+            const float hl_re = 0.5f * (zr + cr);
+            const float hl_im = 0.5f * (zi + ci);
+            const float hr_re = 0.5f * (zi - ci);
+            const float hr_im = -0.5f * (zr - cr);
+            a_re[k] = 0.5f * (hl_re + hr_re);
+            a_im[k] = 0.5f * (hl_im + hr_im);
+            b_re[k] = 0.5f * (hl_re - hr_re);
+            b_im[k] = 0.5f * (hl_im - hr_im);
+        }
+    }
+    return pc;
+}
+
+void partitioned_convolution_clear(PartitionedConvolution *pc) {
+    const int count = pc->partitions * pc->size;
+    SDL_memset(pc->x_re, 0, count * sizeof(float));
+    SDL_memset(pc->x_im, 0, count * sizeof(float));
+    SDL_memset(pc->xr_re, 0, count * sizeof(float));
+    SDL_memset(pc->xr_im, 0, count * sizeof(float));
+    SDL_memset(pc->window_left, 0, pc->size * sizeof(float));
+    SDL_memset(pc->window_right, 0, pc->size * sizeof(float));
+    pc->newest = 0;
+}
+
+// acc += x * h, complex, n a multiple of SIMD_WIDTH
+void convolution_multiply_add(
+    float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, int n
+) {
+    for (int k = 0; k < n; k += SIMD_WIDTH) {
+        const f32x4 xr = simd_load(x_re + k);
+        const f32x4 xi = simd_load(x_im + k);
+        const f32x4 hr = simd_load(h_re + k);
+        const f32x4 hi = simd_load(h_im + k);
+        simd_store(acc_re + k, simd_load(acc_re + k) + xr * hr - xi * hi);
+        simd_store(acc_im + k, simd_load(acc_im + k) + xr * hi + xi * hr);
+    }
+}
+
+// one block of input in, the matching block of output out
+void partitioned_convolution_process(
+    PartitionedConvolution *pc, const float *in_left, const float *in_right, float *out_left, float *out_right
+) {
+    const int block = pc->block;
+    const int size = pc->size;
+
+    // overlap-save: transform the previous block followed by the new one
+    SDL_memmove(pc->window_left, pc->window_left + block, block * sizeof(float));
+    SDL_memmove(pc->window_right, pc->window_right + block, block * sizeof(float));
+    SDL_memcpy(pc->window_left + block, in_left, block * sizeof(float));
+    SDL_memcpy(pc->window_right + block, in_right, block * sizeof(float));
+    SDL_memcpy(pc->work_re, pc->window_left, size * sizeof(float));
+    SDL_memcpy(pc->work_im, pc->window_right, size * sizeof(float));
+    fft_forward(&pc->fft, pc->work_re, pc->work_im);
+
+    pc->newest = (pc->newest + 1) % pc->partitions;
+    float *x_re = pc->x_re + pc->newest * size;
+    float *x_im = pc->x_im + pc->newest * size;
+    float *xr_re = pc->xr_re + pc->newest * size;
+    float *xr_im = pc->xr_im + pc->newest * size;
+    for (int k = 0; k < size; k++) {
+        const int m = (size - k) & (size - 1);
+        x_re[k] = pc->work_re[k];
+        x_im[k] = pc->work_im[k];
+        xr_re[k] = pc->work_re[m];
+        xr_im[k] = -pc->work_im[m];
+    }
+
+    // partition p of the response meets the input spectrum from p blocks ago
+    SDL_memset(pc->acc_re, 0, size * sizeof(float));
+    SDL_memset(pc->acc_im, 0, size * sizeof(float));
+    for (int p = 0; p < pc->partitions; p++) {
+        const int slot = (pc->newest - p + pc->partitions) % pc->partitions;
+        convolution_multiply_add(
+            pc->acc_re, pc->acc_im, pc->x_re + slot * size, pc->x_im + slot * size,
+            pc->a_re + p * size, pc->a_im + p * size, size
+        );
+        if (pc->stereo) {
+            convolution_multiply_add(
+                pc->acc_re, pc->acc_im, pc->xr_re + slot * size, pc->xr_im + slot * size,
+                pc->b_re + p * size, pc->b_im + p * size, size
+            );
+        }
+    }
+
+    fft_inverse(&pc->fft, pc->acc_re, pc->acc_im);
+    const float scale = 1.0f / (float) size;
+    for (int i = 0; i < block; i++) {
+        out_left[i] = pc->acc_re[block + i] * scale;
+        out_right[i] = pc->acc_im[block + i] * scale;
+    }
+}
+
+/*
+    The effect, the wet output is CONVOLUTION_HEAD_BLOCK samples behind the input
+*/
+typedef struct {
+    float mix;
+    int length; // of the response in samples
+
+    PartitionedConvolution head;
+    float head_in_left[CONVOLUTION_HEAD_BLOCK];
+    float head_in_right[CONVOLUTION_HEAD_BLOCK];
+    float head_out_left[CONVOLUTION_HEAD_BLOCK];
+    float head_out_right[CONVOLUTION_HEAD_BLOCK];
+    int head_pos;
+
+    // tail, only with a response longer than CONVOLUTION_HEAD_LENGTH
+    bool has_tail;
+    PartitionedConvolution tail; // only touched by the worker
+    float *tail_in_left[CONVOLUTION_TAIL_SLOTS];
+    float *tail_in_right[CONVOLUTION_TAIL_SLOTS];
+    float *tail_out_left[CONVOLUTION_TAIL_SLOTS];
+    float *tail_out_right[CONVOLUTION_TAIL_SLOTS];
+    int tail_in_pos;
+    int tail_posted; // blocks handed to the worker
+    int tail_delay; // samples until the first tail block is played
+    int tail_read_block;
+    int tail_read_pos;
+    bool tail_read_ready;
+    int tail_late; // blocks the worker did not deliver in time, played as silence
+    int tail_processed; // worker side count, only the worker touches it
+
+    SDL_Thread *worker;
+    SDL_Semaphore *wake;
+    SDL_AtomicInt requested; // tail_posted, published to the worker
+    SDL_AtomicInt done; // blocks finished by the worker
+    SDL_AtomicInt quit;
+    SDL_AtomicInt reset_requested; // generation, bumped by convolution_clear
+    SDL_AtomicInt reset_done; // the last generation the worker cleared its side for
+    WorkerSetup worker_setup;
+} Convolution;
+
+int SDLCALL convolution_worker(void *data) {
+    Convolution *conv = data;
+    rt_flush_denormals();
+    if (conv->worker_setup.function != NULL) {
+        conv->worker_setup.function(conv->worker_setup.userdata);
+    }
+    TRACE_THREAD("convolution");
+    for (;;) {
+        SDL_WaitSemaphore(conv->wake);
+        if (SDL_GetAtomicInt(&conv->quit)) {
+            break;
+        }
+        // a clear: the tail and the count are the worker's, they are reset here and not by the clearing thread
+        const int reset = SDL_GetAtomicInt(&conv->reset_requested);
+        if (reset != SDL_GetAtomicInt(&conv->reset_done)) {
+            partitioned_convolution_clear(&conv->tail);
+            conv->tail_processed = 0;
+            SDL_SetAtomicInt(&conv->done, 0);
+            SDL_SetAtomicInt(&conv->reset_done, reset);
+            continue;
+        }
+        while (conv->tail_processed < SDL_GetAtomicInt(&conv->requested)) {
+            TRACE_SCOPE("convolution tail");
+            const int slot = conv->tail_processed % CONVOLUTION_TAIL_SLOTS;
+            partitioned_convolution_process(
+                &conv->tail, conv->tail_in_left[slot], conv->tail_in_right[slot],
+                conv->tail_out_left[slot], conv->tail_out_right[slot]
+            );
+            conv->tail_processed++;
+            SDL_SetAtomicInt(&conv->done, conv->tail_processed);
+        }
+    }
+    return 0;
+}
+
+size_t convolution_footprint(int length) {
+    size_t size = arena_align(sizeof(Convolution));
+    size += partitioned_convolution_footprint(SDL_min(length, CONVOLUTION_HEAD_LENGTH), CONVOLUTION_HEAD_BLOCK);
+    if (length > CONVOLUTION_HEAD_LENGTH) {
+        size += partitioned_convolution_footprint(length - CONVOLUTION_HEAD_LENGTH, CONVOLUTION_TAIL_BLOCK);
+        size += 4 * CONVOLUTION_TAIL_SLOTS * arena_align(CONVOLUTION_TAIL_BLOCK * sizeof(float));
+    }
+    return size;
+}
+
+// right may be the same pointer as left for a mono response, the samples are copied. The worker runs worker_setup
+// first, the host of libsynth sets up its scheduling there
+Convolution *convolution_init(Arena *arena, const float *left, const float *right, int length, WorkerSetup worker_setup) {
+    assert(length > 0);
+    Convolution *conv = arena_alloc(arena, sizeof(Convolution));
+    conv->mix = 0.35f;
+    conv->length = length;
+    conv->worker_setup = worker_setup;
+    conv->head = partitioned_convolution_init(arena, left, right, SDL_min(length, CONVOLUTION_HEAD_LENGTH), CONVOLUTION_HEAD_BLOCK);
+
+    conv->has_tail = length > CONVOLUTION_HEAD_LENGTH;
+    if (conv->has_tail) {
+        conv->tail = partitioned_convolution_init(
+            arena, left + CONVOLUTION_HEAD_LENGTH, right + CONVOLUTION_HEAD_LENGTH,
+            length - CONVOLUTION_HEAD_LENGTH, CONVOLUTION_TAIL_BLOCK
+        );
+        for (int s = 0; s < CONVOLUTION_TAIL_SLOTS; s++) {
+            conv->tail_in_left[s] = convolution_alloc(arena, CONVOLUTION_TAIL_BLOCK);
+            conv->tail_in_right[s] = convolution_alloc(arena, CONVOLUTION_TAIL_BLOCK);
+            conv->tail_out_left[s] = convolution_alloc(arena, CONVOLUTION_TAIL_BLOCK);
+            conv->tail_out_right[s] = convolution_alloc(arena, CONVOLUTION_TAIL_BLOCK);
+        }
+        conv->tail_delay = CONVOLUTION_HEAD_BLOCK + CONVOLUTION_HEAD_LENGTH;
+        conv->wake = SDL_CreateSemaphore(0);
+        conv->worker = SDL_CreateThread(convolution_worker, "convolution", conv);
+        assert(conv->wake != NULL && conv->worker != NULL);
+    }
+    return conv;
+}
+
+/*
+    An impulse response at the sample rate of the engine, normalized to unit energy. synth_create
+    copies it from the samples of SynthConfig. It is only needed until the convolution is built
+    from it.
+*/
+typedef struct {
+    float *left;
+    float *right; // same as left for a mono file
+    int length; // 0 when the file can't be read
+} ImpulseResponse;
+
+// both channels by the same gain, so the louder one has unit energy
+void impulse_response_normalize(ImpulseResponse *ir) {
+    double energy_left = 0.0;
+    double energy_right = 0.0;
+    for (int i = 0; i < ir->length; i++) {
+        energy_left += (double) ir->left[i] * ir->left[i];
+        energy_right += (double) ir->right[i] * ir->right[i];
+    }
+    const double energy = SDL_max(energy_left, energy_right);
+    if (energy > 0.0) {
+        const float gain = (float) (1.0 / SDL_sqrt(energy));
+        for (int i = 0; i < ir->length; i++) ir->left[i] *= gain;
+        if (ir->right != ir->left) {
+            for (int i = 0; i < ir->length; i++) ir->right[i] *= gain;
+        }
+    }
+}
+
+void impulse_response_free(ImpulseResponse *ir) {
+    if (ir->right != ir->left) SDL_free(ir->right);
+    SDL_free(ir->left);
+    ir->left = NULL;
+    ir->right = NULL;
+    ir->length = 0;
+}
+
+// blocks until the worker has finished every block it was given
+void convolution_wait_idle(Convolution *conv) {
+    if (!conv->has_tail) return;
+    while (SDL_GetAtomicInt(&conv->done) < SDL_GetAtomicInt(&conv->requested)) {
+        SDL_Delay(1);
+    }
+}
+
+// not from the audio thread, and the audio thread must not be processing this effect. Nothing is requested
+// from then on, the worker clears its side when it gets to the reset and the caller waits for that
+void convolution_clear(Convolution *conv) {
+    partitioned_convolution_clear(&conv->head);
+    SDL_memset(conv->head_in_left, 0, sizeof(conv->head_in_left));
+    SDL_memset(conv->head_in_right, 0, sizeof(conv->head_in_right));
+    SDL_memset(conv->head_out_left, 0, sizeof(conv->head_out_left));
+    SDL_memset(conv->head_out_right, 0, sizeof(conv->head_out_right));
+    conv->head_pos = 0;
+    if (conv->has_tail) {
+        SDL_SetAtomicInt(&conv->requested, 0);
+        const int reset = SDL_GetAtomicInt(&conv->reset_requested) + 1;
+        SDL_SetAtomicInt(&conv->reset_requested, reset);
+        SDL_SignalSemaphore(conv->wake);
+        while (SDL_GetAtomicInt(&conv->reset_done) != reset) {
+            SDL_Delay(1);
+        }
+        conv->tail_in_pos = 0;
+        conv->tail_posted = 0;
+        conv->tail_delay = CONVOLUTION_HEAD_BLOCK + CONVOLUTION_HEAD_LENGTH;
+        conv->tail_read_block = 0;
+        conv->tail_read_pos = 0;
+    }
+}
+
+// stops the worker, the memory belongs to the arena
+void convolution_stop(Convolution *conv) {
+    if (conv == NULL || !conv->has_tail || conv->worker == NULL) return;
+    SDL_SetAtomicInt(&conv->quit, 1);
+    SDL_SignalSemaphore(conv->wake);
+    SDL_WaitThread(conv->worker, NULL);
+    SDL_DestroySemaphore(conv->wake);
+    conv->worker = NULL;
+    conv->wake = NULL;
+}
+
+// hand the input to the worker and read back its output, a tail block late counts as silence
+void convolution_tail_process(Convolution *conv, float l, float r, float *out_left, float *out_right) {
+    const int in_slot = conv->tail_posted % CONVOLUTION_TAIL_SLOTS;
+    conv->tail_in_left[in_slot][conv->tail_in_pos] = l;
+    conv->tail_in_right[in_slot][conv->tail_in_pos] = r;
+    if (++conv->tail_in_pos == CONVOLUTION_TAIL_BLOCK) {
+        conv->tail_in_pos = 0;
+        conv->tail_posted++;
+        SDL_SetAtomicInt(&conv->requested, conv->tail_posted);
+        SDL_SignalSemaphore(conv->wake);
+    }
+
+    if (conv->tail_delay > 0) {
+        conv->tail_delay--;
+        *out_left = 0.0f;
+        *out_right = 0.0f;
+        return;
+    }
+    if (conv->tail_read_pos == 0) {
+        conv->tail_read_ready = SDL_GetAtomicInt(&conv->done) > conv->tail_read_block;
+        conv->tail_late += !conv->tail_read_ready;
+    }
+    const int out_slot = conv->tail_read_block % CONVOLUTION_TAIL_SLOTS;
+    *out_left = conv->tail_read_ready ? conv->tail_out_left[out_slot][conv->tail_read_pos] : 0.0f;
+    *out_right = conv->tail_read_ready ? conv->tail_out_right[out_slot][conv->tail_read_pos] : 0.0f;
+    if (++conv->tail_read_pos == CONVOLUTION_TAIL_BLOCK) {
+        conv->tail_read_pos = 0;
+        conv->tail_read_block++;
+    }
+}
+
+// writes the wet signal only, the caller mixes it
+void convolution_process(Convolution *conv, const float *left, const float *right, float *wet_left, float *wet_right, int n) {
+    for (int i = 0; i < n; i++) {
+        conv->head_in_left[conv->head_pos] = left[i];
+        conv->head_in_right[conv->head_pos] = right[i];
+        wet_left[i] = conv->head_out_left[conv->head_pos];
+        wet_right[i] = conv->head_out_right[conv->head_pos];
+
+        if (conv->has_tail) {
+            float tail_left;
+            float tail_right;
+            convolution_tail_process(conv, left[i], right[i], &tail_left, &tail_right);
+            wet_left[i] += tail_left;
+            wet_right[i] += tail_right;
+        }
+
+        if (++conv->head_pos == CONVOLUTION_HEAD_BLOCK) {
+            conv->head_pos = 0;
+            partitioned_convolution_process(
+                &conv->head, conv->head_in_left, conv->head_in_right, conv->head_out_left, conv->head_out_right
+            );
+        }
+    }
+}
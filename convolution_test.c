@@ -0,0 +1,183 @@
+#include "greatest.h"
+#include "rtcheck.c"
+#include "trace.c"
+#include "simd.c"
+#include "arena.c"
+#include "fft.c"
+#include "convolution.c"
+
+#define TEST_IR_LENGTH 9000 // head and several tail partitions
+#define TEST_INPUT_LENGTH 20000
+
+uint32_t test_seed = 12345;
+
+float test_noise(void) {
+    test_seed ^= test_seed << 13;
+    test_seed ^= test_seed >> 17;
+    test_seed ^= test_seed << 5;
+    return (float) test_seed / 4294967296.0f * 2.0f - 1.0f;
+}
+
+TEST fft_matches_dft(void) {
+    const int n = 64;
+    float re[64];
+    float im[64];
+    float in_re[64];
+    float in_im[64];
+    for (int i = 0; i < n; i++) {
+        in_re[i] = re[i] = test_noise();
+        in_im[i] = im[i] = test_noise();
+    }
+    Arena arena = arena_init(fft_footprint(n));
+    Fft fft = fft_init(&arena, n);
+    fft_forward(&fft, re, im);
+    for (int k = 0; k < n; k++) {
+        double sum_re = 0.0;
+        double sum_im = 0.0;
+        for (int i = 0; i < n; i++) {
+            const double angle = -2.0 * SDL_PI_D * i * k / n;
+            sum_re += in_re[i] * cos(angle) - in_im[i] * sin(angle);
+            sum_im += in_re[i] * sin(angle) + in_im[i] * cos(angle);
+        }
+        ASSERT_IN_RANGE(sum_re, re[k], 1e-4);
+        ASSERT_IN_RANGE(sum_im, im[k], 1e-4);
+    }
+
+    fft_inverse(&fft, re, im);
+    for (int i = 0; i < n; i++) {
+        ASSERT_IN_RANGE(in_re[i], re[i] / n, 1e-5f);
+        ASSERT_IN_RANGE(in_im[i], im[i] / n, 1e-5f);
+    }
+    arena_free(&arena);
+    PASS();
+}
+
+// the effect against direct convolution, delayed by the head block
+static enum greatest_test_res check_against_direct(bool stereo) {
+    static float ir_left[TEST_IR_LENGTH];
+    static float ir_right[TEST_IR_LENGTH];
+    static float in_left[TEST_INPUT_LENGTH];
+    static float in_right[TEST_INPUT_LENGTH];
+    static float out_left[TEST_INPUT_LENGTH];
+    static float out_right[TEST_INPUT_LENGTH];
+    for (int i = 0; i < TEST_IR_LENGTH; i++) {
+        const float decay = SDL_expf(-(float) i / 2000.0f);
+        ir_left[i] = test_noise() * decay * 0.05f;
+        ir_right[i] = stereo ? test_noise() * decay * 0.05f : ir_left[i];
+    }
+    for (int i = 0; i < TEST_INPUT_LENGTH; i++) {
+        in_left[i] = test_noise();
+        in_right[i] = test_noise();
+    }
+
+    Arena arena = arena_init(convolution_footprint(TEST_IR_LENGTH));
+    Convolution *conv = convolution_init(&arena, ir_left, stereo ? ir_right : ir_left, TEST_IR_LENGTH, (WorkerSetup) {0});
+    ASSERT(conv->has_tail);
+    ASSERT_EQ(arena.size, arena.used);
+    // uneven callback sizes, the worker gets its time between them
+    int done = 0;
+    int chunk = 1;
+    while (done < TEST_INPUT_LENGTH) {
+        const int n = SDL_min(chunk, TEST_INPUT_LENGTH - done);
+        convolution_process(conv, in_left + done, in_right + done, out_left + done, out_right + done, n);
+        convolution_wait_idle(conv);
+        done += n;
+        chunk = chunk % 127 + 13;
+    }
+    ASSERT_EQ(0, conv->tail_late);
+
+    for (int t = 0; t < TEST_INPUT_LENGTH; t += 7) {
+        double expected_left = 0.0;
+        double expected_right = 0.0;
+        for (int j = 0; j < TEST_IR_LENGTH; j++) {
+            const int i = t - CONVOLUTION_HEAD_BLOCK - j;
+            if (i < 0) break;
+            expected_left += (double) in_left[i] * ir_left[j];
+            expected_right += (double) in_right[i] * ir_right[j];
+        }
+        ASSERT_IN_RANGE(expected_left, out_left[t], 1e-3);
+        ASSERT_IN_RANGE(expected_right, out_right[t], 1e-3);
+    }
+    convolution_stop(conv);
+    arena_free(&arena);
+    PASS();
+}
+
+TEST convolution_mono_matches_direct(void) {
+    CHECK_CALL(check_against_direct(false));
+    PASS();
+}
+
+TEST convolution_stereo_matches_direct(void) {
+    CHECK_CALL(check_against_direct(true));
+    PASS();
+}
+
+TEST convolution_short_response_has_no_tail(void) {
+    const float ir[3] = {1.0f, 0.5f, 0.25f};
+    Arena arena = arena_init(convolution_footprint(3));
+    Convolution *conv = convolution_init(&arena, ir, ir, 3, (WorkerSetup) {0});
+    ASSERT_EQ(arena.size, arena.used);
+    ASSERT_FALSE(conv->has_tail);
+
+    float in[2 * CONVOLUTION_HEAD_BLOCK] = {0};
+    float out_left[2 * CONVOLUTION_HEAD_BLOCK];
+    float out_right[2 * CONVOLUTION_HEAD_BLOCK];
+    in[0] = 1.0f;
+    convolution_process(conv, in, in, out_left, out_right, 2 * CONVOLUTION_HEAD_BLOCK);
+    for (int i = 0; i < 2 * CONVOLUTION_HEAD_BLOCK; i++) {
+        const int j = i - CONVOLUTION_HEAD_BLOCK;
+        const float expected = j >= 0 && j < 3 ? ir[j] : 0.0f;
+        ASSERT_IN_RANGE(expected, out_left[i], 1e-6f);
+        ASSERT_IN_RANGE(expected, out_right[i], 1e-6f);
+    }
+    convolution_stop(conv);
+    arena_free(&arena);
+    PASS();
+}
+
+TEST convolution_clear_silences_the_tail(void) {
+    // cleared while the worker still has blocks, nothing of the old input comes out afterwards
+    static float ir[TEST_IR_LENGTH];
+    static float in[TEST_INPUT_LENGTH];
+    static float out_left[TEST_INPUT_LENGTH];
+    static float out_right[TEST_INPUT_LENGTH];
+    for (int i = 0; i < TEST_IR_LENGTH; i++) {
+        ir[i] = test_noise() * 0.05f;
+    }
+    for (int i = 0; i < TEST_INPUT_LENGTH; i++) {
+        in[i] = test_noise();
+    }
+    Arena arena = arena_init(convolution_footprint(TEST_IR_LENGTH));
+    Convolution *conv = convolution_init(&arena, ir, ir, TEST_IR_LENGTH, (WorkerSetup) {0});
+    for (int round = 0; round < 20; round++) {
+        convolution_process(conv, in, in, out_left, out_right, TEST_INPUT_LENGTH / 2);
+        convolution_clear(conv);
+        static const float silence[TEST_INPUT_LENGTH] = {0};
+        convolution_process(conv, silence, silence, out_left, out_right, TEST_INPUT_LENGTH);
+        convolution_wait_idle(conv);
+        for (int i = 0; i < TEST_INPUT_LENGTH; i++) {
+            ASSERT_EQ(0.0f, out_left[i]);
+            ASSERT_EQ(0.0f, out_right[i]);
+        }
+    }
+    convolution_stop(conv);
+    arena_free(&arena);
+    PASS();
+}
+
+SUITE(convolution_suite) {
+    RUN_TEST(fft_matches_dft);
+    RUN_TEST(convolution_mono_matches_direct);
+    RUN_TEST(convolution_stereo_matches_direct);
+    RUN_TEST(convolution_short_response_has_no_tail);
+    RUN_TEST(convolution_clear_silences_the_tail);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(convolution_suite);
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,450 @@
+/*
+    Property tests of the DSP kernels: random phases, amplitudes, cutoffs and block sizes,
+    odd tails included. The vector forms have to match their scalar references, the filters
+    have to stay finite and bounded, and splitting a stream into other blocks must not change it.
+    The Makefile builds this twice, with ASan and unoptimized, and optimized for the host CPU,
+    so both the checked and the vectorized code are run. DSP_TEST_SEED picks another sequence.
+    The two builds must also sound the same: with DSP_TEST_REFERENCE set to a file, the outputs of
+    the kernels for a fixed seed are written to it when it does not exist and compared with it when
+    it does, the unoptimized build runs first.
+*/
+#include <stdlib.h>
+#include <math.h>
+#include "greatest.h"
+#include "rtcheck.c"
+#include "trace.c"
+#include "simd.c"
+#include "fastmath.c"
+#include "arena.c"
+#include "oscillator.c"
+#include "note.c"
+#include "filter.c"
+#include "modulation.c"
+#include "patch.c"
+#include "oversampling.c"
+#include "voice.c"
+#include "fft.c"
+#include "convolution.c"
+
+#define TEST_SAMPLE_RATE 44100.0f
+#define TEST_ITERATIONS 2000
+#define FILTER_OUTPUT_MAX 16.0f // noise in [-1, 1] never gets this loud, resonance included
+
+static uint32_t test_seed = 0x2545F491;
+static char message[256];
+
+// the message is only formatted when the property does not hold
+#define ASSERT_PROPERTY(cond, ...)                               \
+    do {                                                         \
+        if (!(cond)) {                                           \
+            SDL_snprintf(message, sizeof(message), __VA_ARGS__); \
+            FAILm(message);                                      \
+        }                                                        \
+    } while (0)
+
+static uint32_t test_random_bits(void) {
+    test_seed ^= test_seed << 13;
+    test_seed ^= test_seed >> 17;
+    test_seed ^= test_seed << 5;
+    return test_seed;
+}
+
+static float test_random(float min, float max) {
+    return min + (max - min) * (float) (test_random_bits() >> 8) / 16777216.0f;
+}
+
+static int test_random_int(int min, int max) {
+    return min + (int) (test_random_bits() % (uint32_t) (max - min + 1));
+}
+
+static bool same_bits(float a, float b) {
+    return fast_float_bits(a) == fast_float_bits(b);
+}
+
+TEST unison_wave_matches_scalar(void) {
+    for (int iteration = 0; iteration < TEST_ITERATIONS; iteration++) {
+        Oscillator osc = oscillator_init((WavesType) test_random_int(WAVE_SINE, WAVE_TRIANGLE));
+        osc.square_pulse_width = test_random(0.0f, 1.0f);
+        const f32x4 phase = {test_random(0.0f, 1.0f), test_random(0.0f, 1.0f), test_random(0.0f, 1.0f), test_random(0.0f, 1.0f)};
+        const f32x4 y = unison_wave(&osc, phase);
+        for (int lane = 0; lane < SIMD_WIDTH; lane++) {
+            const float expected = oscillator_next_point(osc, 1.0f, phase[lane]);
+            // the scalar triangle takes its absolute value in double
+            const bool matches = osc.wave_type == WAVE_TRIANGLE ? SDL_fabsf(y[lane] - expected) <= 1e-6f : same_bits(y[lane], expected);
+            ASSERT_PROPERTY(
+                matches, "%s at phase %.9g: %.9g, scalar %.9g",
+                waves_type_to_str(osc.wave_type), phase[lane], y[lane], expected
+            );
+        }
+    }
+    PASS();
+}
+
+TEST waves_stay_within_amplitude(void) {
+    for (int iteration = 0; iteration < TEST_ITERATIONS * 10; iteration++) {
+        const float amplitude = test_random(0.0f, 4.0f);
+        const float phase = test_random(0.0f, 1.0f);
+        const float bound = amplitude * (1.0f + 1e-6f) + 1e-6f;
+        const float y[] = {
+            waves_sine(amplitude, phase),
+            waves_square(amplitude, phase, test_random(0.0f, 1.0f)),
+            waves_saw(amplitude, phase),
+            waves_triangle(amplitude, phase),
+        };
+        for (int wave = 0; wave < (int) SDL_arraysize(y); wave++) {
+            ASSERT_PROPERTY(
+                isfinite(y[wave]) && SDL_fabsf(y[wave]) <= bound,
+                "%s(%.9g, %.9g) = %.9g", waves_type_to_str(wave), amplitude, phase, y[wave]
+            );
+        }
+    }
+    PASS();
+}
+
+TEST filter_lowpass_stays_bounded(void) {
+    for (int iteration = 0; iteration < TEST_ITERATIONS / 10; iteration++) {
+        FilterLowpass filter = filter_lowpass_init();
+        for (int block = 0; block < 50; block++) {
+            // out of range cutoffs are clamped
+            filter_lowpass_set_cutoff(&filter, test_random(-0.5f, 1.5f));
+            const int n = test_random_int(1, 257);
+            for (int i = 0; i < n; i++) {
+                const float y = filter_lowpass_process(&filter, test_random(-1.0f, 1.0f));
+                ASSERT_PROPERTY(isfinite(y) && SDL_fabsf(y) <= 1.0f + 1e-5f, "cutoff %.9g gives %.9g", filter.cutoff, y);
+            }
+        }
+    }
+    PASS();
+}
+
+TEST filters_stay_stable(void) {
+    for (int iteration = 0; iteration < TEST_ITERATIONS / 10; iteration++) {
+        const FilterMode mode = (FilterMode) test_random_int(0, FILTER_MODE_COUNT - 1);
+        Filter filter = filter_init(mode, TEST_SAMPLE_RATE * (float) (1 << test_random_int(0, 2)));
+        filter_set_resonance(&filter, test_random(0.0f, 1.0f));
+        for (int block = 0; block < 50; block++) {
+            // cutoffs past Nyquist and sudden jumps of the modulation, in blocks of any size
+            filter_set_cutoff(&filter, test_random(FILTER_CUTOFF_MIN_HZ, FILTER_CUTOFF_MAX_HZ));
+            filter_set_modulation(&filter, fast_exp2(test_random(-4.0f, 4.0f)));
+            const int n = test_random_int(1, 257);
+            for (int i = 0; i < n; i++) {
+                const float y = filter_process(&filter, test_random(-1.0f, 1.0f));
+                ASSERT_PROPERTY(
+                    isfinite(y) && SDL_fabsf(y) < FILTER_OUTPUT_MAX,
+                    "%s at %.1f Hz, resonance %.3f gives %.9g",
+                    filter_mode_to_str(mode), filter.cutoff * filter.cutoff_mod, filter.resonance, y
+                );
+            }
+            filter_flush_denormals(&filter);
+        }
+    }
+    PASS();
+}
+
+TEST simd_dot_matches_scalar(void) {
+    float a[256];
+    float b[256];
+    for (int iteration = 0; iteration < TEST_ITERATIONS; iteration++) {
+        const int n = SIMD_WIDTH * test_random_int(1, 64);
+        double expected = 0.0;
+        double magnitude = 0.0;
+        for (int i = 0; i < n; i++) {
+            a[i] = test_random(-1.0f, 1.0f);
+            b[i] = test_random(-1.0f, 1.0f);
+            expected += (double) a[i] * b[i];
+            magnitude += SDL_fabs((double) a[i] * b[i]);
+        }
+        const float dot = simd_dot(a, b, n);
+        ASSERT_PROPERTY(SDL_fabs(dot - expected) <= 1e-6 * magnitude + 1e-9, "n %d: %.9g, scalar %.9g", n, dot, expected);
+    }
+    PASS();
+}
+
+TEST convolution_multiply_add_matches_scalar(void) {
+    float acc_re[256], acc_im[256], x_re[256], x_im[256], h_re[256], h_im[256];
+    for (int iteration = 0; iteration < TEST_ITERATIONS / 10; iteration++) {
+        const int n = SIMD_WIDTH * test_random_int(1, 64);
+        for (int k = 0; k < n; k++) {
+            acc_re[k] = test_random(-1.0f, 1.0f);
+            acc_im[k] = test_random(-1.0f, 1.0f);
+            x_re[k] = test_random(-1.0f, 1.0f);
+            x_im[k] = test_random(-1.0f, 1.0f);
+            h_re[k] = test_random(-1.0f, 1.0f);
+            h_im[k] = test_random(-1.0f, 1.0f);
+        }
+        float expected_re[256], expected_im[256];
+        for (int k = 0; k < n; k++) {
+            expected_re[k] = acc_re[k] + x_re[k] * h_re[k] - x_im[k] * h_im[k];
+            expected_im[k] = acc_im[k] + x_re[k] * h_im[k] + x_im[k] * h_re[k];
+        }
+        convolution_multiply_add(acc_re, acc_im, x_re, x_im, h_re, h_im, n);
+        for (int k = 0; k < n; k++) {
+            ASSERT_PROPERTY(
+                SDL_fabsf(acc_re[k] - expected_re[k]) <= 1e-6f && SDL_fabsf(acc_im[k] - expected_im[k]) <= 1e-6f,
+                "bin %d of %d: %.9g%+.9gi, scalar %.9g%+.9gi", k, n, acc_re[k], acc_im[k], expected_re[k], expected_im[k]
+            );
+        }
+    }
+    PASS();
+}
+
+TEST halfband_table_matches_design(void) {
+    // the table of oversampling.c, designed again: Blackman windowed sinc, the even branch adds up to 0.5
+    const int length = 4 * HALFBAND_HALF_TAPS - 1;
+    const int centre = 2 * HALFBAND_HALF_TAPS - 1;
+    double taps[HALFBAND_BRANCH_TAPS];
+    double sum = 0.0;
+    for (int i = 0; i < HALFBAND_BRANCH_TAPS; i++) {
+        const int j = 2 * i;
+        const double n = (double) (j - centre);
+        const double x = (double) (j + 1) / (double) (length + 1);
+        const double window = 0.42 - 0.5 * cos(2.0 * SDL_PI_D * x) + 0.08 * cos(4.0 * SDL_PI_D * x);
+        taps[i] = sin(SDL_PI_D * n / 2.0) / (SDL_PI_D * n) * window;
+        sum += taps[i];
+    }
+    for (int i = 0; i < HALFBAND_BRANCH_TAPS; i++) {
+        const double expected = taps[i] * 0.5 / sum;
+        ASSERT_PROPERTY(fabs(halfband_coefficients[i] - expected) <= 1e-7, "tap %d: %.9g, designed %.9g", i, halfband_coefficients[i], expected);
+    }
+    PASS();
+}
+
+TEST oversampler_ignores_block_sizes(void) {
+    // one stream through two decimators, one in full blocks and one in random sizes with odd tails
+    static float high[4096 * OVERSAMPLING_MAX];
+    static float whole[4096];
+    static float split[4096];
+    for (int factor = 2; factor <= OVERSAMPLING_MAX; factor *= 2) {
+        for (int i = 0; i < 4096 * factor; i++) high[i] = test_random(-1.0f, 1.0f);
+
+        Oversampler a = oversampler_init(factor);
+        Oversampler b = oversampler_init(factor);
+        for (int i = 0; i < 4096; i += HALFBAND_BLOCK_MAX / 2) {
+            oversampler_downsample(&a, high + i * factor, whole + i, HALFBAND_BLOCK_MAX / 2);
+        }
+        for (int i = 0, n; i < 4096; i += n) {
+            n = test_random_int(1, SDL_min(HALFBAND_BLOCK_MAX / 2, 4096 - i));
+            oversampler_downsample(&b, high + i * factor, split + i, n);
+        }
+        for (int i = 0; i < 4096; i++) {
+            ASSERT_PROPERTY(isfinite(whole[i]) && same_bits(whole[i], split[i]),
+                            "%dx down, sample %d: %.9g, in blocks %.9g", factor, i, split[i], whole[i]);
+        }
+    }
+    PASS();
+}
+
+TEST voice_render_ignores_block_sizes(void) {
+    // the same random patch and note in two pools, one rendered in whole control blocks and
+    // one with every control block split at random
+    enum { FRAMES = 2048 };
+    static float whole_left[FRAMES * OVERSAMPLING_MAX], whole_right[FRAMES * OVERSAMPLING_MAX];
+    static float split_left[FRAMES * OVERSAMPLING_MAX], split_right[FRAMES * OVERSAMPLING_MAX];
+    for (int iteration = 0; iteration < 20; iteration++) {
+        Patch patch = patch_init(TEST_SAMPLE_RATE);
+        patch.oscillator = oscillator_init((WavesType) test_random_int(WAVE_SINE, WAVE_TRIANGLE));
+        patch.oscillator.unison = test_random_int(1, UNISON_MAX);
+        patch.oscillator.unison_detune = test_random(0.0f, 1.0f);
+        patch.oscillator.unison_spread = test_random(0.0f, 1.0f);
+        patch.filter = filter_init((FilterMode) test_random_int(0, FILTER_MODE_COUNT - 1), TEST_SAMPLE_RATE);
+        filter_set_cutoff(&patch.filter, test_random(100.0f, 10000.0f));
+        filter_set_resonance(&patch.filter, test_random(0.0f, 1.0f));
+        mod_matrix_set_slot(&patch.mod_matrix, 0, MOD_SRC_ENV2, MOD_SRC_NONE, MOD_DST_CUTOFF, test_random(-2.0f, 2.0f));
+        mod_matrix_compile(&patch.mod_matrix);
+        const int factor = 1 << test_random_int(0, 2);
+        filter_set_sample_rate(&patch.filter, TEST_SAMPLE_RATE * (float) factor);
+        const float phase_scale = 1.0f / (TEST_SAMPLE_RATE * (float) factor);
+        const float dt = (float) patch.mod_matrix.control_rate / TEST_SAMPLE_RATE;
+        const MidiNote midi_note = (MidiNote) test_random_int(24, 108);
+        const PressedNote note = {.midi_note = midi_note, .freq = note_to_freq(midi_note), .velocity = test_random(0.1f, 1.0f)};
+
+        Arena arena = arena_init(2 * voice_pool_footprint(1));
+        VoicePool whole = voice_pool_init(&arena, 1);
+        VoicePool split = voice_pool_init(&arena, 1);
+        float values[MOD_SRC_COUNT] = {[MOD_SRC_NONE] = 1.0f};
+        voice_pool_note_on(&whole, note, &patch, values);
+        voice_pool_note_on(&split, note, &patch, values);
+        SDL_memset(whole_left, 0, sizeof(whole_left));
+        SDL_memset(whole_right, 0, sizeof(whole_right));
+        SDL_memset(split_left, 0, sizeof(split_left));
+        SDL_memset(split_right, 0, sizeof(split_right));
+
+        const int control_rate = patch.mod_matrix.control_rate;
+        for (int start = 0; start < FRAMES; start += control_rate) {
+            const int block = SDL_min(control_rate, FRAMES - start);
+            voice_control(&whole.voices[0], &patch, values, dt);
+            voice_render(&whole.voices[0], &patch.oscillator, 0.5f, phase_scale, factor,
+                         whole_left + start * factor, whole_right + start * factor, block);
+            voice_control(&split.voices[0], &patch, values, dt);
+            for (int i = 0, n; i < block; i += n) {
+                n = test_random_int(1, block - i);
+                voice_render(&split.voices[0], &patch.oscillator, 0.5f, phase_scale, factor,
+                             split_left + (start + i) * factor, split_right + (start + i) * factor, n);
+            }
+        }
+        for (int i = 0; i < FRAMES * factor; i++) {
+            ASSERT_PROPERTY(
+                isfinite(whole_left[i]) && same_bits(whole_left[i], split_left[i]) && same_bits(whole_right[i], split_right[i]),
+                "%s unison %d %s %dx, sample %d: %.9g, split %.9g",
+                waves_type_to_str(patch.oscillator.wave_type), patch.oscillator.unison,
+                filter_mode_to_str(patch.filter.mode), factor, i, whole_left[i], split_left[i]
+            );
+        }
+        arena_free(&arena);
+    }
+    PASS();
+}
+
+#define REFERENCE_FRAMES 4096
+#define REFERENCE_SECTIONS 8
+#define REFERENCE_TOLERANCE 1e-4 // of the peak of a section, contraction and the vector paths round differently
+
+static const char *reference_names[REFERENCE_SECTIONS] = {
+    "voice 1x", "voice 2x", "voice 4x", "decimate 2x", "decimate 4x", "convolution", "fast_sin_turns", "fast_exp2",
+};
+
+// the kernels on a fixed seed, a section of REFERENCE_FRAMES each
+static void reference_render(float *out) {
+    static float left[REFERENCE_FRAMES * OVERSAMPLING_MAX];
+    static float right[REFERENCE_FRAMES * OVERSAMPLING_MAX];
+    const uint32_t seed = test_seed;
+    test_seed = 0x2545F491;
+    SDL_memset(out, 0, REFERENCE_SECTIONS * REFERENCE_FRAMES * sizeof(float));
+
+    // a detuned unison saw through the ladder with its cutoff on an envelope, decimated at every factor
+    for (int s = 0; s < 3; s++) {
+        const int factor = 1 << s;
+        Patch patch = patch_init(TEST_SAMPLE_RATE);
+        patch.oscillator = oscillator_init(WAVE_SAW);
+        patch.oscillator.unison = UNISON_MAX;
+        patch.oscillator.unison_detune = 0.4f;
+        patch.oscillator.unison_spread = 0.7f;
+        patch.filter = filter_init(FILTER_MODE_LADDER, TEST_SAMPLE_RATE * (float) factor);
+        filter_set_cutoff(&patch.filter, 1500.0f);
+        filter_set_resonance(&patch.filter, 0.6f);
+        mod_matrix_set_slot(&patch.mod_matrix, 0, MOD_SRC_ENV2, MOD_SRC_NONE, MOD_DST_CUTOFF, 1.5f);
+        mod_matrix_compile(&patch.mod_matrix);
+        const float dt = (float) patch.mod_matrix.control_rate / TEST_SAMPLE_RATE;
+        const PressedNote note = {.midi_note = 45, .freq = note_to_freq(45), .velocity = 0.8f};
+        Arena arena = arena_init(voice_pool_footprint(1));
+        VoicePool pool = voice_pool_init(&arena, 1);
+        float values[MOD_SRC_COUNT] = {[MOD_SRC_NONE] = 1.0f};
+        voice_pool_note_on(&pool, note, &patch, values);
+        SDL_memset(left, 0, sizeof(left));
+        SDL_memset(right, 0, sizeof(right));
+        for (int start = 0; start < REFERENCE_FRAMES; start += patch.mod_matrix.control_rate) {
+            const int n = SDL_min(patch.mod_matrix.control_rate, REFERENCE_FRAMES - start);
+            voice_control(&pool.voices[0], &patch, values, dt);
+            voice_render(&pool.voices[0], &patch.oscillator, 0.5f, 1.0f / (TEST_SAMPLE_RATE * (float) factor), factor,
+                         left + start * factor, right + start * factor, n);
+        }
+        Oversampler os = oversampler_init(factor);
+        for (int i = 0; i < REFERENCE_FRAMES; i += HALFBAND_BLOCK_MAX / 2) {
+            oversampler_downsample(&os, left + i * factor, out + s * REFERENCE_FRAMES + i, HALFBAND_BLOCK_MAX / 2);
+        }
+        arena_free(&arena);
+    }
+
+    // the decimators alone on noise
+    for (int s = 3; s < 5; s++) {
+        const int factor = s == 3 ? 2 : 4;
+        for (int i = 0; i < REFERENCE_FRAMES * factor; i++) left[i] = test_random(-1.0f, 1.0f);
+        Oversampler os = oversampler_init(factor);
+        for (int i = 0; i < REFERENCE_FRAMES; i += HALFBAND_BLOCK_MAX / 2) {
+            oversampler_downsample(&os, left + i * factor, out + s * REFERENCE_FRAMES + i, HALFBAND_BLOCK_MAX / 2);
+        }
+    }
+
+    // noise through a decaying response long enough for the tail, the FFTs of both partitions
+    const int ir_length = CONVOLUTION_HEAD_LENGTH + 2 * CONVOLUTION_TAIL_BLOCK;
+    static float ir[CONVOLUTION_HEAD_LENGTH + 2 * CONVOLUTION_TAIL_BLOCK];
+    for (int i = 0; i < ir_length; i++) ir[i] = test_random(-1.0f, 1.0f) * SDL_expf(-(float) i / 1000.0f) * 0.05f;
+    for (int i = 0; i < REFERENCE_FRAMES; i++) left[i] = test_random(-1.0f, 1.0f);
+    Arena arena = arena_init(convolution_footprint(ir_length));
+    Convolution *conv = convolution_init(&arena, ir, ir, ir_length, (WorkerSetup) {0});
+    for (int i = 0; i < REFERENCE_FRAMES; i += CONVOLUTION_HEAD_BLOCK) {
+        convolution_process(conv, left + i, left + i, out + 5 * REFERENCE_FRAMES + i, right, CONVOLUTION_HEAD_BLOCK);
+        convolution_wait_idle(conv);
+    }
+    convolution_stop(conv);
+    arena_free(&arena);
+
+    for (int i = 0; i < REFERENCE_FRAMES; i++) {
+        out[6 * REFERENCE_FRAMES + i] = fast_sin_turns(test_random(-1000.0f, 1000.0f));
+        out[7 * REFERENCE_FRAMES + i] = fast_exp2(test_random(-20.0f, 20.0f));
+    }
+    test_seed = seed;
+}
+
+TEST builds_match_reference(void) {
+    const char *path = getenv("DSP_TEST_REFERENCE");
+    if (path == NULL) {
+        SKIPm("DSP_TEST_REFERENCE not set");
+    }
+    static float outputs[REFERENCE_SECTIONS * REFERENCE_FRAMES];
+    static float reference[REFERENCE_SECTIONS * REFERENCE_FRAMES];
+    reference_render(outputs);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        file = fopen(path, "wb");
+        ASSERT(file != NULL);
+        ASSERT_EQ(SDL_arraysize(outputs), fwrite(outputs, sizeof(float), SDL_arraysize(outputs), file));
+        fclose(file);
+        SKIPm("reference written");
+    }
+    const size_t read = fread(reference, sizeof(float), SDL_arraysize(reference), file);
+    fclose(file);
+    ASSERT_EQ(SDL_arraysize(reference), read);
+    for (int s = 0; s < REFERENCE_SECTIONS; s++) {
+        const float *a = outputs + s * REFERENCE_FRAMES;
+        const float *b = reference + s * REFERENCE_FRAMES;
+        double peak = 0.0;
+        for (int i = 0; i < REFERENCE_FRAMES; i++) peak = SDL_max(peak, fabs(b[i]));
+        ASSERT_PROPERTY(peak > 0.0, "%s is silent", reference_names[s]);
+        for (int i = 0; i < REFERENCE_FRAMES; i++) {
+            ASSERT_PROPERTY(
+                isfinite(a[i]) && fabs(a[i] - b[i]) <= REFERENCE_TOLERANCE * peak,
+                "%s, sample %d: %.9g, the other build %.9g", reference_names[s], i, a[i], b[i]
+            );
+        }
+    }
+    PASS();
+}
+
+SUITE(kernel_suite) {
+    RUN_TEST(unison_wave_matches_scalar);
+    RUN_TEST(waves_stay_within_amplitude);
+    RUN_TEST(simd_dot_matches_scalar);
+    RUN_TEST(convolution_multiply_add_matches_scalar);
+    RUN_TEST(halfband_table_matches_design);
+}
+
+SUITE(stability_suite) {
+    RUN_TEST(filter_lowpass_stays_bounded);
+    RUN_TEST(filters_stay_stable);
+}
+
+SUITE(block_size_suite) {
+    RUN_TEST(oversampler_ignores_block_sizes);
+    RUN_TEST(voice_render_ignores_block_sizes);
+}
+
+SUITE(build_suite) {
+    RUN_TEST(builds_match_reference);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    const char *seed = getenv("DSP_TEST_SEED");
+    if (seed != NULL && SDL_atoi(seed) != 0) {
+        test_seed = (uint32_t) SDL_atoi(seed);
+    }
+    printf("DSP_TEST_SEED=%u\n", (unsigned) test_seed);
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(kernel_suite);
+    RUN_SUITE(stability_suite);
+    RUN_SUITE(block_size_suite);
+    RUN_SUITE(build_suite);
+    GREATEST_MAIN_END();
+}
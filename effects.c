@@ -0,0 +1,472 @@
+/*
+    Effects bus after the voices: impulse response convolution, stereo delay, chorus and
+    a feedback delay network reverb.
+    Delay lines are power of two ring buffers indexed with a mask, carved from the
+    engine arena by effects_init. Everything runs per block at the device rate and a disabled effect
+    is skipped as a whole, its buffers are not touched.
+    Once the input has been silent for longer than the tails of the enabled effects the bus
+    goes idle and outputs zeros until the input comes back.
+*/
+#include "platform.h"
+#include <assert.h>
+
+typedef struct {
+    float *buffer;
+    int mask; // size - 1, the size is a power of two
+    int write;
+} DelayLine;
+
+int delay_line_size(int max_delay) {
+    int size = 1;
+    while (size < max_delay + 2) size <<= 1; // room for the interpolation neighbour
+    return size;
+}
+
+size_t delay_line_footprint(int max_delay) {
+    return arena_align(delay_line_size(max_delay) * sizeof(float));
+}
+
+DelayLine delay_line_init(Arena *arena, int max_delay) {
+    const int size = delay_line_size(max_delay);
+    DelayLine line = {.buffer = arena_alloc(arena, size * sizeof(float)), .mask = size - 1, .write = 0};
+    return line;
+}
+
+void delay_line_clear(DelayLine *line) {
+    SDL_memset(line->buffer, 0, (line->mask + 1) * sizeof(float));
+}
+
+void delay_line_write(DelayLine *line, float x) {
+    line->buffer[line->write] = x;
+    line->write = (line->write + 1) & line->mask;
+}
+
+// delay in samples from the last written one, at least 0 and at most the max delay
+float delay_line_read(const DelayLine *line, int delay) {
+    return line->buffer[(line->write - 1 - delay) & line->mask];
+}
+
+// fractional delay with linear interpolation
+float delay_line_read_frac(const DelayLine *line, float delay) {
+    const int whole = (int) delay;
+    const float frac = delay - (float) whole;
+    const float a = line->buffer[(line->write - 1 - whole) & line->mask];
+    const float b = line->buffer[(line->write - 2 - whole) & line->mask];
+    return a + frac * (b - a);
+}
+
+// dry = dry * (1 - mix) + wet * mix, vectorized with a scalar tail
+void effects_mix(float *dry, const float *wet, float mix, int n) {
+    const f32x4 dry_gain = simd_set1(1.0f - mix);
+    const f32x4 wet_gain = simd_set1(mix);
+    int i = 0;
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        simd_store(dry + i, simd_load(dry + i) * dry_gain + simd_load(wet + i) * wet_gain);
+    }
+    for (; i < n; i++) {
+        dry[i] = dry[i] * (1.0f - mix) + wet[i] * mix;
+    }
+}
+
+/*
+    Stereo delay with the feedback crossed between channels (ping pong)
+*/
+#define DELAY_MAX_SECONDS 2.0f // default for max_time
+
+typedef struct {
+    DelayLine left;
+    DelayLine right;
+    float max_time; // seconds, sizes the lines
+    float time; // seconds
+    float smoothed; // samples, follows time to avoid zipper noise
+    float feedback; // 0.0 to 0.95
+    float mix;
+    float sample_rate;
+} StereoDelay;
+
+size_t stereo_delay_footprint(float sample_rate, float max_time) {
+    return 2 * delay_line_footprint((int) (max_time * sample_rate));
+}
+
+StereoDelay stereo_delay_init(Arena *arena, float sample_rate, float max_time) {
+    const int max_delay = (int) (max_time * sample_rate);
+    StereoDelay delay = {
+        .left = delay_line_init(arena, max_delay),
+        .right = delay_line_init(arena, max_delay),
+        .max_time = max_time,
+        .time = 0.375f,
+        .smoothed = 0.375f * sample_rate,
+        .feedback = 0.4f,
+        .mix = 0.3f,
+        .sample_rate = sample_rate,
+    };
+    return delay;
+}
+
+void stereo_delay_process(StereoDelay *delay, float *left, float *right, float *wet_left, float *wet_right, int n) {
+    const float target = SDL_clamp(delay->time, 0.001f, delay->max_time) * delay->sample_rate;
+    const float feedback = SDL_clamp(delay->feedback, 0.0f, 0.95f);
+    for (int i = 0; i < n; i++) {
+        delay->smoothed += 0.001f * (target - delay->smoothed);
+        const float l = delay_line_read_frac(&delay->left, delay->smoothed);
+        const float r = delay_line_read_frac(&delay->right, delay->smoothed);
+        delay_line_write(&delay->left, left[i] + feedback * r);
+        delay_line_write(&delay->right, right[i] + feedback * l);
+        wet_left[i] = l;
+        wet_right[i] = r;
+    }
+    effects_mix(left, wet_left, delay->mix, n);
+    effects_mix(right, wet_right, delay->mix, n);
+}
+
+void stereo_delay_clear(StereoDelay *delay) {
+    delay_line_clear(&delay->left);
+    delay_line_clear(&delay->right);
+}
+
+/*
+    Chorus, a short delay modulated by an lfo, in quadrature between channels
+*/
+#define CHORUS_MAX_SECONDS 0.05f
+
+typedef struct {
+    DelayLine left;
+    DelayLine right;
+    float rate; // Hz
+    float depth; // seconds
+    float centre; // seconds
+    float mix;
+    float phase;
+    float sample_rate;
+} Chorus;
+
+size_t chorus_footprint(float sample_rate) {
+    return 2 * delay_line_footprint((int) (CHORUS_MAX_SECONDS * sample_rate));
+}
+
+Chorus chorus_init(Arena *arena, float sample_rate) {
+    const int max_delay = (int) (CHORUS_MAX_SECONDS * sample_rate);
+    Chorus chorus = {
+        .left = delay_line_init(arena, max_delay),
+        .right = delay_line_init(arena, max_delay),
+        .rate = 0.8f,
+        .depth = 0.003f,
+        .centre = 0.012f,
+        .mix = 0.5f,
+        .sample_rate = sample_rate,
+    };
+    return chorus;
+}
+
+void chorus_process(Chorus *chorus, float *left, float *right, float *wet_left, float *wet_right, int n) {
+    const float centre = chorus->centre * chorus->sample_rate;
+    const float depth = SDL_min(chorus->depth, chorus->centre) * chorus->sample_rate;
+    const float phase_step = chorus->rate / chorus->sample_rate;
+    for (int i = 0; i < n; i++) {
+        delay_line_write(&chorus->left, left[i]);
+        delay_line_write(&chorus->right, right[i]);
+        wet_left[i] = delay_line_read_frac(&chorus->left, centre + depth * fast_sin_turns(chorus->phase));
+        wet_right[i] = delay_line_read_frac(&chorus->right, centre + depth * fast_cos_turns(chorus->phase));
+        chorus->phase += phase_step;
+        if (chorus->phase >= 1.0f) chorus->phase -= 1.0f;
+    }
+    effects_mix(left, wet_left, chorus->mix, n);
+    effects_mix(right, wet_right, chorus->mix, n);
+}
+
+void chorus_clear(Chorus *chorus) {
+    delay_line_clear(&chorus->left);
+    delay_line_clear(&chorus->right);
+}
+
+/*
+    Feedback delay network reverb with 8 lines and a Householder feedback matrix,
+    y = x - 2 / N * sum(x), which needs no shuffles. The 8 lines are two f32x4 so
+    damping, decay and the matrix run on vectors.
+*/
+#define REVERB_LINES 8
+#define REVERB_VECTORS (REVERB_LINES / SIMD_WIDTH)
+
+// mutually prime lengths in samples at 44100 Hz, scaled with the sample rate
+const int reverb_line_lengths[REVERB_LINES] = {1327, 1637, 1811, 1931, 2357, 2647, 2989, 3229};
+
+typedef struct {
+    DelayLine lines[REVERB_LINES];
+    int lengths[REVERB_LINES];
+    f32x4 gain[REVERB_VECTORS]; // per line decay for decay_time
+    f32x4 damping_state[REVERB_VECTORS];
+    float decay_time; // seconds to fall 60 dB
+    float damping; // 0.0 to 1.0, high frequencies decay faster
+    float mix;
+    float sample_rate;
+} Reverb;
+
+void reverb_set_decay(Reverb *reverb, float decay_time) {
+    reverb->decay_time = SDL_max(decay_time, 0.1f);
+    for (int i = 0; i < REVERB_LINES; i++) {
+        // -60 dB after decay_time, for one trip around this line
+        const float seconds = (float) reverb->lengths[i] / reverb->sample_rate;
+        reverb->gain[i / SIMD_WIDTH][i % SIMD_WIDTH] = fast_exp2(-9.96578428f * seconds / reverb->decay_time);
+    }
+}
+
+int reverb_line_length(int line, float sample_rate) {
+    return (int) ((float) reverb_line_lengths[line] * sample_rate / 44100.0f);
+}
+
+size_t reverb_footprint(float sample_rate) {
+    size_t size = 0;
+    for (int i = 0; i < REVERB_LINES; i++) {
+        size += delay_line_footprint(reverb_line_length(i, sample_rate));
+    }
+    return size;
+}
+
+Reverb reverb_init(Arena *arena, float sample_rate) {
+    Reverb reverb = {.damping = 0.3f, .mix = 0.25f, .sample_rate = sample_rate};
+    for (int i = 0; i < REVERB_LINES; i++) {
+        reverb.lengths[i] = reverb_line_length(i, sample_rate);
+        reverb.lines[i] = delay_line_init(arena, reverb.lengths[i]);
+    }
+    reverb_set_decay(&reverb, 2.5f);
+    return reverb;
+}
+
+void reverb_process(Reverb *reverb, float *left, float *right, float *wet_left, float *wet_right, int n) {
+    const f32x4 damping = simd_set1(SDL_clamp(reverb->damping, 0.0f, 0.99f));
+    const f32x4 householder = simd_set1(-2.0f / REVERB_LINES);
+    // even lines take the left input and feed the left output, odd lines the right ones
+    const f32x4 left_mask = {1.0f, 0.0f, 1.0f, 0.0f};
+    const f32x4 right_mask = {0.0f, 1.0f, 0.0f, 1.0f};
+
+    for (int i = 0; i < n; i++) {
+        float taps[REVERB_LINES];
+        for (int l = 0; l < REVERB_LINES; l++) {
+            taps[l] = delay_line_read(&reverb->lines[l], reverb->lengths[l] - 1);
+        }
+
+        f32x4 x[REVERB_VECTORS];
+        f32x4 sum = simd_set1(0.0f);
+        f32x4 out_left = simd_set1(0.0f);
+        f32x4 out_right = simd_set1(0.0f);
+        for (int v = 0; v < REVERB_VECTORS; v++) {
+            x[v] = simd_load(taps + v * SIMD_WIDTH);
+            // one-pole lowpass in the loop, then the decay of the line
+            reverb->damping_state[v] = x[v] + damping * (reverb->damping_state[v] - x[v]);
+            x[v] = reverb->damping_state[v] * reverb->gain[v];
+            sum += x[v];
+            out_left += x[v] * left_mask;
+            out_right += x[v] * right_mask;
+        }
+        const f32x4 feedback = simd_set1(simd_sum(sum)) * householder;
+        const f32x4 input = left[i] * left_mask + right[i] * right_mask;
+        for (int v = 0; v < REVERB_VECTORS; v++) {
+            simd_store(taps + v * SIMD_WIDTH, x[v] + feedback + input);
+        }
+        for (int l = 0; l < REVERB_LINES; l++) {
+            delay_line_write(&reverb->lines[l], taps[l]);
+        }
+
+        wet_left[i] = simd_sum(out_left) * (2.0f / REVERB_LINES);
+        wet_right[i] = simd_sum(out_right) * (2.0f / REVERB_LINES);
+    }
+    effects_mix(left, wet_left, reverb->mix, n);
+    effects_mix(right, wet_right, reverb->mix, n);
+}
+
+void reverb_clear(Reverb *reverb) {
+    for (int i = 0; i < REVERB_LINES; i++) {
+        delay_line_clear(&reverb->lines[i]);
+    }
+    for (int v = 0; v < REVERB_VECTORS; v++) {
+        reverb->damping_state[v] = simd_set1(0.0f);
+    }
+}
+
+/*
+    The bus, in order: convolution, chorus, delay, reverb
+*/
+#define EFFECTS_BLOCK_MAX 128
+#define EFFECTS_SILENCE_THRESHOLD 1e-5f // -100 dB
+
+typedef enum {
+    EFFECT_CONVOLUTION,
+    EFFECT_CHORUS,
+    EFFECT_DELAY,
+    EFFECT_REVERB,
+    EFFECT_COUNT,
+} EffectType;
+
+typedef struct {
+    bool enabled[EFFECT_COUNT];
+    bool cleared[EFFECT_COUNT]; // by effects_clear since it was last enabled
+    Convolution *convolution; // NULL without an impulse response
+    Chorus chorus;
+    StereoDelay delay;
+    Reverb reverb;
+    Uint64 silent_frames; // since the input was last above EFFECTS_SILENCE_THRESHOLD
+    bool idle; // every tail has died out, processing is skipped
+    // scratch for the wet signal, EFFECTS_BLOCK_MAX each
+    float *wet_left;
+    float *wet_right;
+} Effects;
+
+// ir_length 0 without an impulse response
+size_t effects_footprint(float sample_rate, float max_delay_time, int ir_length) {
+    size_t size = chorus_footprint(sample_rate) + stereo_delay_footprint(sample_rate, max_delay_time) + reverb_footprint(sample_rate)
+        + 2 * arena_align(EFFECTS_BLOCK_MAX * sizeof(float));
+    if (ir_length > 0) {
+        size += convolution_footprint(ir_length);
+    }
+    return size;
+}
+
+Effects effects_init(Arena *arena, float sample_rate, float max_delay_time, const ImpulseResponse *ir, WorkerSetup worker_setup) {
+    Effects effects = {
+        .chorus = chorus_init(arena, sample_rate),
+        .delay = stereo_delay_init(arena, sample_rate, max_delay_time),
+        .reverb = reverb_init(arena, sample_rate),
+        .wet_left = arena_alloc(arena, EFFECTS_BLOCK_MAX * sizeof(float)),
+        .wet_right = arena_alloc(arena, EFFECTS_BLOCK_MAX * sizeof(float)),
+    };
+    if (ir->length > 0) {
+        effects.convolution = convolution_init(arena, ir->left, ir->right, ir->length, worker_setup);
+    }
+    return effects;
+}
+
+// stops the threads of the effects, the memory belongs to the arena
+void effects_stop(Effects *effects) {
+    convolution_stop(effects->convolution);
+}
+
+bool effects_any_enabled(const Effects *effects) {
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        if (effects->enabled[i]) return true;
+    }
+    return false;
+}
+
+// an idle bus outputs silence without running
+bool effects_idle(const Effects *effects) {
+    return effects->idle || !effects_any_enabled(effects);
+}
+
+// samples until the enabled effects fall below EFFECTS_SILENCE_THRESHOLD after the input stops,
+// they are in series so the tails add up
+Uint64 effects_tail_frames(const Effects *effects) {
+    const float silence_db = 100.0f;
+    const float sample_rate = effects->chorus.sample_rate;
+    float frames = 0.0f;
+    if (effects->enabled[EFFECT_CONVOLUTION]) {
+        frames += (float) (effects->convolution->length + CONVOLUTION_HEAD_BLOCK + 2 * CONVOLUTION_TAIL_BLOCK);
+    }
+    if (effects->enabled[EFFECT_CHORUS]) {
+        frames += CHORUS_MAX_SECONDS * sample_rate;
+    }
+    if (effects->enabled[EFFECT_DELAY]) {
+        const StereoDelay *delay = &effects->delay;
+        const float feedback = SDL_clamp(delay->feedback, 0.0f, 0.95f);
+        const float repeats = feedback > 0.0f ? SDL_logf(EFFECTS_SILENCE_THRESHOLD) / SDL_logf(feedback) : 0.0f;
+        frames += (repeats + 1.0f) * SDL_max(delay->smoothed, delay->time * sample_rate);
+    }
+    if (effects->enabled[EFFECT_REVERB]) {
+        frames += effects->reverb.decay_time * silence_db / 60.0f * sample_rate + (float) effects->reverb.lengths[REVERB_LINES - 1];
+    }
+    return (Uint64) frames;
+}
+
+bool effects_input_is_silent(const float *left, const float *right, int n) {
+    float peak = 0.0f;
+    for (int i = 0; i < n; i++) {
+        peak = SDL_max(peak, SDL_max(SDL_fabsf(left[i]), SDL_fabsf(right[i])));
+    }
+    return peak < EFFECTS_SILENCE_THRESHOLD;
+}
+
+// not from the audio thread, while the effect is disabled. The audio thread skips a disabled effect, so this runs
+// without holding it up: the convolution waits for its worker and the delay lines are zeroed. Then
+// effects_set_enabled under the lock only flips the flag
+void effects_clear(Effects *effects, EffectType effect) {
+    assert(!effects->enabled[effect]);
+    switch (effect) {
+        case EFFECT_CONVOLUTION:
+            if (effects->convolution == NULL) return;
+            convolution_clear(effects->convolution);
+            break;
+        case EFFECT_CHORUS:
+            chorus_clear(&effects->chorus);
+            break;
+        case EFFECT_DELAY:
+            stereo_delay_clear(&effects->delay);
+            break;
+        case EFFECT_REVERB:
+            reverb_clear(&effects->reverb);
+            break;
+        default:
+            assert(false);
+    }
+    effects->cleared[effect] = true;
+}
+
+// not from the audio thread, every effect off and silent with its lfo at the start, as effects_init left them.
+// The settings stay
+void effects_reset(Effects *effects) {
+    for (int e = 0; e < EFFECT_COUNT; e++) {
+        effects->enabled[e] = false;
+        effects_clear(effects, e);
+    }
+    effects->chorus.phase = 0.0f;
+    effects->delay.smoothed = effects->delay.time * effects->delay.sample_rate;
+    effects->silent_frames = 0;
+    effects->idle = false;
+}
+
+// not from the audio thread, an effect starts from silence when enabled. It is cleared here unless effects_clear
+// did it already
+void effects_set_enabled(Effects *effects, EffectType effect, bool enabled) {
+    if (effect == EFFECT_CONVOLUTION && effects->convolution == NULL) {
+        return;
+    }
+    if (enabled && !effects->enabled[effect] && !effects->cleared[effect]) {
+        effects_clear(effects, effect);
+    }
+    effects->enabled[effect] = enabled;
+    effects->cleared[effect] = false;
+}
+
+void effects_process(Effects *effects, float *left, float *right, int n) {
+    assert(n <= EFFECTS_BLOCK_MAX);
+    if (!effects_input_is_silent(left, right, n)) {
+        effects->silent_frames = 0;
+        effects->idle = false;
+    } else if (!effects->idle) {
+        effects->silent_frames += n;
+        if (effects->silent_frames > effects_tail_frames(effects)) {
+            // what is left in the lines is below the threshold, only the feedback state could decay further
+            for (int v = 0; v < REVERB_VECTORS; v++) {
+                effects->reverb.damping_state[v] = simd_set1(0.0f);
+            }
+            effects->idle = true;
+        }
+    }
+    if (effects->idle) {
+        SDL_memset(left, 0, n * sizeof(float));
+        SDL_memset(right, 0, n * sizeof(float));
+        return;
+    }
+    if (effects->enabled[EFFECT_CONVOLUTION]) {
+        convolution_process(effects->convolution, left, right, effects->wet_left, effects->wet_right, n);
+        effects_mix(left, effects->wet_left, effects->convolution->mix, n);
+        effects_mix(right, effects->wet_right, effects->convolution->mix, n);
+    }
+    if (effects->enabled[EFFECT_CHORUS]) {
+        chorus_process(&effects->chorus, left, right, effects->wet_left, effects->wet_right, n);
+    }
+    if (effects->enabled[EFFECT_DELAY]) {
+        stereo_delay_process(&effects->delay, left, right, effects->wet_left, effects->wet_right, n);
+    }
+    if (effects->enabled[EFFECT_REVERB]) {
+        reverb_process(&effects->reverb, left, right, effects->wet_left, effects->wet_right, n);
+    }
+}
@@ -0,0 +1,340 @@
+/*
+    The engine, everything that makes the sound: the voices and their modulation, oversampling,
+    the effects and the load watchdog, with the memory arena they are carved from, the patch
+    snapshots they read and the queue of timed MIDI events. Nothing of it is global, so a
+    process can run several engines, libsynth has one per SynthEngine: the synth one for the
+    audio device, the multisample export one per worker thread.
+    engine_render and engine_perform run on the thread that renders, inside synth_process. The
+    owner publishes patches into patch_exchange and queues events into midi_to_audio
+    from its own thread, the messages that edit the patch come back to it in midi_to_ui. Live
+    performance messages, from a device as they arrive, go into midi_live and play at the start
+    of the next block: the timed events may be queued seconds ahead and a live note would wait
+    behind them. Neither side ever waits for the other.
+*/
+#include "platform.h"
+#include <assert.h>
+
+#define ENGINE_BLOCK 128 // frames rendered at a time
+#define ENGINE_CHANNELS 2 // interleaved stereo
+#define ENGINE_MIDI_QUEUE_SIZE 4096
+#define ENGINE_UI_QUEUE_SIZE 256
+#define ENGINE_LIVE_QUEUE_SIZE 256
+#define ENGINE_CROSSFADE_FRAMES 256 // of a switch of the oversampling factor
+
+// every DSP buffer is carved from one arena sized from this config
+typedef struct {
+    int max_polyphony;
+    float max_delay_time; // seconds
+    int impulse_response_length; // samples, 0 without one
+    WorkerSetup worker_setup; // run by the threads of the effects as they start
+    bool lock_required; // engine_init fails when the arena cannot be locked, otherwise it runs prefaulted only
+} EngineConfig;
+
+typedef struct {
+    float sample_rate;
+    Arena arena;
+
+    // patch, shared by all voices. The owner publishes it, the render thread only reads snapshots
+    PatchExchange patch_exchange;
+
+    // voices and the notes held, the latest on top
+    VoicePool voice_pool;
+    NoteMemory note_memory;
+    MidiNote last_note; // of the latest note on
+    SDL_AtomicInt voices_active; // at the end of the last block, for the other threads
+
+    // oversampling of the voice path at the factor of the patch. A change crossfades from the decimators at the old
+    // factor into the spare ones at the new factor, then they trade places
+    Oversampler *oversampler_left;
+    Oversampler *oversampler_right;
+    Oversampler *oversampler_spare_left;
+    Oversampler *oversampler_spare_right;
+    bool crossfading;
+    int crossfade_done; // frames
+
+    // effects after the voices, and load shedding when rendering gets close to its deadline
+    Effects effects;
+    Watchdog watchdog;
+
+    // modulation, the routing is part of the patch
+    ModSources mod_sources;
+    float mod_values[MOD_SRC_COUNT];
+    int control_countdown; // samples left in the current control block, shared by all voices
+
+    // timed MIDI events, queued by the owner and played at their frame. Those that edit the patch go back
+    Ring midi_to_audio;
+    Ring midi_to_ui;
+    Ring midi_live; // performance messages, played at the start of the next block
+    SDL_AtomicInt midi_flush; // set by the owner to drop the queued events and release the voices
+    Uint64 frames; // rendered so far, the clock of the queued events
+    SDL_AtomicInt frame_clock; // the low 32 bits of frames, for the other threads
+    Uint64 events_late; // events played after the frame they were due at
+} Engine;
+
+size_t engine_footprint(EngineConfig config, float sample_rate) {
+    return voice_pool_footprint(config.max_polyphony)
+        + effects_footprint(sample_rate, config.max_delay_time, config.impulse_response_length)
+        + ring_footprint(sizeof(MidiEvent), ENGINE_MIDI_QUEUE_SIZE) + ring_footprint(sizeof(MidiEvent), ENGINE_UI_QUEUE_SIZE)
+        + ring_footprint(sizeof(Uint32), ENGINE_LIVE_QUEUE_SIZE) + 4 * arena_align(sizeof(Oversampler)) + patch_exchange_footprint();
+}
+
+// the owner, while no thread renders: the engine plays as if it was just set up with patch, on the memory it has.
+// The effects are off and silent, the watchdog is back at full quality and the clock at 0
+void engine_reset(Engine *engine, const Patch *patch) {
+    patch_exchange_reset(&engine->patch_exchange, patch);
+    voice_pool_reset(&engine->voice_pool);
+    engine->note_memory.count = 0;
+    engine->last_note = DEFAULT_MIDI_NOTE;
+    SDL_SetAtomicInt(&engine->voices_active, 0);
+    *engine->oversampler_left = oversampler_init(patch->oversampling);
+    *engine->oversampler_right = oversampler_init(patch->oversampling);
+    engine->crossfading = false;
+    effects_reset(&engine->effects);
+    engine->watchdog = watchdog_init(engine->watchdog.degrade_load);
+    engine->mod_sources = mod_sources_init();
+    mod_sources_next(&engine->mod_sources, 0.0f, engine->mod_values); // a note before the first block sees them
+    engine->control_countdown = 0;
+    ring_reset(&engine->midi_to_audio);
+    ring_reset(&engine->midi_to_ui);
+    ring_reset(&engine->midi_live);
+    SDL_SetAtomicInt(&engine->midi_flush, 0);
+    engine->frames = 0;
+    SDL_SetAtomicInt(&engine->frame_clock, 0);
+    engine->events_late = 0;
+}
+
+// the engine points into itself, so it is set up in place, before any thread renders from it. The memory is
+// allocated, prefaulted and locked once here: the snapshots, oversamplers and scratch buffers too, the Engine
+// itself keeps only the pointers and the small state of the render thread, about a KiB. False when the memory
+// cannot be had, or locked with lock_required, then there is nothing to free
+bool engine_init(Engine *engine, EngineConfig config, float sample_rate, const ImpulseResponse *impulse_response, const Patch *patch) {
+    assert(config.impulse_response_length == impulse_response->length);
+    SDL_zerop(engine);
+    engine->sample_rate = sample_rate;
+    engine->arena = arena_init(engine_footprint(config, sample_rate));
+    if (engine->arena.base == NULL || (config.lock_required && !engine->arena.locked)) {
+        arena_free(&engine->arena);
+        return false;
+    }
+    engine->voice_pool = voice_pool_init(&engine->arena, config.max_polyphony);
+    engine->midi_to_audio = ring_init(&engine->arena, sizeof(MidiEvent), ENGINE_MIDI_QUEUE_SIZE);
+    engine->midi_to_ui = ring_init(&engine->arena, sizeof(MidiEvent), ENGINE_UI_QUEUE_SIZE);
+    engine->midi_live = ring_init(&engine->arena, sizeof(Uint32), ENGINE_LIVE_QUEUE_SIZE);
+    // every delay line is carved here
+    engine->effects = effects_init(&engine->arena, sample_rate, config.max_delay_time, impulse_response, config.worker_setup);
+    engine->watchdog = watchdog_init(WATCHDOG_DEGRADE_LOAD);
+    engine->oversampler_left = arena_alloc(&engine->arena, sizeof(Oversampler));
+    engine->oversampler_right = arena_alloc(&engine->arena, sizeof(Oversampler));
+    engine->oversampler_spare_left = arena_alloc(&engine->arena, sizeof(Oversampler));
+    engine->oversampler_spare_right = arena_alloc(&engine->arena, sizeof(Oversampler));
+    patch_exchange_init(&engine->arena, &engine->patch_exchange, patch);
+    engine_reset(engine, patch);
+    return true;
+}
+
+// once no thread renders from it, stops the threads of the effects and frees the memory
+void engine_free(Engine *engine) {
+    effects_stop(&engine->effects);
+    arena_free(&engine->arena);
+}
+
+// notes, mod wheel, all notes off and pressure play the engine, everything else edits the patch
+bool midi_is_performance(Uint32 message) {
+    const Uint32 type = message & 0xF0;
+    const Uint32 cc_number = (message >> 8) & 0xFF;
+    return type == 0x80 || type == 0x90 || type == 0xD0 || (type == 0xB0 && (cc_number == 1 || cc_number == 123));
+}
+
+// render thread, or the owner while nothing renders. New voices start with the given patch
+void engine_perform(Engine *engine, Uint32 message, const Patch *voice_patch) {
+    const Uint32 type = message & 0xF0;
+    const int data1 = (int) ((message >> 8) & 0xFF);
+    const int data2 = (int) ((message >> 16) & 0xFF);
+
+    if (type == 0x90 && data2 > 0) {
+        // note on, velocity from 0 to 1 over twice the MIDI range
+        engine->last_note = data1;
+        const PressedNote pressed_note = {
+            .freq = note_to_freq(data1),
+            .midi_note = data1,
+            .velocity = (1.0f / 255.0f) * (float) data2,
+        };
+        note_memory_push(&engine->note_memory, pressed_note);
+        voice_pool_note_on(&engine->voice_pool, pressed_note, voice_patch, engine->mod_values);
+    } else if (type == 0x80 || type == 0x90) {
+        // note off, or note on without velocity
+        note_memory_remove(&engine->note_memory, data1);
+        voice_pool_note_off(&engine->voice_pool, data1, note_memory_peek(&engine->note_memory));
+    } else if (type == 0xB0 && data1 == 1) {
+        // mod wheel
+        engine->mod_sources.mod_wheel = (1.0f / 127.0f) * (float) data2;
+    } else if (type == 0xB0 && data1 == 123) {
+        // all notes off, the voices ring out
+        engine->note_memory.count = 0;
+        voice_pool_release_all(&engine->voice_pool);
+    } else if (type == 0xD0) {
+        // channel pressure (aftertouch)
+        engine->mod_sources.aftertouch = (1.0f / 127.0f) * (float) data1;
+    }
+}
+
+// owner thread, a performance message played at the start of the next block. False when the queue is full
+bool engine_play_live(Engine *engine, Uint32 message) {
+    assert(midi_is_performance(message));
+    return ring_push(&engine->midi_live, &message);
+}
+
+// render thread, the next queued event, left in the queue until it is played so the owner counts it as queued.
+// False when there is none
+bool engine_next_event(Engine *engine, MidiEvent *event) {
+    return ring_peek(&engine->midi_to_audio, event);
+}
+
+// render thread, the owner asked with midi_flush: the queued events are dropped and the voices ring out
+void engine_flush_midi(Engine *engine) {
+    MidiEvent event;
+    while (ring_pop(&engine->midi_to_audio, &event)) {}
+    engine->note_memory.count = 0;
+    voice_pool_release_all(&engine->voice_pool);
+}
+
+// effects keep running without voices until their tails die out, queued MIDI events keep the engine
+// running so they are played at their frame. Otherwise the output is silence until the next note
+bool engine_idle(Engine *engine) {
+    const bool events_queued = ring_count(&engine->midi_to_audio) > 0 || ring_count(&engine->midi_live) > 0;
+    return voice_pool_active_count(&engine->voice_pool) == 0 && effects_idle(&engine->effects) && !events_queued;
+}
+
+// render thread, moves the clock on by frames that were rendered or skipped while idle
+void engine_advance(Engine *engine, int num_frames) {
+    engine->frames += (Uint64) num_frames;
+    SDL_SetAtomicInt(&engine->frame_clock, (int) (Uint32) engine->frames);
+}
+
+// any thread, the frames rendered so far without a lock. Counted on from seen, the clock this thread got last,
+// so it must look at least once every 2^32 frames
+Uint64 engine_frame_clock(Engine *engine, Uint64 seen) {
+    const Uint32 clock = (Uint32) SDL_GetAtomicInt(&engine->frame_clock);
+    return seen + (Uint64) (Uint32) (clock - (Uint32) seen);
+}
+
+// render thread. Renders up to ENGINE_BLOCK frames of interleaved stereo
+void engine_render(Engine *engine, float *samples, int num_frames) {
+    TRACE_SCOPE("engine_render");
+    assert(num_frames <= ENGINE_BLOCK);
+    VoicePool *pool = &engine->voice_pool;
+
+    // shed load at the level the watchdog settled on in the last callbacks
+    const int voice_limit = watchdog_voice_limit(&engine->watchdog, pool->polyphony);
+    if (voice_limit < pool->polyphony) {
+        engine->watchdog.voices_stolen += voice_pool_limit(pool, voice_limit);
+    }
+
+    // the latest published patch, as rendered at this rate and quality level. While the oversampling factor
+    // switches the voices render at the higher of the two, both paths are taken from that. A change that comes
+    // during a switch waits for it to end
+    Patch render_patch = *patch_acquire(&engine->patch_exchange);
+    const int next_factor = watchdog_oversampling(&engine->watchdog, render_patch.oversampling);
+    if (!engine->crossfading && next_factor != engine->oversampler_left->factor) {
+        *engine->oversampler_spare_left = oversampler_init(next_factor);
+        *engine->oversampler_spare_right = oversampler_init(next_factor);
+        engine->crossfading = true;
+        engine->crossfade_done = 0;
+    }
+    const int factor = engine->crossfading ? SDL_max(engine->oversampler_left->factor, engine->oversampler_spare_left->factor)
+                                           : engine->oversampler_left->factor;
+    filter_set_sample_rate(&render_patch.filter, engine->sample_rate * (float) factor);
+    watchdog_degrade_patch(&engine->watchdog, &render_patch);
+    const float phase_scale = 1.0f / (engine->sample_rate * (float) factor);
+    const float control_dt = (float) render_patch.mod_matrix.control_rate / engine->sample_rate;
+
+    // live messages arrived since the last block
+    Uint32 live_message;
+    while (ring_pop(&engine->midi_live, &live_message)) {
+        engine_perform(engine, live_message, &render_patch);
+    }
+
+    float left[ENGINE_BLOCK];
+    float right[ENGINE_BLOCK];
+    float mix_left[ENGINE_BLOCK * OVERSAMPLING_MAX];
+    float mix_right[ENGINE_BLOCK * OVERSAMPLING_MAX];
+    SDL_memset(mix_left, 0, num_frames * factor * sizeof(float));
+    SDL_memset(mix_right, 0, num_frames * factor * sizeof(float));
+
+    int i = 0;
+    while (i < num_frames) {
+        // MIDI events due at this frame, the block is split at the next one so they are sample accurate
+        const Uint64 frame = engine->frames + (Uint64) i;
+        MidiEvent event;
+        bool has_event;
+        while ((has_event = engine_next_event(engine, &event)) && event.frame <= frame) {
+            if (event.frame < frame) {
+                engine->events_late++;
+            }
+            if (midi_is_performance(event.message)) {
+                engine_perform(engine, event.message, &render_patch);
+            } else {
+                ring_push(&engine->midi_to_ui, &event); // dropped when the owner falls that far behind
+            }
+            ring_pop(&engine->midi_to_audio, &event);
+        }
+
+        // sources and routing are evaluated once per control block
+        if (engine->control_countdown <= 0) {
+            mod_sources_next(&engine->mod_sources, control_dt, engine->mod_values);
+            for (int v = 0; v < pool->voices_max; v++) {
+                if (pool->voices[v].active) {
+                    voice_control(&pool->voices[v], &render_patch, engine->mod_values, control_dt);
+                }
+            }
+            engine->control_countdown = render_patch.mod_matrix.control_rate;
+        }
+        int n = SDL_min(num_frames - i, engine->control_countdown);
+        if (has_event && event.frame - frame < (Uint64) n) {
+            n = (int) (event.frame - frame);
+        }
+
+        for (int v = 0; v < pool->voices_max; v++) {
+            if (pool->voices[v].active) {
+                voice_render(
+                    &pool->voices[v], &render_patch.oscillator, render_patch.volume, phase_scale, factor,
+                    mix_left + i * factor, mix_right + i * factor, n
+                );
+            }
+        }
+        engine->control_countdown -= n;
+        i += n;
+    }
+
+    oversampler_downsample_from(engine->oversampler_left, mix_left, factor, left, num_frames);
+    oversampler_downsample_from(engine->oversampler_right, mix_right, factor, right, num_frames);
+    if (engine->crossfading) {
+        // the decimators at the new factor start from silence while their part of the crossfade is still small
+        float next_left[ENGINE_BLOCK];
+        float next_right[ENGINE_BLOCK];
+        oversampler_downsample_from(engine->oversampler_spare_left, mix_left, factor, next_left, num_frames);
+        oversampler_downsample_from(engine->oversampler_spare_right, mix_right, factor, next_right, num_frames);
+        const int n = SDL_min(num_frames, ENGINE_CROSSFADE_FRAMES - engine->crossfade_done);
+        oversampler_crossfade(left, next_left, n, engine->crossfade_done, ENGINE_CROSSFADE_FRAMES);
+        oversampler_crossfade(right, next_right, n, engine->crossfade_done, ENGINE_CROSSFADE_FRAMES);
+        SDL_memcpy(left + n, next_left + n, (num_frames - n) * sizeof(float));
+        SDL_memcpy(right + n, next_right + n, (num_frames - n) * sizeof(float));
+        engine->crossfade_done += n;
+        if (engine->crossfade_done == ENGINE_CROSSFADE_FRAMES) {
+            Oversampler *old_left = engine->oversampler_left;
+            Oversampler *old_right = engine->oversampler_right;
+            engine->oversampler_left = engine->oversampler_spare_left;
+            engine->oversampler_right = engine->oversampler_spare_right;
+            engine->oversampler_spare_left = old_left;
+            engine->oversampler_spare_right = old_right;
+            engine->crossfading = false;
+        }
+    }
+    effects_process(&engine->effects, left, right, num_frames);
+    for (int f = 0; f < num_frames; f++) {
+        samples[f * ENGINE_CHANNELS] = left[f];
+        samples[f * ENGINE_CHANNELS + 1] = right[f];
+    }
+    SDL_SetAtomicInt(&engine->voices_active, voice_pool_active_count(pool));
+    engine_advance(engine, num_frames);
+}
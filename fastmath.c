@@ -0,0 +1,160 @@
+/*
+    Fast approximations of the math used in the audio path, each in a scalar and a
+    f32x4 form. Both forms run the same operations in the same order so they give
+    identical results. Maximum errors, checked against libm by fastmath_test.c:
+
+    fast_sin_turns   sin(2 pi x), |x| < 2^22      absolute 5e-7
+    fast_cos_turns   cos(2 pi x), |x| < 2^22      absolute 5e-7
+    fast_tanf        tan(x), 0 <= x <= 0.45 pi    relative 1e-5
+    fast_exp2        2^x, -126 <= x <= 127        relative 5e-7
+    fast_log2        log2(x), x > 0 and normal    absolute 5e-7 * max(1, |log2(x)|)
+    fast_tanh        tanh(x), any x               absolute 5e-7
+    fast_semitones_to_ratio  2^(x / 12), |x| < 128  relative 1e-6
+
+    Phases are in turns (0.0 to 1.0 is a full cycle) like the oscillator phase.
+    Polynomial coefficients are Chebyshev interpolants over the reduced ranges.
+*/
+#include "platform.h"
+#include <string.h>
+
+// adding and subtracting 1.5 * 2^23 rounds to the nearest integer, valid for |x| < 2^22
+#define FAST_ROUND_MAGIC 12582912.0f
+#define FAST_SQRT2 1.41421356f
+
+float fast_round(float x) {
+    return (x + FAST_ROUND_MAGIC) - FAST_ROUND_MAGIC;
+}
+
+f32x4 fast_round_x4(f32x4 x) {
+    return (x + simd_set1(FAST_ROUND_MAGIC)) - simd_set1(FAST_ROUND_MAGIC);
+}
+
+uint32_t fast_float_bits(float x) {
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+float fast_bits_float(uint32_t bits) {
+    float x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+f32x4 fast_select_x4(i32x4 mask, f32x4 a, f32x4 b) {
+    return (f32x4) ((mask & (i32x4) a) | (~mask & (i32x4) b));
+}
+
+// sin(2 pi x) for x in [-0.25, 0.25]
+float fast_sin_kernel(float x) {
+    const float x2 = x * x;
+    return x * (6.28318531f + x2 * (-41.3417008f + x2 * (81.6045589f + x2 * (-76.6441941f + x2 * 40.3257417f))));
+}
+
+f32x4 fast_sin_kernel_x4(f32x4 x) {
+    const f32x4 x2 = x * x;
+    return x * (6.28318531f + x2 * (-41.3417008f + x2 * (81.6045589f + x2 * (-76.6441941f + x2 * 40.3257417f))));
+}
+
+float fast_sin_turns(float x) {
+    // reduce to [-0.5, 0.5] and fold around the peaks into [-0.25, 0.25]
+    x = x - fast_round(x);
+    const float abs_x = SDL_fabsf(x);
+    const float folded = abs_x > 0.25f ? 0.5f - abs_x : abs_x;
+    return fast_sin_kernel(SDL_copysignf(folded, x));
+}
+
+f32x4 fast_sin_turns_x4(f32x4 x) {
+    const i32x4 sign_mask = (i32x4) simd_set1(-0.0f);
+    x = x - fast_round_x4(x);
+    const f32x4 abs_x = (f32x4) ((i32x4) x & ~sign_mask);
+    const f32x4 folded = fast_select_x4(abs_x > 0.25f, 0.5f - abs_x, abs_x);
+    return fast_sin_kernel_x4((f32x4) ((i32x4) folded | ((i32x4) x & sign_mask)));
+}
+
+// reduced before the quarter turn is added, x + 0.25f alone rounds away the fraction of large phases
+float fast_cos_turns(float x) {
+    return fast_sin_turns((x - fast_round(x)) + 0.25f);
+}
+
+f32x4 fast_cos_turns_x4(f32x4 x) {
+    return fast_sin_turns_x4((x - fast_round_x4(x)) + 0.25f);
+}
+
+// only meant for prewarping filter cutoffs, x from 0 to 0.45 pi
+float fast_tanf(float x) {
+    const float turns = x * (0.5f / SDL_PI_F);
+    return fast_sin_turns(turns) / fast_cos_turns(turns);
+}
+
+float fast_exp2(float x) {
+    x = SDL_clamp(x, -126.0f, 127.0f);
+    const float n = fast_round(x);
+    const float f = x - n; // [-0.5, 0.5]
+    const float p = 1.0f + f * (0.693147181f + f * (0.240223490f + f * (0.0555038101f + f * (0.00966636852f + f * 0.00133813025f))));
+    return p * fast_bits_float((uint32_t) ((int32_t) n + 127) << 23);
+}
+
+f32x4 fast_exp2_x4(f32x4 x) {
+    const i32x4 too_low = x < -126.0f;
+    const i32x4 too_high = x > 127.0f;
+    x = fast_select_x4(too_low, simd_set1(-126.0f), fast_select_x4(too_high, simd_set1(127.0f), x));
+    const f32x4 n = fast_round_x4(x);
+    const f32x4 f = x - n;
+    const f32x4 p = 1.0f + f * (0.693147181f + f * (0.240223490f + f * (0.0555038101f + f * (0.00966636852f + f * 0.00133813025f))));
+    const i32x4 exponent = (__builtin_convertvector(n, i32x4) + 127) << 23;
+    return p * (f32x4) exponent;
+}
+
+// log2(m) for m in [sqrt(0.5), sqrt(2)] with the atanh series of t = (m - 1) / (m + 1)
+float fast_log2_kernel(float m) {
+    const float t = (m - 1.0f) / (m + 1.0f);
+    const float t2 = t * t;
+    return t * (2.88539008f + t2 * (0.961796694f + t2 * (0.577078016f + t2 * 0.412198583f)));
+}
+
+f32x4 fast_log2_kernel_x4(f32x4 m) {
+    const f32x4 t = (m - 1.0f) / (m + 1.0f);
+    const f32x4 t2 = t * t;
+    return t * (2.88539008f + t2 * (0.961796694f + t2 * (0.577078016f + t2 * 0.412198583f)));
+}
+
+float fast_log2(float x) {
+    const uint32_t bits = fast_float_bits(x);
+    float e = (float) ((int32_t) ((bits >> 23) & 0xff) - 127);
+    float m = fast_bits_float((bits & 0x7fffff) | 0x3f800000); // [1, 2)
+    if (m > FAST_SQRT2) {
+        m *= 0.5f;
+        e += 1.0f;
+    }
+    return e + fast_log2_kernel(m);
+}
+
+f32x4 fast_log2_x4(f32x4 x) {
+    const i32x4 bits = (i32x4) x;
+    f32x4 e = __builtin_convertvector(((bits >> 23) & 0xff) - 127, f32x4);
+    f32x4 m = (f32x4) ((bits & 0x7fffff) | 0x3f800000);
+    const i32x4 above = m > FAST_SQRT2;
+    m = fast_select_x4(above, m * 0.5f, m);
+    e = fast_select_x4(above, e + 1.0f, e);
+    return e + fast_log2_kernel_x4(m);
+}
+
+// tanh(x) = 1 - 2 / (e^2x + 1), saturated where tanh is 1 in float
+float fast_tanh(float x) {
+    x = SDL_clamp(x, -9.0f, 9.0f);
+    return 1.0f - 2.0f / (fast_exp2(x * 2.88539008f) + 1.0f);
+}
+
+f32x4 fast_tanh_x4(f32x4 x) {
+    x = fast_select_x4(x < -9.0f, simd_set1(-9.0f), fast_select_x4(x > 9.0f, simd_set1(9.0f), x));
+    return 1.0f - 2.0f / (fast_exp2_x4(x * 2.88539008f) + 1.0f);
+}
+
+float fast_semitones_to_ratio(float semitones) {
+    return fast_exp2(semitones * (1.0f / 12.0f));
+}
+
+f32x4 fast_semitones_to_ratio_x4(f32x4 semitones) {
+    return fast_exp2_x4(semitones * (1.0f / 12.0f));
+}
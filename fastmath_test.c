@@ -0,0 +1,173 @@
+#include <math.h>
+#include "greatest.h"
+#include "simd.c"
+#include "fastmath.c"
+
+#define SWEEP_STEPS 1000000
+
+TEST fast_sin_turns_error(void) {
+    float max_error = 0.0f;
+    for (int i = 0; i <= SWEEP_STEPS; i++) {
+        const float x = -8.0f + 16.0f * (float) i / SWEEP_STEPS;
+        const float error = (float) fabs(fast_sin_turns(x) - sin(2.0 * SDL_PI_D * x));
+        max_error = SDL_max(max_error, error);
+    }
+    ASSERT(max_error < 5e-7f);
+    PASS();
+}
+
+TEST fast_cos_turns_error(void) {
+    float max_error = 0.0f;
+    for (int i = 0; i <= SWEEP_STEPS; i++) {
+        const float x = -8.0f + 16.0f * (float) i / SWEEP_STEPS;
+        const float error = (float) fabs(fast_cos_turns(x) - cos(2.0 * SDL_PI_D * x));
+        max_error = SDL_max(max_error, error);
+    }
+    ASSERT(max_error < 5e-7f);
+    PASS();
+}
+
+// both signs of log-spaced magnitudes from 2^-20 up to the documented 2^22, the fractional part is what is
+// left after the range reduction and spans the whole turn at every octave
+static float log_sweep(int i) {
+    const float magnitude = (float) ldexp(1.0, -20) * (float) pow(2.0, 42.0 * (i / 2) / (SWEEP_STEPS / 2));
+    return i % 2 == 0 ? magnitude : -magnitude;
+}
+
+TEST fast_sin_cos_turns_error_full_range(void) {
+    float max_error = 0.0f;
+    for (int i = 0; i < SWEEP_STEPS; i++) {
+        const float x = SDL_min(log_sweep(i), 4194303.75f);
+        max_error = SDL_max(max_error, (float) fabs(fast_sin_turns(x) - sin(2.0 * SDL_PI_D * fmod(x, 1.0))));
+        max_error = SDL_max(max_error, (float) fabs(fast_cos_turns(x) - cos(2.0 * SDL_PI_D * fmod(x, 1.0))));
+    }
+    ASSERT(max_error < 5e-7f);
+    PASS();
+}
+
+TEST fast_tanf_error(void) {
+    float max_error = 0.0f;
+    for (int i = 1; i <= SWEEP_STEPS; i++) {
+        const float x = 0.45f * (float) SDL_PI_D * (float) i / SWEEP_STEPS;
+        const double expected = tan(x);
+        const float error = (float) fabs((fast_tanf(x) - expected) / expected);
+        max_error = SDL_max(max_error, error);
+    }
+    ASSERT(max_error < 1e-5f);
+    PASS();
+}
+
+TEST fast_exp2_error(void) {
+    float max_error = 0.0f;
+    for (int i = 0; i <= SWEEP_STEPS; i++) {
+        const float x = -126.0f + 253.0f * (float) i / SWEEP_STEPS;
+        const double expected = exp2(x);
+        const float error = (float) fabs((fast_exp2(x) - expected) / expected);
+        max_error = SDL_max(max_error, error);
+    }
+    ASSERT(max_error < 5e-7f);
+    PASS();
+}
+
+TEST fast_exp2_integers_are_exact(void) {
+    for (int i = -126; i <= 127; i++) {
+        ASSERT_EQ_FMT((float) exp2(i), fast_exp2((float) i), "%g");
+    }
+    PASS();
+}
+
+TEST fast_log2_error(void) {
+    float max_error = 0.0f;
+    // every exponent, with the mantissa swept inside each octave
+    for (int e = -126; e <= 127; e++) {
+        for (int i = 0; i < 4096; i++) {
+            const float x = ldexpf(1.0f + (float) i / 4096.0f, e);
+            const double expected = log2(x);
+            const float error = (float) (fabs(fast_log2(x) - expected) / SDL_max(1.0, fabs(expected)));
+            max_error = SDL_max(max_error, error);
+        }
+    }
+    ASSERT(max_error < 5e-7f);
+    PASS();
+}
+
+TEST fast_tanh_error(void) {
+    float max_error = 0.0f;
+    for (int i = 0; i <= SWEEP_STEPS; i++) {
+        const float x = -20.0f + 40.0f * (float) i / SWEEP_STEPS;
+        const float error = (float) fabs(fast_tanh(x) - tanh(x));
+        max_error = SDL_max(max_error, error);
+    }
+    ASSERT(max_error < 5e-7f);
+    PASS();
+}
+
+TEST fast_semitones_to_ratio_error(void) {
+    float max_error = 0.0f;
+    for (int i = 0; i <= SWEEP_STEPS; i++) {
+        const float x = -128.0f + 256.0f * (float) i / SWEEP_STEPS;
+        const double expected = pow(2.0, x / 12.0);
+        const float error = (float) fabs((fast_semitones_to_ratio(x) - expected) / expected);
+        max_error = SDL_max(max_error, error);
+    }
+    ASSERT(max_error < 1e-6f);
+    PASS();
+}
+
+typedef float (*ScalarFn)(float);
+typedef f32x4 (*VectorFn)(f32x4);
+
+// the f32x4 form must give bit identical results to the scalar one
+int vector_matches_scalar(ScalarFn scalar, VectorFn vector, float from, float to) {
+    for (int i = 0; i < SWEEP_STEPS; i += SIMD_WIDTH) {
+        float in[SIMD_WIDTH];
+        float out[SIMD_WIDTH];
+        for (int lane = 0; lane < SIMD_WIDTH; lane++) {
+            in[lane] = from + (to - from) * (float) (i + lane) / SWEEP_STEPS;
+        }
+        simd_store(out, vector(simd_load(in)));
+        for (int lane = 0; lane < SIMD_WIDTH; lane++) {
+            if (fast_float_bits(out[lane]) != fast_float_bits(scalar(in[lane]))) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+TEST vector_forms_match_scalar(void) {
+    ASSERT(vector_matches_scalar(fast_sin_turns, fast_sin_turns_x4, -8.0f, 8.0f));
+    ASSERT(vector_matches_scalar(fast_cos_turns, fast_cos_turns_x4, -8.0f, 8.0f));
+    ASSERT(vector_matches_scalar(fast_sin_turns, fast_sin_turns_x4, -4194303.0f, 4194303.0f));
+    ASSERT(vector_matches_scalar(fast_cos_turns, fast_cos_turns_x4, -4194303.0f, 4194303.0f));
+    ASSERT(vector_matches_scalar(fast_exp2, fast_exp2_x4, -130.0f, 130.0f));
+    ASSERT(vector_matches_scalar(fast_log2, fast_log2_x4, 1e-30f, 1e30f));
+    ASSERT(vector_matches_scalar(fast_tanh, fast_tanh_x4, -20.0f, 20.0f));
+    ASSERT(vector_matches_scalar(fast_semitones_to_ratio, fast_semitones_to_ratio_x4, -128.0f, 128.0f));
+    PASS();
+}
+
+SUITE(fastmath_error_suite) {
+    RUN_TEST(fast_sin_turns_error);
+    RUN_TEST(fast_cos_turns_error);
+    RUN_TEST(fast_sin_cos_turns_error_full_range);
+    RUN_TEST(fast_tanf_error);
+    RUN_TEST(fast_exp2_error);
+    RUN_TEST(fast_exp2_integers_are_exact);
+    RUN_TEST(fast_log2_error);
+    RUN_TEST(fast_tanh_error);
+    RUN_TEST(fast_semitones_to_ratio_error);
+}
+
+SUITE(fastmath_simd_suite) {
+    RUN_TEST(vector_forms_match_scalar);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(fastmath_error_suite);
+    RUN_SUITE(fastmath_simd_suite);
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,84 @@
+/*
+    Radix-2 complex FFT, iterative and in place on split real/imaginary arrays.
+    Tables are built by fft_init in the arena so the transforms never allocate.
+*/
+#include "platform.h"
+#include <assert.h>
+
+typedef struct {
+    int size; // power of two
+    int *bit_reverse;
+    float *cos_table; // size / 2 twiddles
+    float *sin_table;
+} Fft;
+
+size_t fft_footprint(int size) {
+    return arena_align(size * sizeof(int)) + 2 * arena_align(size / 2 * sizeof(float));
+}
+
+Fft fft_init(Arena *arena, int size) {
+    assert(size >= 2 && (size & (size - 1)) == 0);
+    Fft fft = {
+        .size = size,
+        .bit_reverse = arena_alloc(arena, size * sizeof(int)),
+        .cos_table = arena_alloc(arena, size / 2 * sizeof(float)),
+        .sin_table = arena_alloc(arena, size / 2 * sizeof(float)),
+    };
+
+    int bits = 0;
+    while ((1 << bits) < size) bits++;
+    for (int i = 0; i < size; i++) {
+        int reversed = 0;
+        for (int b = 0; b < bits; b++) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        fft.bit_reverse[i] = reversed;
+    }
+    for (int i = 0; i < size / 2; i++) {
+        const double angle = -2.0 * SDL_PI_D * i / size;
+        fft.cos_table[i] = (float) SDL_cos(angle);
+        fft.sin_table[i] = (float) SDL_sin(angle);
+    }
+    return fft;
+}
+
+void fft_forward(const Fft *fft, float *re, float *im) {
+    const int n = fft->size;
+    for (int i = 0; i < n; i++) {
+        const int j = fft->bit_reverse[i];
+        if (j > i) {
+            float t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+
+    for (int half = 1; half < n; half <<= 1) {
+        const int stride = n / (2 * half);
+        for (int start = 0; start < n; start += 2 * half) {
+            for (int k = 0; k < half; k++) {
+                const float wr = fft->cos_table[k * stride];
+                const float wi = fft->sin_table[k * stride];
+                const int a = start + k;
+                const int b = a + half;
+                const float tr = re[b] * wr - im[b] * wi;
+                const float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+// unscaled, the result is size times the input of fft_forward
+void fft_inverse(const Fft *fft, float *re, float *im) {
+    // ifft(x) = conj(fft(conj(x)))
+    for (int i = 0; i < fft->size; i++) im[i] = -im[i];
+    fft_forward(fft, re, im);
+    for (int i = 0; i < fft->size; i++) im[i] = -im[i];
+}
@@ -1,4 +1,5 @@
-#include <SDL3/SDL.h>
+#include "platform.h"
+#include <assert.h>
 
 typedef struct {
     // 4 buffer stages for -24dB/octave
@@ -6,7 +7,7 @@ typedef struct {
     float buf1;
     float buf2;
     float buf3;
-    float cutoff; // 0.01 to 1.00
+    float cutoff; // 0.0001 to 1.00
 } FilterLowpass;
 
 FilterLowpass filter_lowpass_init() {
@@ -21,7 +22,7 @@ FilterLowpass filter_lowpass_init() {
 }
 
 void filter_lowpass_set_cutoff(FilterLowpass *filter, float cutoff) {
-    filter->cutoff = SDL_clamp(cutoff, 0.01f, 1.0f);
+    filter->cutoff = SDL_clamp(cutoff, 0.0001f, 1.0f);
 }
 
 // Process a single sample through the filter
@@ -31,7 +32,7 @@ float filter_lowpass_process(FilterLowpass *filter, float input) {
         return input;
     }
 
-    float calculated_cutoff = SDL_clamp(filter->cutoff, 0.01f, 1.0f);
+    float calculated_cutoff = SDL_clamp(filter->cutoff, 0.0001f, 1.0f);
 
     filter->buf0 += calculated_cutoff * (input - filter->buf0);
     filter->buf1 += calculated_cutoff * (filter->buf0 - filter->buf1);
@@ -40,3 +41,259 @@ float filter_lowpass_process(FilterLowpass *filter, float input) {
 
     return filter->buf3;
 }
+
+/*
+    Filter with cutoff in Hz and several modes. The ladder and the state variable
+    filter are zero-delay-feedback (topology preserving transform) designs, see
+    "The Art of VA Filter Design" by Vadim Zavalishin.
+    Coefficients need a tan, they are cached and only recomputed (with fast_tanf)
+    when the modulated cutoff moves more than coefficient_threshold from the cached one.
+*/
+#define FILTER_CUTOFF_MIN_HZ 20.0f
+#define FILTER_CUTOFF_MAX_HZ 20000.0f
+#define FILTER_COEFFICIENT_THRESHOLD 0.001f // relative change, about 1.7 cents
+#define FILTER_COEFFICIENT_THRESHOLD_CHEAP 0.01f // about 17 cents, when the cpu is overloaded
+
+typedef enum {
+    FILTER_MODE_LOWPASS, // 4 cascaded one-poles, no resonance
+    FILTER_MODE_LADDER, // 4-pole ladder with resonance
+    FILTER_MODE_SVF_LOWPASS,
+    FILTER_MODE_SVF_BANDPASS,
+    FILTER_MODE_SVF_HIGHPASS,
+    FILTER_MODE_SVF_NOTCH,
+    FILTER_MODE_COUNT,
+} FilterMode;
+
+char *filter_mode_to_str(FilterMode mode) {
+    switch (mode) {
+        case FILTER_MODE_LOWPASS:
+            return "LP";
+        case FILTER_MODE_LADDER:
+            return "LADDER";
+        case FILTER_MODE_SVF_LOWPASS:
+            return "SVF LP";
+        case FILTER_MODE_SVF_BANDPASS:
+            return "SVF BP";
+        case FILTER_MODE_SVF_HIGHPASS:
+            return "SVF HP";
+        case FILTER_MODE_SVF_NOTCH:
+            return "SVF NOTCH";
+        default:
+            assert(false);
+    }
+}
+
+typedef struct {
+    FilterMode mode;
+    float cutoff; // Hz
+    float resonance; // 0.0 to 1.0
+    float cutoff_mod; // ratio applied to cutoff, set per sample by the modulation matrix
+    float sample_rate; // rate process is called at, device rate times oversampling
+    float coefficient_threshold; // relative cutoff change that recomputes the coefficients
+
+    // coefficients for cached_cutoff, a negative cached_cutoff forces a recompute
+    float cached_cutoff;
+    float G; // g / (1 + g) of a one-pole, g = tan(pi * cutoff / sample_rate)
+    float k; // ladder feedback or svf damping
+    float a1;
+    float a2;
+    float a3;
+
+    // state
+    FilterLowpass lowpass;
+    float s[4]; // ladder one-pole states
+    float ic1eq; // svf integrator states
+    float ic2eq;
+} Filter;
+
+Filter filter_init(FilterMode mode, float sample_rate) {
+    Filter filter = {
+        .mode = mode,
+        .cutoff = FILTER_CUTOFF_MAX_HZ,
+        .resonance = 0.0f,
+        .cutoff_mod = 1.0f,
+        .sample_rate = sample_rate,
+        .coefficient_threshold = FILTER_COEFFICIENT_THRESHOLD,
+        .cached_cutoff = -1.0f,
+        .lowpass = filter_lowpass_init(),
+    };
+    return filter;
+}
+
+void filter_reset(Filter *filter) {
+    filter->lowpass = filter_lowpass_init();
+    for (int i = 0; i < 4; i++) filter->s[i] = 0.0f;
+    filter->ic1eq = 0.0f;
+    filter->ic2eq = 0.0f;
+    filter->cached_cutoff = -1.0f;
+}
+
+void filter_set_mode(Filter *filter, FilterMode mode) {
+    filter->mode = mode;
+    filter_reset(filter);
+}
+
+void filter_set_cutoff(Filter *filter, float cutoff) {
+    filter->cutoff = SDL_clamp(cutoff, FILTER_CUTOFF_MIN_HZ, FILTER_CUTOFF_MAX_HZ);
+}
+
+void filter_set_resonance(Filter *filter, float resonance) {
+    filter->resonance = SDL_clamp(resonance, 0.0f, 1.0f);
+    filter->cached_cutoff = -1.0f;
+}
+
+void filter_set_modulation(Filter *filter, float cutoff_mod) {
+    filter->cutoff_mod = cutoff_mod;
+}
+
+void filter_set_sample_rate(Filter *filter, float sample_rate) {
+    filter->sample_rate = sample_rate;
+    filter->cached_cutoff = -1.0f;
+}
+
+// take the settings of a patch filter, the state is only reset when the mode changes
+void filter_copy_settings(Filter *filter, const Filter *settings) {
+    if (filter->mode != settings->mode) {
+        filter_set_mode(filter, settings->mode);
+    }
+    if (filter->resonance != settings->resonance) {
+        filter_set_resonance(filter, settings->resonance);
+    }
+    if (filter->sample_rate != settings->sample_rate) {
+        filter_set_sample_rate(filter, settings->sample_rate);
+    }
+    filter->cutoff = settings->cutoff;
+    filter->coefficient_threshold = settings->coefficient_threshold;
+}
+
+// a filter that would pass the input unchanged is skipped
+bool filter_is_open(const Filter *filter, float cutoff) {
+    switch (filter->mode) {
+        case FILTER_MODE_LOWPASS:
+        case FILTER_MODE_SVF_LOWPASS:
+            return cutoff > 0.99f * FILTER_CUTOFF_MAX_HZ;
+        case FILTER_MODE_LADDER:
+            // resonance lowers the passband gain, only open without it
+            return cutoff > 0.99f * FILTER_CUTOFF_MAX_HZ && filter->resonance == 0.0f;
+        case FILTER_MODE_SVF_HIGHPASS:
+            return cutoff < 1.01f * FILTER_CUTOFF_MIN_HZ;
+        default:
+            return false;
+    }
+}
+
+// states that decayed below this are zeroed before they become denormals
+#define FILTER_STATE_FLOOR 1e-15f
+
+float filter_flush(float x) {
+    return SDL_fabsf(x) < FILTER_STATE_FLOOR ? 0.0f : x;
+}
+
+// called at control rate, cheaper than checking every sample
+void filter_flush_denormals(Filter *filter) {
+    filter->lowpass.buf0 = filter_flush(filter->lowpass.buf0);
+    filter->lowpass.buf1 = filter_flush(filter->lowpass.buf1);
+    filter->lowpass.buf2 = filter_flush(filter->lowpass.buf2);
+    filter->lowpass.buf3 = filter_flush(filter->lowpass.buf3);
+    for (int i = 0; i < 4; i++) filter->s[i] = filter_flush(filter->s[i]);
+    filter->ic1eq = filter_flush(filter->ic1eq);
+    filter->ic2eq = filter_flush(filter->ic2eq);
+}
+
+// largest state that reaches the output, the filter is silent with no input when this is small
+float filter_state_level(const Filter *filter) {
+    if (filter_is_open(filter, filter->cutoff * filter->cutoff_mod)) {
+        return 0.0f;
+    }
+    float level = SDL_max(SDL_max(SDL_fabsf(filter->lowpass.buf0), SDL_fabsf(filter->lowpass.buf1)),
+                          SDL_max(SDL_fabsf(filter->lowpass.buf2), SDL_fabsf(filter->lowpass.buf3)));
+    for (int i = 0; i < 4; i++) level = SDL_max(level, SDL_fabsf(filter->s[i]));
+    return SDL_max(level, SDL_max(SDL_fabsf(filter->ic1eq), SDL_fabsf(filter->ic2eq)));
+}
+
+void filter_update_coefficients(Filter *filter, float cutoff) {
+    filter->cached_cutoff = cutoff;
+    // keep the cutoff away from nyquist where tan blows up
+    const float fc = SDL_clamp(cutoff, FILTER_CUTOFF_MIN_HZ, SDL_min(FILTER_CUTOFF_MAX_HZ, 0.45f * filter->sample_rate));
+    const float g = fast_tanf(SDL_PI_F * fc / filter->sample_rate);
+
+    switch (filter->mode) {
+        case FILTER_MODE_LOWPASS:
+            // 1 - e^(-2 pi fc / fs)
+            filter_lowpass_set_cutoff(&filter->lowpass, 1.0f - fast_exp2(-2.0f * SDL_PI_F * 1.44269504f * fc / filter->sample_rate));
+            break;
+        case FILTER_MODE_LADDER:
+            filter->G = g / (1.0f + g);
+            filter->k = 4.0f * filter->resonance; // self oscillates at 4
+            break;
+        default:
+            filter->k = 2.0f - 1.98f * filter->resonance; // 1 / Q
+            filter->a1 = 1.0f / (1.0f + g * (g + filter->k));
+            filter->a2 = g * filter->a1;
+            filter->a3 = g * filter->a2;
+            break;
+    }
+}
+
+float filter_ladder_process(Filter *filter, float input) {
+    const float G = filter->G;
+    const float beta = 1.0f - G; // 1 / (1 + g)
+
+    // solve the feedback loop: y4 = G^4 * u + S, u = input - k * y4
+    const float S = beta * (G * (G * (G * filter->s[0] + filter->s[1]) + filter->s[2]) + filter->s[3]);
+    const float G4 = G * G * G * G;
+    const float y4 = (G4 * input + S) / (1.0f + filter->k * G4);
+
+    float x = input - filter->k * y4;
+    for (int i = 0; i < 4; i++) {
+        const float v = (x - filter->s[i]) * G;
+        const float y = v + filter->s[i];
+        filter->s[i] = y + v;
+        x = y;
+    }
+    return x;
+}
+
+float filter_svf_process(Filter *filter, float input) {
+    const float v3 = input - filter->ic2eq;
+    const float v1 = filter->a1 * filter->ic1eq + filter->a2 * v3;
+    const float v2 = filter->ic2eq + filter->a2 * filter->ic1eq + filter->a3 * v3;
+    filter->ic1eq = 2.0f * v1 - filter->ic1eq;
+    filter->ic2eq = 2.0f * v2 - filter->ic2eq;
+
+    switch (filter->mode) {
+        case FILTER_MODE_SVF_LOWPASS:
+            return v2;
+        case FILTER_MODE_SVF_BANDPASS:
+            return v1;
+        case FILTER_MODE_SVF_HIGHPASS:
+            return input - filter->k * v1 - v2;
+        case FILTER_MODE_SVF_NOTCH:
+            return input - filter->k * v1;
+        default:
+            assert(false);
+    }
+}
+
+// Process a single sample through the filter
+float filter_process(Filter *filter, float input) {
+    const float cutoff = filter->cutoff * filter->cutoff_mod;
+
+    // Bypass filter when fully open
+    if (filter_is_open(filter, cutoff)) {
+        return input;
+    }
+
+    if (SDL_fabsf(cutoff - filter->cached_cutoff) > filter->coefficient_threshold * filter->cached_cutoff) {
+        filter_update_coefficients(filter, cutoff);
+    }
+
+    switch (filter->mode) {
+        case FILTER_MODE_LOWPASS:
+            return filter_lowpass_process(&filter->lowpass, input);
+        case FILTER_MODE_LADDER:
+            return filter_ladder_process(filter, input);
+        default:
+            return filter_svf_process(filter, input);
+    }
+}
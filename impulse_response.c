@@ -0,0 +1,59 @@
+/*
+    An impulse response read from a wav file and resampled to sample_rate. SDL reads and
+    converts the file, so this is part of the synth and not of the engine: the samples go
+    into SynthConfig and synth_create cuts and normalizes its own copy of them.
+*/
+#include <SDL3/SDL.h>
+#include <assert.h>
+
+typedef struct {
+    float *left;
+    float *right; // same as left for a mono file
+    int length; // 0 when the file can't be read
+} ImpulseResponseFile;
+
+ImpulseResponseFile impulse_response_load(const char *path, float sample_rate) {
+    ImpulseResponseFile ir = {0};
+    SDL_AudioSpec spec;
+    Uint8 *data = NULL;
+    Uint32 data_len = 0;
+    if (!SDL_LoadWAV(path, &spec, &data, &data_len)) {
+        SDL_Log("Couldn't load impulse response %s: %s", path, SDL_GetError());
+        return ir;
+    }
+
+    const int channels = spec.channels == 1 ? 1 : 2;
+    const SDL_AudioSpec target = {.format = SDL_AUDIO_F32, .channels = channels, .freq = (int) sample_rate};
+    float *samples = NULL;
+    int samples_len = 0;
+    const bool converted = SDL_ConvertAudioSamples(&spec, data, (int) data_len, &target, (Uint8 **) &samples, &samples_len);
+    SDL_free(data);
+    if (!converted) {
+        SDL_Log("Couldn't convert impulse response %s: %s", path, SDL_GetError());
+        return ir;
+    }
+
+    const int length = samples_len / (int) (channels * sizeof(float));
+    if (length == 0) {
+        SDL_Log("Impulse response %s is empty", path);
+        SDL_free(samples);
+        return ir;
+    }
+    ir.left = SDL_malloc(length * sizeof(float));
+    ir.right = channels == 2 ? SDL_malloc(length * sizeof(float)) : ir.left;
+    assert(ir.left != NULL && ir.right != NULL);
+    ir.length = length;
+    for (int i = 0; i < length; i++) {
+        ir.left[i] = samples[i * channels];
+        ir.right[i] = samples[i * channels + channels - 1];
+    }
+    SDL_free(samples);
+    SDL_Log("Impulse response %s: %d samples, %d channels", path, length, channels);
+    return ir;
+}
+
+void impulse_response_file_free(ImpulseResponseFile *ir) {
+    if (ir->right != ir->left) SDL_free(ir->right);
+    SDL_free(ir->left);
+    *ir = (ImpulseResponseFile) {0};
+}
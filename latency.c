@@ -0,0 +1,111 @@
+/*
+    Input to output latency of the synth, measured on notes of the synthetic latency pattern.
+    Each note on is stamped with the performance counter at the time it was due, as a
+    controller would have sent it, and arms the probes. A probe is a tap on audio: the first
+    sample above the threshold after arming is the onset, and the onset time minus the stamp
+    is one latency.
+    The render tap is the output of the audio callback. A sample is timed from the start of
+    its callback plus its position in the callback's output, so the MIDI polling, the queueing
+    and the rendering are in it, the device buffer is not. The capture tap is a recording
+    device with the output looped back into it, by a cable or the monitor source of the sound
+    server: the whole round trip, both device buffers and the recording latency included.
+    A note not heard before the next one is armed counts as missed. latency_report logs the
+    distribution of each probe.
+*/
+#include <SDL3/SDL.h>
+#include <assert.h>
+
+#define LATENCY_SAMPLES_MAX 4096
+#define LATENCY_THRESHOLD 0.01f // -40 dBFS, above the noise of a quiet loopback
+#define LATENCY_HISTOGRAM_ROWS 10
+#define LATENCY_HISTOGRAM_WIDTH 40
+
+typedef struct {
+    SDL_AtomicInt armed; // the number of the note waited for, 0 when none
+    Uint64 note_ticks; // when that note was due, written while disarmed
+    int notes; // ui thread, armed so far
+    int count; // tap thread, heard so far
+    float samples[LATENCY_SAMPLES_MAX]; // milliseconds
+} LatencyProbe;
+
+// ui thread, the tap now waits for this note. A tap that read the previous note fails to disarm it, so its
+// onset is never taken for this one
+void latency_probe_arm(LatencyProbe *probe, Uint64 note_ticks) {
+    if (probe->notes >= LATENCY_SAMPLES_MAX) return;
+    SDL_SetAtomicInt(&probe->armed, 0);
+    probe->note_ticks = note_ticks;
+    probe->notes++;
+    SDL_SetAtomicInt(&probe->armed, probe->notes);
+}
+
+// tap thread, interleaved samples. The first frame is at first_ticks and the next ones ticks_per_frame apart
+void latency_probe_scan(
+    LatencyProbe *probe, const float *samples, int frames, int channels, Uint64 first_ticks, double ticks_per_frame
+) {
+    const int armed = SDL_GetAtomicInt(&probe->armed);
+    if (armed == 0) return;
+    const Uint64 note_ticks = probe->note_ticks;
+    for (int f = 0; f < frames; f++) {
+        const Uint64 ticks = first_ticks + (Uint64) ((double) f * ticks_per_frame);
+        if (ticks < note_ticks) continue; // recorded before the note was due, noise
+        for (int c = 0; c < channels; c++) {
+            if (SDL_fabsf(samples[f * channels + c]) < LATENCY_THRESHOLD) continue;
+            if (SDL_CompareAndSwapAtomicInt(&probe->armed, armed, 0)) {
+                probe->samples[probe->count++] = (float) ((double) (ticks - note_ticks) * 1000.0 / (double) SDL_GetPerformanceFrequency());
+            }
+            return;
+        }
+    }
+}
+
+int SDLCALL latency_compare(const void *a, const void *b) {
+    const float x = *(const float *) a;
+    const float y = *(const float *) b;
+    return (x > y) - (x < y);
+}
+
+// sorted samples, p from 0 to 1
+float latency_percentile(const float *sorted, int count, float p) {
+    assert(count > 0);
+    return sorted[SDL_clamp((int) (p * (float) (count - 1) + 0.5f), 0, count - 1)];
+}
+
+// ui thread, once the taps stopped
+void latency_report(const LatencyProbe *probe, const char *name) {
+    if (probe->notes == 0) return;
+    SDL_Log("Latency %s: %d notes, %d heard, %d missed", name, probe->notes, probe->count, probe->notes - probe->count);
+    if (probe->count == 0) return;
+
+    float sorted[LATENCY_SAMPLES_MAX];
+    SDL_memcpy(sorted, probe->samples, (size_t) probe->count * sizeof(float));
+    SDL_qsort(sorted, (size_t) probe->count, sizeof(float), latency_compare);
+    double sum = 0.0;
+    for (int i = 0; i < probe->count; i++) {
+        sum += sorted[i];
+    }
+    const float low = sorted[0];
+    const float high = sorted[probe->count - 1];
+    SDL_Log(
+        "  min %.2f ms, median %.2f, p90 %.2f, p99 %.2f, max %.2f, mean %.2f", low,
+        latency_percentile(sorted, probe->count, 0.5f), latency_percentile(sorted, probe->count, 0.9f),
+        latency_percentile(sorted, probe->count, 0.99f), high, sum / probe->count
+    );
+
+    // the distribution in equal rows from min to max
+    int rows[LATENCY_HISTOGRAM_ROWS] = {0};
+    const float width = SDL_max((high - low) / LATENCY_HISTOGRAM_ROWS, 0.01f);
+    int peak = 1;
+    for (int i = 0; i < probe->count; i++) {
+        const int row = SDL_min((int) ((sorted[i] - low) / width), LATENCY_HISTOGRAM_ROWS - 1);
+        rows[row]++;
+        peak = SDL_max(peak, rows[row]);
+    }
+    for (int r = 0; r < LATENCY_HISTOGRAM_ROWS; r++) {
+        if (low + r * width > high) break;
+        char bar[LATENCY_HISTOGRAM_WIDTH + 1];
+        const int length = rows[r] * LATENCY_HISTOGRAM_WIDTH / peak;
+        SDL_memset(bar, '#', (size_t) length);
+        bar[length] = '\0';
+        SDL_Log("  %7.2f ms %5d %s", low + r * width, rows[r], bar);
+    }
+}
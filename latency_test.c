@@ -0,0 +1,79 @@
+#include "greatest.h"
+#include "latency.c"
+
+#define TEST_FRAMES 64
+
+static float test_block[TEST_FRAMES * 2];
+
+// a stereo block, silent up to onset
+static const float *block_with_onset(int onset) {
+    for (int f = 0; f < TEST_FRAMES; f++) {
+        test_block[2 * f] = f >= onset ? 0.5f : 0.0f;
+        test_block[2 * f + 1] = test_block[2 * f];
+    }
+    return test_block;
+}
+
+TEST latency_probe_times_the_first_loud_sample(void) {
+    static LatencyProbe probe;
+    SDL_zero(probe);
+    const Uint64 ms = SDL_GetPerformanceFrequency() / 1000;
+
+    // nothing is taken before arming, then silence is skipped and the onset is 10 frames of 1 ms into the block
+    latency_probe_scan(&probe, block_with_onset(0), TEST_FRAMES, 2, 100 * ms, (double) ms);
+    ASSERT_EQ(0, probe.count);
+    latency_probe_arm(&probe, 1000 * ms);
+    latency_probe_scan(&probe, block_with_onset(TEST_FRAMES), TEST_FRAMES, 2, 1000 * ms, (double) ms);
+    ASSERT_EQ(0, probe.count);
+    latency_probe_scan(&probe, block_with_onset(10), TEST_FRAMES, 2, 1005 * ms, (double) ms);
+    ASSERT_EQ(1, probe.count);
+    ASSERT_IN_RANGE(15.0f, probe.samples[0], 0.01f);
+
+    // heard once, the tail of the same note is not another onset
+    latency_probe_scan(&probe, block_with_onset(0), TEST_FRAMES, 2, 1100 * ms, (double) ms);
+    ASSERT_EQ(1, probe.count);
+    PASS();
+}
+
+TEST latency_probe_counts_missed_notes(void) {
+    static LatencyProbe probe;
+    SDL_zero(probe);
+    const Uint64 ms = SDL_GetPerformanceFrequency() / 1000;
+
+    // the first note is never heard, the second is. Sound stamped before its note is noise
+    latency_probe_arm(&probe, 1000 * ms);
+    latency_probe_arm(&probe, 2000 * ms);
+    latency_probe_scan(&probe, block_with_onset(0), TEST_FRAMES, 2, 1990 * ms, (double) ms);
+    ASSERT_EQ(1, probe.count);
+    ASSERT_IN_RANGE(0.0f, probe.samples[0], 0.01f);
+    ASSERT_EQ(2, probe.notes);
+    latency_report(&probe, "test");
+    PASS();
+}
+
+TEST latency_percentiles_of_sorted_samples(void) {
+    float sorted[101];
+    for (int i = 0; i <= 100; i++) {
+        sorted[i] = (float) i;
+    }
+    ASSERT_EQ(0.0f, latency_percentile(sorted, 101, 0.0f));
+    ASSERT_EQ(50.0f, latency_percentile(sorted, 101, 0.5f));
+    ASSERT_EQ(99.0f, latency_percentile(sorted, 101, 0.99f));
+    ASSERT_EQ(100.0f, latency_percentile(sorted, 101, 1.0f));
+    ASSERT_EQ(0.0f, latency_percentile(sorted, 1, 0.9f));
+    PASS();
+}
+
+SUITE(latency_suite) {
+    RUN_TEST(latency_probe_times_the_first_loud_sample);
+    RUN_TEST(latency_probe_counts_missed_notes);
+    RUN_TEST(latency_percentiles_of_sorted_samples);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(latency_suite);
+    GREATEST_MAIN_END();
+}
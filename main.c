@@ -1,11 +1,31 @@
+#define _GNU_SOURCE // cpu affinity in realtime.c
 #define SDL_MAIN_USE_CALLBACKS 1
 #include <assert.h>
 #include <stdio.h>
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
-#include "oscillator.c"
+#include "synth.h"
+#include "rtcheck.c"
+#include "realtime.c"
+#include "trace.c"
+#include "simd.c"
+#include "fastmath.c"
 #include "note.c"
-#include "filter.c"
+#include "arena.c"
+#include "ring.c"
+#include "midi_event.c"
+#include "mapped_file.c"
+#include "bank.c"
+#include "smf.c"
+#include "midi_log.c"
+#include "midi_generator.c"
+#include "latency.c"
+#include "impulse_response.c"
+#include "wav.c"
+#include "multisample.c"
+#include "recorder.c"
+#include "benchmark.c"
+#include "perf_counters.c"
 #include "portmidi.h"
 #include "porttime.h"
 
@@ -23,12 +43,22 @@ float fps = 0.0f;
 // Audio
 SDL_AudioStream *audio_stream = NULL;
 int sample_rate = 44100;
-float BASE_FREQ_A = 440.0f;
-float volume = 1.0f;
-float audio_phase = 0;
+int audio_buffer_frames = 0; // of the device, 0 until it is open
+#define AUDIO_CHANNELS SYNTH_CHANNELS
+#define AUDIO_CALLBACK_FRAMES_MAX 4096 // rendered by one synth_process, a callback that asks for more takes several
 
-Oscillator oscillator = {0};
-FilterLowpass filter = {0};
+// The engine that plays on the audio device, libsynth linked through synth.h. The callback renders it, the ui
+// thread is its control thread. Set up by engine_setup
+SynthConfig synth_config = {0};
+SynthEngine *synth = NULL;
+
+// Patch, shared by all voices. The ui edits patch and hands it to the engine, which plays a copy of its own
+SynthPatch patch = {0};
+
+// Presets, a memory-mapped bank selected by program change or the arrow keys
+PatchBank patch_bank = {0};
+const char *patch_bank_path = "patches.bank";
+int program = 0;
 
 // MIDI
 PortMidiStream *midi = NULL;
@@ -37,9 +67,61 @@ PortMidiStream *midi = NULL;
 #define TIME_INFO NULL
 #define MIDI_DEVICE_ID 5
 #define MIDI_EVENT_BUFFER_SIZE 32
+int midi_device_id = MIDI_DEVICE_ID;
 PmEvent midi_event_buffer[MIDI_EVENT_BUFFER_SIZE];
-MidiNote current_midi_note = DEFAULT_MIDI_NOTE;
 
+// Playback, --play with a MIDI file or a MIDI log. The ui reads ahead and queues the events into the engine with the
+// frame they are due at, the callback plays them at that sample. The messages that edit the patch come back to the ui
+// to be published. The ui reads the frame clock the callback publishes
+SmfPlayer smf_player = {0};
+MidiLogPlayer midi_log_player = {0};
+const char *playback_path = NULL;
+bool playback_start_requested = false;
+
+// Tracing, T writes the trace recorded so far
+const char *trace_path = "trace.json";
+bool trace_at_exit = false;
+
+// Hardware counters of the audio path, --perf-counters. The thread that renders opens them for itself
+bool perf_counters_enabled = false;
+PerfCounters perf_counters = {0};
+
+// Synthetic MIDI, --midi-source pattern plays a pattern in place of the device
+bool midi_generator_enabled = false;
+MidiGenerator midi_generator = {0};
+
+// Latency, --latency notes plays the latency pattern, measures that many notes and quits. --latency-capture
+// also listens for them on the default recording device
+#define LATENCY_TIMEOUT_MS 1000 // after the last note, before quitting
+int latency_notes = 0;
+Uint32 latency_last_note_ms = 0;
+LatencyProbe latency_render = {0};
+LatencyProbe latency_capture = {0};
+SDL_AudioStream *capture_stream = NULL;
+
+// Multisample export, --multisample dir renders a program into a WAV file per note and velocity and quits
+const char *multisample_dir = NULL;
+MultisampleGrid multisample_grid = {0};
+int multisample_program = 0;
+
+// Audio recording, W starts and stops a take of the output into a WAV file numbered after recording_path.
+// --record-audio file.wav names them and starts the first take at once
+const char *recording_path = "recording.wav";
+Recorder recorder = {0};
+
+// MIDI input log, --record file.log. Every event read from the device, to replay the session with --play
+MidiLogWriter midi_log = {0};
+
+float clamp(const float v, const float v_min, const float v_max) {
+    if (v < v_min) { return v_min; }
+    if (v > v_max) { return v_max; }
+    return v;
+}
+
+// the worker threads of the engine get the scheduling and affinity of their role
+void worker_setup(void *userdata) {
+    realtime_setup_thread(THREAD_ROLE_WORKER);
+}
 
 void SDLCALL audio_callback(
     void *userdata,
@@ -47,36 +129,491 @@ void SDLCALL audio_callback(
     int additional_amount,
     int total_amount
 ) {
-    const PressedNote *last_note = note_memory_peek(&note_memory);
-    if (last_note == NULL) {
-        return;
+    TRACE_SCOPE("audio_callback");
+    rt_audio_enter();
+    if (!SDL_GetAtomicInt(&thread_reports[THREAD_ROLE_AUDIO].ready)) {
+        realtime_setup_thread(THREAD_ROLE_AUDIO);
+        TRACE_THREAD("audio");
+        if (perf_counters_enabled) {
+            perf_counters_open(&perf_counters);
+        }
     }
+    const int frames = additional_amount / (int) (sizeof(float) * AUDIO_CHANNELS); /* convert from bytes to frames */
+    const Uint64 callback_start = SDL_GetPerformanceCounter();
+    const double ticks_per_frame = (double) SDL_GetPerformanceFrequency() / sample_rate;
+    perf_counters_begin(&perf_counters, synth_active_voices(synth));
 
-    float amplitude = last_note->velocity * volume;
+    // the whole request at once, the load shedding of the engine times it against its duration
+    static float left[AUDIO_CALLBACK_FRAMES_MAX];
+    static float right[AUDIO_CALLBACK_FRAMES_MAX];
+    float *out[AUDIO_CHANNELS] = {left, right};
+    for (int done = 0; done < frames;) {
+        const int num_frames = SDL_min(frames - done, AUDIO_CALLBACK_FRAMES_MAX);
+        synth_process(synth, out, num_frames, NULL, 0);
+        for (int block = 0; block < num_frames; block += SYNTH_BLOCK) {
+            float samples[SYNTH_BLOCK * AUDIO_CHANNELS]; // interleaved
+            const int block_frames = SDL_min(num_frames - block, SYNTH_BLOCK);
+            for (int f = 0; f < block_frames; f++) {
+                samples[f * AUDIO_CHANNELS] = left[block + f];
+                samples[f * AUDIO_CHANNELS + 1] = right[block + f];
+            }
+            const Uint64 block_start = callback_start + (Uint64) ((done + block) * ticks_per_frame);
+            latency_probe_scan(&latency_render, samples, block_frames, AUDIO_CHANNELS, block_start, ticks_per_frame);
+            SDL_PutAudioStreamData(stream, samples, block_frames * AUDIO_CHANNELS * (int) sizeof(float));
+            recorder_push(&recorder, samples, block_frames);
+        }
+        done += num_frames;
+    }
+    perf_counters_end(&perf_counters, frames);
+    rt_audio_exit(__FILE__, __LINE__);
+}
 
-    additional_amount = additional_amount / (int) sizeof(float); /* convert from bytes to samples */
-    while (additional_amount > 0) {
-        float samples[128];
-        const int num_samples = SDL_min(additional_amount, SDL_arraysize(samples));
+// recording thread of --latency-capture, what the recording device heard of the output
+void SDLCALL capture_callback(
+    void *userdata,
+    SDL_AudioStream *stream,
+    int additional_amount,
+    int total_amount
+) {
+    const Uint64 now = SDL_GetPerformanceCounter();
+    const double ticks_per_frame = (double) SDL_GetPerformanceFrequency() / sample_rate;
+    // the last frame available arrived about now, the ones before it a frame apart
+    int frames_left = SDL_GetAudioStreamAvailable(stream) / (int) sizeof(float);
+    float samples[SYNTH_BLOCK]; // mono
+    int bytes;
+    while (frames_left > 0 && (bytes = SDL_GetAudioStreamData(stream, samples, (int) sizeof(samples))) > 0) {
+        const int frames = bytes / (int) sizeof(float);
+        latency_probe_scan(&latency_capture, samples, frames, 1, now - (Uint64) (frames_left * ticks_per_frame), ticks_per_frame);
+        frames_left -= frames;
+    }
+}
 
-        for (int i = 0; i < num_samples; i++) {
-            float sample = oscillator_next_point(oscillator, amplitude, audio_phase);
-            samples[i] = filter_lowpass_process(&filter, sample);
-            audio_phase += last_note->freq / (float) sample_rate;
-            if (audio_phase >= 1.0f) audio_phase -= 1.0f;
+// a probe patch for the latency measurement: a square at full level from the first sample and a short release,
+// so the onset is sharp and the note is silent again long before the next one. env1 is the amplitude envelope,
+// no routing is needed for it
+void latency_setup(void) {
+    patch = synth_patch_init();
+    patch.wave_type = SYNTH_WAVE_SQUARE;
+    const float env1[4] = {0.0f, 0.0f, 1.0f, 0.02f};
+    SDL_memcpy(patch.env1, env1, sizeof(env1));
+    patch.volume = 0.5f;
+    synth_set_patch(synth, &patch);
+    for (int effect = 0; effect < SYNTH_EFFECT_COUNT; effect++) {
+        synth_set_effect(synth, effect, false);
+    }
+}
+
+// ui thread, arms the probes for the note ons of the latency pattern. Each is stamped with the time it was due
+void latency_arm(const PmEvent *events, int num_events) {
+    const Uint32 now_ms = (Uint32) Pt_Time();
+    const Uint64 now_ticks = SDL_GetPerformanceCounter();
+    for (int i = 0; i < num_events; i++) {
+        const Uint32 message = (Uint32) events[i].message;
+        if ((message & 0xF0) != 0x90 || ((message >> 16) & 0x7F) == 0 || latency_render.notes >= latency_notes) continue;
+        const Uint32 late_ms = now_ms - (Uint32) events[i].timestamp;
+        const Uint64 note_ticks = now_ticks - (Uint64) late_ms * SDL_GetPerformanceFrequency() / 1000;
+        latency_probe_arm(&latency_render, note_ticks);
+        if (capture_stream != NULL) {
+            latency_probe_arm(&latency_capture, note_ticks);
+        }
+        latency_last_note_ms = now_ms;
+    }
+}
+
+// a program the bank does not have keeps the current sound, returns whether the patch changed
+bool program_select(int selected) {
+    program = SDL_clamp(selected, 0, PATCH_BANK_PROGRAMS_MAX - 1);
+    const SynthPatch *record = patch_bank_get(&patch_bank, program);
+    if (record == NULL) {
+        return false;
+    }
+    patch = *record;
+    return true;
+}
+
+// the current patch into its program of the bank, the file is written and mapped again
+void program_save(void) {
+    SynthPatch saved = patch;
+    const SynthPatch *record = patch_bank_get(&patch_bank, program);
+    if (record != NULL) {
+        SDL_strlcpy(saved.name, record->name, sizeof(saved.name));
+    } else {
+        SDL_snprintf(saved.name, sizeof(saved.name), "Program %d", program);
+    }
+    if (!patch_bank_store(&patch_bank, patch_bank_path, program, &saved)) {
+        SDL_Log("Could not save program %d to %s", program, patch_bank_path);
+    }
+}
+
+// ui thread, the messages that are not performance edit the ui copy of the patch. Returns whether it changed
+bool midi_edit_patch(PmMessage msg) {
+    if ((Pm_MessageStatus(msg) & 0xF0) == 0xC0) {
+        // Program change 0xC0
+        return program_select(Pm_MessageData1(msg));
+    }
+    return synth_patch_control_change(&patch, (Uint32) msg);
+}
+
+// ui thread, the MIDI file messages that edit the patch, the engine hands them back when they are due
+bool midi_edit_patch_queued(void) {
+    bool patch_changed = false;
+    Uint32 messages[MIDI_EVENT_BUFFER_SIZE];
+    int count;
+    while ((count = synth_poll_messages(synth, messages, MIDI_EVENT_BUFFER_SIZE)) > 0) {
+        for (int i = 0; i < count; i++) {
+            patch_changed = midi_edit_patch((PmMessage) messages[i]) || patch_changed;
         }
+    }
+    return patch_changed;
+}
+
+// a MIDI file or a MIDI log, told apart by the header. False when it cannot be played
+bool playback_open(const char *path) {
+    MappedFile file = mapped_file_open(path);
+    const bool is_log = midi_log_is_log(&file);
+    mapped_file_close(&file);
+    if (is_log) {
+        midi_log_player = midi_log_player_open(path, (float) sample_rate);
+        SDL_Log("MIDI log %s: %d events", path, (int) ((midi_log_player.end - midi_log_player.pos) / MIDI_LOG_RECORD_SIZE));
+        return midi_log_player.end != NULL;
+    }
+    smf_player = smf_open(path, (float) sample_rate);
+    SDL_Log("MIDI file %s: format %d, %d tracks", path, smf_player.format, smf_player.n_tracks);
+    return smf_player.n_tracks > 0;
+}
+
+bool playback_playing(void) {
+    return smf_player.playing || midi_log_player.playing;
+}
 
-        SDL_PutAudioStreamData(stream, samples, num_samples * (int) sizeof(float));
-        additional_amount -= num_samples;
+// ui thread, the first event plays at start_frame of the engine
+void playback_start(Uint64 start_frame) {
+    if (smf_player.n_tracks > 0) {
+        smf_player_start(&smf_player, start_frame);
     }
+    if (midi_log_player.end != NULL) {
+        midi_log_player_start(&midi_log_player, start_frame);
+    }
+}
+
+// the players queue into the engine
+bool playback_push(void *queue, const MidiEvent *event) {
+    return synth_queue_event(queue, event->frame, event->message);
+}
+
+// ui thread, queues the events due before until_frame
+void playback_fill(Uint64 until_frame) {
+    smf_player_fill(&smf_player, playback_push, synth, until_frame);
+    midi_log_player_fill(&midi_log_player, playback_push, synth, until_frame);
+}
+
+// ui thread, plays from the start once the callback has dropped what was queued
+void playback_restart(void) {
+    synth_flush(synth);
+    playback_start_requested = smf_player.n_tracks > 0 || midi_log_player.end != NULL;
+}
+
+// ui thread, stops playing, the sounding notes ring out
+void playback_stop(void) {
+    synth_flush(synth);
+    playback_start_requested = false;
+    smf_player.playing = false;
+    midi_log_player.playing = false;
+}
+
+// the default patch and the engine that plays it, before the audio device is opened. False when the memory of
+// the engine cannot be had
+bool engine_setup(const ImpulseResponseFile *impulse_response) {
+    synth_config.impulse_response_left = impulse_response->left;
+    synth_config.impulse_response_right = impulse_response->right;
+    synth_config.impulse_response_length = impulse_response->length;
+    patch = synth_patch_default();
+    program_select(0);
+    SDL_Log("Patch bank %s: %d programs", patch_bank_path, patch_bank.count);
+
+    synth = synth_create(&synth_config);
+    if (synth == NULL) {
+        SDL_Log("Engine: cannot allocate or lock its memory");
+        return false;
+    }
+    synth_set_patch(synth, &patch);
+    SDL_Log("Voices: %d", synth_config.max_polyphony);
+    return true;
+}
+
+#define OFFLINE_TAIL_SECONDS 4.0 // rendered at most after the last event, for releases and effect tails
+
+// offline, without an audio device. Plays the queued events and what is playing back as fast as the engine
+// renders, then lets the voices and effect tails ring out. The audio is dropped. Returns the frames rendered
+Uint64 engine_render_offline(void) {
+    float left[SYNTH_BLOCK];
+    float right[SYNTH_BLOCK];
+    float *out[AUDIO_CHANNELS] = {left, right};
+    const Uint64 start = synth_frames(synth);
+    Uint64 tail_end = 0;
+    for (;;) {
+        const Uint64 frames = synth_frames(synth);
+        playback_fill(frames + 2 * SYNTH_BLOCK);
+        const bool events_left = playback_playing() || synth_events_queued(synth);
+        if (events_left) {
+            tail_end = frames + (Uint64) (OFFLINE_TAIL_SECONDS * sample_rate);
+        } else if (synth_idle(synth) || frames >= tail_end) {
+            break;
+        }
+        perf_counters_begin(&perf_counters, synth_active_voices(synth));
+        synth_process(synth, out, SYNTH_BLOCK, NULL, 0);
+        perf_counters_end(&perf_counters, SYNTH_BLOCK);
+        if (midi_edit_patch_queued()) {
+            synth_set_patch(synth, &patch);
+        }
+    }
+    return synth_frames(synth) - start;
+}
+
+void engine_log_speed(const char *name, Uint64 frames, Uint64 start, Uint64 end) {
+    const double audio_seconds = (double) frames / sample_rate;
+    const double wall_seconds = (double) (end - start) / (double) SDL_GetPerformanceFrequency();
+    SDL_Log("%-20s %7.2f s audio in %7.3f s, %6.1fx real time", name, audio_seconds, wall_seconds, audio_seconds / wall_seconds);
+}
+
+// --benchmark, every benchmark case rendered offline at full quality. False when a case could not be queued whole,
+// its timing would be of another workload
+bool benchmark_run(void) {
+    MidiEvent events[BENCHMARK_EVENTS_MAX];
+    Uint64 total_frames = 0;
+    Uint64 total_ticks = 0;
+    for (int c = 0; c < (int) SDL_arraysize(benchmark_cases); c++) {
+        const BenchmarkCase *bench = &benchmark_cases[c];
+        patch = benchmark_patch(bench);
+        synth_set_patch(synth, &patch);
+        synth_set_polyphony(synth, bench->polyphony);
+        synth_set_effect(synth, SYNTH_EFFECT_CHORUS, bench->chorus);
+        synth_set_effect(synth, SYNTH_EFFECT_DELAY, bench->delay);
+        synth_set_effect(synth, SYNTH_EFFECT_REVERB, bench->reverb);
+
+        const int n_events = benchmark_part(events, (float) sample_rate);
+        const Uint64 frames_now = synth_frames(synth);
+        for (int i = 0; i < n_events; i++) {
+            if (!synth_queue_event(synth, frames_now + events[i].frame, events[i].message)) {
+                SDL_Log("Benchmark %s: the MIDI queue is full after %d of %d events", bench->name, i, n_events);
+                return false;
+            }
+        }
+        const Uint64 start = SDL_GetPerformanceCounter();
+        const Uint64 frames = engine_render_offline();
+        const Uint64 end = SDL_GetPerformanceCounter();
+        engine_log_speed(bench->name, frames, start, end);
+        perf_counters_report(&perf_counters, bench->name);
+        perf_counters_reset(&perf_counters);
+        total_frames += frames;
+        total_ticks += end - start;
+    }
+    engine_log_speed("total", total_frames, 0, total_ticks);
+    return true;
 }
 
 /* This function runs once at startup. */
 SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
+    rt_check_init();
+
+    // --trace file.json, where T and quitting write the trace of a -DTRACE build
+    for (int i = 1; i + 1 < argc; i++) {
+        if (SDL_strcmp(argv[i], "--trace") == 0) {
+            trace_path = argv[i + 1];
+            trace_at_exit = true;
+        }
+    }
+    trace_init();
+    TRACE_THREAD("ui");
+
+    // --perf-counters, cycles, instructions, cache and branch misses of every callback per voice count, logged at
+    // quit. Offline the ui thread renders, so it counts for itself
+    perf_counters = perf_counters_init();
+    for (int i = 1; i < argc; i++) {
+        if (SDL_strcmp(argv[i], "--perf-counters") == 0) {
+            perf_counters_enabled = true;
+        }
+    }
+
+    // --multisample dir, the grid of --notes low:high:step and --velocities v1,v2,... held for --hold seconds, of
+    // --program n, rendered on --threads threads
+    multisample_grid = multisample_grid_init();
+    for (int i = 1; i + 1 < argc; i++) {
+        if (SDL_strcmp(argv[i], "--multisample") == 0) {
+            multisample_dir = argv[i + 1];
+        }
+        if (SDL_strcmp(argv[i], "--notes") == 0 && !multisample_parse_notes(&multisample_grid, argv[i + 1])) {
+            SDL_Log("Notes %s: not a range low:high:step of MIDI notes", argv[i + 1]);
+            return SDL_APP_FAILURE;
+        }
+        if (SDL_strcmp(argv[i], "--velocities") == 0 && !multisample_parse_velocities(&multisample_grid, argv[i + 1])) {
+            SDL_Log("Velocities %s: not a list v1,v2,... of up to %d velocities", argv[i + 1], MULTISAMPLE_VELOCITIES_MAX);
+            return SDL_APP_FAILURE;
+        }
+        if (SDL_strcmp(argv[i], "--hold") == 0) {
+            multisample_grid.hold_seconds = SDL_clamp((float) SDL_atof(argv[i + 1]), 0.0f, 60.0f);
+        }
+        if (SDL_strcmp(argv[i], "--threads") == 0) {
+            multisample_grid.threads = SDL_clamp(SDL_atoi(argv[i + 1]), 1, MULTISAMPLE_THREADS_MAX);
+        }
+        if (SDL_strcmp(argv[i], "--program") == 0) {
+            multisample_program = SDL_atoi(argv[i + 1]);
+        }
+    }
+
     SDL_SetHint(SDL_HINT_SHUTDOWN_DBUS_ON_QUIT, "1");
 
     SDL_SetAppMetadata("Learning audio", "0.1", "dev.daniboy.learning-audio");
 
+    // scheduling, the ui thread is moved off the audio cores before it starts other threads. An export has no audio
+    // thread, its workers render on every cpu
+    realtime_default_affinity();
+    realtime_parse_args(argc, argv);
+    if (multisample_dir == NULL) {
+        realtime_setup_thread(THREAD_ROLE_UI);
+    }
+
+    // the engine of the audio device sheds load, its workers run with the real-time settings of their role and
+    // its memory is locked when RLIMIT_MEMLOCK allows. --max-load, the fraction of the buffer time the callback
+    // may use before quality drops
+    synth_config = synth_config_default((float) sample_rate);
+    synth_config.shed_load = true;
+    synth_config.worker_setup = worker_setup;
+    synth_config.lock_memory = false;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (SDL_strcmp(argv[i], "--max-load") == 0) {
+            synth_config.max_load = SDL_clamp((float) SDL_atof(argv[i + 1]), 0.1f, 1.0f);
+        }
+    }
+
+    // --bank file, patches.bank by default. --import-bank text.txt writes it from the text form and
+    // --export-bank text.txt the other way, both quit after converting
+    for (int i = 1; i + 1 < argc; i++) {
+        if (SDL_strcmp(argv[i], "--bank") == 0) {
+            patch_bank_path = argv[i + 1];
+        }
+    }
+    for (int i = 1; i + 1 < argc; i++) {
+        if (SDL_strcmp(argv[i], "--import-bank") == 0) {
+            const int count = patch_bank_import_text(argv[i + 1], patch_bank_path);
+            SDL_Log("Imported %d programs from %s into %s", count, argv[i + 1], patch_bank_path);
+            return count < 0 ? SDL_APP_FAILURE : SDL_APP_SUCCESS;
+        }
+        if (SDL_strcmp(argv[i], "--export-bank") == 0) {
+            patch_bank = patch_bank_open(patch_bank_path);
+            const bool exported = patch_bank.count > 0 && patch_bank_export_text(&patch_bank, argv[i + 1]);
+            SDL_Log("Exported %d programs from %s into %s", patch_bank.count, patch_bank_path, argv[i + 1]);
+            patch_bank_close(&patch_bank);
+            return exported ? SDL_APP_SUCCESS : SDL_APP_FAILURE;
+        }
+    }
+    patch_bank = patch_bank_open(patch_bank_path);
+
+    // the export needs neither the engine of the synth nor any device
+    if (multisample_dir != NULL) {
+        patch = synth_patch_init();
+        program_select(multisample_program);
+        const bool exported = multisample_run(&multisample_grid, &patch, (float) sample_rate, multisample_dir);
+        return exported ? SDL_APP_SUCCESS : SDL_APP_FAILURE;
+    }
+
+    // --play file, a Standard MIDI File or a MIDI log played into the engine, M restarts it
+    for (int i = 1; i + 1 < argc; i++) {
+        if (SDL_strcmp(argv[i], "--play") == 0) {
+            playback_path = argv[i + 1];
+        }
+    }
+
+    // MIDI input: --midi-device id opens that device instead of MIDI_DEVICE_ID, --midi-source scale|chords|latency
+    // plays a synthetic pattern without one. --latency notes measures how long that many notes of the latency
+    // pattern take to be heard and quits, --latency-capture adds the round trip through the recording device
+    for (int i = 1; i + 1 < argc; i++) {
+        if (SDL_strcmp(argv[i], "--midi-device") == 0) {
+            midi_device_id = SDL_atoi(argv[i + 1]);
+        }
+        if (SDL_strcmp(argv[i], "--midi-source") == 0) {
+            MidiPattern pattern;
+            if (!midi_pattern_from_str(argv[i + 1], &pattern)) {
+                SDL_Log("Unknown MIDI source %s, the patterns are scale, chords and latency", argv[i + 1]);
+                return SDL_APP_FAILURE;
+            }
+            midi_generator = midi_generator_init(pattern, 0);
+            midi_generator_enabled = true;
+        }
+        if (SDL_strcmp(argv[i], "--latency") == 0) {
+            latency_notes = SDL_clamp(SDL_atoi(argv[i + 1]), 1, LATENCY_SAMPLES_MAX);
+            midi_generator = midi_generator_init(MIDI_PATTERN_LATENCY, 0);
+            midi_generator_enabled = true;
+        }
+    }
+
+    // --benchmark and --render time the engine at full quality, it does not shed load offline
+    for (int i = 1; i < argc; i++) {
+        if (SDL_strcmp(argv[i], "--benchmark") == 0 || SDL_strcmp(argv[i], "--render") == 0) {
+            synth_config.shed_load = false;
+        }
+    }
+
+    // an impulse response for the convolution effect, --ir file.wav
+    ImpulseResponseFile impulse_response = {0};
+    for (int i = 1; i + 1 < argc; i++) {
+        if (SDL_strcmp(argv[i], "--ir") == 0) {
+            impulse_response = impulse_response_load(argv[i + 1], (float) sample_rate);
+        }
+    }
+    const bool engine_ready = engine_setup(&impulse_response);
+    impulse_response_file_free(&impulse_response);
+    if (!engine_ready) {
+        return SDL_APP_FAILURE;
+    }
+    if (latency_notes > 0) {
+        latency_setup();
+    }
+
+    // --benchmark and --render file run the engine offline and quit, without window, audio or MIDI devices.
+    // They time optimized builds, train the profile of make pgo and replay MIDI logs under a profiler
+    for (int i = 1; i < argc; i++) {
+        if (SDL_strcmp(argv[i], "--benchmark") == 0 || SDL_strcmp(argv[i], "--render") == 0) {
+            if (perf_counters_enabled) {
+                perf_counters_open(&perf_counters);
+            }
+        }
+        if (SDL_strcmp(argv[i], "--benchmark") == 0) {
+            return benchmark_run() ? SDL_APP_SUCCESS : SDL_APP_FAILURE;
+        }
+        if (SDL_strcmp(argv[i], "--render") == 0 && i + 1 < argc) {
+            if (!playback_open(argv[i + 1])) {
+                return SDL_APP_FAILURE;
+            }
+            playback_start(synth_frames(synth));
+            const Uint64 start = SDL_GetPerformanceCounter();
+            const Uint64 frames = engine_render_offline();
+            engine_log_speed(argv[i + 1], frames, start, SDL_GetPerformanceCounter());
+            perf_counters_report(&perf_counters, argv[i + 1]);
+            return SDL_APP_SUCCESS;
+        }
+    }
+
+    // --buffer frames, the size SDL asks the audio device for, the device may pick another
+    for (int i = 1; i + 1 < argc; i++) {
+        if (SDL_strcmp(argv[i], "--buffer") == 0) {
+            SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, argv[i + 1]);
+        }
+    }
+
+    // the recorder is set up before the callback can push into it
+    bool record_audio = false;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (SDL_strcmp(argv[i], "--record-audio") == 0) {
+            recording_path = argv[i + 1];
+            record_audio = true;
+        }
+    }
+    recorder_init(&recorder, recording_path, AUDIO_CHANNELS, sample_rate);
+    if (record_audio) {
+        recorder_start(&recorder);
+    }
+
     // window creation
     if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO)) {
         SDL_Log("Couldn't initialize SDL: %s", SDL_GetError());
@@ -118,7 +655,7 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
 
     // audio stream creation
     SDL_AudioSpec spec;
-    spec.channels = 1;
+    spec.channels = AUDIO_CHANNELS;
     spec.format = SDL_AUDIO_F32;
     spec.freq = sample_rate;
     audio_stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, audio_callback, NULL);
@@ -127,25 +664,47 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
         return SDL_APP_FAILURE;
     }
     SDL_ResumeAudioStreamDevice(audio_stream);
+    SDL_AudioSpec device_spec;
+    if (SDL_GetAudioDeviceFormat(SDL_GetAudioStreamDevice(audio_stream), &device_spec, &audio_buffer_frames)) {
+        SDL_Log("Audio device: %d Hz, buffer of %d frames", device_spec.freq, audio_buffer_frames);
+    }
 
+    // the recording device of --latency-capture, mono at the rate of the output
+    for (int i = 1; i < argc; i++) {
+        if (SDL_strcmp(argv[i], "--latency-capture") == 0 && latency_notes > 0) {
+            const SDL_AudioSpec capture_spec = {.format = SDL_AUDIO_F32, .channels = 1, .freq = sample_rate};
+            capture_stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_RECORDING, &capture_spec, capture_callback, NULL);
+            if (!capture_stream) {
+                SDL_Log("Couldn't open the recording device: %s", SDL_GetError());
+                return SDL_APP_FAILURE;
+            }
+            SDL_ResumeAudioStreamDevice(capture_stream);
+        }
+    }
 
     // midi process creation
     Pm_Initialize();
     Pt_Start(1, NULL, NULL);
 
-    // Open the MIDI input device
-    PmError err = Pm_OpenInput(
-        &midi,
-        MIDI_DEVICE_ID,
-        NULL,
-        INPUT_BUFFER_SIZE,
-        TIME_PROC,
-        TIME_INFO
-    );
+    // Open the MIDI input device, or start the synthetic source on the PortMidi clock
+    PmError err = pmNoError;
+    if (midi_generator_enabled) {
+        midi_generator = midi_generator_init(midi_generator.pattern, (Uint32) Pt_Time());
+        SDL_Log("MIDI source: %s pattern", midi_pattern_to_str(midi_generator.pattern));
+    } else {
+        err = Pm_OpenInput(
+            &midi,
+            midi_device_id,
+            NULL,
+            INPUT_BUFFER_SIZE,
+            TIME_PROC,
+            TIME_INFO
+        );
+    }
 
     if (err != pmNoError) {
-        SDL_Log("Couldn't open MIDI device %d: %s", MIDI_DEVICE_ID, Pm_GetErrorText(err));
-        SDL_Log("Available MIDI input devices:");
+        SDL_Log("Couldn't open MIDI device %d: %s", midi_device_id, Pm_GetErrorText(err));
+        SDL_Log("Available MIDI input devices, choose one with --midi-device or play a pattern with --midi-source:");
         const int num_devices = Pm_CountDevices();
         for (int i = 0; i < num_devices; i++) {
             const PmDeviceInfo *info = Pm_GetDeviceInfo(i);
@@ -153,31 +712,32 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
                 SDL_Log("  %d: %s - %s", i, info->interf, info->name);
             }
         }
-        Pm_Terminate();
-        return SDL_APP_FAILURE;
+        // a MIDI file or log can be played without a device
+        if (playback_path == NULL) {
+            Pm_Terminate();
+            return SDL_APP_FAILURE;
+        }
+        midi = NULL;
+    } else if (midi) {
+        SDL_Log("MIDI device %d opened successfully", midi_device_id);
     }
 
-    SDL_Log("MIDI device %d opened successfully", MIDI_DEVICE_ID);
+    // --record file.log, the MIDI input log
+    for (int i = 1; i + 1 < argc; i++) {
+        if (SDL_strcmp(argv[i], "--record") == 0 && midi_log_writer_open(&midi_log, argv[i + 1])) {
+            SDL_Log("MIDI log %s: recording", argv[i + 1]);
+        }
+    }
 
-    // create oscillators
-    oscillator = oscillator_init(WAVE_SINE);
-    // create filters
-    filter = filter_lowpass_init();
+    // playback, its events are queued from SDL_AppIterate
+    if (playback_path != NULL) {
+        playback_open(playback_path);
+        playback_restart();
+    }
 
     return SDL_APP_CONTINUE;
 }
 
-float map(const float v, const float v_min, const float v_max, const float d_min, const float d_max) {
-    const float slope = (d_max - d_min) / (v_max - v_min);
-    return d_min + slope * (v - v_min);
-}
-
-float clamp(const float v, const float v_min, const float v_max) {
-    if (v < v_min) { return v_min; }
-    if (v > v_max) { return v_max; }
-    return v;
-}
-
 float initial_x = -1;
 
 SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
@@ -189,17 +749,86 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
     }
 
     if (event->type == SDL_EVENT_KEY_DOWN) {
+        bool patch_changed = false;
         if (event->key.key == SDLK_1) {
-            oscillator.wave_type = WAVE_SINE;
+            patch.wave_type = SYNTH_WAVE_SINE;
+            patch_changed = true;
         }
         if (event->key.key == SDLK_2) {
-            oscillator.wave_type = WAVE_SQUARE;
+            patch.wave_type = SYNTH_WAVE_SQUARE;
+            patch_changed = true;
         }
         if (event->key.key == SDLK_3) {
-            oscillator.wave_type = WAVE_SAW;
+            patch.wave_type = SYNTH_WAVE_SAW;
+            patch_changed = true;
         }
         if (event->key.key == SDLK_4) {
-            oscillator.wave_type = WAVE_TRIANGLE;
+            patch.wave_type = SYNTH_WAVE_TRIANGLE;
+            patch_changed = true;
+        }
+        if (event->key.key == SDLK_O) {
+            // cycle voice oversampling 1x -> 2x -> 4x
+            patch.oversampling = patch.oversampling >= 1 && patch.oversampling < SYNTH_OVERSAMPLING_MAX ? patch.oversampling * 2 : 1;
+            patch_changed = true;
+        }
+        if (event->key.key == SDLK_F) {
+            patch.filter_mode = (patch.filter_mode + 1) % SYNTH_FILTER_COUNT;
+            patch_changed = true;
+        }
+        if (event->key.key == SDLK_U) {
+            // cycle unison 1 -> 2 -> 4 -> 8 -> 16
+            patch.unison = patch.unison >= 1 && patch.unison < SYNTH_UNISON_MAX ? patch.unison * 2 : 1;
+            patch_changed = true;
+        }
+        if (event->key.key == SDLK_I || event->key.key == SDLK_C || event->key.key == SDLK_D || event->key.key == SDLK_R) {
+            const SynthEffect effect = event->key.key == SDLK_I ? SYNTH_EFFECT_CONVOLUTION
+                                     : event->key.key == SDLK_C ? SYNTH_EFFECT_CHORUS
+                                     : event->key.key == SDLK_D ? SYNTH_EFFECT_DELAY
+                                     : SYNTH_EFFECT_REVERB;
+            const bool enabled = !synth_effect_enabled(synth, effect);
+            if (enabled) {
+                // cleared before taking the lock, the callback waits for the flag only
+                synth_clear_effect(synth, effect);
+            }
+            SDL_LockAudioStream(audio_stream);
+            synth_set_effect(synth, effect, enabled);
+            SDL_UnlockAudioStream(audio_stream);
+        }
+        if (event->key.key == SDLK_P) {
+            // toggle between mono with last note priority and full polyphony
+            SDL_LockAudioStream(audio_stream);
+            synth_set_polyphony(synth, synth_polyphony(synth) == 1 ? synth_config.max_polyphony : 1);
+            SDL_UnlockAudioStream(audio_stream);
+        }
+        if (event->key.key == SDLK_LEFT || event->key.key == SDLK_RIGHT) {
+            // browse the bank
+            patch_changed = program_select(program + (event->key.key == SDLK_RIGHT ? 1 : -1));
+        }
+        if (event->key.key == SDLK_S) {
+            program_save();
+        }
+        if (event->key.key == SDLK_M) {
+            // play the MIDI file or log from the start, or stop it while it plays
+            if (playback_playing() || playback_start_requested || synth_events_queued(synth)) {
+                playback_stop();
+            } else {
+                playback_restart();
+            }
+        }
+        if (event->key.key == SDLK_W) {
+            // a take of the output, until W again
+            if (recorder_recording(&recorder)) {
+                recorder_stop(&recorder);
+            } else {
+                recorder_start(&recorder);
+            }
+        }
+        if (event->key.key == SDLK_T) {
+            // the trace so far, for the trace viewer of a browser
+            trace_dump(trace_path);
+        }
+        if (patch_changed) {
+            synth_set_patch(synth, &patch);
         }
     }
 
@@ -215,7 +844,58 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
     return SDL_APP_CONTINUE;
 }
 
+// ui thread, once per frame
+void midi_process(void) {
+    TRACE_SCOPE("midi");
+    // process MIDI events, the performance ones are queued to the callback and played at its next block.
+    // Patch changes go to the ui copy and are published once after the events
+    bool patch_changed = false;
+    int num_events = 0;
+    if (midi_generator_enabled) {
+        MidiLogRecord records[MIDI_EVENT_BUFFER_SIZE];
+        num_events = midi_generator_read(&midi_generator, (Uint32) Pt_Time(), records, MIDI_EVENT_BUFFER_SIZE);
+        for (int i = 0; i < num_events; i++) {
+            midi_event_buffer[i] = (PmEvent){.message = (PmMessage) records[i].message, .timestamp = (PmTimestamp) records[i].timestamp};
+        }
+        if (latency_notes > 0) {
+            latency_arm(midi_event_buffer, num_events);
+        }
+    } else if (midi) {
+        num_events = Pm_Read(midi, midi_event_buffer, MIDI_EVENT_BUFFER_SIZE);
+    }
+    for (int i = 0; i < num_events; i++) {
+        midi_log_push(&midi_log, (Uint32) midi_event_buffer[i].message, (Uint32) midi_event_buffer[i].timestamp);
+    }
+    for (int i = 0; i < num_events; i++) {
+        const PmMessage msg = midi_event_buffer[i].message;
+        if (!synth_is_performance((Uint32) msg)) {
+            patch_changed = midi_edit_patch(msg) || patch_changed;
+        } else if (!synth_play_live(synth, (Uint32) msg)) {
+            SDL_Log("MIDI: the live queue is full, a message was dropped");
+        }
+    }
+    static Uint64 frames_now = 0;
+    frames_now = synth_frame_clock(synth, frames_now);
+    patch_changed = midi_edit_patch_queued() || patch_changed;
+    if (patch_changed) {
+        synth_set_patch(synth, &patch);
+    }
+
+    // playback, read ahead of the engine. A restart waits until the callback dropped the old events
+    const Uint64 lookahead_frames = (Uint64) (SMF_LOOKAHEAD_SECONDS * sample_rate);
+    if (!synth_flushing(synth)) {
+        if (playback_start_requested) {
+            playback_start(frames_now + lookahead_frames);
+            playback_start_requested = false;
+        }
+        playback_fill(frames_now + 2 * lookahead_frames);
+    }
+}
+
 SDL_AppResult SDL_AppIterate(void *appstate) {
+    TRACE_SCOPE("SDL_AppIterate");
+    realtime_log_reports();
+
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
 
@@ -233,88 +913,123 @@ SDL_AppResult SDL_AppIterate(void *appstate) {
     SDL_RenderDebugTextFormat(renderer, (float) WIDTH - 75, 10, "%.0f FPS", fps);
     SDL_SetRenderScale(renderer, 1.0f, 1.0f);
 
-    // freq display
+    // the counters of the engine, written by the audio thread
+    SynthStats stats;
+    synth_get_stats(synth, &stats);
+
+    // wave display
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
-    SDL_RenderDebugTextFormat(renderer, 10, 10, "%.0f %s", oscillator.freq, waves_type_to_str(oscillator.wave_type));
+    SDL_RenderDebugTextFormat(renderer, 10, 10, "%s", synth_wave_to_str(patch.wave_type));
     SDL_SetRenderScale(renderer, 1.0f, 1.0f);
 
     // note display
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
-    SDL_RenderDebugTextFormat(renderer, 150, 10, "NOTE: %s", note_to_str(current_midi_note));
+    SDL_RenderDebugTextFormat(renderer, 150, 10, "NOTE: %s", note_to_str(stats.last_note));
     SDL_SetRenderScale(renderer, 1.0f, 1.0f);
 
     // Volume display
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
-    SDL_RenderDebugTextFormat(renderer, 230, 10, "VOLUME: %d", (int)(volume * 100));
+    SDL_RenderDebugTextFormat(renderer, 230, 10, "VOLUME: %d", (int)(patch.volume * 100));
     SDL_SetRenderScale(renderer, 1.0f, 1.0f);
 
-    // Volume display
+    // Filter display
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
-    SDL_RenderDebugTextFormat(renderer, 330, 10, "CUTOFF: %0.2f", filter.cutoff);
+    SDL_RenderDebugTextFormat(renderer, 330, 10, "CUTOFF: %0.0f Hz", patch.cutoff);
+    SDL_RenderDebugTextFormat(renderer, 330, 25, "%s RES: %0.2f", synth_filter_mode_to_str(patch.filter_mode), patch.resonance);
     SDL_SetRenderScale(renderer, 1.0f, 1.0f);
 
-    // process MIDI events
-    if (midi) {
-        const int num_events = Pm_Read(midi, midi_event_buffer, 32);
+    // oversampling display
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
+    SDL_RenderDebugTextFormat(renderer, 500, 10, "OS: %dx", (int) patch.oversampling);
+    SDL_SetRenderScale(renderer, 1.0f, 1.0f);
 
-        for (int i = 0; i < num_events; i++) {
-            const PmMessage msg = midi_event_buffer[i].message;
-            const int status = Pm_MessageStatus(msg);
-
-            if ((status & 0xF0) == 0x90 || (status & 0xF0) == 0x80) {
-                const MidiNote note = Pm_MessageData1(msg);
-                const uint8_t velocity = Pm_MessageData2(msg);
-
-                // Note On event 0x90
-                if ((status & 0xF0) == 0x90 && velocity > 0) {
-                    current_midi_note = note;
-                    const float note_freq = note_to_freq(current_midi_note);
-                    const float note_velocity = map(velocity, 0.0f, 255.0f, 0.0f, 1.0f);
-                    const PressedNote pressed_note = {
-                        .freq = note_freq,
-                        .midi_note = current_midi_note,
-                        .velocity = note_velocity
-                    };
-                    note_memory_push(&note_memory, pressed_note);
-                }
-
-                // Note Off event 0x80
-                if ((status & 0xF0) == 0x80 || ((status & 0xF0) == 0x90 && velocity == 0)) {
-                    note_memory_remove(&note_memory, note);
-                }
-            } else if ((status & 0xF0) == 0xB0) {
-                // Control change value 0xB0
-                const int cc_number = Pm_MessageData1(msg);
-                const float cc_value = Pm_MessageData2(msg);
-                // printf("CC: number %d, value %f\n", cc_number, cc_value);
-
-                if (cc_number == 93) {
-                    // knob 5
-                    oscillator.square_pulse_width = map(cc_value, 0.0f, 127.0f, 0.0f, 1.0f);
-                }
-
-                if (cc_number == 17) {
-                    // fader 4
-                    volume = map(cc_value, 0.0f, 127.0f, 0.0f, 1.0f);
-                }
-
-                if (cc_number == 18) {
-                    // knob 6 - filter cutoff
-                    float cutoff = map(cc_value, 0.0f, 127.0f, 0.01f, 1.0f);
-                    filter_lowpass_set_cutoff(&filter, cutoff);
-                }
-            }
+    // voices display
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
+    SDL_RenderDebugTextFormat(
+        renderer, 10, 25, "%s %d/%d UNISON: %d",
+        synth_polyphony(synth) == 1 ? "MONO" : "POLY", synth_active_voices(synth), synth_polyphony(synth), (int) patch.unison
+    );
+    SDL_SetRenderScale(renderer, 1.0f, 1.0f);
+
+    // load display
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
+    Uint64 degrades = 0;
+    for (int level = 0; level < SYNTH_QUALITY_LEVELS; level++) {
+        degrades += stats.degrades[level];
+    }
+    SDL_RenderDebugTextFormat(
+        renderer, 10, 40, "LOAD: %3.0f%% PEAK: %3.0f%% %s DEGRADED: %llu RESTORED: %llu XRUN: %llu STOLEN: %llu",
+        stats.load * 100.0f, stats.load_peak * 100.0f, synth_quality_level_to_str(stats.quality_level),
+        (unsigned long long) degrades, (unsigned long long) stats.restores,
+        (unsigned long long) stats.overruns, (unsigned long long) stats.voices_stolen
+    );
+    SDL_SetRenderScale(renderer, 1.0f, 1.0f);
+
+    // program display
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
+    const SynthPatch *program_record = patch_bank_get(&patch_bank, program);
+    SDL_RenderDebugTextFormat(
+        renderer, 10, 55, "PROGRAM: %d %s (%d IN BANK)", program, program_record ? program_record->name : "-", patch_bank.count
+    );
+    SDL_SetRenderScale(renderer, 1.0f, 1.0f);
+
+    // playback display
+    if (playback_path != NULL) {
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
+        SDL_RenderDebugTextFormat(
+            renderer, 10, 70, "PLAY: %s %s LATE: %llu", playback_path,
+            playback_playing() || synth_events_queued(synth) ? "PLAYING" : "STOPPED",
+            (unsigned long long) stats.events_late
+        );
+        SDL_SetRenderScale(renderer, 1.0f, 1.0f);
+    }
+
+    // synthetic MIDI display
+    if (midi_generator_enabled) {
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
+        if (latency_notes > 0) {
+            SDL_RenderDebugTextFormat(
+                renderer, 10, 85, "LATENCY: %d/%d NOTES, %d HEARD", latency_render.notes, latency_notes, latency_render.count
+            );
+        } else {
+            SDL_RenderDebugTextFormat(renderer, 10, 85, "MIDI SOURCE: %s", midi_pattern_to_str(midi_generator.pattern));
         }
+        SDL_SetRenderScale(renderer, 1.0f, 1.0f);
+    }
+
+    // recording display, the seconds written so far
+    if (recorder_recording(&recorder)) {
+        SDL_SetRenderDrawColor(renderer, 255, 64, 64, SDL_ALPHA_OPAQUE);
+        SDL_RenderDebugTextFormat(
+            renderer, 500, 40, "REC %d:%02d DROPPED: %d", SDL_GetAtomicInt(&recorder.seconds) / 60,
+            SDL_GetAtomicInt(&recorder.seconds) % 60, SDL_GetAtomicInt(&recorder.dropped)
+        );
+        SDL_SetRenderScale(renderer, 1.0f, 1.0f);
+    }
+
+    // effects display
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
+    SDL_RenderDebugTextFormat(
+        renderer, 500, 25, "FX: %s %s %s %s",
+        synth_effect_enabled(synth, SYNTH_EFFECT_CONVOLUTION) ? "IR" : "-",
+        synth_effect_enabled(synth, SYNTH_EFFECT_CHORUS) ? "CHORUS" : "-",
+        synth_effect_enabled(synth, SYNTH_EFFECT_DELAY) ? "DELAY" : "-",
+        synth_effect_enabled(synth, SYNTH_EFFECT_REVERB) ? "REVERB" : "-"
+    );
+    SDL_SetRenderScale(renderer, 1.0f, 1.0f);
+
+    midi_process();
+    if (latency_notes > 0 && latency_render.notes >= latency_notes && (Uint32) Pt_Time() - latency_last_note_ms > LATENCY_TIMEOUT_MS) {
+        return SDL_APP_SUCCESS;
     }
 
     // render
     SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255);
-    const float N_WAVES_BASE = 4;
-    const float waves = N_WAVES_BASE * oscillator.freq / BASE_FREQ_A;
+    const float waves = 4;
     SDL_FPoint points[WIDTH];
     float visual_phase = 0;
     for (int i = 0; i < WIDTH; i++) {
-        float y = oscillator_next_point(oscillator, 100, visual_phase);
+        float y = synth_patch_wave(&patch, visual_phase) * 100;
         y = -y; // correct for graphic coordinates, they increase from top to bottom
         y = y + (float) HEIGHT / 2;
         points[i] = (SDL_FPoint){.x = (float) i, .y = y};
@@ -324,7 +1039,11 @@ SDL_AppResult SDL_AppIterate(void *appstate) {
     }
     SDL_RenderPoints(renderer, points, WIDTH);
 
-    SDL_RenderPresent(renderer);
+    // waits for vsync
+    {
+        TRACE_SCOPE("SDL_RenderPresent");
+        SDL_RenderPresent(renderer);
+    }
 
     return SDL_APP_CONTINUE;
 }
@@ -340,6 +1059,39 @@ void SDL_AppQuit(void *appstate, SDL_AppResult result) {
     if (audio_stream) {
         SDL_DestroyAudioStream(audio_stream);
     }
+    if (capture_stream) {
+        SDL_DestroyAudioStream(capture_stream);
+    }
+    recorder_close(&recorder);
+    if (latency_notes > 0) {
+        SDL_Log("Latency, buffer of %d frames at %d Hz, %d frames per engine block", audio_buffer_frames, sample_rate, SYNTH_BLOCK);
+        latency_report(&latency_render, "MIDI to render");
+        latency_report(&latency_capture, "round trip through the recording device");
+    }
+    if (synth != NULL) {
+        SynthStats stats;
+        synth_get_stats(synth, &stats);
+        SDL_Log(
+            "Watchdog: %llu overruns, %llu restores, %llu voices stolen, peak load %.0f%%",
+            (unsigned long long) stats.overruns, (unsigned long long) stats.restores,
+            (unsigned long long) stats.voices_stolen, stats.load_peak * 100.0f
+        );
+        for (int level = 1; level < SYNTH_QUALITY_LEVELS; level++) {
+            SDL_Log("  degraded to %s %llu times", synth_quality_level_to_str(level), (unsigned long long) stats.degrades[level]);
+        }
+    }
+    synth_destroy(synth);
+    patch_bank_close(&patch_bank);
+    smf_close(&smf_player);
+    midi_log_player_close(&midi_log_player);
+    midi_log_writer_close(&midi_log);
+    perf_counters_report(&perf_counters, "audio callback");
+    perf_counters_close(&perf_counters);
+    if (trace_at_exit) {
+        trace_dump(trace_path);
+    }
+    trace_free();
+    rt_check_report();
     if (renderer) {
         SDL_DestroyRenderer(renderer);
     }
@@ -0,0 +1,49 @@
+/*
+    Read-only files mapped into memory. Pages are only read from disk when first touched,
+    so opening a big file is instant. Without mmap the file is read with SDL_LoadFile.
+    Not for the audio thread, touching a page can fault.
+*/
+#include <SDL3/SDL.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_MMAP 1
+#endif
+
+typedef struct {
+    const Uint8 *data; // NULL when the file could not be read
+    size_t size;
+} MappedFile;
+
+MappedFile mapped_file_open(const char *path) {
+    MappedFile file = {0};
+#ifdef MAPPED_FILE_MMAP
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return file;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *mapping = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            file.data = mapping;
+            file.size = (size_t) st.st_size;
+        }
+    }
+    close(fd); // the mapping stays valid
+#else
+    file.data = SDL_LoadFile(path, &file.size);
+#endif
+    return file;
+}
+
+void mapped_file_close(MappedFile *file) {
+    if (file->data != NULL) {
+#ifdef MAPPED_FILE_MMAP
+        munmap((void *) file->data, file->size);
+#else
+        SDL_free((void *) file->data);
+#endif
+    }
+    *file = (MappedFile){0};
+}
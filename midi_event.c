@@ -0,0 +1,18 @@
+/*
+    A MIDI channel message with the engine frame it is due at, as the engine queues them and
+    the players, the MIDI log and the generator produce them.
+*/
+#include "platform.h"
+
+// a channel message packed like PmMessage: status, data1 << 8, data2 << 16
+typedef struct {
+    Uint64 frame; // engine frame it is due at
+    Uint32 message;
+} MidiEvent;
+
+Uint32 midi_message(int status, int data1, int data2) {
+    return (Uint32) (status & 0xFF) | (Uint32) (data1 & 0xFF) << 8 | (Uint32) (data2 & 0xFF) << 16;
+}
+
+// where a player queues its events, a ring or the queue of a SynthEngine. False when it is full
+typedef bool (*MidiEventPush)(void *queue, const MidiEvent *event);
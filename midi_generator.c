@@ -0,0 +1,124 @@
+/*
+    Synthetic MIDI source, scripted patterns played into the synth in place of a device, so it
+    runs, and can be measured, without a controller. The ui reads it like the device:
+    midi_generator_read returns the events due by now with the PortMidi time they were due at,
+    and they take the same path, the MIDI log, the performance and the patch edits.
+    A pattern moves in steps at a fixed rate, each step releases the notes of the one before
+    and plays its own. scale runs up and down a C major scale, chords plays a progression, and
+    latency plays a lone A4 on every other step with silence between, the material of the
+    latency measurement.
+*/
+#include <SDL3/SDL.h>
+#include <assert.h>
+
+#define MIDI_GENERATOR_NOTES_MAX 4
+#define MIDI_GENERATOR_STEP_EVENTS (2 * MIDI_GENERATOR_NOTES_MAX) // the releases of a step and its notes
+
+typedef enum {
+    MIDI_PATTERN_SCALE,
+    MIDI_PATTERN_CHORDS,
+    MIDI_PATTERN_LATENCY,
+    MIDI_PATTERN_COUNT,
+} MidiPattern;
+
+char *midi_pattern_to_str(MidiPattern pattern) {
+    switch (pattern) {
+        case MIDI_PATTERN_SCALE:
+            return "scale";
+        case MIDI_PATTERN_CHORDS:
+            return "chords";
+        case MIDI_PATTERN_LATENCY:
+            return "latency";
+        default:
+            assert(false);
+    }
+}
+
+// false when the name is not a pattern
+bool midi_pattern_from_str(const char *name, MidiPattern *pattern) {
+    for (int p = 0; p < MIDI_PATTERN_COUNT; p++) {
+        if (SDL_strcmp(name, midi_pattern_to_str(p)) == 0) {
+            *pattern = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+const Uint32 midi_pattern_step_ms[MIDI_PATTERN_COUNT] = {125, 500, 250};
+
+const int midi_pattern_scale[] = {60, 62, 64, 65, 67, 69, 71, 72};
+
+const int midi_pattern_chords[][MIDI_GENERATOR_NOTES_MAX] = {
+    {48, 60, 64, 67},
+    {45, 60, 64, 69},
+    {41, 60, 65, 69},
+    {43, 59, 62, 67},
+};
+
+// the notes of a step and their velocity, returns how many
+int midi_pattern_step(MidiPattern pattern, int step, int notes[MIDI_GENERATOR_NOTES_MAX], int *velocity) {
+    switch (pattern) {
+        case MIDI_PATTERN_SCALE: {
+            const int length = (int) SDL_arraysize(midi_pattern_scale);
+            const int position = step % (2 * length - 2); // up, then down without repeating the ends
+            notes[0] = midi_pattern_scale[position < length ? position : 2 * length - 2 - position];
+            *velocity = 100;
+            return 1;
+        }
+        case MIDI_PATTERN_CHORDS: {
+            const int *chord = midi_pattern_chords[step % (int) SDL_arraysize(midi_pattern_chords)];
+            for (int n = 0; n < MIDI_GENERATOR_NOTES_MAX; n++) {
+                notes[n] = chord[n];
+            }
+            *velocity = 80;
+            return MIDI_GENERATOR_NOTES_MAX;
+        }
+        case MIDI_PATTERN_LATENCY:
+            notes[0] = 69;
+            *velocity = 127;
+            return step % 2 == 0 ? 1 : 0;
+        default:
+            assert(false);
+    }
+}
+
+typedef struct {
+    MidiPattern pattern;
+    Uint32 step_ms;
+    Uint32 next_ms; // PortMidi time the next step is due at
+    int step;
+    int notes[MIDI_GENERATOR_NOTES_MAX]; // sounding, released by the next step
+    int note_count;
+} MidiGenerator;
+
+// the first step is due at now_ms
+MidiGenerator midi_generator_init(MidiPattern pattern, Uint32 now_ms) {
+    MidiGenerator generator = {
+        .pattern = pattern,
+        .step_ms = midi_pattern_step_ms[pattern],
+        .next_ms = now_ms,
+    };
+    return generator;
+}
+
+// ui thread, like Pm_Read: the events due by now_ms, at most max, with the time each step was due at.
+// A step is never split, max holds one at least
+int midi_generator_read(MidiGenerator *generator, Uint32 now_ms, MidiLogRecord *records, int max) {
+    assert(max >= MIDI_GENERATOR_STEP_EVENTS);
+    int count = 0;
+    while ((Sint32) (now_ms - generator->next_ms) >= 0 && max - count >= MIDI_GENERATOR_STEP_EVENTS) {
+        const Uint32 due = generator->next_ms;
+        for (int n = 0; n < generator->note_count; n++) {
+            records[count++] = (MidiLogRecord){.message = midi_message(0x80, generator->notes[n], 0), .timestamp = due};
+        }
+        int velocity;
+        generator->note_count = midi_pattern_step(generator->pattern, generator->step, generator->notes, &velocity);
+        for (int n = 0; n < generator->note_count; n++) {
+            records[count++] = (MidiLogRecord){.message = midi_message(0x90, generator->notes[n], velocity), .timestamp = due};
+        }
+        generator->step++;
+        generator->next_ms += generator->step_ms;
+    }
+    return count;
+}
@@ -0,0 +1,80 @@
+#include "greatest.h"
+#include "trace.c"
+#include "arena.c"
+#include "ring.c"
+#include "mapped_file.c"
+#include "midi_event.c"
+#include "smf.c"
+#include "midi_log.c"
+#include "midi_generator.c"
+
+#define TEST_READ_MAX 32
+
+TEST midi_generator_plays_steps_when_due(void) {
+    MidiGenerator generator = midi_generator_init(MIDI_PATTERN_SCALE, 1000);
+    MidiLogRecord records[TEST_READ_MAX];
+    ASSERT_EQ(0, midi_generator_read(&generator, 999, records, TEST_READ_MAX));
+
+    // the first step is a note, the next releases it and plays the next one of the scale
+    ASSERT_EQ(1, midi_generator_read(&generator, 1000, records, TEST_READ_MAX));
+    ASSERT_EQ_FMT(midi_message(0x90, 60, 100), records[0].message, "%06x");
+    ASSERT_EQ(1000, records[0].timestamp);
+    ASSERT_EQ(0, midi_generator_read(&generator, 1124, records, TEST_READ_MAX));
+    ASSERT_EQ(2, midi_generator_read(&generator, 1125, records, TEST_READ_MAX));
+    ASSERT_EQ_FMT(midi_message(0x80, 60, 0), records[0].message, "%06x");
+    ASSERT_EQ_FMT(midi_message(0x90, 62, 100), records[1].message, "%06x");
+    PASS();
+}
+
+TEST midi_generator_catches_up_with_due_times(void) {
+    MidiGenerator generator = midi_generator_init(MIDI_PATTERN_SCALE, 0);
+    MidiLogRecord records[TEST_READ_MAX];
+
+    // up the scale and back down, every step stamped with the time it was due and not when it was read
+    int notes[16];
+    int count = 0;
+    while (count < 16) {
+        const int n = midi_generator_read(&generator, 10000, records, TEST_READ_MAX);
+        for (int i = 0; i < n && count < 16; i++) {
+            if ((records[i].message & 0xF0) == 0x90) {
+                ASSERT_EQ(125 * (Uint32) count, records[i].timestamp);
+                notes[count++] = (int) (records[i].message >> 8) & 0x7F;
+            }
+        }
+    }
+    const int expected[16] = {60, 62, 64, 65, 67, 69, 71, 72, 71, 69, 67, 65, 64, 62, 60, 62};
+    ASSERT_MEM_EQ(expected, notes, sizeof(expected));
+    PASS();
+}
+
+TEST midi_generator_latency_pattern_leaves_silence(void) {
+    MidiGenerator generator = midi_generator_init(MIDI_PATTERN_LATENCY, 0);
+    MidiLogRecord records[TEST_READ_MAX];
+    const int n = midi_generator_read(&generator, 3 * 250, records, TEST_READ_MAX);
+
+    // on, off, on, off
+    ASSERT_EQ(4, n);
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQ(250 * (Uint32) i, records[i].timestamp);
+        ASSERT_EQ(i % 2 == 0 ? 0x90 : 0x80, (int) records[i].message & 0xF0);
+    }
+    MidiPattern pattern;
+    ASSERT(midi_pattern_from_str("chords", &pattern));
+    ASSERT_EQ(MIDI_PATTERN_CHORDS, pattern);
+    ASSERT_FALSE(midi_pattern_from_str("drums", &pattern));
+    PASS();
+}
+
+SUITE(midi_generator_suite) {
+    RUN_TEST(midi_generator_plays_steps_when_due);
+    RUN_TEST(midi_generator_catches_up_with_due_times);
+    RUN_TEST(midi_generator_latency_pattern_leaves_silence);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(midi_generator_suite);
+    GREATEST_MAIN_END();
+}
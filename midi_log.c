@@ -0,0 +1,185 @@
+/*
+    MIDI input log, every event read from the device with its PortMidi timestamp, to replay
+    a session exactly. The ui pushes the events into a ring and a writer thread appends
+    them to the file, so the MIDI loop never waits on the disk. When the writer falls a
+    whole ring behind the events are counted as dropped.
+    The file is "MLOG", a 32-bit version and then one record per event: the message and
+    the timestamp in milliseconds, both 32-bit little endian.
+    The log player reads it back like the MIDI file player, each event is queued with the
+    engine frame of its timestamp. A replay is sample accurate and the same every time,
+    in real time or offline.
+*/
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include <stdio.h>
+
+#define MIDI_LOG_VERSION 1
+#define MIDI_LOG_HEADER_SIZE 8
+#define MIDI_LOG_RECORD_SIZE 8
+#define MIDI_LOG_QUEUE_SIZE 1024
+
+typedef struct {
+    Uint32 message; // packed like PmMessage
+    Uint32 timestamp; // milliseconds, PortMidi time
+} MidiLogRecord;
+
+void midi_log_write_le(Uint8 *p, Uint32 value) {
+    for (int i = 0; i < 4; i++) p[i] = (Uint8) (value >> (8 * i));
+}
+
+Uint32 midi_log_read_le(const Uint8 *p) {
+    return (Uint32) p[0] | (Uint32) p[1] << 8 | (Uint32) p[2] << 16 | (Uint32) p[3] << 24;
+}
+
+typedef struct {
+    FILE *file; // NULL when not recording
+    Arena arena;
+    Ring queue; // ui to writer
+    SDL_Thread *writer;
+    SDL_Semaphore *wake;
+    SDL_AtomicInt quit;
+    Uint64 pushed; // ui thread
+    Uint64 dropped; // ui thread
+} MidiLogWriter;
+
+int SDLCALL midi_log_writer_thread(void *data) {
+    MidiLogWriter *log = data;
+    TRACE_THREAD("midi log");
+    for (;;) {
+        SDL_WaitSemaphore(log->wake);
+        TRACE_SCOPE("midi log write");
+        const bool quit = SDL_GetAtomicInt(&log->quit);
+        MidiLogRecord record;
+        while (ring_pop(&log->queue, &record)) {
+            Uint8 bytes[MIDI_LOG_RECORD_SIZE];
+            midi_log_write_le(bytes, record.message);
+            midi_log_write_le(bytes + 4, record.timestamp);
+            fwrite(bytes, 1, sizeof(bytes), log->file);
+        }
+        fflush(log->file); // what was played is on disk if the process dies
+        if (quit) break;
+    }
+    return 0;
+}
+
+// the writer thread points into the log, so it is not returned by value. False when the file cannot be written
+bool midi_log_writer_open(MidiLogWriter *log, const char *path) {
+    SDL_zerop(log);
+    log->file = fopen(path, "wb");
+    if (log->file == NULL) {
+        SDL_Log("MIDI log %s: cannot write", path);
+        return false;
+    }
+    Uint8 header[MIDI_LOG_HEADER_SIZE] = {'M', 'L', 'O', 'G'};
+    midi_log_write_le(header + 4, MIDI_LOG_VERSION);
+    fwrite(header, 1, sizeof(header), log->file);
+
+    log->arena = arena_init(ring_footprint(sizeof(MidiLogRecord), MIDI_LOG_QUEUE_SIZE));
+    log->queue = ring_init(&log->arena, sizeof(MidiLogRecord), MIDI_LOG_QUEUE_SIZE);
+    log->wake = SDL_CreateSemaphore(0);
+    log->writer = SDL_CreateThread(midi_log_writer_thread, "midi log", log);
+    assert(log->wake != NULL && log->writer != NULL);
+    return true;
+}
+
+// ui thread, never blocks
+void midi_log_push(MidiLogWriter *log, Uint32 message, Uint32 timestamp) {
+    if (log->file == NULL) return;
+    const MidiLogRecord record = {.message = message, .timestamp = timestamp};
+    if (ring_push(&log->queue, &record)) {
+        log->pushed++;
+        SDL_SignalSemaphore(log->wake);
+    } else {
+        log->dropped++;
+    }
+}
+
+// writes what is still queued and closes the file
+void midi_log_writer_close(MidiLogWriter *log) {
+    if (log->file == NULL) return;
+    SDL_SetAtomicInt(&log->quit, 1);
+    SDL_SignalSemaphore(log->wake);
+    SDL_WaitThread(log->writer, NULL);
+    SDL_DestroySemaphore(log->wake);
+    fclose(log->file);
+    arena_free(&log->arena);
+    SDL_Log("MIDI log: %llu events, %llu dropped", (unsigned long long) log->pushed, (unsigned long long) log->dropped);
+    SDL_zerop(log);
+}
+
+typedef struct {
+    MappedFile file;
+    const Uint8 *pos; // next record
+    const Uint8 *end; // after the last whole record
+    Uint32 first_timestamp;
+    float sample_rate;
+
+    // playback
+    bool playing;
+    Uint64 start_frame; // engine frame of the first event
+    MidiEvent pending; // read but not queued yet, the queue was full
+    bool has_pending;
+} MidiLogPlayer;
+
+// a log file starts with its magic, anything else is left to the MIDI file player
+bool midi_log_is_log(const MappedFile *file) {
+    return file->data != NULL && file->size >= MIDI_LOG_HEADER_SIZE && SDL_memcmp(file->data, "MLOG", 4) == 0;
+}
+
+// end is NULL when the file could not be read or is not a log
+MidiLogPlayer midi_log_player_open(const char *path, float sample_rate) {
+    MidiLogPlayer player = {.file = mapped_file_open(path), .sample_rate = sample_rate};
+    if (!midi_log_is_log(&player.file) || midi_log_read_le(player.file.data + 4) != MIDI_LOG_VERSION) {
+        SDL_Log("MIDI log %s: cannot read or not a MIDI log", path);
+        mapped_file_close(&player.file);
+        return player;
+    }
+    const size_t records = (player.file.size - MIDI_LOG_HEADER_SIZE) / MIDI_LOG_RECORD_SIZE;
+    player.pos = player.file.data + MIDI_LOG_HEADER_SIZE;
+    player.end = player.pos + records * MIDI_LOG_RECORD_SIZE; // a record cut short by a crash is ignored
+    if (records > 0) {
+        player.first_timestamp = midi_log_read_le(player.pos + 4);
+    }
+    return player;
+}
+
+void midi_log_player_close(MidiLogPlayer *player) {
+    mapped_file_close(&player->file);
+    *player = (MidiLogPlayer){0};
+}
+
+// the next event, frame relative to the first one. False at the end
+bool midi_log_next(MidiLogPlayer *player, MidiEvent *event) {
+    if (player->pos == NULL || player->pos >= player->end) return false;
+    const Uint32 elapsed = midi_log_read_le(player->pos + 4) - player->first_timestamp; // wraps with PortMidi time
+    event->message = midi_log_read_le(player->pos);
+    event->frame = (Uint64) ((double) elapsed * 1e-3 * player->sample_rate);
+    player->pos += MIDI_LOG_RECORD_SIZE;
+    return true;
+}
+
+// ui thread, the first event plays at start_frame of the engine
+void midi_log_player_start(MidiLogPlayer *player, Uint64 start_frame) {
+    player->pos = player->end != NULL ? player->file.data + MIDI_LOG_HEADER_SIZE : NULL;
+    player->start_frame = start_frame;
+    player->playing = player->end != NULL;
+    player->has_pending = false;
+}
+
+// ui thread, queues the events due before until_frame, stops at the end of the log
+void midi_log_player_fill(MidiLogPlayer *player, MidiEventPush push, void *queue, Uint64 until_frame) {
+    while (player->playing) {
+        if (!player->has_pending) {
+            if (!midi_log_next(player, &player->pending)) {
+                player->playing = false;
+                return;
+            }
+            player->pending.frame += player->start_frame;
+            player->has_pending = true;
+        }
+        if (player->pending.frame >= until_frame || !push(queue, &player->pending)) {
+            return;
+        }
+        player->has_pending = false;
+    }
+}
@@ -0,0 +1,113 @@
+#include "greatest.h"
+#include "trace.c"
+#include "arena.c"
+#include "ring.c"
+#include "mapped_file.c"
+#include "midi_event.c"
+#include "smf.c"
+#include "midi_log.c"
+
+#define TEST_SAMPLE_RATE 48000.0f
+#define TEST_LOG "midi_log_test.log"
+
+// the queue of the engine is a ring of events
+static bool push_to_ring(void *ring, const MidiEvent *event) {
+    return ring_push(ring, event);
+}
+
+static void write_file(const Uint8 *data, size_t size) {
+    FILE *file = fopen(TEST_LOG, "wb");
+    fwrite(data, 1, size, file);
+    fclose(file);
+}
+
+TEST midi_log_replays_what_was_recorded(void) {
+    MidiLogWriter log;
+    ASSERT(midi_log_writer_open(&log, TEST_LOG));
+    midi_log_push(&log, midi_message(0x90, 60, 100), 1000);
+    midi_log_push(&log, midi_message(0xB0, 1, 64), 1010);
+    midi_log_push(&log, midi_message(0x80, 60, 0), 1500);
+    midi_log_writer_close(&log);
+
+    // timestamps are relative to the first event, 48 frames per millisecond
+    MidiLogPlayer player = midi_log_player_open(TEST_LOG, TEST_SAMPLE_RATE);
+    const MidiEvent expected[] = {{0, 0x643C90}, {480, 0x4001B0}, {24000, 0x003C80}};
+    MidiEvent event;
+    for (int i = 0; i < (int) SDL_arraysize(expected); i++) {
+        ASSERT(midi_log_next(&player, &event));
+        ASSERT_EQ(expected[i].frame, event.frame);
+        ASSERT_EQ_FMT(expected[i].message, event.message, "%06x");
+    }
+    ASSERT_FALSE(midi_log_next(&player, &event));
+    midi_log_player_close(&player);
+    remove(TEST_LOG);
+    PASS();
+}
+
+TEST midi_log_player_fills_up_to_the_lookahead(void) {
+    MidiLogWriter log;
+    ASSERT(midi_log_writer_open(&log, TEST_LOG));
+    for (int i = 0; i < 6; i++) {
+        midi_log_push(&log, midi_message(0x90, 60 + i, 100), 100 * (Uint32) i);
+    }
+    midi_log_writer_close(&log);
+
+    MidiLogPlayer player = midi_log_player_open(TEST_LOG, TEST_SAMPLE_RATE);
+    Arena arena = arena_init(ring_footprint(sizeof(MidiEvent), 4));
+    Ring ring = ring_init(&arena, sizeof(MidiEvent), 4);
+    midi_log_player_start(&player, 1000);
+    midi_log_player_fill(&player, push_to_ring, &ring, 1000 + 9600);
+    ASSERT_EQ(2, ring_count(&ring));
+
+    // the ring holds 4, the rest waits for room
+    midi_log_player_fill(&player, push_to_ring, &ring, 100000);
+    ASSERT_EQ(4, ring_count(&ring));
+    MidiEvent event;
+    while (ring_pop(&ring, &event)) {}
+    midi_log_player_fill(&player, push_to_ring, &ring, 100000);
+    ASSERT_FALSE(player.playing);
+    MidiEvent last = {0};
+    while (ring_pop(&ring, &event)) last = event;
+    ASSERT_EQ(1000 + 5 * 4800, last.frame);
+    ASSERT_EQ_FMT(midi_message(0x90, 65, 100), last.message, "%06x");
+
+    arena_free(&arena);
+    midi_log_player_close(&player);
+    remove(TEST_LOG);
+    PASS();
+}
+
+TEST midi_log_rejects_bad_files(void) {
+    MidiLogPlayer player = midi_log_player_open("midi_log_test_missing.log", TEST_SAMPLE_RATE);
+    ASSERT_EQ(NULL, player.end);
+
+    const Uint8 not_log[] = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 1, 0, 96};
+    write_file(not_log, sizeof(not_log));
+    player = midi_log_player_open(TEST_LOG, TEST_SAMPLE_RATE);
+    ASSERT_EQ(NULL, player.end);
+
+    // a record cut short, as when the process died while writing it
+    const Uint8 truncated[] = {'M', 'L', 'O', 'G', 1, 0, 0, 0, 0x90, 60, 100, 0, 0, 0, 0, 0, 0x80, 60, 0};
+    write_file(truncated, sizeof(truncated));
+    player = midi_log_player_open(TEST_LOG, TEST_SAMPLE_RATE);
+    MidiEvent event;
+    ASSERT(midi_log_next(&player, &event));
+    ASSERT_FALSE(midi_log_next(&player, &event));
+    midi_log_player_close(&player);
+    remove(TEST_LOG);
+    PASS();
+}
+
+SUITE(midi_log_suite) {
+    RUN_TEST(midi_log_replays_what_was_recorded);
+    RUN_TEST(midi_log_player_fills_up_to_the_lookahead);
+    RUN_TEST(midi_log_rejects_bad_files);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(midi_log_suite);
+    GREATEST_MAIN_END();
+}
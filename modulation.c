@@ -0,0 +1,299 @@
+/*
+    Modulation: LFOs, envelopes and a modulation matrix.
+    Sources are evaluated once every control block (mod_matrix.control_rate samples)
+    and destinations are linearly interpolated per sample inside the block.
+    The routing is shared, every voice keeps its own envelopes and ModState.
+    env1 is also the amplitude envelope of the voice: the amplitude destination scales it,
+    so a note starts and ends in silence whatever the routing.
+*/
+#include "platform.h"
+#include <assert.h>
+
+typedef struct {
+    WavesType wave_type;
+    float rate; // Hz
+    float phase;
+} Lfo;
+
+Lfo lfo_init(WavesType wave_type, float rate) {
+    Lfo lfo = {.wave_type = wave_type, .rate = rate, .phase = 0.0f};
+    return lfo;
+}
+
+// advance the lfo by dt seconds, returns a value from -1.0 to 1.0
+float lfo_next(Lfo *lfo, float dt) {
+    float y;
+    switch (lfo->wave_type) {
+        case WAVE_SINE:
+            y = waves_sine(1.0f, lfo->phase);
+            break;
+        case WAVE_SQUARE:
+            y = waves_square(1.0f, lfo->phase, 0.0f);
+            break;
+        case WAVE_SAW:
+            y = waves_saw(1.0f, lfo->phase);
+            break;
+        case WAVE_TRIANGLE:
+            y = waves_triangle(1.0f, lfo->phase);
+            break;
+        default:
+            assert(false);
+    }
+
+    lfo->phase += lfo->rate * dt;
+    while (lfo->phase >= 1.0f) lfo->phase -= 1.0f;
+    return y;
+}
+
+typedef enum {
+    ENVELOPE_IDLE,
+    ENVELOPE_ATTACK,
+    ENVELOPE_DECAY,
+    ENVELOPE_SUSTAIN,
+    ENVELOPE_RELEASE,
+} EnvelopeStage;
+
+// linear ADSR, times in seconds and sustain level from 0.0 to 1.0
+typedef struct {
+    float attack;
+    float decay;
+    float sustain;
+    float release;
+    EnvelopeStage stage;
+    float level;
+} Envelope;
+
+Envelope envelope_init(float attack, float decay, float sustain, float release) {
+    Envelope envelope = {
+        .attack = attack,
+        .decay = decay,
+        .sustain = SDL_clamp(sustain, 0.0f, 1.0f),
+        .release = release,
+        .stage = ENVELOPE_IDLE,
+        .level = 0.0f
+    };
+    return envelope;
+}
+
+// take the times and the sustain level of a patch envelope, stage and level are kept
+void envelope_copy_settings(Envelope *envelope, const Envelope *settings) {
+    envelope->attack = settings->attack;
+    envelope->decay = settings->decay;
+    envelope->sustain = settings->sustain;
+    envelope->release = settings->release;
+}
+
+void envelope_gate_on(Envelope *envelope) {
+    envelope->stage = ENVELOPE_ATTACK;
+}
+
+void envelope_gate_off(Envelope *envelope) {
+    if (envelope->stage != ENVELOPE_IDLE) {
+        envelope->stage = ENVELOPE_RELEASE;
+    }
+}
+
+// advance the envelope by dt seconds, returns a value from 0.0 to 1.0
+float envelope_next(Envelope *envelope, float dt) {
+    switch (envelope->stage) {
+        case ENVELOPE_IDLE:
+            envelope->level = 0.0f;
+            break;
+        case ENVELOPE_ATTACK:
+            envelope->level += envelope->attack > 0.0f ? dt / envelope->attack : 1.0f;
+            if (envelope->level >= 1.0f) {
+                envelope->level = 1.0f;
+                envelope->stage = ENVELOPE_DECAY;
+            }
+            break;
+        case ENVELOPE_DECAY:
+            envelope->level -= envelope->decay > 0.0f ? dt * (1.0f - envelope->sustain) / envelope->decay : 1.0f;
+            if (envelope->level <= envelope->sustain) {
+                envelope->level = envelope->sustain;
+                envelope->stage = ENVELOPE_SUSTAIN;
+            }
+            break;
+        case ENVELOPE_SUSTAIN:
+            envelope->level = envelope->sustain;
+            break;
+        case ENVELOPE_RELEASE:
+            envelope->level -= envelope->release > 0.0f ? dt / envelope->release : 1.0f;
+            if (envelope->level <= 0.0f) {
+                envelope->level = 0.0f;
+                envelope->stage = ENVELOPE_IDLE;
+            }
+            break;
+    }
+    return envelope->level;
+}
+
+typedef enum {
+    MOD_SRC_NONE,
+    MOD_SRC_LFO1,
+    MOD_SRC_LFO2,
+    MOD_SRC_ENV1,
+    MOD_SRC_ENV2,
+    MOD_SRC_VELOCITY,
+    MOD_SRC_MOD_WHEEL,
+    MOD_SRC_AFTERTOUCH,
+    MOD_SRC_COUNT,
+} ModSource;
+
+typedef enum {
+    MOD_DST_PITCH, // amount in semitones, interpolated as a frequency ratio
+    MOD_DST_CUTOFF, // amount in octaves, interpolated as a cutoff ratio
+    MOD_DST_PULSE_WIDTH, // added to the square pulse width
+    MOD_DST_AMPLITUDE, // gain of env1 times 1 + amount, never negative
+    MOD_DST_COUNT,
+} ModDestination;
+
+typedef struct {
+    ModSource source;
+    ModSource via; // scales the source, MOD_SRC_NONE to use the source alone
+    ModDestination destination;
+    float amount;
+} ModSlot;
+
+// sources shared by all voices
+typedef struct {
+    Lfo lfo1;
+    Lfo lfo2;
+    float mod_wheel; // from 0.0 to 1.0
+    float aftertouch; // from 0.0 to 1.0
+} ModSources;
+
+ModSources mod_sources_init() {
+    ModSources sources = {
+        .lfo1 = lfo_init(WAVE_SINE, 5.0f),
+        .lfo2 = lfo_init(WAVE_TRIANGLE, 0.5f),
+    };
+    return sources;
+}
+
+// advance the sources by dt seconds and write their values indexed by ModSource
+void mod_sources_next(ModSources *sources, float dt, float values[MOD_SRC_COUNT]) {
+    values[MOD_SRC_NONE] = 1.0f;
+    values[MOD_SRC_LFO1] = lfo_next(&sources->lfo1, dt);
+    values[MOD_SRC_LFO2] = lfo_next(&sources->lfo2, dt);
+    values[MOD_SRC_MOD_WHEEL] = sources->mod_wheel;
+    values[MOD_SRC_AFTERTOUCH] = sources->aftertouch;
+}
+
+// sources owned by each voice
+typedef struct {
+    Envelope env1;
+    Envelope env2;
+    float velocity; // from 0.0 to 1.0
+} ModVoiceSources;
+
+ModVoiceSources mod_voice_sources_init(float velocity) {
+    ModVoiceSources sources = {
+        .env1 = envelope_init(0.01f, 0.2f, 0.8f, 0.3f),
+        .env2 = envelope_init(0.5f, 1.0f, 0.0f, 0.5f),
+        .velocity = velocity,
+    };
+    return sources;
+}
+
+// same as mod_sources_next for the voice sources
+void mod_voice_sources_next(ModVoiceSources *sources, float dt, float values[MOD_SRC_COUNT]) {
+    values[MOD_SRC_ENV1] = envelope_next(&sources->env1, dt);
+    values[MOD_SRC_ENV2] = envelope_next(&sources->env2, dt);
+    values[MOD_SRC_VELOCITY] = sources->velocity;
+}
+
+void mod_voice_sources_gate_on(ModVoiceSources *sources) {
+    envelope_gate_on(&sources->env1);
+    envelope_gate_on(&sources->env2);
+}
+
+void mod_voice_sources_gate_off(ModVoiceSources *sources) {
+    envelope_gate_off(&sources->env1);
+    envelope_gate_off(&sources->env2);
+}
+
+// both envelopes are done releasing
+bool mod_voice_sources_idle(const ModVoiceSources *sources) {
+    return sources->env1.stage == ENVELOPE_IDLE && sources->env2.stage == ENVELOPE_IDLE;
+}
+
+#define MOD_MATRIX_SLOTS_MAX 16
+#define MOD_CONTROL_RATE_DEFAULT 32
+
+typedef struct {
+    // routing as edited, empty slots have source MOD_SRC_NONE
+    ModSlot slots[MOD_MATRIX_SLOTS_MAX];
+    // routing compiled by mod_matrix_compile, only the used slots
+    ModSlot routes[MOD_MATRIX_SLOTS_MAX];
+    int n_routes;
+
+    int control_rate; // samples per control block
+} ModMatrix;
+
+// destination values of one voice, interpolated per sample
+typedef struct {
+    float current[MOD_DST_COUNT];
+    float step[MOD_DST_COUNT];
+} ModState;
+
+ModMatrix mod_matrix_init(int control_rate) {
+    assert(control_rate > 0);
+    ModMatrix mm = {.control_rate = control_rate};
+    return mm;
+}
+
+void mod_matrix_set_slot(ModMatrix *mm, int slot, ModSource source, ModSource via, ModDestination destination, float amount) {
+    assert(slot >= 0 && slot < MOD_MATRIX_SLOTS_MAX);
+    mm->slots[slot] = (ModSlot){.source = source, .via = via, .destination = destination, .amount = amount};
+}
+
+// flatten the used slots, call it when the routing changes, not from the audio loop
+void mod_matrix_compile(ModMatrix *mm) {
+    mm->n_routes = 0;
+    for (int i = 0; i < MOD_MATRIX_SLOTS_MAX; i++) {
+        const ModSlot slot = mm->slots[i];
+        if (slot.source == MOD_SRC_NONE || slot.amount == 0.0f) {
+            continue;
+        }
+        mm->routes[mm->n_routes++] = slot;
+    }
+}
+
+// the destination values the routing asks for with these source values
+void mod_matrix_targets(const ModMatrix *mm, const float sources[MOD_SRC_COUNT], float target[MOD_DST_COUNT]) {
+    float sum[MOD_DST_COUNT] = {0};
+    for (int i = 0; i < mm->n_routes; i++) {
+        const ModSlot *route = &mm->routes[i];
+        sum[route->destination] += route->amount * sources[route->source] * sources[route->via];
+    }
+
+    target[MOD_DST_PITCH] = fast_semitones_to_ratio(sum[MOD_DST_PITCH]);
+    target[MOD_DST_CUTOFF] = fast_exp2(sum[MOD_DST_CUTOFF]);
+    target[MOD_DST_PULSE_WIDTH] = sum[MOD_DST_PULSE_WIDTH];
+    target[MOD_DST_AMPLITUDE] = sources[MOD_SRC_ENV1] * SDL_max(1.0f + sum[MOD_DST_AMPLITUDE], 0.0f);
+}
+
+// start a new control block, destinations ramp from their current value to the new target
+void mod_matrix_evaluate(const ModMatrix *mm, ModState *state, const float sources[MOD_SRC_COUNT]) {
+    float target[MOD_DST_COUNT];
+    mod_matrix_targets(mm, sources, target);
+    const float inv_rate = 1.0f / (float) mm->control_rate;
+    for (int d = 0; d < MOD_DST_COUNT; d++) {
+        state->step[d] = (target[d] - state->current[d]) * inv_rate;
+    }
+}
+
+// the state of a new voice, already at its targets so the first samples do not ramp from the defaults
+ModState mod_state_start(const ModMatrix *mm, const float sources[MOD_SRC_COUNT]) {
+    ModState state = {0};
+    mod_matrix_targets(mm, sources, state.current);
+    return state;
+}
+
+// advance the per-sample interpolation by one sample
+void mod_state_next(ModState *state) {
+    state->current[MOD_DST_PITCH] += state->step[MOD_DST_PITCH];
+    state->current[MOD_DST_CUTOFF] += state->step[MOD_DST_CUTOFF];
+    state->current[MOD_DST_PULSE_WIDTH] += state->step[MOD_DST_PULSE_WIDTH];
+    state->current[MOD_DST_AMPLITUDE] += state->step[MOD_DST_AMPLITUDE];
+}
@@ -0,0 +1,260 @@
+/*
+    Multisample export, a patch rendered once per note and velocity of a grid, each into a WAV
+    file of its own, the material of a sample library. The files are named
+    <note number>_<note name>_v<velocity>.wav so a sampler maps them by name.
+    The renders are spread over a pool of threads. Every worker owns an engine and takes the
+    next job from a shared counter until none is left, they share nothing else but the patch
+    and the jobs, both read only. The engine is set up once per worker and reset for every job,
+    the unison phases and the LFOs start the same, so a file does not depend on the worker that
+    rendered it or on the order of the jobs.
+    A render plays the note on at the first frame and the note off after the hold time, then
+    the release until the engine is idle or MULTISAMPLE_TAIL_SECONDS passed, and the silence at
+    both ends is trimmed. One voice at the highest oversampling and no effects: the samples are
+    dry, the sampler that plays them adds its own.
+*/
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include "synth.h"
+
+#define MULTISAMPLE_VELOCITIES_MAX 16
+#define MULTISAMPLE_THREADS_MAX 64
+#define MULTISAMPLE_TAIL_SECONDS 10.0f // rendered at most after the note off
+#define MULTISAMPLE_THRESHOLD 1e-4f // -80 dBFS, the ends below it are trimmed
+#define MULTISAMPLE_PATH_MAX 512
+
+typedef struct {
+    MidiNote note_low;
+    MidiNote note_high;
+    int note_step;
+    int velocities[MULTISAMPLE_VELOCITIES_MAX];
+    int velocity_count;
+    float hold_seconds;
+    int threads;
+} MultisampleGrid;
+
+// every third note from C2 to C7 at full velocity, held for two seconds, a thread per cpu
+MultisampleGrid multisample_grid_init(void) {
+    MultisampleGrid grid = {
+        .note_low = 36,
+        .note_high = 96,
+        .note_step = 3,
+        .velocities = {127},
+        .velocity_count = 1,
+        .hold_seconds = 2.0f,
+        .threads = SDL_clamp(SDL_GetNumLogicalCPUCores(), 1, MULTISAMPLE_THREADS_MAX),
+    };
+    return grid;
+}
+
+// "low:high:step" or "low:high", a step of 1 when not given. False, and the grid unchanged, when it is not a range
+bool multisample_parse_notes(MultisampleGrid *grid, const char *text) {
+    char *end;
+    const long low = SDL_strtol(text, &end, 10);
+    if (end == text || *end != ':') return false;
+    text = end + 1;
+    const long high = SDL_strtol(text, &end, 10);
+    if (end == text || (*end != ':' && *end != '\0')) return false;
+    long step = 1;
+    if (*end == ':') {
+        text = end + 1;
+        step = SDL_strtol(text, &end, 10);
+        if (end == text || *end != '\0') return false;
+    }
+    if (low < 0 || high > 127 || low > high || step < 1) return false;
+    grid->note_low = (MidiNote) low;
+    grid->note_high = (MidiNote) high;
+    grid->note_step = (int) step;
+    return true;
+}
+
+// "v1,v2,...", each from 1 to 127. False, and the grid unchanged, when one is not a velocity
+bool multisample_parse_velocities(MultisampleGrid *grid, const char *text) {
+    int velocities[MULTISAMPLE_VELOCITIES_MAX];
+    int count = 0;
+    for (;;) {
+        char *end;
+        const long velocity = SDL_strtol(text, &end, 10);
+        if (end == text || velocity < 1 || velocity > 127 || count == MULTISAMPLE_VELOCITIES_MAX) return false;
+        velocities[count++] = (int) velocity;
+        if (*end == '\0') break;
+        if (*end != ',') return false;
+        text = end + 1;
+    }
+    SDL_memcpy(grid->velocities, velocities, (size_t) count * sizeof(int));
+    grid->velocity_count = count;
+    return true;
+}
+
+int multisample_grid_notes(const MultisampleGrid *grid) {
+    return (grid->note_high - grid->note_low) / grid->note_step + 1;
+}
+
+// the frames from the first to the last one above threshold in any channel, count is 0 for silence
+void multisample_trim(const float *samples, int frames, int channels, float threshold, int *first, int *count) {
+    int start = 0;
+    int end = frames;
+    while (start < end) {
+        bool loud = false;
+        for (int c = 0; c < channels; c++) {
+            loud = loud || SDL_fabsf(samples[start * channels + c]) >= threshold;
+        }
+        if (loud) break;
+        start++;
+    }
+    while (end > start) {
+        bool loud = false;
+        for (int c = 0; c < channels; c++) {
+            loud = loud || SDL_fabsf(samples[(end - 1) * channels + c]) >= threshold;
+        }
+        if (loud) break;
+        end--;
+    }
+    *first = start;
+    *count = end - start;
+}
+
+// the calling thread renders the engine, no other does. The note held for hold_seconds and its release into
+// interleaved samples, returns the frames rendered, at most max_frames
+int multisample_render(
+    SynthEngine *synth, float sample_rate, MidiNote note, int velocity, float hold_seconds, float *samples, int max_frames
+) {
+    const Uint64 start = synth_frames(synth);
+    synth_queue_event(synth, start, midi_message(0x90, note, velocity));
+    synth_queue_event(synth, start + (Uint64) (hold_seconds * sample_rate), midi_message(0x80, note, 0));
+    float left[SYNTH_BLOCK];
+    float right[SYNTH_BLOCK];
+    float *out[] = {left, right};
+    int frames = 0;
+    while (frames < max_frames && !synth_idle(synth)) {
+        const int n = SDL_min(max_frames - frames, SYNTH_BLOCK);
+        synth_process(synth, out, n, NULL, 0);
+        for (int f = 0; f < n; f++) {
+            samples[(frames + f) * SYNTH_CHANNELS] = left[f];
+            samples[(frames + f) * SYNTH_CHANNELS + 1] = right[f];
+        }
+        frames += n;
+    }
+    return frames;
+}
+
+typedef struct {
+    MidiNote note;
+    int velocity;
+    char path[MULTISAMPLE_PATH_MAX];
+} MultisampleJob;
+
+// shared by the workers, only next_job and failed change while they run
+typedef struct {
+    SynthPatch patch;
+    SynthConfig config;
+    float hold_seconds;
+    int max_frames; // the longest render, the hold and the tail
+    MultisampleJob *jobs;
+    int job_count;
+    SDL_AtomicInt next_job;
+    SDL_AtomicInt failed;
+} MultisampleExport;
+
+typedef struct {
+    MultisampleExport *export;
+    SDL_Thread *thread;
+    SynthEngine *synth;
+    float *samples; // interleaved, max_frames
+    int rendered;
+} MultisampleWorker;
+
+int SDLCALL multisample_worker_thread(void *data) {
+    MultisampleWorker *worker = data;
+    MultisampleExport *export = worker->export;
+    TRACE_THREAD("multisample");
+    worker->synth = synth_create(&export->config);
+    if (worker->synth == NULL) {
+        return 0; // the other workers take the jobs, those nobody renders count as failed
+    }
+    synth_set_patch(worker->synth, &export->patch);
+    for (;;) {
+        const int j = SDL_AddAtomicInt(&export->next_job, 1);
+        if (j >= export->job_count) break;
+        TRACE_SCOPE("multisample render");
+        const MultisampleJob *job = &export->jobs[j];
+        synth_reset(worker->synth);
+        const int frames = multisample_render(
+            worker->synth, export->config.sample_rate, job->note, job->velocity, export->hold_seconds, worker->samples,
+            export->max_frames
+        );
+
+        int first;
+        int count;
+        multisample_trim(worker->samples, frames, SYNTH_CHANNELS, MULTISAMPLE_THRESHOLD, &first, &count);
+        const float *trimmed = worker->samples + first * SYNTH_CHANNELS;
+        if (!wav_write(job->path, trimmed, SYNTH_CHANNELS, (int) export->config.sample_rate, (Uint32) count)) {
+            SDL_AddAtomicInt(&export->failed, 1);
+        }
+        worker->rendered++;
+    }
+    synth_destroy(worker->synth);
+    return 0;
+}
+
+// renders the grid into dir, created when missing, and waits for it. False when a file could not be written
+bool multisample_run(const MultisampleGrid *grid, const SynthPatch *patch, float sample_rate, const char *dir) {
+    if (!SDL_CreateDirectory(dir)) {
+        SDL_Log("Multisample %s: cannot create the directory", dir);
+        return false;
+    }
+    // one voice and no delay lines, the effects stay off. Prefaulted only, a worker per cpu may need more than a
+    // process can lock
+    SynthConfig config = synth_config_default(sample_rate);
+    config.max_polyphony = 1;
+    config.max_delay_time = 0.0f;
+    config.lock_memory = false;
+    MultisampleExport export = {
+        .patch = *patch,
+        .config = config,
+        .hold_seconds = grid->hold_seconds,
+        .max_frames = (int) ((grid->hold_seconds + MULTISAMPLE_TAIL_SECONDS) * sample_rate),
+        .job_count = multisample_grid_notes(grid) * grid->velocity_count,
+    };
+    export.patch.oversampling = SYNTH_OVERSAMPLING_MAX;
+    // the names are made here, note_to_str is not safe from several threads
+    export.jobs = SDL_calloc((size_t) export.job_count, sizeof(MultisampleJob));
+    assert(export.jobs != NULL);
+    int j = 0;
+    for (MidiNote note = grid->note_low; note <= grid->note_high; note += grid->note_step) {
+        for (int v = 0; v < grid->velocity_count; v++) {
+            MultisampleJob *job = &export.jobs[j++];
+            job->note = note;
+            job->velocity = grid->velocities[v];
+            SDL_snprintf(job->path, sizeof(job->path), "%s/%03d_%s_v%03d.wav", dir, note, note_to_str(note), job->velocity);
+        }
+    }
+    assert(j == export.job_count);
+
+    const int threads = SDL_clamp(SDL_min(grid->threads, export.job_count), 1, MULTISAMPLE_THREADS_MAX);
+    SDL_Log(
+        "Multisample %s: %d notes x %d velocities on %d threads", dir, multisample_grid_notes(grid),
+        grid->velocity_count, threads
+    );
+    const Uint64 start = SDL_GetPerformanceCounter();
+    MultisampleWorker *workers = SDL_calloc((size_t) threads, sizeof(MultisampleWorker));
+    assert(workers != NULL);
+    for (int w = 0; w < threads; w++) {
+        workers[w].export = &export;
+        workers[w].samples = SDL_malloc((size_t) export.max_frames * SYNTH_CHANNELS * sizeof(float));
+        assert(workers[w].samples != NULL);
+        workers[w].thread = SDL_CreateThread(multisample_worker_thread, "multisample", &workers[w]);
+        assert(workers[w].thread != NULL);
+    }
+    int rendered = 0;
+    for (int w = 0; w < threads; w++) {
+        SDL_WaitThread(workers[w].thread, NULL);
+        SDL_free(workers[w].samples);
+        rendered += workers[w].rendered;
+    }
+    const double seconds = (double) (SDL_GetPerformanceCounter() - start) / (double) SDL_GetPerformanceFrequency();
+    const int failed = SDL_GetAtomicInt(&export.failed) + export.job_count - rendered;
+    SDL_Log("Multisample %s: %d files in %.2f s, %d failed", dir, export.job_count - failed, seconds, failed);
+    SDL_free(workers);
+    SDL_free(export.jobs);
+    return failed == 0;
+}
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include "greatest.h"
+#include "synth.c"
+#include "wav.c"
+#include "multisample.c"
+
+#define TEST_SAMPLE_RATE 44100.0f
+#define TEST_DIR "multisample_test_out"
+#define TEST_HOLD 0.1f
+#define TEST_FRAMES_MAX 44100
+
+TEST multisample_parses_the_grid(void) {
+    MultisampleGrid grid = multisample_grid_init();
+    ASSERT(multisample_parse_notes(&grid, "21:108:12"));
+    ASSERT_EQ(21, grid.note_low);
+    ASSERT_EQ(108, grid.note_high);
+    ASSERT_EQ(12, grid.note_step);
+    ASSERT_EQ(8, multisample_grid_notes(&grid));
+    ASSERT(multisample_parse_notes(&grid, "60:64"));
+    ASSERT_EQ(1, grid.note_step);
+    ASSERT_EQ(5, multisample_grid_notes(&grid));
+    ASSERT(multisample_parse_velocities(&grid, "1,64,127"));
+    ASSERT_EQ(3, grid.velocity_count);
+    ASSERT_EQ(64, grid.velocities[1]);
+
+    // a bad value leaves the grid as it was
+    ASSERT_FALSE(multisample_parse_notes(&grid, "64:60"));
+    ASSERT_FALSE(multisample_parse_notes(&grid, "60:128"));
+    ASSERT_FALSE(multisample_parse_notes(&grid, "60:64:0"));
+    ASSERT_FALSE(multisample_parse_notes(&grid, "C4:C5"));
+    ASSERT_FALSE(multisample_parse_velocities(&grid, "64,0"));
+    ASSERT_FALSE(multisample_parse_velocities(&grid, "64,"));
+    ASSERT_EQ(60, grid.note_low);
+    ASSERT_EQ(3, grid.velocity_count);
+    PASS();
+}
+
+TEST multisample_trims_the_silent_ends(void) {
+    float samples[16 * 2] = {0};
+    int first;
+    int count;
+    multisample_trim(samples, 16, 2, MULTISAMPLE_THRESHOLD, &first, &count);
+    ASSERT_EQ(0, count);
+
+    // loud in either channel counts, what is quiet in between stays
+    samples[3 * 2 + 1] = 0.5f;
+    samples[10 * 2] = -0.5f;
+    samples[12 * 2] = MULTISAMPLE_THRESHOLD * 0.5f;
+    multisample_trim(samples, 16, 2, MULTISAMPLE_THRESHOLD, &first, &count);
+    ASSERT_EQ(3, first);
+    ASSERT_EQ(8, count);
+    PASS();
+}
+
+static float render_a[TEST_FRAMES_MAX * SYNTH_CHANNELS];
+static float render_b[TEST_FRAMES_MAX * SYNTH_CHANNELS];
+
+// a saw with unison, its phases have to start the same for every render
+static SynthPatch test_patch(void) {
+    SynthPatch patch = synth_patch_init();
+    patch.wave_type = SYNTH_WAVE_SAW;
+    patch.unison = 4;
+    patch.unison_detune = 0.3f;
+    patch.oversampling = SYNTH_OVERSAMPLING_MAX;
+    return patch;
+}
+
+// an engine as a worker of the export sets it up
+static SynthEngine *test_synth(const SynthPatch *patch) {
+    SynthConfig config = synth_config_default(TEST_SAMPLE_RATE);
+    config.max_polyphony = 1;
+    config.max_delay_time = 0.0f;
+    config.lock_memory = false;
+    SynthEngine *synth = synth_create(&config);
+    assert(synth != NULL);
+    synth_set_patch(synth, patch);
+    synth_reset(synth);
+    return synth;
+}
+
+// a fresh engine of the export renders the note
+static int render_note(float *samples, const SynthPatch *patch, MidiNote note) {
+    SynthEngine *synth = test_synth(patch);
+    const int frames = multisample_render(synth, TEST_SAMPLE_RATE, note, 100, TEST_HOLD, samples, TEST_FRAMES_MAX);
+    synth_destroy(synth);
+    return frames;
+}
+
+TEST multisample_render_is_the_same_every_time(void) {
+    const SynthPatch patch = test_patch();
+
+    // the note is held, then released until the engine is idle, long before the end of the buffer
+    const int frames = render_note(render_a, &patch, 57);
+    ASSERT(frames > (int) (TEST_HOLD * TEST_SAMPLE_RATE));
+    ASSERT(frames < TEST_FRAMES_MAX);
+    ASSERT_EQ(frames, render_note(render_b, &patch, 57));
+    ASSERT_MEM_EQ(render_a, render_b, (size_t) frames * SYNTH_CHANNELS * sizeof(float));
+    PASS();
+}
+
+TEST multisample_reset_engine_renders_like_a_new_one(void) {
+    // a worker resets its engine between jobs, what the last note left behind must not be heard
+    const SynthPatch patch = test_patch();
+    SynthEngine *synth = test_synth(&patch);
+    multisample_render(synth, TEST_SAMPLE_RATE, 45, 127, TEST_HOLD * 0.5f, render_b, TEST_FRAMES_MAX);
+    synth_reset(synth);
+    const int frames = multisample_render(synth, TEST_SAMPLE_RATE, 57, 100, TEST_HOLD, render_b, TEST_FRAMES_MAX);
+    synth_destroy(synth);
+
+    ASSERT_EQ(render_note(render_a, &patch, 57), frames);
+    ASSERT_MEM_EQ(render_a, render_b, (size_t) frames * SYNTH_CHANNELS * sizeof(float));
+    PASS();
+}
+
+TEST multisample_run_writes_a_file_per_note_and_velocity(void) {
+    MultisampleGrid grid = multisample_grid_init();
+    ASSERT(multisample_parse_notes(&grid, "48:60:12"));
+    ASSERT(multisample_parse_velocities(&grid, "40,127"));
+    grid.hold_seconds = TEST_HOLD;
+    grid.threads = 3;
+    const SynthPatch patch = synth_patch_init();
+    ASSERT(multisample_run(&grid, &patch, TEST_SAMPLE_RATE, TEST_DIR));
+
+    const char *names[] = {"048_C3_v040.wav", "048_C3_v127.wav", "060_C4_v040.wav", "060_C4_v127.wav"};
+    for (int i = 0; i < (int) SDL_arraysize(names); i++) {
+        char path[MULTISAMPLE_PATH_MAX];
+        SDL_snprintf(path, sizeof(path), "%s/%s", TEST_DIR, names[i]);
+        FILE *file = fopen(path, "rb");
+        ASSERT(file != NULL);
+        Uint8 header[WAV_HEADER_SIZE];
+        ASSERT_EQ(sizeof(header), fread(header, 1, sizeof(header), file));
+        fseek(file, 0, SEEK_END);
+        const long size = ftell(file);
+        fclose(file);
+        remove(path);
+        ASSERT_MEM_EQ("RIFF", header, 4);
+        ASSERT(size > WAV_HEADER_SIZE + (long) (TEST_HOLD * TEST_SAMPLE_RATE) * 4);
+    }
+    remove(TEST_DIR);
+    PASS();
+}
+
+SUITE(multisample_suite) {
+    RUN_TEST(multisample_parses_the_grid);
+    RUN_TEST(multisample_trims_the_silent_ends);
+    RUN_TEST(multisample_render_is_the_same_every_time);
+    RUN_TEST(multisample_reset_engine_renders_like_a_new_one);
+    RUN_TEST(multisample_run_writes_a_file_per_note_and_velocity);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(multisample_suite);
+    GREATEST_MAIN_END();
+}
@@ -1,23 +1,24 @@
 #include <assert.h>
 #include <stdio.h>
-#include <SDL3/SDL.h>
+#include "platform.h"
 
 typedef int MidiNote;
 
 const int DEFAULT_MIDI_NOTE = 69; // A = 440 hz = MIDI 69
 const char *note_names[] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
-char note_str_buffer[4] = "A4"; // enough for "C#9\0"
+char note_str_buffer[5] = "A4"; // enough for "C#-1\0"
 
 float note_to_freq(const MidiNote note) {
     // notes https://en.wikipedia.org/wiki/Piano_key_frequencies
     const int a440_to_n = 20;
     const int n = note - a440_to_n;
-    return SDL_powf(2, ((float) n - 49.0f) / 12.0f) * 440.0f;
+    return fast_semitones_to_ratio((float) n - 49.0f) * 440.0f;
 }
 
 char *note_to_str(const MidiNote note) {
-    int octave = note / 12 - 1;
-    int note_index = note % 12;
+    const int midi_note = SDL_clamp(note, 0, 127);
+    int octave = midi_note / 12 - 1;
+    int note_index = midi_note % 12;
 
     snprintf(note_str_buffer, sizeof(note_str_buffer), "%s%d", note_names[note_index], octave);
     return note_str_buffer;
@@ -38,10 +39,12 @@ typedef struct {
     PressedNote memory[NOTE_MEMORY_STACK_MAX];
 } NoteMemory;
 
-NoteMemory note_memory = {0};
-
+// when full the oldest note is forgotten, files can hold more notes than hands
 void note_memory_push(NoteMemory *nm, const PressedNote note) {
-    assert(nm->count < NOTE_MEMORY_STACK_MAX);
+    if (nm->count == NOTE_MEMORY_STACK_MAX) {
+        SDL_memmove(nm->memory, nm->memory + 1, (NOTE_MEMORY_STACK_MAX - 1) * sizeof(PressedNote));
+        nm->count--;
+    }
     nm->memory[nm->count++] = note;
 }
 
@@ -55,8 +58,7 @@ void note_memory_remove(NoteMemory *nm, MidiNote midi_note) {
             return;
         }
     }
-    SDL_Log("MIDI note %d not found in stack\n", midi_note);
-    assert(false);
+    // a note off without its note on, or one that was forgotten, runs on the audio thread so it is not logged
 }
 
 const PressedNote *note_memory_peek(const NoteMemory *nm) {
@@ -1,4 +1,6 @@
 #include "greatest.h"
+#include "simd.c"
+#include "fastmath.c"
 #include "note.c"
 
 TEST note_to_freq_a440(void) {
@@ -202,6 +204,31 @@ TEST note_memory_max_capacity(void) {
     PASS();
 }
 
+TEST note_memory_push_when_full_drops_oldest(void) {
+    NoteMemory nm = {0};
+
+    for (int i = 0; i <= NOTE_MEMORY_STACK_MAX; i++) {
+        PressedNote note = {.midi_note = i, .freq = 100.0f + i, .velocity = 0.5f};
+        note_memory_push(&nm, note);
+    }
+
+    ASSERT_EQ(NOTE_MEMORY_STACK_MAX, nm.count);
+    ASSERT_EQ(1, nm.memory[0].midi_note);
+    ASSERT_EQ(NOTE_MEMORY_STACK_MAX, note_memory_peek(&nm)->midi_note);
+    PASS();
+}
+
+TEST note_memory_remove_unknown_note(void) {
+    NoteMemory nm = {0};
+    PressedNote note = {.midi_note = 60, .freq = 261.63f, .velocity = 0.5f};
+    note_memory_push(&nm, note);
+    note_memory_remove(&nm, 61);
+
+    ASSERT_EQ(1, nm.count);
+    ASSERT_EQ(60, note_memory_peek(&nm)->midi_note);
+    PASS();
+}
+
 SUITE(note_to_freq_suite) {
     RUN_TEST(note_to_freq_a440);
     RUN_TEST(note_to_freq_middle_c);
@@ -228,6 +255,8 @@ SUITE(note_memory_suite) {
     RUN_TEST(note_memory_remove_from_beginning);
     RUN_TEST(note_memory_remove_from_end);
     RUN_TEST(note_memory_max_capacity);
+    RUN_TEST(note_memory_push_when_full_drops_oldest);
+    RUN_TEST(note_memory_remove_unknown_note);
 }
 
 GREATEST_MAIN_DEFS();
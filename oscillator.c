@@ -2,7 +2,7 @@
     Wave functions, checks desmos for the plot of the signals genrated
     https://www.desmos.com/calculator/eugiiu4iky
 */
-#include <SDL3/SDL.h>
+#include "platform.h"
 #include <assert.h>
 
 typedef enum {
@@ -28,7 +28,7 @@ char *waves_type_to_str(WavesType t) {
 }
 
 float waves_sine(float amplitude, float phase) {
-    float y = amplitude * SDL_sinf(2 * SDL_PI_F * phase);
+    float y = amplitude * fast_sin_turns(phase);
     return y;
 }
 
@@ -38,7 +38,7 @@ float waves_sine(float amplitude, float phase) {
 float waves_square(float amplitude, float phase, float pulse_with) {
     assert(pulse_with >= 0);
     assert(pulse_with <= 1);
-    float y = amplitude * (SDL_sinf(2 * SDL_PI_F * phase) > pulse_with ? 1.0f : -1.0f);
+    float y = amplitude * (fast_sin_turns(phase) > pulse_with ? 1.0f : -1.0f);
     return y;
 }
 
@@ -48,20 +48,32 @@ float waves_saw(float amplitude, float phase) {
 }
 
 float waves_triangle(float amplitude, float phase) {
-    float y = amplitude - 4 * amplitude * SDL_fabsf(phase - 0.5);
+    float y = amplitude - 4 * amplitude * SDL_fabsf(phase - 0.5f);
     return y;
 }
 
 
+#define UNISON_MAX 16
+#define UNISON_VECTORS (UNISON_MAX / SIMD_WIDTH)
+
 typedef struct {
     WavesType wave_type;
     float freq;
     float initial_phase;
     float square_pulse_width;
+    int unison; // stacked copies, 1 to UNISON_MAX
+    float unison_detune; // semitones between the lowest and the highest copy
+    float unison_spread; // stereo width, 0.0 is mono and 1.0 hard left to hard right
 } Oscillator;
 
 Oscillator oscillator_init(WavesType wave_type) {
-    Oscillator oscillator = {.freq = 440.0f, .wave_type = wave_type};
+    Oscillator oscillator = {
+        .freq = 440.0f,
+        .wave_type = wave_type,
+        .unison = 1,
+        .unison_detune = 0.3f,
+        .unison_spread = 0.8f
+    };
     return oscillator;
 }
 
@@ -79,3 +91,113 @@ float oscillator_next_point(Oscillator oscillator, float amplitude, float phase)
             assert(false);
     }
 }
+
+/*
+    Unison, every copy of the oscillator is one SIMD lane so a sample of up to
+    UNISON_MAX copies costs UNISON_VECTORS vector operations. Unused lanes have zero gain.
+*/
+typedef struct {
+    int count;
+    float detune;
+    float spread;
+    int vectors; // vectors holding the count lanes
+    f32x4 phase[UNISON_VECTORS];
+    f32x4 ratio[UNISON_VECTORS]; // detune as a frequency ratio
+    f32x4 gain_left[UNISON_VECTORS];
+    f32x4 gain_right[UNISON_VECTORS];
+} Unison;
+
+// xorshift32, good enough for phases
+float unison_random(uint32_t *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return (float) (*seed >> 8) / 16777216.0f;
+}
+
+// derive the lane ratios and gains from the oscillator, phases are kept
+void unison_configure(Unison *unison, const Oscillator *oscillator) {
+    const int count = SDL_clamp(oscillator->unison, 1, UNISON_MAX);
+    unison->count = count;
+    unison->detune = oscillator->unison_detune;
+    unison->spread = oscillator->unison_spread;
+    unison->vectors = (count + SIMD_WIDTH - 1) / SIMD_WIDTH;
+
+    // equal power pan with 1 / sqrt(count) so the stack is as loud as one copy
+    const float normalize = 1.0f / SDL_sqrtf((float) count);
+    for (int i = 0; i < UNISON_MAX; i++) {
+        const int v = i / SIMD_WIDTH;
+        const int lane = i % SIMD_WIDTH;
+        if (i >= count) {
+            unison->ratio[v][lane] = 1.0f;
+            unison->gain_left[v][lane] = 0.0f;
+            unison->gain_right[v][lane] = 0.0f;
+            continue;
+        }
+        const float position = count > 1 ? (float) i / (float) (count - 1) - 0.5f : 0.0f; // -0.5 to 0.5
+        // alternate sides so neighbouring detunes are not panned together
+        const float pan = (i % 2 == 0 ? 1.0f : -1.0f) * SDL_fabsf(position) * unison->spread; // -0.5 to 0.5
+        unison->ratio[v][lane] = fast_semitones_to_ratio(position * unison->detune);
+        unison->gain_left[v][lane] = normalize * fast_cos_turns(0.125f * (1.0f + 2.0f * pan)) * SDL_sqrtf(2.0f);
+        unison->gain_right[v][lane] = normalize * fast_sin_turns(0.125f * (1.0f + 2.0f * pan)) * SDL_sqrtf(2.0f);
+    }
+}
+
+// the count as unison_configure stores it, a patch value out of range would never match
+bool unison_is_configured(const Unison *unison, const Oscillator *oscillator) {
+    return unison->count == SDL_clamp(oscillator->unison, 1, UNISON_MAX)
+        && unison->detune == oscillator->unison_detune
+        && unison->spread == oscillator->unison_spread;
+}
+
+// free running copies start at random phases, otherwise they sum into a single louder copy
+void unison_randomize_phases(Unison *unison, uint32_t *seed) {
+    for (int v = 0; v < UNISON_VECTORS; v++) {
+        for (int lane = 0; lane < SIMD_WIDTH; lane++) {
+            unison->phase[v][lane] = unison_random(seed);
+        }
+    }
+}
+
+Unison unison_init(const Oscillator *oscillator, uint32_t *seed) {
+    Unison unison = {0};
+    unison_configure(&unison, oscillator);
+    unison_randomize_phases(&unison, seed);
+    return unison;
+}
+
+f32x4 unison_wave(const Oscillator *oscillator, f32x4 phase) {
+    switch (oscillator->wave_type) {
+        case WAVE_SINE:
+            return fast_sin_turns_x4(phase);
+        case WAVE_SQUARE: {
+            const i32x4 high = fast_sin_turns_x4(phase) > oscillator->square_pulse_width;
+            return fast_select_x4(high, simd_set1(1.0f), simd_set1(-1.0f));
+        }
+        case WAVE_SAW:
+            return -1.0f + 2.0f * phase;
+        case WAVE_TRIANGLE: {
+            const i32x4 sign_mask = (i32x4) simd_set1(-0.0f);
+            return 1.0f - 4.0f * (f32x4) ((i32x4) (phase - 0.5f) & ~sign_mask);
+        }
+        default:
+            assert(false);
+    }
+}
+
+// phase_step is the phase increment of the centre copy
+void unison_next_point(Unison *unison, const Oscillator *oscillator, float amplitude, float phase_step, float *left, float *right) {
+    f32x4 sum_left = simd_set1(0.0f);
+    f32x4 sum_right = simd_set1(0.0f);
+    for (int v = 0; v < unison->vectors; v++) {
+        const f32x4 y = unison_wave(oscillator, unison->phase[v]);
+        sum_left += y * unison->gain_left[v];
+        sum_right += y * unison->gain_right[v];
+
+        f32x4 phase = unison->phase[v] + phase_step * unison->ratio[v];
+        phase -= (f32x4) ((i32x4) (phase >= 1.0f) & (i32x4) simd_set1(1.0f));
+        unison->phase[v] = phase;
+    }
+    *left = amplitude * simd_sum(sum_left);
+    *right = amplitude * simd_sum(sum_right);
+}
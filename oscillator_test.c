@@ -0,0 +1,245 @@
+#include <time.h>
+#include "greatest.h"
+#include "simd.c"
+#include "fastmath.c"
+#include "arena.c"
+#include "oscillator.c"
+#include "note.c"
+#include "filter.c"
+#include "modulation.c"
+#include "patch.c"
+#include "voice.c"
+
+#define TEST_SAMPLE_RATE 44100
+
+TEST unison_single_copy_matches_oscillator(void) {
+    Oscillator osc = oscillator_init(WAVE_SAW);
+    osc.unison = 1;
+    uint32_t seed = 1;
+    Unison unison = unison_init(&osc, &seed);
+    unison.phase[0][0] = 0.0f;
+
+    float phase = 0.0f;
+    for (int i = 0; i < 1000; i++) {
+        float left;
+        float right;
+        unison_next_point(&unison, &osc, 0.5f, 0.01f, &left, &right);
+        const float expected = oscillator_next_point(osc, 0.5f, phase);
+        ASSERT_IN_RANGE(expected, left, 1e-5f);
+        ASSERT_IN_RANGE(expected, right, 1e-5f);
+        phase += 0.01f;
+        if (phase >= 1.0f) phase -= 1.0f;
+    }
+    PASS();
+}
+
+TEST unison_unused_lanes_are_silent(void) {
+    Oscillator osc = oscillator_init(WAVE_SQUARE);
+    osc.unison = 5;
+    uint32_t seed = 1;
+    Unison unison = unison_init(&osc, &seed);
+
+    ASSERT_EQ(2, unison.vectors);
+    for (int i = osc.unison; i < UNISON_MAX; i++) {
+        ASSERT_EQ(0.0f, unison.gain_left[i / SIMD_WIDTH][i % SIMD_WIDTH]);
+        ASSERT_EQ(0.0f, unison.gain_right[i / SIMD_WIDTH][i % SIMD_WIDTH]);
+    }
+    PASS();
+}
+
+TEST unison_out_of_range_count_stays_configured(void) {
+    Oscillator osc = oscillator_init(WAVE_SAW);
+    osc.unison = UNISON_MAX + 10;
+    uint32_t seed = 1;
+    Unison unison = unison_init(&osc, &seed);
+
+    ASSERT_EQ(UNISON_MAX, unison.count);
+    ASSERT(unison_is_configured(&unison, &osc));
+    osc.unison = 0;
+    unison_configure(&unison, &osc);
+    ASSERT_EQ(1, unison.count);
+    ASSERT(unison_is_configured(&unison, &osc));
+    PASS();
+}
+
+TEST unison_detune_is_symmetric(void) {
+    Oscillator osc = oscillator_init(WAVE_SAW);
+    osc.unison = 8;
+    osc.unison_detune = 0.5f;
+    uint32_t seed = 1;
+    Unison unison = unison_init(&osc, &seed);
+
+    for (int i = 0; i < osc.unison; i++) {
+        const int mirror = osc.unison - 1 - i;
+        const float ratio = unison.ratio[i / SIMD_WIDTH][i % SIMD_WIDTH];
+        const float mirror_ratio = unison.ratio[mirror / SIMD_WIDTH][mirror % SIMD_WIDTH];
+        ASSERT_IN_RANGE(1.0f, ratio * mirror_ratio, 1e-5f);
+    }
+    ASSERT_IN_RANGE(fast_semitones_to_ratio(-0.25f), unison.ratio[0][0], 1e-6f);
+    PASS();
+}
+
+TEST unison_without_spread_is_mono(void) {
+    Oscillator osc = oscillator_init(WAVE_TRIANGLE);
+    osc.unison = 7;
+    osc.unison_spread = 0.0f;
+    uint32_t seed = 1;
+    Unison unison = unison_init(&osc, &seed);
+
+    for (int i = 0; i < 1000; i++) {
+        float left;
+        float right;
+        unison_next_point(&unison, &osc, 1.0f, 0.003f, &left, &right);
+        ASSERT_EQ(left, right);
+        ASSERT(SDL_fabsf(left) <= SDL_sqrtf(7.0f));
+    }
+    PASS();
+}
+
+TEST unison_chord_renders_in_real_time(void) {
+    // 8 copies on each note of a 16 note chord, a second of audio has to take less than a second
+    Patch patch = patch_init(TEST_SAMPLE_RATE);
+    patch.oscillator = oscillator_init(WAVE_SAW);
+    patch.oscillator.unison = 8;
+    patch.filter = filter_init(FILTER_MODE_SVF_LOWPASS, TEST_SAMPLE_RATE);
+    filter_set_cutoff(&patch.filter, 2000.0f);
+    Arena arena = arena_init(voice_pool_footprint(VOICES_MAX));
+    VoicePool pool = voice_pool_init(&arena, VOICES_MAX);
+    float values[MOD_SRC_COUNT] = {[MOD_SRC_NONE] = 1.0f};
+    for (int i = 0; i < VOICES_MAX; i++) {
+        const PressedNote note = {.midi_note = 48 + i, .freq = note_to_freq(48 + i), .velocity = 0.5f};
+        voice_pool_note_on(&pool, note, &patch, values);
+    }
+    ASSERT_EQ(VOICES_MAX, voice_pool_active_count(&pool));
+
+    float left[MOD_CONTROL_RATE_DEFAULT];
+    float right[MOD_CONTROL_RATE_DEFAULT];
+    const float dt = (float) MOD_CONTROL_RATE_DEFAULT / TEST_SAMPLE_RATE;
+    const clock_t start = clock();
+    for (int block = 0; block < TEST_SAMPLE_RATE / MOD_CONTROL_RATE_DEFAULT; block++) {
+        SDL_memset(left, 0, sizeof(left));
+        SDL_memset(right, 0, sizeof(right));
+        for (int v = 0; v < VOICES_MAX; v++) {
+            voice_control(&pool.voices[v], &patch, values, dt);
+            voice_render(&pool.voices[v], &patch.oscillator, 0.1f, 1.0f / TEST_SAMPLE_RATE, 1, left, right, MOD_CONTROL_RATE_DEFAULT);
+        }
+        for (int i = 0; i < MOD_CONTROL_RATE_DEFAULT; i++) {
+            ASSERT(SDL_fabsf(left[i]) < 16.0f && SDL_fabsf(right[i]) < 16.0f);
+        }
+    }
+    const double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    ASSERT(seconds < 1.0);
+    arena_free(&arena);
+    PASS();
+}
+
+TEST new_voice_starts_at_its_envelope(void) {
+    Patch patch = patch_init(TEST_SAMPLE_RATE);
+    patch.oscillator = oscillator_init(WAVE_SQUARE);
+    patch.env1 = envelope_init(0.1f, 0.0f, 1.0f, 0.1f);
+    Arena arena = arena_init(voice_pool_footprint(1));
+    VoicePool pool = voice_pool_init(&arena, 1);
+    float values[MOD_SRC_COUNT] = {[MOD_SRC_NONE] = 1.0f};
+    const PressedNote note = {.midi_note = 57, .freq = note_to_freq(57), .velocity = 1.0f};
+    voice_pool_note_on(&pool, note, &patch, values);
+    Voice *voice = &pool.voices[0];
+    ASSERT_EQ(0.0f, voice->mod.current[MOD_DST_AMPLITUDE]);
+
+    // the attack ramps the amplitude up from silence, the first control block stays quiet
+    float left[MOD_CONTROL_RATE_DEFAULT] = {0};
+    float right[MOD_CONTROL_RATE_DEFAULT] = {0};
+    const float dt = (float) MOD_CONTROL_RATE_DEFAULT / TEST_SAMPLE_RATE;
+    voice_control(voice, &patch, values, dt);
+    voice_render(voice, &patch.oscillator, 1.0f, 1.0f / TEST_SAMPLE_RATE, 1, left, right, MOD_CONTROL_RATE_DEFAULT);
+    ASSERT(SDL_fabsf(left[0]) < 1e-3f);
+    ASSERT(SDL_fabsf(left[MOD_CONTROL_RATE_DEFAULT - 1]) <= dt / 0.1f + 1e-6f);
+    arena_free(&arena);
+    PASS();
+}
+
+TEST released_voice_rings_out_then_sleeps(void) {
+    Patch patch = patch_init(TEST_SAMPLE_RATE);
+    patch.oscillator = oscillator_init(WAVE_SAW);
+    patch.filter = filter_init(FILTER_MODE_SVF_LOWPASS, TEST_SAMPLE_RATE);
+    filter_set_cutoff(&patch.filter, 500.0f);
+    filter_set_resonance(&patch.filter, 0.9f);
+    Arena arena = arena_init(voice_pool_footprint(VOICES_MAX));
+    VoicePool pool = voice_pool_init(&arena, VOICES_MAX);
+    const PressedNote note = {.midi_note = 57, .freq = note_to_freq(57), .velocity = 1.0f};
+    float values[MOD_SRC_COUNT] = {[MOD_SRC_NONE] = 1.0f};
+    voice_pool_note_on(&pool, note, &patch, values);
+    Voice *voice = &pool.voices[0];
+
+    float left[MOD_CONTROL_RATE_DEFAULT];
+    float right[MOD_CONTROL_RATE_DEFAULT];
+    const float dt = (float) MOD_CONTROL_RATE_DEFAULT / TEST_SAMPLE_RATE;
+    int released_blocks = -1;
+    for (int block = 0; block < TEST_SAMPLE_RATE / MOD_CONTROL_RATE_DEFAULT && voice->active; block++) {
+        if (block == 100) {
+            voice_pool_note_off(&pool, note.midi_note, NULL);
+            ASSERT(voice->active);
+            released_blocks = 0;
+        }
+        SDL_memset(left, 0, sizeof(left));
+        SDL_memset(right, 0, sizeof(right));
+        voice_control(voice, &patch, values, dt);
+        voice_render(voice, &patch.oscillator, 0.1f, 1.0f / TEST_SAMPLE_RATE, 1, left, right, MOD_CONTROL_RATE_DEFAULT);
+        if (released_blocks == 0) {
+            // the first released block still carries the resonance
+            ASSERT(SDL_fabsf(left[0]) > VOICE_SILENCE_THRESHOLD);
+        }
+        if (released_blocks >= 0) released_blocks++;
+    }
+    ASSERT_FALSE(voice->active);
+    // the oscillator plays through the release of env1, from the sustain level of 0.8 in 0.3 s per unit
+    ASSERT(released_blocks * MOD_CONTROL_RATE_DEFAULT >= (int) (0.8f * 0.3f * TEST_SAMPLE_RATE));
+    ASSERT_EQ(0.0f, filter_state_level(&voice->filter_left));
+    ASSERT_EQ(0, voice_pool_active_count(&pool));
+    arena_free(&arena);
+    PASS();
+}
+
+TEST patch_exchange_takes_the_latest_snapshot(void) {
+    static PatchExchange exchange;
+    Arena arena = arena_init(patch_exchange_footprint());
+    Patch patch = patch_init(TEST_SAMPLE_RATE);
+    patch_exchange_init(&arena, &exchange, &patch);
+    ASSERT_EQ(1.0f, patch_acquire(&exchange)->volume);
+
+    // published twice between blocks, only the last one is seen
+    for (int round = 0; round < 10; round++) {
+        patch.volume = 0.5f;
+        patch_publish(&exchange, &patch);
+        patch.volume = (float) round;
+        patch_publish(&exchange, &patch);
+        const Patch *current = patch_acquire(&exchange);
+        ASSERT_EQ((float) round, current->volume);
+        // publishing reclaims the snapshot the audio thread just retired
+        patch.volume = -1.0f;
+        patch_publish(&exchange, &patch);
+        ASSERT_EQ(-1.0f, patch_acquire(&exchange)->volume);
+        ASSERT_EQ(-1.0f, patch_acquire(&exchange)->volume);
+    }
+    arena_free(&arena);
+    PASS();
+}
+
+SUITE(unison_suite) {
+    RUN_TEST(unison_single_copy_matches_oscillator);
+    RUN_TEST(unison_unused_lanes_are_silent);
+    RUN_TEST(unison_out_of_range_count_stays_configured);
+    RUN_TEST(unison_detune_is_symmetric);
+    RUN_TEST(unison_without_spread_is_mono);
+    RUN_TEST(unison_chord_renders_in_real_time);
+    RUN_TEST(new_voice_starts_at_its_envelope);
+    RUN_TEST(released_voice_rings_out_then_sleeps);
+    RUN_TEST(patch_exchange_takes_the_latest_snapshot);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(unison_suite);
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,109 @@
+/*
+    2x/4x oversampling with polyphase half-band FIR filters. The voices render straight at the
+    high rate, so only the way down is filtered. Every other tap of a half-band filter is zero,
+    so each 2x stage splits into a FIR branch over the even samples and a pure delay over the
+    odd ones. 4x runs two 2x stages in cascade. Processing is done per block.
+*/
+#include "platform.h"
+#include <assert.h>
+
+#define HALFBAND_HALF_TAPS 8 // taps on each side of the centre, the filter has 4 * 8 - 1 taps
+#define HALFBAND_BRANCH_TAPS (2 * HALFBAND_HALF_TAPS) // taps of the FIR branch, multiple of SIMD_WIDTH
+#define HALFBAND_BLOCK_MAX 256 // low rate samples per call
+#define OVERSAMPLING_MAX 4
+
+// the non-zero taps of the even branch of a Blackman windowed sinc, normalized so the branch adds up to 0.5
+// for unity gain at DC. The centre tap is always 0.5. A constant table, so engines on any thread share it
+// without setting it up; dsp_test designs it again and checks it
+static const float halfband_coefficients[HALFBAND_BRANCH_TAPS] = {
+    -7.46389123e-05f, 0.000853939448f, -0.00322899944f, 0.00878936052f,
+    -0.0201708041f, 0.0424680635f, -0.0919110104f, 0.313274086f,
+    0.313274086f, -0.0919109955f, 0.0424680524f, -0.0201708041f,
+    0.00878935773f, -0.00322899735f, 0.000853939273f, -7.46385995e-05f,
+};
+
+typedef struct {
+    // history followed by the current block, so every output reads a contiguous window
+    float even[HALFBAND_BRANCH_TAPS - 1 + HALFBAND_BLOCK_MAX];
+    float odd[HALFBAND_HALF_TAPS + HALFBAND_BLOCK_MAX];
+} Halfband;
+
+Halfband halfband_init() {
+    Halfband hb = {0};
+    return hb;
+}
+
+// in has 2 * n_out samples
+void halfband_decimate(Halfband *hb, const float *in, float *out, int n_out) {
+    assert(n_out <= HALFBAND_BLOCK_MAX);
+    float *even = hb->even + HALFBAND_BRANCH_TAPS - 1;
+    float *odd = hb->odd + HALFBAND_HALF_TAPS;
+    for (int m = 0; m < n_out; m++) {
+        even[m] = in[2 * m];
+        odd[m] = in[2 * m + 1];
+    }
+
+    for (int m = 0; m < n_out; m++) {
+        out[m] = simd_dot(halfband_coefficients, hb->even + m, HALFBAND_BRANCH_TAPS) + 0.5f * hb->odd[m];
+    }
+
+    SDL_memmove(hb->even, hb->even + n_out, (HALFBAND_BRANCH_TAPS - 1) * sizeof(float));
+    SDL_memmove(hb->odd, hb->odd + n_out, HALFBAND_HALF_TAPS * sizeof(float));
+}
+
+typedef struct {
+    int factor; // 1, 2 or 4
+    Halfband down[2];
+    float work[HALFBAND_BLOCK_MAX * 2];
+} Oversampler;
+
+Oversampler oversampler_init(int factor) {
+    assert(factor == 1 || factor == 2 || factor == 4);
+    Oversampler os = {
+        .factor = factor,
+        .down = {halfband_init(), halfband_init()},
+    };
+    return os;
+}
+
+// in has n_out * factor samples
+void oversampler_downsample(Oversampler *os, const float *in, float *out, int n_out) {
+    switch (os->factor) {
+        case 1:
+            SDL_memcpy(out, in, n_out * sizeof(float));
+            break;
+        case 2:
+            halfband_decimate(&os->down[0], in, out, n_out);
+            break;
+        case 4:
+            halfband_decimate(&os->down[0], in, os->work, n_out * 2);
+            halfband_decimate(&os->down[1], os->work, out, n_out);
+            break;
+        default:
+            assert(false);
+    }
+}
+
+// the voices render at the higher factor while the factor switches, a path at a lower one takes every
+// in_factor / factor sample of it. Close to what rendering at that factor gives, the voices are continuous
+void oversampler_downsample_from(Oversampler *os, const float *in, int in_factor, float *out, int n_out) {
+    assert(in_factor >= os->factor && n_out <= HALFBAND_BLOCK_MAX);
+    if (in_factor == os->factor) {
+        oversampler_downsample(os, in, out, n_out);
+        return;
+    }
+    const int step = in_factor / os->factor;
+    float picked[HALFBAND_BLOCK_MAX * 2];
+    for (int i = 0; i < n_out * os->factor; i++) {
+        picked[i] = in[i * step];
+    }
+    oversampler_downsample(os, picked, out, n_out);
+}
+
+// n samples of a crossfade of length that has done samples behind it, from reaches to on its last one
+void oversampler_crossfade(float *from, const float *to, int n, int done, int length) {
+    const float step = 1.0f / (float) length;
+    for (int i = 0; i < n; i++) {
+        from[i] += (to[i] - from[i]) * step * (float) (done + i + 1);
+    }
+}
@@ -0,0 +1,103 @@
+/*
+    The patch, everything about the sound that is shared by all voices: oscillator, filter
+    settings, envelopes, modulation routing, volume and the oversampling of the voice path.
+    The audio thread only reads immutable snapshots. The ui edits its own copy and publishes
+    it with patch_publish, which copies it into a free snapshot and swaps it in as pending with
+    an atomic pointer exchange. At a block boundary patch_acquire takes the pending snapshot and
+    hands back the one it replaces as retired, patch_reclaim frees it on the ui thread.
+    There are never more than three snapshots in use (current, pending and retired), so
+    publishing always finds a free one and nothing blocks on either side.
+*/
+#include "platform.h"
+#include <assert.h>
+
+typedef struct {
+    Oscillator oscillator;
+    Filter filter; // settings only, each voice keeps its own state
+    Envelope env1; // settings only, stage and level are per voice. Also the amplitude envelope
+    Envelope env2;
+    ModMatrix mod_matrix;
+    float volume;
+    int oversampling; // of the voice path, 1 = off, 2 or 4
+} Patch;
+
+Patch patch_init(float sample_rate) {
+    const ModVoiceSources sources = mod_voice_sources_init(1.0f);
+    Patch patch = {
+        .oscillator = oscillator_init(WAVE_SINE),
+        .filter = filter_init(FILTER_MODE_LOWPASS, sample_rate),
+        .env1 = sources.env1,
+        .env2 = sources.env2,
+        .mod_matrix = mod_matrix_init(MOD_CONTROL_RATE_DEFAULT),
+        .volume = 1.0f,
+        .oversampling = 1,
+    };
+    return patch;
+}
+
+#define PATCH_SNAPSHOTS 4 // current, pending, retired and one to write
+
+typedef struct {
+    Patch *snapshots; // PATCH_SNAPSHOTS of them, from the arena
+    bool in_use[PATCH_SNAPSHOTS]; // ui thread only
+    void *pending; // atomic, published and not yet taken by the audio thread
+    void *retired; // atomic, replaced by the audio thread and not yet reclaimed
+    const Patch *current; // audio thread only
+} PatchExchange;
+
+size_t patch_exchange_footprint(void) {
+    return arena_align(PATCH_SNAPSHOTS * sizeof(Patch));
+}
+
+// while the audio thread does not read, patch is current and nothing is pending
+void patch_exchange_reset(PatchExchange *exchange, const Patch *patch) {
+    Patch *snapshots = exchange->snapshots;
+    SDL_zerop(exchange);
+    exchange->snapshots = snapshots;
+    exchange->snapshots[0] = *patch;
+    exchange->in_use[0] = true;
+    exchange->current = &exchange->snapshots[0];
+}
+
+// before the audio thread starts reading
+void patch_exchange_init(Arena *arena, PatchExchange *exchange, const Patch *patch) {
+    exchange->snapshots = arena_alloc(arena, PATCH_SNAPSHOTS * sizeof(Patch));
+    patch_exchange_reset(exchange, patch);
+}
+
+// ui thread, frees the snapshot the audio thread stopped using
+void patch_reclaim(PatchExchange *exchange) {
+    const Patch *retired = SDL_SetAtomicPointer(&exchange->retired, NULL);
+    if (retired != NULL) {
+        exchange->in_use[retired - exchange->snapshots] = false;
+    }
+}
+
+// ui thread, the audio thread picks it up at its next block
+void patch_publish(PatchExchange *exchange, const Patch *patch) {
+    patch_reclaim(exchange);
+    int slot = 0;
+    while (slot < PATCH_SNAPSHOTS && exchange->in_use[slot]) slot++;
+    assert(slot < PATCH_SNAPSHOTS);
+    exchange->snapshots[slot] = *patch;
+    exchange->in_use[slot] = true;
+
+    const Patch *replaced = SDL_SetAtomicPointer(&exchange->pending, &exchange->snapshots[slot]);
+    if (replaced != NULL) {
+        // published after the last block, the audio thread never saw it
+        exchange->in_use[replaced - exchange->snapshots] = false;
+    }
+}
+
+// audio thread, at a block boundary. A new snapshot is only taken once the ui reclaimed the
+// last retired one, until then the current one stays.
+const Patch *patch_acquire(PatchExchange *exchange) {
+    if (SDL_GetAtomicPointer(&exchange->pending) != NULL && SDL_GetAtomicPointer(&exchange->retired) == NULL) {
+        const Patch *next = SDL_SetAtomicPointer(&exchange->pending, NULL);
+        if (next != NULL) {
+            SDL_SetAtomicPointer(&exchange->retired, (void *) exchange->current);
+            exchange->current = next;
+        }
+    }
+    return exchange->current;
+}
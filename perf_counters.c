@@ -0,0 +1,235 @@
+/*
+    Hardware performance counters of the audio path, through perf_event_open on Linux.
+    With --perf-counters the audio thread opens one group of counters for itself on its
+    first callback: cycles, instructions, cache misses, branches and branch misses. Every
+    callback reads the group once at its start and once at its end, a read call each, and
+    adds the difference to the bucket of the number of voices active when it started.
+    The offline renders count the same way around each engine block on the ui thread.
+    perf_counters_report logs IPC, cycles per frame and the miss rates per voice count, at
+    quit for the live engine and after each offline render.
+    Only user space of the counting thread is counted. When the kernel refuses
+    (perf_event_paranoid, no PMU in a virtual machine) or elsewhere than Linux, the report
+    says why and nothing is counted.
+*/
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include "synth.h"
+#if defined(__linux__) && defined(_GNU_SOURCE)
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#define PERF_COUNTERS_LINUX 1
+#endif
+
+typedef enum {
+    PERF_COUNTER_CYCLES,
+    PERF_COUNTER_INSTRUCTIONS,
+    PERF_COUNTER_CACHE_MISSES,
+    PERF_COUNTER_BRANCHES,
+    PERF_COUNTER_BRANCH_MISSES,
+    PERF_COUNTER_COUNT,
+} PerfCounter;
+
+char *perf_counter_to_str(PerfCounter counter) {
+    switch (counter) {
+        case PERF_COUNTER_CYCLES:
+            return "cycles";
+        case PERF_COUNTER_INSTRUCTIONS:
+            return "instructions";
+        case PERF_COUNTER_CACHE_MISSES:
+            return "cache misses";
+        case PERF_COUNTER_BRANCHES:
+            return "branches";
+        case PERF_COUNTER_BRANCH_MISSES:
+            return "branch misses";
+        default:
+            assert(false);
+    }
+}
+
+#define PERF_COUNTERS_BUCKETS (SYNTH_POLYPHONY_DEFAULT + 1) // 0 to SYNTH_POLYPHONY_DEFAULT active voices
+
+typedef struct {
+    Uint64 calls;
+    Uint64 frames;
+    Uint64 counts[PERF_COUNTER_COUNT];
+} PerfCountersBucket;
+
+typedef struct {
+    int fds[PERF_COUNTER_COUNT]; // fds[0] leads the group, -1 when not counting
+    int error; // why the group could not be opened, 0 when it was or was not tried
+    bool multiplexed; // the counters shared the PMU with other events, the counts are partial
+    Uint64 begin[PERF_COUNTER_COUNT]; // at the start of the current call
+    int begin_voices;
+    PerfCountersBucket buckets[PERF_COUNTERS_BUCKETS];
+} PerfCounters;
+
+PerfCounters perf_counters_init(void) {
+    PerfCounters counters = {0};
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+        counters.fds[c] = -1;
+    }
+    return counters;
+}
+
+bool perf_counters_counting(const PerfCounters *counters) {
+    return counters->fds[0] >= 0;
+}
+
+#ifdef PERF_COUNTERS_LINUX
+
+static const Uint64 perf_counter_configs[PERF_COUNTER_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+// the layout read returns for a group with both times
+typedef struct {
+    Uint64 nr;
+    Uint64 time_enabled;
+    Uint64 time_running;
+    Uint64 values[PERF_COUNTER_COUNT];
+} PerfCountersGroupRead;
+
+#endif
+
+void perf_counters_close(PerfCounters *counters) {
+#ifdef PERF_COUNTERS_LINUX
+    for (int c = PERF_COUNTER_COUNT - 1; c >= 0; c--) {
+        if (counters->fds[c] >= 0) close(counters->fds[c]);
+        counters->fds[c] = -1;
+    }
+#endif
+}
+
+// counts the calling thread from now on. False, with the reason in error, when the kernel refuses
+bool perf_counters_open(PerfCounters *counters) {
+    perf_counters_close(counters);
+#ifdef PERF_COUNTERS_LINUX
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+        struct perf_event_attr attr;
+        SDL_zero(attr);
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = perf_counter_configs[c];
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        const int fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, c == 0 ? -1 : counters->fds[0], 0);
+        if (fd < 0) {
+            counters->error = errno;
+            perf_counters_close(counters);
+            return false;
+        }
+        counters->fds[c] = fd;
+    }
+    counters->error = 0;
+    return true;
+#else
+    counters->error = -1;
+    return false;
+#endif
+}
+
+// the group as it stands, one read call. False when not counting
+bool perf_counters_read(PerfCounters *counters, Uint64 values[PERF_COUNTER_COUNT]) {
+#ifdef PERF_COUNTERS_LINUX
+    if (!perf_counters_counting(counters)) return false;
+    PerfCountersGroupRead group;
+    if (read(counters->fds[0], &group, sizeof(group)) != (ssize_t) sizeof(group)) return false;
+    if (group.time_running < group.time_enabled) {
+        counters->multiplexed = true;
+    }
+    SDL_memcpy(values, group.values, sizeof(group.values));
+    return true;
+#else
+    return false;
+#endif
+}
+
+// adds one call that rendered frames with voices active, from the counts before and after it
+void perf_counters_add(
+    PerfCounters *counters, int voices, int frames, const Uint64 begin[PERF_COUNTER_COUNT], const Uint64 end[PERF_COUNTER_COUNT]
+) {
+    PerfCountersBucket *bucket = &counters->buckets[SDL_clamp(voices, 0, PERF_COUNTERS_BUCKETS - 1)];
+    bucket->calls++;
+    bucket->frames += (Uint64) frames;
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+        bucket->counts[c] += end[c] - begin[c];
+    }
+}
+
+// around a call of the audio path, nothing when not counting
+void perf_counters_begin(PerfCounters *counters, int voices) {
+    if (!perf_counters_counting(counters)) return;
+    counters->begin_voices = voices;
+    perf_counters_read(counters, counters->begin);
+}
+
+void perf_counters_end(PerfCounters *counters, int frames) {
+    Uint64 end[PERF_COUNTER_COUNT];
+    if (perf_counters_read(counters, end)) {
+        perf_counters_add(counters, counters->begin_voices, frames, counters->begin, end);
+    }
+}
+
+// drops the counts so far, the counters stay open
+void perf_counters_reset(PerfCounters *counters) {
+    SDL_zeroa(counters->buckets);
+    counters->multiplexed = false;
+}
+
+void perf_counters_log_bucket(const char *label, const PerfCountersBucket *bucket) {
+    const Uint64 *counts = bucket->counts;
+    const double frames = bucket->frames > 0 ? (double) bucket->frames : 1.0;
+    SDL_Log(
+        "%-8s %8llu %7.2f %10.1f %9.0f %10.3f %8.2f%%", label, (unsigned long long) bucket->calls,
+        counts[PERF_COUNTER_CYCLES] > 0 ? (double) counts[PERF_COUNTER_INSTRUCTIONS] / (double) counts[PERF_COUNTER_CYCLES] : 0.0,
+        (double) counts[PERF_COUNTER_CYCLES] / frames,
+        (double) counts[PERF_COUNTER_CYCLES] / (double) SDL_max(bucket->calls, 1),
+        (double) counts[PERF_COUNTER_CACHE_MISSES] / frames,
+        counts[PERF_COUNTER_BRANCHES] > 0 ? 100.0 * (double) counts[PERF_COUNTER_BRANCH_MISSES] / (double) counts[PERF_COUNTER_BRANCHES] : 0.0
+    );
+}
+
+// ui thread, once the counting thread stopped or between its calls. Per voice count and in total, or why
+// nothing was counted, that only once
+void perf_counters_report(PerfCounters *counters, const char *name) {
+    if (counters->error != 0) {
+        SDL_Log(
+            "Perf counters %s: cannot count (%s)", name,
+#ifdef PERF_COUNTERS_LINUX
+            strerror(counters->error)
+#else
+            "not supported here"
+#endif
+        );
+        counters->error = 0;
+        return;
+    }
+    PerfCountersBucket total = {0};
+    for (int v = 0; v < PERF_COUNTERS_BUCKETS; v++) {
+        const PerfCountersBucket *bucket = &counters->buckets[v];
+        total.calls += bucket->calls;
+        total.frames += bucket->frames;
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+            total.counts[c] += bucket->counts[c];
+        }
+    }
+    if (total.calls == 0) return;
+
+    SDL_Log("Perf counters %s%s", name, counters->multiplexed ? ", multiplexed with other events, counts are partial" : "");
+    SDL_Log("%-8s %8s %7s %10s %9s %10s %9s", "voices", "calls", "IPC", "cycles/fr", "cycles", "cmiss/fr", "br miss");
+    for (int v = 0; v < PERF_COUNTERS_BUCKETS; v++) {
+        if (counters->buckets[v].calls == 0) continue;
+        char label[8];
+        SDL_snprintf(label, sizeof(label), "%d", v);
+        perf_counters_log_bucket(label, &counters->buckets[v]);
+    }
+    perf_counters_log_bucket("all", &total);
+}
@@ -0,0 +1,64 @@
+#define _GNU_SOURCE // perf_event_open
+#include "greatest.h"
+#include "perf_counters.c"
+
+#define TEST_LOOP 1000000
+
+TEST perf_counters_buckets_by_voice_count(void) {
+    PerfCounters counters = perf_counters_init();
+    const Uint64 begin[PERF_COUNTER_COUNT] = {1000, 2000, 10, 500, 5};
+    const Uint64 end[PERF_COUNTER_COUNT] = {1512, 3024, 12, 628, 6};
+    perf_counters_add(&counters, 3, 128, begin, end);
+    perf_counters_add(&counters, 3, 128, begin, end);
+    perf_counters_add(&counters, SYNTH_POLYPHONY_DEFAULT + 5, 64, begin, end); // more than the pool holds goes to the last bucket
+
+    const PerfCountersBucket *three = &counters.buckets[3];
+    ASSERT_EQ(2, three->calls);
+    ASSERT_EQ(256, three->frames);
+    ASSERT_EQ(1024, three->counts[PERF_COUNTER_CYCLES]);
+    ASSERT_EQ(2048, three->counts[PERF_COUNTER_INSTRUCTIONS]);
+    ASSERT_EQ(2, three->counts[PERF_COUNTER_BRANCH_MISSES]);
+    ASSERT_EQ(1, counters.buckets[SYNTH_POLYPHONY_DEFAULT].calls);
+    ASSERT_FALSE(perf_counters_counting(&counters));
+
+    perf_counters_reset(&counters);
+    ASSERT_EQ(0, counters.buckets[3].calls);
+    PASS();
+}
+
+TEST perf_counters_count_this_thread(void) {
+    PerfCounters counters = perf_counters_init();
+    if (!perf_counters_open(&counters)) {
+        perf_counters_report(&counters, "test");
+        SKIPm("no hardware counters here");
+    }
+    volatile Uint64 sum = 0;
+    perf_counters_begin(&counters, 1);
+    for (int i = 0; i < TEST_LOOP; i++) {
+        sum += (Uint64) i;
+    }
+    perf_counters_end(&counters, TEST_LOOP);
+    perf_counters_close(&counters);
+
+    // a few instructions an iteration at least, the loop branch is taken every time but the last
+    const PerfCountersBucket *bucket = &counters.buckets[1];
+    ASSERT_EQ(1, bucket->calls);
+    ASSERT(bucket->counts[PERF_COUNTER_INSTRUCTIONS] >= TEST_LOOP);
+    ASSERT(bucket->counts[PERF_COUNTER_BRANCHES] >= TEST_LOOP);
+    ASSERT(bucket->counts[PERF_COUNTER_CYCLES] > 0);
+    perf_counters_report(&counters, "test loop");
+    PASS();
+}
+
+SUITE(perf_counters_suite) {
+    RUN_TEST(perf_counters_buckets_by_voice_count);
+    RUN_TEST(perf_counters_count_this_thread);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(perf_counters_suite);
+    GREATEST_MAIN_END();
+}
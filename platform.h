@@ -0,0 +1,278 @@
+/*
+    The part of SDL the engine uses: sized integers, math and memory, atomics, logging,
+    threads and semaphores, the performance counter. The engine sources include this file in
+    place of SDL. The synth builds with SDL and this file includes SDL itself. Built with
+    -DSYNTH_NO_SDL, as libsynth is, the same names come from the C library, POSIX threads
+    and the atomics of GCC and Clang instead, so a host embeds the engine without SDL.
+    Only the names the engine uses are here. The trace recorder and the real-time checks,
+    -DTRACE and -DRT_CHECK, need the whole of SDL.
+    clock_gettime, nanosleep and posix_memalign are POSIX, which -std=c99 hides. The feature
+    macro only takes effect before the first system header, synth.c is included first for that.
+*/
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#ifndef SYNTH_NO_SDL
+#include <SDL3/SDL.h>
+#else
+
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(TRACE) || defined(RT_CHECK)
+#error "the trace recorder and the real-time checks need SDL"
+#endif
+
+typedef uint8_t Uint8;
+typedef int16_t Sint16;
+typedef uint16_t Uint16;
+typedef int32_t Sint32;
+typedef uint32_t Uint32;
+typedef int64_t Sint64;
+typedef uint64_t Uint64;
+
+#define SDLCALL
+#define SDL_PI_F 3.141592653589793238462643383279502884F
+#define SDL_PI_D 3.141592653589793238462643383279502884
+
+#define SDL_min(x, y) (((x) < (y)) ? (x) : (y))
+#define SDL_max(x, y) (((x) > (y)) ? (x) : (y))
+#define SDL_clamp(x, a, b) (((x) < (a)) ? (a) : (((x) > (b)) ? (b) : (x)))
+#define SDL_arraysize(array) (sizeof(array) / sizeof(array[0]))
+#define SDL_COMPILE_TIME_ASSERT(name, x) typedef int SDL_compile_time_assert_##name[(x) * 2 - 1]
+
+#define SDL_fabsf fabsf
+#define SDL_sqrtf sqrtf
+#define SDL_sinf sinf
+#define SDL_cosf cosf
+#define SDL_logf logf
+#define SDL_copysignf copysignf
+#define SDL_sqrt sqrt
+#define SDL_sin sin
+#define SDL_cos cos
+
+#define SDL_memset memset
+#define SDL_memcpy memcpy
+#define SDL_memmove memmove
+#define SDL_memcmp memcmp
+#define SDL_zero(x) memset(&(x), 0, sizeof(x))
+#define SDL_zerop(x) memset((x), 0, sizeof(*(x)))
+#define SDL_zeroa(x) memset((x), 0, sizeof(x))
+#define SDL_malloc malloc
+#define SDL_calloc calloc
+#define SDL_realloc realloc
+#define SDL_free free
+#define SDL_strcmp strcmp
+#define SDL_atoi atoi
+#define SDL_snprintf snprintf
+
+// copies at most max_length - 1 bytes and terminates, returns the length of src
+static inline size_t SDL_strlcpy(char *dst, const char *src, size_t max_length) {
+    const size_t length = strlen(src);
+    if (max_length > 0) {
+        const size_t n = SDL_min(length, max_length - 1);
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return length;
+}
+
+static inline void *SDL_aligned_alloc(size_t alignment, size_t size) {
+    void *memory = NULL;
+    return posix_memalign(&memory, alignment, size) == 0 ? memory : NULL;
+}
+
+static inline void SDL_aligned_free(void *memory) {
+    free(memory);
+}
+
+static inline void SDL_Log(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+typedef struct {
+    int value;
+} SDL_AtomicInt;
+
+static inline int SDL_GetAtomicInt(SDL_AtomicInt *a) {
+    return __atomic_load_n(&a->value, __ATOMIC_SEQ_CST);
+}
+
+static inline int SDL_SetAtomicInt(SDL_AtomicInt *a, int v) {
+    return __atomic_exchange_n(&a->value, v, __ATOMIC_SEQ_CST);
+}
+
+static inline int SDL_AddAtomicInt(SDL_AtomicInt *a, int v) {
+    return __atomic_fetch_add(&a->value, v, __ATOMIC_SEQ_CST);
+}
+
+static inline bool SDL_CompareAndSwapAtomicInt(SDL_AtomicInt *a, int old_value, int new_value) {
+    return __atomic_compare_exchange_n(&a->value, &old_value, new_value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline void *SDL_GetAtomicPointer(void **a) {
+    return __atomic_load_n(a, __ATOMIC_SEQ_CST);
+}
+
+static inline void *SDL_SetAtomicPointer(void **a, void *v) {
+    return __atomic_exchange_n(a, v, __ATOMIC_SEQ_CST);
+}
+
+static inline Uint64 SDL_GetPerformanceCounter(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (Uint64) now.tv_sec * 1000000000u + (Uint64) now.tv_nsec;
+}
+
+static inline Uint64 SDL_GetPerformanceFrequency(void) {
+    return 1000000000u;
+}
+
+static inline void SDL_Delay(Uint32 ms) {
+    const struct timespec delay = {.tv_sec = ms / 1000, .tv_nsec = (long) (ms % 1000) * 1000000};
+    nanosleep(&delay, NULL);
+}
+
+static inline int SDL_GetNumLogicalCPUCores(void) {
+    return (int) sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+typedef enum {
+    SDL_THREAD_PRIORITY_LOW,
+    SDL_THREAD_PRIORITY_NORMAL,
+    SDL_THREAD_PRIORITY_HIGH,
+    SDL_THREAD_PRIORITY_TIME_CRITICAL,
+} SDL_ThreadPriority;
+
+// without SDL there is no fallback when the real-time policy is refused
+static inline bool SDL_SetCurrentThreadPriority(SDL_ThreadPriority priority) {
+    (void) priority;
+    return false;
+}
+
+typedef int (*SDL_ThreadFunction)(void *data);
+
+typedef struct {
+    pthread_t thread;
+    SDL_ThreadFunction function;
+    void *data;
+    int status;
+} SDL_Thread;
+
+static inline void *SDL_RunThread(void *thread) {
+    SDL_Thread *t = thread;
+    t->status = t->function(t->data);
+    return NULL;
+}
+
+static inline SDL_Thread *SDL_CreateThread(SDL_ThreadFunction function, const char *name, void *data) {
+    (void) name;
+    SDL_Thread *thread = calloc(1, sizeof(SDL_Thread));
+    if (thread == NULL) return NULL;
+    thread->function = function;
+    thread->data = data;
+    if (pthread_create(&thread->thread, NULL, SDL_RunThread, thread) != 0) {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+static inline void SDL_WaitThread(SDL_Thread *thread, int *status) {
+    if (thread == NULL) return;
+    pthread_join(thread->thread, NULL);
+    if (status != NULL) *status = thread->status;
+    free(thread);
+}
+
+#ifndef __APPLE__
+#include <semaphore.h>
+
+// sem_post never blocks, the audio thread signals the workers with it
+typedef struct {
+    sem_t semaphore;
+} SDL_Semaphore;
+
+static inline SDL_Semaphore *SDL_CreateSemaphore(Uint32 initial_value) {
+    SDL_Semaphore *semaphore = calloc(1, sizeof(SDL_Semaphore));
+    if (semaphore != NULL && sem_init(&semaphore->semaphore, 0, initial_value) != 0) {
+        free(semaphore);
+        return NULL;
+    }
+    return semaphore;
+}
+
+static inline void SDL_DestroySemaphore(SDL_Semaphore *semaphore) {
+    if (semaphore == NULL) return;
+    sem_destroy(&semaphore->semaphore);
+    free(semaphore);
+}
+
+static inline void SDL_WaitSemaphore(SDL_Semaphore *semaphore) {
+    while (sem_wait(&semaphore->semaphore) != 0) {} // interrupted by a signal
+}
+
+static inline void SDL_SignalSemaphore(SDL_Semaphore *semaphore) {
+    sem_post(&semaphore->semaphore);
+}
+
+#else
+
+// a counter under a mutex, macOS has no unnamed POSIX semaphores
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    Uint32 count;
+} SDL_Semaphore;
+
+static inline SDL_Semaphore *SDL_CreateSemaphore(Uint32 initial_value) {
+    SDL_Semaphore *semaphore = calloc(1, sizeof(SDL_Semaphore));
+    if (semaphore == NULL) return NULL;
+    pthread_mutex_init(&semaphore->mutex, NULL);
+    pthread_cond_init(&semaphore->condition, NULL);
+    semaphore->count = initial_value;
+    return semaphore;
+}
+
+static inline void SDL_DestroySemaphore(SDL_Semaphore *semaphore) {
+    if (semaphore == NULL) return;
+    pthread_cond_destroy(&semaphore->condition);
+    pthread_mutex_destroy(&semaphore->mutex);
+    free(semaphore);
+}
+
+static inline void SDL_WaitSemaphore(SDL_Semaphore *semaphore) {
+    pthread_mutex_lock(&semaphore->mutex);
+    while (semaphore->count == 0) {
+        pthread_cond_wait(&semaphore->condition, &semaphore->mutex);
+    }
+    semaphore->count--;
+    pthread_mutex_unlock(&semaphore->mutex);
+}
+
+static inline void SDL_SignalSemaphore(SDL_Semaphore *semaphore) {
+    pthread_mutex_lock(&semaphore->mutex);
+    semaphore->count++;
+    pthread_cond_signal(&semaphore->condition);
+    pthread_mutex_unlock(&semaphore->mutex);
+}
+
+#endif
+#endif
+#endif
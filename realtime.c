@@ -0,0 +1,205 @@
+/*
+    Scheduling policy and CPU affinity of the threads of the synth. Each thread calls
+    realtime_setup_thread for its role from inside itself, SDL owns the audio thread so
+    it is set up on the first callback. When a real-time policy is not permitted (no
+    CAP_SYS_NICE or rtprio limit) it falls back to SDL_SetCurrentThreadPriority, which
+    may still get a boost through RealtimeKit.
+    What took effect is kept per role and logged by realtime_log_reports from the UI thread,
+    the audio thread never logs.
+    MIDI is polled on the UI thread, it follows the UI settings.
+*/
+#include "platform.h"
+#if defined(__linux__) && defined(_GNU_SOURCE)
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#define REALTIME_LINUX 1
+#endif
+
+typedef enum {
+    THREAD_ROLE_AUDIO,
+    THREAD_ROLE_WORKER, // dsp workers like the convolution tail
+    THREAD_ROLE_UI, // render, events and midi
+    THREAD_ROLE_COUNT,
+} ThreadRole;
+
+typedef enum {
+    THREAD_POLICY_OTHER, // normal time sharing
+    THREAD_POLICY_FIFO,
+    THREAD_POLICY_RR,
+} ThreadPolicy;
+
+char *thread_role_to_str(ThreadRole role) {
+    switch (role) {
+        case THREAD_ROLE_AUDIO:
+            return "audio";
+        case THREAD_ROLE_WORKER:
+            return "worker";
+        case THREAD_ROLE_UI:
+            return "ui";
+        default:
+            return "?";
+    }
+}
+
+char *thread_policy_to_str(ThreadPolicy policy) {
+    switch (policy) {
+        case THREAD_POLICY_OTHER:
+            return "OTHER";
+        case THREAD_POLICY_FIFO:
+            return "FIFO";
+        case THREAD_POLICY_RR:
+            return "RR";
+        default:
+            return "?";
+    }
+}
+
+typedef struct {
+    ThreadPolicy policy;
+    int priority; // 1 to 99 for FIFO and RR
+    int cpu; // pinned to this cpu, -1 for any; the ui takes every cpu not used by the others
+} ThreadConfig;
+
+typedef struct {
+    SDL_AtomicInt ready; // set by the thread once the fields below are written
+    bool logged;
+    ThreadPolicy policy; // what took effect
+    int priority;
+    bool sdl_priority; // the policy was refused and SDL raised the priority instead
+    int cpu; // -1 when not pinned
+    int error; // errno of the refused policy, 0 when it took effect
+} ThreadReport;
+
+// the audio thread preempts the worker, which preempts everything else
+ThreadConfig thread_configs[THREAD_ROLE_COUNT] = {
+    [THREAD_ROLE_AUDIO] = {.policy = THREAD_POLICY_FIFO, .priority = 80, .cpu = -1},
+    [THREAD_ROLE_WORKER] = {.policy = THREAD_POLICY_FIFO, .priority = 70, .cpu = -1},
+    [THREAD_ROLE_UI] = {.policy = THREAD_POLICY_OTHER, .priority = 0, .cpu = -1},
+};
+ThreadReport thread_reports[THREAD_ROLE_COUNT];
+
+// with 4 or more cpus the audio thread gets the last one and the workers the one before
+void realtime_default_affinity(void) {
+    const int cpus = SDL_GetNumLogicalCPUCores();
+    if (cpus >= 4) {
+        thread_configs[THREAD_ROLE_AUDIO].cpu = cpus - 1;
+        thread_configs[THREAD_ROLE_WORKER].cpu = cpus - 2;
+    }
+}
+
+// --sched fifo|rr|other for the audio and worker threads, --audio-cpu N and --worker-cpu N, -1 for any
+void realtime_parse_args(int argc, char *argv[]) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (SDL_strcmp(argv[i], "--sched") == 0) {
+            const char *name = argv[i + 1];
+            const ThreadPolicy policy = SDL_strcmp(name, "rr") == 0 ? THREAD_POLICY_RR
+                                      : SDL_strcmp(name, "other") == 0 ? THREAD_POLICY_OTHER
+                                      : THREAD_POLICY_FIFO;
+            thread_configs[THREAD_ROLE_AUDIO].policy = policy;
+            thread_configs[THREAD_ROLE_WORKER].policy = policy;
+        }
+        if (SDL_strcmp(argv[i], "--audio-cpu") == 0) {
+            thread_configs[THREAD_ROLE_AUDIO].cpu = SDL_atoi(argv[i + 1]);
+        }
+        if (SDL_strcmp(argv[i], "--worker-cpu") == 0) {
+            thread_configs[THREAD_ROLE_WORKER].cpu = SDL_atoi(argv[i + 1]);
+        }
+    }
+}
+
+#ifdef REALTIME_LINUX
+int realtime_native_policy(ThreadPolicy policy) {
+    switch (policy) {
+        case THREAD_POLICY_FIFO:
+            return SCHED_FIFO;
+        case THREAD_POLICY_RR:
+            return SCHED_RR;
+        default:
+            return SCHED_OTHER;
+    }
+}
+
+// returns the cpu the thread was pinned to, or -1
+int realtime_set_affinity(ThreadRole role) {
+    const int cpus = SDL_GetNumLogicalCPUCores();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (role == THREAD_ROLE_UI) {
+        // every cpu not reserved for the real-time threads
+        for (int cpu = 0; cpu < cpus; cpu++) {
+            if (cpu != thread_configs[THREAD_ROLE_AUDIO].cpu && cpu != thread_configs[THREAD_ROLE_WORKER].cpu) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (CPU_COUNT(&set) == cpus || CPU_COUNT(&set) == 0) return -1;
+    } else {
+        const int cpu = thread_configs[role].cpu;
+        if (cpu < 0 || cpu >= cpus) return -1;
+        CPU_SET(cpu, &set);
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) return -1;
+    return role == THREAD_ROLE_UI ? -1 : thread_configs[role].cpu;
+}
+#endif
+
+void realtime_setup_thread(ThreadRole role) {
+    const ThreadConfig *config = &thread_configs[role];
+    ThreadReport *report = &thread_reports[role];
+    report->policy = THREAD_POLICY_OTHER;
+    report->priority = 0;
+    report->sdl_priority = false;
+    report->cpu = -1;
+    report->error = 0;
+
+#ifdef REALTIME_LINUX
+    report->cpu = realtime_set_affinity(role);
+    if (config->policy != THREAD_POLICY_OTHER) {
+        const struct sched_param param = {.sched_priority = config->priority};
+        report->error = pthread_setschedparam(pthread_self(), realtime_native_policy(config->policy), &param);
+        if (report->error == 0) {
+            report->policy = config->policy;
+            report->priority = config->priority;
+        }
+    }
+#else
+    report->error = config->policy != THREAD_POLICY_OTHER ? -1 : 0;
+#endif
+    if (report->error != 0) {
+        report->sdl_priority = SDL_SetCurrentThreadPriority(
+            role == THREAD_ROLE_AUDIO ? SDL_THREAD_PRIORITY_TIME_CRITICAL : SDL_THREAD_PRIORITY_HIGH
+        );
+    }
+    SDL_SetAtomicInt(&report->ready, 1);
+}
+
+// from the ui thread, logs each report once as the threads come up
+void realtime_log_reports(void) {
+    for (int role = 0; role < THREAD_ROLE_COUNT; role++) {
+        ThreadReport *report = &thread_reports[role];
+        if (report->logged || !SDL_GetAtomicInt(&report->ready)) continue;
+        report->logged = true;
+
+        const ThreadConfig *config = &thread_configs[role];
+        char cpu[32] = "any cpu";
+        if (report->cpu >= 0) {
+            SDL_snprintf(cpu, sizeof(cpu), "cpu %d", report->cpu);
+        } else if (role == THREAD_ROLE_UI && (thread_configs[THREAD_ROLE_AUDIO].cpu >= 0 || thread_configs[THREAD_ROLE_WORKER].cpu >= 0)) {
+            SDL_snprintf(cpu, sizeof(cpu), "cpus left by audio and workers");
+        }
+        if (report->error == 0) {
+            SDL_Log("Thread %s: %s %d, %s", thread_role_to_str(role), thread_policy_to_str(report->policy), report->priority, cpu);
+        } else {
+            SDL_Log(
+                "Thread %s: %s %d refused (%s), %s, %s",
+                thread_role_to_str(role), thread_policy_to_str(config->policy), config->priority,
+#ifdef REALTIME_LINUX
+                strerror(report->error),
+#else
+                "not supported here",
+#endif
+                report->sdl_priority ? "SDL raised the priority" : "normal priority", cpu
+            );
+        }
+    }
+}
@@ -0,0 +1,249 @@
+/*
+    Recording of the synth output, exactly what the audio callback hands the device, into WAV
+    files. The audio thread only copies each block into a ring, sized for seconds of audio, and
+    wakes the writer thread every few blocks. The writer owns the files: it appends the blocks
+    through a large stdio buffer and never makes the callback wait. When the ring is full the
+    block is dropped and counted, the callback goes on.
+    A take runs from recorder_start to recorder_stop, the blocks carry the take they belong to,
+    so those the callback pushed after a stop never end up in the next take. Every take is a
+    new file named after the path: recording.wav is written as recording_001.wav, then
+    recording_002.wav and so on. A file of a long take is cut when the 32-bit sizes of WAV
+    would overflow, past three hours of stereo at 44.1 kHz, and the take goes on in the next
+    file without a gap.
+    The memory is fixed once set up, so a take of hours does not grow it. On Linux the file is
+    allocated ahead in big steps, the disk space is found up front instead of at every write,
+    and trimmed to its size when closed. The header is written again every few seconds, a file
+    stays readable up to then if the process dies.
+*/
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include <stdio.h>
+#include "synth.h"
+#if defined(__linux__) && defined(_GNU_SOURCE)
+#include <fcntl.h>
+#include <unistd.h>
+#define RECORDER_PREALLOCATE 1
+#endif
+
+#define RECORDER_QUEUE_SIZE 4096 // blocks, 12 s of audio at 44.1 kHz
+#define RECORDER_WAKE_BLOCKS 16 // pushed before the writer is woken
+#define RECORDER_WRITE_BUFFER (1 << 20) // bytes, of each fwrite that reaches the disk
+#define RECORDER_PREALLOCATE_BYTES (64 << 20) // allocated ahead of the end of the file
+#define RECORDER_HEADER_SECONDS 5 // between writes of the header
+#define RECORDER_PATH_MAX 512
+
+typedef struct {
+    int take; // the take it belongs to
+    int frames;
+    float samples[SYNTH_BLOCK * SYNTH_CHANNELS]; // interleaved
+} RecorderBlock;
+
+typedef struct {
+    const char *path; // NULL when not set up
+    int channels;
+    int sample_rate;
+    Arena arena;
+    Ring queue; // audio to writer
+    SDL_Thread *writer;
+    SDL_Semaphore *wake;
+    SDL_AtomicInt quit;
+    SDL_AtomicInt take; // recording while not 0, the ui writes it, the audio thread reads it
+    SDL_AtomicInt dropped; // frames, the ring was full
+    SDL_AtomicInt seconds; // written of the current take
+    int takes; // ui thread, started so far
+    int pushed; // audio thread, since the writer was woken
+
+    // writer thread
+    char *buffer;
+    FILE *file;
+    char file_path[RECORDER_PATH_MAX];
+    int file_count;
+    int file_take; // of the open file, 0 when none
+    int last_take; // the latest take seen, older blocks are dropped
+    Uint32 file_frames;
+    Uint32 file_frames_max; // then the take goes on in a new file
+    Uint32 header_frames; // when the header was last written
+    Uint64 allocated; // bytes of the file on disk
+    Uint64 take_frames;
+} Recorder;
+
+// writer thread, the data written so far described by the header, the file position is kept
+void recorder_write_header(Recorder *recorder) {
+    Uint8 header[WAV_HEADER_SIZE];
+    wav_header(header, recorder->channels, recorder->sample_rate, recorder->file_frames);
+    fpos_t end; // past 2 GiB, where a long offset may not reach
+    fgetpos(recorder->file, &end);
+    fseek(recorder->file, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), recorder->file);
+    fsetpos(recorder->file, &end);
+    recorder->header_frames = recorder->file_frames;
+}
+
+// writer thread, the next file of the take. A file that cannot be written loses its blocks
+void recorder_file_open(Recorder *recorder) {
+    recorder->file_count++;
+    const char *extension = SDL_strrchr(recorder->path, '.');
+    const int stem = extension != NULL && SDL_strcasecmp(extension, ".wav") == 0
+        ? (int) (extension - recorder->path) : (int) SDL_strlen(recorder->path);
+    SDL_snprintf(recorder->file_path, sizeof(recorder->file_path), "%.*s_%03d.wav", stem, recorder->path, recorder->file_count);
+    recorder->file = fopen(recorder->file_path, "wb");
+    recorder->file_frames = 0;
+    recorder->allocated = 0;
+    if (recorder->file == NULL) {
+        SDL_Log("Recording %s: cannot write", recorder->file_path);
+        return;
+    }
+    setvbuf(recorder->file, recorder->buffer, _IOFBF, RECORDER_WRITE_BUFFER);
+    Uint8 header[WAV_HEADER_SIZE];
+    wav_header(header, recorder->channels, recorder->sample_rate, 0);
+    fwrite(header, 1, sizeof(header), recorder->file);
+    recorder->header_frames = 0;
+    SDL_Log("Recording %s", recorder->file_path);
+}
+
+void recorder_file_close(Recorder *recorder) {
+    if (recorder->file == NULL) return;
+    recorder_write_header(recorder);
+    fflush(recorder->file);
+#ifdef RECORDER_PREALLOCATE
+    // what was allocated ahead and not written goes back to the disk
+    const off_t size = WAV_HEADER_SIZE + (off_t) recorder->file_frames * recorder->channels * (off_t) sizeof(float);
+    if (ftruncate(fileno(recorder->file), size) != 0) {
+        SDL_Log("Recording %s: cannot trim the space allocated ahead", recorder->file_path);
+    }
+#endif
+    fclose(recorder->file);
+    recorder->file = NULL;
+    SDL_Log("Recording %s: %.1f s", recorder->file_path, (double) recorder->file_frames / recorder->sample_rate);
+}
+
+// writer thread, appends a block of the open take
+void recorder_file_write(Recorder *recorder, const RecorderBlock *block) {
+    if (recorder->file_frames_max - recorder->file_frames < (Uint32) block->frames) {
+        recorder_file_close(recorder);
+        recorder_file_open(recorder);
+    }
+    if (recorder->file == NULL) return;
+    const Uint64 end = WAV_HEADER_SIZE + ((Uint64) recorder->file_frames + block->frames) * recorder->channels * sizeof(float);
+#ifdef RECORDER_PREALLOCATE
+    if (end > recorder->allocated) {
+        // a file system that cannot allocate ahead is written as it grows
+        if (fallocate(fileno(recorder->file), 0, (off_t) recorder->allocated, RECORDER_PREALLOCATE_BYTES) != 0) {
+            recorder->allocated = UINT64_MAX;
+        } else {
+            recorder->allocated += RECORDER_PREALLOCATE_BYTES;
+        }
+    }
+#else
+    recorder->allocated = end;
+#endif
+    if (!wav_write_samples(recorder->file, block->samples, (size_t) block->frames * recorder->channels)) {
+        SDL_Log("Recording %s: write failed, the take stops here", recorder->file_path);
+        recorder_file_close(recorder);
+        return;
+    }
+    recorder->file_frames += (Uint32) block->frames;
+    recorder->take_frames += (Uint64) block->frames;
+    SDL_SetAtomicInt(&recorder->seconds, (int) (recorder->take_frames / (Uint64) recorder->sample_rate));
+    if (recorder->file_frames - recorder->header_frames >= (Uint32) (RECORDER_HEADER_SECONDS * recorder->sample_rate)) {
+        recorder_write_header(recorder);
+    }
+}
+
+int SDLCALL recorder_writer_thread(void *data) {
+    Recorder *recorder = data;
+    TRACE_THREAD("recorder");
+    for (;;) {
+        SDL_WaitSemaphore(recorder->wake);
+        TRACE_SCOPE("recorder write");
+        const bool quit = SDL_GetAtomicInt(&recorder->quit);
+        RecorderBlock block;
+        while (ring_pop(&recorder->queue, &block)) {
+            if (block.take > recorder->last_take) {
+                // a new take, in a new file
+                recorder_file_close(recorder);
+                recorder->last_take = block.take;
+                recorder->file_take = block.take;
+                recorder->take_frames = 0;
+                recorder_file_open(recorder);
+            }
+            if (block.take == recorder->file_take) {
+                recorder_file_write(recorder, &block);
+            }
+        }
+        // stopped, the blocks the callback pushed after the stop are dropped when they come
+        if (recorder->file_take != 0 && SDL_GetAtomicInt(&recorder->take) != recorder->file_take) {
+            recorder_file_close(recorder);
+            recorder->file_take = 0;
+        }
+        if (quit) break;
+    }
+    return 0;
+}
+
+// the writer thread points into the recorder, so it is not returned by value. The takes are numbered after path
+void recorder_init(Recorder *recorder, const char *path, int channels, int sample_rate) {
+    assert(channels == SYNTH_CHANNELS);
+    SDL_zerop(recorder);
+    recorder->path = path;
+    recorder->channels = channels;
+    recorder->sample_rate = sample_rate;
+    recorder->file_frames_max = WAV_DATA_MAX / (Uint32) (channels * sizeof(float));
+    recorder->arena = arena_init(ring_footprint(sizeof(RecorderBlock), RECORDER_QUEUE_SIZE));
+    recorder->queue = ring_init(&recorder->arena, sizeof(RecorderBlock), RECORDER_QUEUE_SIZE);
+    recorder->buffer = SDL_malloc(RECORDER_WRITE_BUFFER);
+    recorder->wake = SDL_CreateSemaphore(0);
+    recorder->writer = SDL_CreateThread(recorder_writer_thread, "recorder", recorder);
+    assert(recorder->buffer != NULL && recorder->wake != NULL && recorder->writer != NULL);
+}
+
+bool recorder_recording(Recorder *recorder) {
+    return SDL_GetAtomicInt(&recorder->take) != 0;
+}
+
+// ui thread, the next block of the callback starts a new take
+void recorder_start(Recorder *recorder) {
+    if (recorder->path == NULL) return;
+    recorder->takes++;
+    SDL_SetAtomicInt(&recorder->take, recorder->takes);
+}
+
+// ui thread, the writer closes the file once the blocks queued so far are written
+void recorder_stop(Recorder *recorder) {
+    if (recorder->path == NULL) return;
+    SDL_SetAtomicInt(&recorder->take, 0);
+    SDL_SignalSemaphore(recorder->wake);
+}
+
+// audio thread, never blocks. A block of the output, nothing while not recording
+void recorder_push(Recorder *recorder, const float *samples, int frames) {
+    const int take = SDL_GetAtomicInt(&recorder->take);
+    if (take == 0) return;
+    assert(frames <= SYNTH_BLOCK);
+    RecorderBlock block = {.take = take, .frames = frames};
+    SDL_memcpy(block.samples, samples, (size_t) frames * SYNTH_CHANNELS * sizeof(float));
+    if (!ring_push(&recorder->queue, &block)) {
+        SDL_AddAtomicInt(&recorder->dropped, frames);
+        return;
+    }
+    if (++recorder->pushed >= RECORDER_WAKE_BLOCKS) {
+        recorder->pushed = 0;
+        SDL_SignalSemaphore(recorder->wake);
+    }
+}
+
+// once the callback stopped, writes what is still queued and closes the file
+void recorder_close(Recorder *recorder) {
+    if (recorder->path == NULL) return;
+    SDL_SetAtomicInt(&recorder->take, 0);
+    SDL_SetAtomicInt(&recorder->quit, 1);
+    SDL_SignalSemaphore(recorder->wake);
+    SDL_WaitThread(recorder->writer, NULL);
+    SDL_DestroySemaphore(recorder->wake);
+    SDL_free(recorder->buffer);
+    arena_free(&recorder->arena);
+    if (recorder->takes > 0) {
+        SDL_Log("Recording: %d takes, %d frames dropped", recorder->takes, SDL_GetAtomicInt(&recorder->dropped));
+    }
+    SDL_zerop(recorder);
+}
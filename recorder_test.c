@@ -0,0 +1,104 @@
+#define _GNU_SOURCE // fallocate
+#include <stdio.h>
+#include "greatest.h"
+#include "trace.c"
+#include "arena.c"
+#include "ring.c"
+#include "wav.c"
+#include "recorder.c"
+
+#define TEST_SAMPLE_RATE 200 // low, the header is written again every 1000 frames
+#define TEST_PATH "recorder_test.wav"
+#define TEST_FRAMES_MAX 4096
+
+static float test_samples[TEST_FRAMES_MAX * SYNTH_CHANNELS];
+
+// pushes frames of a ramp that goes on from first, as the callback would in blocks
+static void push_ramp(Recorder *recorder, int first, int frames) {
+    float block[SYNTH_BLOCK * SYNTH_CHANNELS];
+    for (int done = 0; done < frames; done += SYNTH_BLOCK) {
+        const int n = SDL_min(frames - done, SYNTH_BLOCK);
+        for (int f = 0; f < n; f++) {
+            block[2 * f] = (float) (first + done + f);
+            block[2 * f + 1] = -(float) (first + done + f);
+        }
+        recorder_push(recorder, block, n);
+    }
+}
+
+// the frames of a recorded file into test_samples, -1 when it cannot be read or its header is wrong
+static int read_recording(int number) {
+    char path[64];
+    SDL_snprintf(path, sizeof(path), "recorder_test_%03d.wav", number);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return -1;
+    Uint8 header[WAV_HEADER_SIZE];
+    const size_t header_size = fread(header, 1, sizeof(header), file);
+    const size_t samples = fread(test_samples, sizeof(float), TEST_FRAMES_MAX * SYNTH_CHANNELS, file);
+    fclose(file);
+    remove(path);
+    const Uint32 frames = (Uint32) header[46] | (Uint32) header[47] << 8 | (Uint32) header[48] << 16 | (Uint32) header[49] << 24;
+    if (header_size != sizeof(header) || samples != frames * SYNTH_CHANNELS) return -1;
+    return (int) frames;
+}
+
+// the ramp goes on from first in every frame
+static bool is_ramp(int first, int frames) {
+    for (int f = 0; f < frames; f++) {
+        if (test_samples[2 * f] != (float) (first + f) || test_samples[2 * f + 1] != -(float) (first + f)) return false;
+    }
+    return true;
+}
+
+TEST recorder_writes_each_take_into_its_file(void) {
+    static Recorder recorder;
+    recorder_init(&recorder, TEST_PATH, SYNTH_CHANNELS, TEST_SAMPLE_RATE);
+
+    // nothing is kept before a take starts or between takes
+    push_ramp(&recorder, 0, 1000);
+    recorder_start(&recorder);
+    push_ramp(&recorder, 0, 3000);
+    recorder_stop(&recorder);
+    push_ramp(&recorder, 5000, 1000);
+    recorder_start(&recorder);
+    push_ramp(&recorder, 10000, 200);
+    recorder_close(&recorder);
+
+    ASSERT_EQ(3000, read_recording(1));
+    ASSERT(is_ramp(0, 3000));
+    ASSERT_EQ(200, read_recording(2));
+    ASSERT(is_ramp(10000, 200));
+    ASSERT_EQ(-1, read_recording(3));
+    PASS();
+}
+
+TEST recorder_goes_on_in_a_new_file_when_one_is_full(void) {
+    static Recorder recorder;
+    recorder_init(&recorder, TEST_PATH, SYNTH_CHANNELS, TEST_SAMPLE_RATE);
+    recorder.file_frames_max = 1000;
+    recorder_start(&recorder);
+    push_ramp(&recorder, 0, 20 * SYNTH_BLOCK);
+    recorder_close(&recorder);
+
+    // files are cut between blocks, without a gap
+    ASSERT_EQ(7 * SYNTH_BLOCK, read_recording(1));
+    ASSERT(is_ramp(0, 7 * SYNTH_BLOCK));
+    ASSERT_EQ(7 * SYNTH_BLOCK, read_recording(2));
+    ASSERT(is_ramp(7 * SYNTH_BLOCK, 7 * SYNTH_BLOCK));
+    ASSERT_EQ(6 * SYNTH_BLOCK, read_recording(3));
+    ASSERT(is_ramp(14 * SYNTH_BLOCK, 6 * SYNTH_BLOCK));
+    PASS();
+}
+
+SUITE(recorder_suite) {
+    RUN_TEST(recorder_writes_each_take_into_its_file);
+    RUN_TEST(recorder_goes_on_in_a_new_file_when_one_is_full);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(recorder_suite);
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,387 @@
+/*
+    Golden renders: fixed event scripts queued into an engine and rendered offline with
+    engine_render, as the audio callback does, and compared with the buffers stored in golden/.
+    After a change that is meant to change the sound, `make golden` writes them again.
+    The buffers are raw float32 stereo interleaved in the byte order of the machine.
+    The render time of a heavy script is compared with a baseline recorded on this machine
+    in golden/render_time.local, which is not versioned.
+*/
+#include <stdlib.h>
+#include "greatest.h"
+#include "rtcheck.c"
+#include "trace.c"
+#include "simd.c"
+#include "fastmath.c"
+#include "arena.c"
+#include "ring.c"
+#include "oscillator.c"
+#include "note.c"
+#include "filter.c"
+#include "modulation.c"
+#include "patch.c"
+#include "midi_event.c"
+#include "oversampling.c"
+#include "voice.c"
+#include "fft.c"
+#include "convolution.c"
+#include "effects.c"
+#include "watchdog.c"
+#include "engine.c"
+
+#define RENDER_SAMPLE_RATE 44100
+#define RENDER_FRAMES_MAX 44100
+#define GOLDEN_DIR "golden/"
+#define GOLDEN_TOLERANCE 1e-4f // largest difference of any sample
+#define RENDER_TIME_BASELINE GOLDEN_DIR "render_time.local"
+#define RENDER_TIME_TOLERANCE 1.5 // slower than the baseline by more than this fails
+#define RENDER_ALIAS_MAX 1e-2 // energy off the harmonics relative to all of it, -20 dB
+
+typedef struct {
+    int frame;
+    MidiNote note;
+    int velocity; // MIDI, 0 is note off
+} RenderEvent;
+
+typedef struct {
+    const char *name; // golden/<name>.f32
+    void (*setup)(Patch *patch);
+    int oversampling;
+    int polyphony; // 0 for all the voices
+    bool chorus;
+    bool delay;
+    bool reverb;
+    const RenderEvent *events;
+    int n_events;
+    int frames;
+} RenderScript;
+
+static Engine engine;
+static float render_out[RENDER_FRAMES_MAX * ENGINE_CHANNELS];
+static float render_left[RENDER_FRAMES_MAX];
+static float render_right[RENDER_FRAMES_MAX];
+static float golden[RENDER_FRAMES_MAX * ENGINE_CHANNELS];
+
+// the script queued into a new engine as timed MIDI events, rendered a callback block at a time into render_out
+static void render_script(const RenderScript *script, float *left_out, float *right_out) {
+    assert(script->frames <= RENDER_FRAMES_MAX);
+    const float sample_rate = (float) RENDER_SAMPLE_RATE;
+    const EngineConfig config = {.max_polyphony = VOICES_MAX, .max_delay_time = DELAY_MAX_SECONDS};
+    const ImpulseResponse no_ir = {0};
+    Patch patch = patch_init(sample_rate);
+    script->setup(&patch);
+    patch.oversampling = script->oversampling;
+    const bool ready = engine_init(&engine, config, sample_rate, &no_ir, &patch);
+    assert(ready);
+    if (script->polyphony > 0) {
+        voice_pool_set_polyphony(&engine.voice_pool, script->polyphony);
+    }
+    effects_set_enabled(&engine.effects, EFFECT_CHORUS, script->chorus);
+    effects_set_enabled(&engine.effects, EFFECT_DELAY, script->delay);
+    effects_set_enabled(&engine.effects, EFFECT_REVERB, script->reverb);
+    for (int e = 0; e < script->n_events; e++) {
+        const RenderEvent *event = &script->events[e];
+        const MidiEvent midi = {
+            .frame = (Uint64) event->frame,
+            .message = event->velocity > 0 ? midi_message(0x90, event->note, event->velocity) : midi_message(0x80, event->note, 0),
+        };
+        const bool queued = ring_push(&engine.midi_to_audio, &midi);
+        assert(queued);
+    }
+
+    for (int start = 0; start < script->frames; start += ENGINE_BLOCK) {
+        engine_render(&engine, render_out + start * ENGINE_CHANNELS, SDL_min(script->frames - start, ENGINE_BLOCK));
+    }
+    for (int i = 0; i < script->frames; i++) {
+        left_out[i] = render_out[i * ENGINE_CHANNELS];
+        right_out[i] = render_out[i * ENGINE_CHANNELS + 1];
+    }
+    engine_free(&engine);
+}
+
+static void setup_sine(Patch *patch) {
+    patch->volume = 0.5f;
+}
+
+static void setup_saw_ladder_unison(Patch *patch) {
+    patch->oscillator = oscillator_init(WAVE_SAW);
+    patch->oscillator.unison = 4;
+    patch->oscillator.unison_detune = 0.3f;
+    patch->oscillator.unison_spread = 0.8f;
+    patch->filter = filter_init(FILTER_MODE_LADDER, RENDER_SAMPLE_RATE);
+    filter_set_cutoff(&patch->filter, 1500.0f);
+    filter_set_resonance(&patch->filter, 0.6f);
+    patch->env2 = envelope_init(0.01f, 0.05f, 0.2f, 0.05f);
+    mod_matrix_set_slot(&patch->mod_matrix, 0, MOD_SRC_ENV2, MOD_SRC_NONE, MOD_DST_CUTOFF, 2.0f);
+    mod_matrix_compile(&patch->mod_matrix);
+    patch->volume = 0.2f;
+}
+
+static void setup_mono_square(Patch *patch) {
+    patch->oscillator = oscillator_init(WAVE_SQUARE);
+    patch->filter = filter_init(FILTER_MODE_SVF_LOWPASS, RENDER_SAMPLE_RATE);
+    filter_set_cutoff(&patch->filter, 3000.0f);
+    mod_matrix_set_slot(&patch->mod_matrix, 0, MOD_SRC_LFO1, MOD_SRC_NONE, MOD_DST_PULSE_WIDTH, 0.4f);
+    mod_matrix_compile(&patch->mod_matrix);
+    patch->volume = 0.3f;
+}
+
+static void setup_triangle(Patch *patch) {
+    patch->oscillator = oscillator_init(WAVE_TRIANGLE);
+    patch->volume = 0.4f;
+}
+
+static void setup_high_saw(Patch *patch) {
+    patch->oscillator = oscillator_init(WAVE_SAW);
+    patch->volume = 0.5f;
+}
+
+static void setup_heavy(Patch *patch) {
+    setup_saw_ladder_unison(patch);
+    patch->oscillator.unison = 8;
+}
+
+static const RenderEvent single_note[] = {{0, 69, 127}, {2048, 69, 0}};
+static const RenderEvent chord[] = {
+    {0, 48, 102}, {0, 55, 102}, {100, 60, 102}, {2100, 48, 0}, {2100, 55, 0}, {2600, 60, 0},
+};
+static const RenderEvent legato[] = {
+    {0, 57, 127}, {1000, 60, 127}, {1500, 64, 127}, {2000, 64, 0}, {2600, 60, 0}, {3000, 57, 0},
+};
+static const RenderEvent high_note[] = {{0, 96, 127}};
+static const RenderEvent full_chord[] = {
+    {0, 36, 64}, {0, 40, 64}, {0, 43, 64}, {0, 48, 64}, {0, 52, 64}, {0, 55, 64}, {0, 60, 64}, {0, 64, 64},
+    {0, 67, 64}, {0, 72, 64}, {0, 76, 64}, {0, 79, 64}, {0, 84, 64}, {0, 88, 64}, {0, 91, 64}, {0, 96, 64},
+};
+
+static const RenderScript golden_scripts[] = {
+    {.name = "sine_note", .setup = setup_sine, .oversampling = 1, .events = single_note, .n_events = SDL_arraysize(single_note), .frames = 4096},
+    {.name = "saw_ladder_unison_chord", .setup = setup_saw_ladder_unison, .oversampling = 1, .events = chord, .n_events = SDL_arraysize(chord), .frames = 4096},
+    {.name = "mono_square_legato", .setup = setup_mono_square, .oversampling = 1, .polyphony = 1, .events = legato, .n_events = SDL_arraysize(legato), .frames = 4096},
+    {
+        .name = "effects_note", .setup = setup_triangle, .oversampling = 1, .chorus = true, .delay = true, .reverb = true,
+        .events = single_note, .n_events = SDL_arraysize(single_note), .frames = 4096,
+    },
+    {.name = "saw_oversampled_4x", .setup = setup_high_saw, .oversampling = 4, .events = high_note, .n_events = SDL_arraysize(high_note), .frames = 4096},
+};
+
+static bool golden_update(void) {
+    const char *update = getenv("GOLDEN_UPDATE");
+    return update != NULL && update[0] != '\0' && update[0] != '0';
+}
+
+static enum greatest_test_res check_golden(const RenderScript *script) {
+    static char message[256];
+    char path[128];
+    SDL_snprintf(path, sizeof(path), GOLDEN_DIR "%s.f32", script->name);
+    render_script(script, render_left, render_right);
+    const int n = script->frames * ENGINE_CHANNELS;
+
+    if (golden_update()) {
+        FILE *file = fopen(path, "wb");
+        ASSERTm("cannot write the golden buffer, is there a golden/ directory?", file != NULL);
+        const size_t written = fwrite(render_out, sizeof(float), n, file);
+        fclose(file);
+        ASSERT_EQ((size_t) n, written);
+        PASS();
+    }
+
+    FILE *file = fopen(path, "rb");
+    SDL_snprintf(message, sizeof(message), "no golden buffer %s, make golden writes it", path);
+    ASSERTm(message, file != NULL);
+    const size_t read = fread(golden, sizeof(float), RENDER_FRAMES_MAX * ENGINE_CHANNELS, file);
+    fclose(file);
+    ASSERT_EQm("the golden buffer has another length", (size_t) n, read);
+
+    int worst = 0;
+    for (int i = 0; i < n; i++) {
+        if (SDL_fabsf(render_out[i] - golden[i]) > SDL_fabsf(render_out[worst] - golden[worst])) {
+            worst = i;
+        }
+    }
+    const float error = SDL_fabsf(render_out[worst] - golden[worst]);
+    SDL_snprintf(
+        message, sizeof(message), "%s: frame %d %s is %f, golden %f", script->name,
+        worst / 2, worst % 2 ? "right" : "left", render_out[worst], golden[worst]
+    );
+    ASSERTm(message, error <= GOLDEN_TOLERANCE);
+    PASS();
+}
+
+TEST golden_render(const RenderScript *script) {
+    CHECK_CALL(check_golden(script));
+    PASS();
+}
+
+// Hann-windowed spectrum, the energy that is not within a few bins of a harmonic of freq over all of it
+static double alias_ratio(const float *x, int n, float freq) {
+    Arena arena = arena_init(fft_footprint(n) + 2 * arena_align(n * sizeof(float)));
+    const Fft fft = fft_init(&arena, n);
+    float *re = arena_alloc(&arena, n * sizeof(float));
+    float *im = arena_alloc(&arena, n * sizeof(float));
+    for (int i = 0; i < n; i++) {
+        re[i] = x[i] * (0.5f - 0.5f * SDL_cosf(2.0f * SDL_PI_F * (float) i / (float) n));
+    }
+    fft_forward(&fft, re, im);
+
+    const double bin_hz = (double) RENDER_SAMPLE_RATE / n;
+    double total = 0.0;
+    double off_harmonic = 0.0;
+    for (int bin = 1; bin < n / 2; bin++) {
+        const double energy = (double) re[bin] * re[bin] + (double) im[bin] * im[bin];
+        const double hz = bin * bin_hz;
+        const double harmonic = SDL_round(hz / freq) * freq;
+        total += energy;
+        if (harmonic < freq || SDL_fabs(hz - harmonic) > 4.0 * bin_hz) {
+            off_harmonic += energy;
+        }
+    }
+    arena_free(&arena);
+    return off_harmonic / total;
+}
+
+TEST oversampling_keeps_aliasing_down(void) {
+    // a held C7 saw, its upper harmonics fold back between the harmonics when not oversampled
+    RenderScript script = {
+        .name = "", .setup = setup_high_saw, .oversampling = 1, .events = high_note, .n_events = SDL_arraysize(high_note), .frames = 8192,
+    };
+    render_script(&script, render_left, render_right);
+    const double plain = alias_ratio(render_left + 4096, 4096, note_to_freq(96));
+    script.oversampling = 4;
+    render_script(&script, render_left, render_right);
+    const double oversampled = alias_ratio(render_left + 4096, 4096, note_to_freq(96));
+
+    // 4x is about 12 dB cleaner than 1x, the naive saw still folds some harmonics back
+    ASSERT(oversampled < plain * 0.1);
+    ASSERT(oversampled < RENDER_ALIAS_MAX);
+    PASS();
+}
+
+// largest difference between neighbouring samples
+static float largest_step(const float *x, int n) {
+    float step = 0.0f;
+    for (int i = 1; i < n; i++) {
+        step = SDL_max(step, SDL_fabsf(x[i] - x[i - 1]));
+    }
+    return step;
+}
+
+static double window_rms(const float *x, int n) {
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        sum += (double) x[i] * x[i];
+    }
+    return SDL_sqrt(sum / n);
+}
+
+TEST oversampling_switch_does_not_click(void) {
+    // a held sine switched from 1x to 4x and back by publishing the patch, as the O key does
+    const float sample_rate = (float) RENDER_SAMPLE_RATE;
+    const EngineConfig config = {.max_polyphony = 1, .max_delay_time = DELAY_MAX_SECONDS};
+    const ImpulseResponse no_ir = {0};
+    Patch patch = patch_init(sample_rate);
+    setup_sine(&patch);
+    ASSERT(engine_init(&engine, config, sample_rate, &no_ir, &patch));
+    const MidiEvent note_on = {.frame = 0, .message = midi_message(0x90, 69, 127)};
+    ring_push(&engine.midi_to_audio, &note_on);
+
+    const int blocks = 24;
+    for (int b = 0; b < blocks; b++) {
+        if (b == 8 || b == 16) {
+            patch.oversampling = b == 8 ? 4 : 1;
+            patch_publish(&engine.patch_exchange, &patch);
+        }
+        engine_render(&engine, render_out + b * ENGINE_BLOCK * ENGINE_CHANNELS, ENGINE_BLOCK);
+    }
+    for (int i = 0; i < blocks * ENGINE_BLOCK; i++) {
+        render_left[i] = render_out[i * ENGINE_CHANNELS];
+    }
+    engine_free(&engine);
+
+    // the steepest slope of the steady sine, after the attack, bounds every step across both switches
+    const float steady = largest_step(render_left + 4 * ENGINE_BLOCK, 4 * ENGINE_BLOCK);
+    ASSERT(steady > 0.0f);
+    ASSERT(largest_step(render_left + 4 * ENGINE_BLOCK, (blocks - 4) * ENGINE_BLOCK) <= steady * 1.05f);
+    // and the level holds through the crossfades, over windows of about two periods. The paths at the two factors
+    // are a few samples apart, a crossfade between them dips a little, a fade out and in would go down to nothing
+    const int window = 200;
+    for (int s = 8 * ENGINE_BLOCK; s <= 16 * ENGINE_BLOCK; s += 8 * ENGINE_BLOCK) {
+        const double before = window_rms(render_left + s - window, window);
+        for (int start = s - window; start <= s + ENGINE_CROSSFADE_FRAMES; start += 8) {
+            const double rms = window_rms(render_left + start, window);
+            if (SDL_fabs(rms / before - 1.0) > 0.1) {
+                static char message[128];
+                SDL_snprintf(message, sizeof(message), "level %.4f at frame %d, %.4f before the switch", rms, start, before);
+                FAILm(message);
+            }
+        }
+    }
+    PASS();
+}
+
+TEST frame_clock_counts_past_32_bits(void) {
+    // the other threads get the whole count from the low bits the engine publishes
+    static Engine clock; // not initialized, only the clock is used
+    clock.frames = 0xFFFFFF00u;
+    Uint64 seen = 0;
+    engine_advance(&clock, 0);
+    seen = engine_frame_clock(&clock, seen);
+    ASSERT_EQ(clock.frames, seen);
+    for (int b = 0; b < 4; b++) {
+        engine_advance(&clock, ENGINE_BLOCK);
+        seen = engine_frame_clock(&clock, seen);
+        ASSERT_EQ(clock.frames, seen);
+    }
+    ASSERT(seen > 0xFFFFFFFFu);
+    PASS();
+}
+
+TEST render_time_within_baseline(void) {
+    // a 16 note chord of 8 unison saws through the ladder, chorus and reverb. Best of three
+    const RenderScript script = {
+        .name = "", .setup = setup_heavy, .oversampling = 1, .chorus = true, .reverb = true,
+        .events = full_chord, .n_events = SDL_arraysize(full_chord), .frames = RENDER_FRAMES_MAX,
+    };
+    double best = 0.0;
+    for (int run = 0; run < 3; run++) {
+        const Uint64 start = SDL_GetPerformanceCounter();
+        render_script(&script, render_left, render_right);
+        const double seconds = (double) (SDL_GetPerformanceCounter() - start) / (double) SDL_GetPerformanceFrequency();
+        best = run == 0 ? seconds : SDL_min(best, seconds);
+    }
+
+    double baseline = 0.0;
+    FILE *file = golden_update() ? NULL : fopen(RENDER_TIME_BASELINE, "r");
+    if (file == NULL || fscanf(file, "%lf", &baseline) != 1 || baseline <= 0.0) {
+        if (file != NULL) fclose(file);
+        file = fopen(RENDER_TIME_BASELINE, "w");
+        ASSERTm("cannot write the render time baseline", file != NULL);
+        fprintf(file, "%f\n", best);
+        fclose(file);
+        SKIPm("render time baseline recorded");
+    }
+    fclose(file);
+
+    static char message[128];
+    SDL_snprintf(message, sizeof(message), "render took %.3f s, the baseline is %.3f s", best, baseline);
+    ASSERTm(message, best <= baseline * RENDER_TIME_TOLERANCE);
+    PASS();
+}
+
+SUITE(golden_suite) {
+    for (int i = 0; i < (int) SDL_arraysize(golden_scripts); i++) {
+        greatest_set_test_suffix(golden_scripts[i].name);
+        RUN_TEST1(golden_render, &golden_scripts[i]);
+    }
+    RUN_TEST(oversampling_keeps_aliasing_down);
+    RUN_TEST(oversampling_switch_does_not_click);
+    RUN_TEST(frame_clock_counts_past_32_bits);
+    RUN_TEST(render_time_within_baseline);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(golden_suite);
+    GREATEST_MAIN_END();
+}
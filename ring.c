@@ -0,0 +1,69 @@
+/*
+    Single producer, single consumer ring of fixed-size items. Neither side locks or
+    allocates, so either end can be the audio thread. The counters only grow, their
+    difference is the fill, and the capacity is a power of two so they index with a mask.
+*/
+#include "platform.h"
+#include <assert.h>
+
+typedef struct {
+    Uint8 *items;
+    int item_size;
+    int capacity; // items, a power of two
+    SDL_AtomicInt written; // items pushed, written by the producer only
+    SDL_AtomicInt read; // items popped, written by the consumer only
+} Ring;
+
+size_t ring_footprint(int item_size, int capacity) {
+    return arena_align((size_t) item_size * capacity);
+}
+
+Ring ring_init(Arena *arena, int item_size, int capacity) {
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    Ring ring = {
+        .items = arena_alloc(arena, (size_t) item_size * capacity),
+        .item_size = item_size,
+        .capacity = capacity,
+    };
+    return ring;
+}
+
+// neither side uses the ring meanwhile, what was queued is dropped
+void ring_reset(Ring *ring) {
+    SDL_SetAtomicInt(&ring->written, 0);
+    SDL_SetAtomicInt(&ring->read, 0);
+}
+
+int ring_count(Ring *ring) {
+    return (int) ((Uint32) SDL_GetAtomicInt(&ring->written) - (Uint32) SDL_GetAtomicInt(&ring->read));
+}
+
+// producer, false when full
+bool ring_push(Ring *ring, const void *item) {
+    const Uint32 written = (Uint32) SDL_GetAtomicInt(&ring->written);
+    if ((int) (written - (Uint32) SDL_GetAtomicInt(&ring->read)) == ring->capacity) {
+        return false;
+    }
+    SDL_memcpy(ring->items + (size_t) (written & (Uint32) (ring->capacity - 1)) * ring->item_size, item, ring->item_size);
+    SDL_SetAtomicInt(&ring->written, (int) (written + 1)); // publishes the item
+    return true;
+}
+
+// consumer, copies the oldest item without removing it, false when empty
+bool ring_peek(Ring *ring, void *item) {
+    const Uint32 read = (Uint32) SDL_GetAtomicInt(&ring->read);
+    if (read == (Uint32) SDL_GetAtomicInt(&ring->written)) {
+        return false;
+    }
+    SDL_memcpy(item, ring->items + (size_t) (read & (Uint32) (ring->capacity - 1)) * ring->item_size, ring->item_size);
+    return true;
+}
+
+// consumer, false when empty
+bool ring_pop(Ring *ring, void *item) {
+    if (!ring_peek(ring, item)) {
+        return false;
+    }
+    SDL_AddAtomicInt(&ring->read, 1);
+    return true;
+}
@@ -0,0 +1,218 @@
+/*
+    Real-time safety of the audio thread.
+    rt_audio_enter and rt_audio_exit bracket audio_callback. Entering always sets
+    flush-to-zero and denormals-are-zero, denormals are slow on most CPUs.
+    Built with -DRT_CHECK, anything that can block or take unbounded time on the audio
+    thread is recorded with its call site and reported by rt_check_report at exit:
+    allocations (ours and SDL's, through SDL_SetMemoryFunctions), locks and waits,
+    logging, and results that underflowed to a denormal. With -DRT_CHECK_TRAP the first
+    one stops in the debugger instead.
+    The macros at the end of this file wrap the SDL calls, so it must be included before
+    the engine code.
+*/
+#include "platform.h"
+#include <stdio.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <xmmintrin.h>
+#endif
+
+void rt_flush_denormals(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_setcsr(_mm_getcsr() | 0x8040); // FTZ and DAZ
+#elif defined(__aarch64__)
+    Uint64 fpcr;
+    __asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+    __asm__ volatile("msr fpcr, %0" : : "r"(fpcr | (1 << 24))); // FZ
+#endif
+}
+
+#ifdef RT_CHECK
+
+typedef enum {
+    RT_VIOLATION_ALLOC,
+    RT_VIOLATION_LOCK,
+    RT_VIOLATION_LOG,
+    RT_VIOLATION_DENORMAL,
+    RT_VIOLATION_COUNT,
+} RtViolation;
+
+char *rt_violation_to_str(RtViolation violation) {
+    switch (violation) {
+        case RT_VIOLATION_ALLOC:
+            return "allocation";
+        case RT_VIOLATION_LOCK:
+            return "lock or wait";
+        case RT_VIOLATION_LOG:
+            return "logging";
+        case RT_VIOLATION_DENORMAL:
+            return "denormal";
+        default:
+            return "?";
+    }
+}
+
+#define RT_CHECK_SITES_MAX 64
+
+typedef struct {
+    RtViolation violation;
+    const char *file;
+    int line;
+    Uint64 count;
+} RtSite;
+
+// only the audio thread writes these, the report is read after it stopped
+RtSite rt_sites[RT_CHECK_SITES_MAX];
+int rt_sites_count = 0;
+Uint64 rt_sites_dropped = 0;
+
+__thread bool rt_in_audio_thread = false;
+// call site of the wrapped SDL allocation in progress, NULL when SDL allocates by itself
+__thread const char *rt_alloc_file = NULL;
+__thread int rt_alloc_line = 0;
+
+SDL_malloc_func rt_original_malloc;
+SDL_calloc_func rt_original_calloc;
+SDL_realloc_func rt_original_realloc;
+SDL_free_func rt_original_free;
+
+void rt_check_violation(RtViolation violation, const char *file, int line) {
+    if (!rt_in_audio_thread) return;
+#ifdef RT_CHECK_TRAP
+    SDL_TriggerBreakpoint();
+#endif
+    for (int i = 0; i < rt_sites_count; i++) {
+        RtSite *site = &rt_sites[i];
+        if (site->violation == violation && site->line == line && SDL_strcmp(site->file, file) == 0) {
+            site->count++;
+            return;
+        }
+    }
+    if (rt_sites_count == RT_CHECK_SITES_MAX) {
+        rt_sites_dropped++;
+        return;
+    }
+    rt_sites[rt_sites_count++] = (RtSite){.violation = violation, .file = file, .line = line, .count = 1};
+}
+
+void rt_check_site(const char *file, int line) {
+    rt_alloc_file = file;
+    rt_alloc_line = line;
+}
+
+void rt_check_alloc(void) {
+    if (!rt_in_audio_thread) return;
+    rt_check_violation(RT_VIOLATION_ALLOC, rt_alloc_file ? rt_alloc_file : "inside SDL", rt_alloc_line);
+    rt_alloc_file = NULL;
+    rt_alloc_line = 0;
+}
+
+void *SDLCALL rt_malloc(size_t size) {
+    rt_check_alloc();
+    return rt_original_malloc(size);
+}
+
+void *SDLCALL rt_calloc(size_t count, size_t size) {
+    rt_check_alloc();
+    return rt_original_calloc(count, size);
+}
+
+void *SDLCALL rt_realloc(void *memory, size_t size) {
+    rt_check_alloc();
+    return rt_original_realloc(memory, size);
+}
+
+void SDLCALL rt_free(void *memory) {
+    rt_check_alloc();
+    rt_original_free(memory);
+}
+
+// before SDL_Init, the hooks forward to the original functions so earlier allocations stay valid
+void rt_check_init(void) {
+    SDL_GetOriginalMemoryFunctions(&rt_original_malloc, &rt_original_calloc, &rt_original_realloc, &rt_original_free);
+    SDL_SetMemoryFunctions(rt_malloc, rt_calloc, rt_realloc, rt_free);
+}
+
+void rt_clear_fp_flags(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_setcsr(_mm_getcsr() & ~0x3fu);
+#elif defined(__aarch64__)
+    __asm__ volatile("msr fpsr, %0" : : "r"((Uint64) 0));
+#endif
+}
+
+// a result flushed to zero or a denormal operand since rt_clear_fp_flags
+bool rt_denormal_seen(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return (_mm_getcsr() & 0x12) != 0; // UE, DE
+#elif defined(__aarch64__)
+    Uint64 fpsr;
+    __asm__ volatile("mrs %0, fpsr" : "=r"(fpsr));
+    return (fpsr & 0x88) != 0; // IDC, UFC
+#else
+    return false;
+#endif
+}
+
+void rt_audio_enter(void) {
+    rt_flush_denormals();
+    rt_clear_fp_flags();
+    rt_in_audio_thread = true;
+}
+
+// the call site is where the callback ends, the operation itself is not known
+void rt_audio_exit(const char *file, int line) {
+    if (rt_denormal_seen()) {
+        rt_check_violation(RT_VIOLATION_DENORMAL, file, line);
+    }
+    rt_in_audio_thread = false;
+}
+
+void rt_check_report(void) {
+    if (rt_sites_count == 0) {
+        SDL_Log("Real-time check: no violations on the audio thread");
+        return;
+    }
+    SDL_Log("Real-time check: %d call sites with violations on the audio thread", rt_sites_count);
+    for (int i = 0; i < rt_sites_count; i++) {
+        const RtSite *site = &rt_sites[i];
+        SDL_Log(
+            "  %s at %s:%d, %llu times",
+            rt_violation_to_str(site->violation), site->file, site->line, (unsigned long long) site->count
+        );
+    }
+    if (rt_sites_dropped > 0) {
+        SDL_Log("  and %llu more in sites that did not fit", (unsigned long long) rt_sites_dropped);
+    }
+}
+
+// every use below this point is checked, SDL_SignalSemaphore is not wrapped because it never blocks
+#define SDL_malloc(size) (rt_check_site(__FILE__, __LINE__), SDL_malloc(size))
+#define SDL_calloc(count, size) (rt_check_site(__FILE__, __LINE__), SDL_calloc(count, size))
+#define SDL_realloc(memory, size) (rt_check_site(__FILE__, __LINE__), SDL_realloc(memory, size))
+#define SDL_free(memory) (rt_check_site(__FILE__, __LINE__), SDL_free(memory))
+#define SDL_aligned_alloc(alignment, size) (rt_check_violation(RT_VIOLATION_ALLOC, __FILE__, __LINE__), SDL_aligned_alloc(alignment, size))
+#define SDL_aligned_free(memory) (rt_check_violation(RT_VIOLATION_ALLOC, __FILE__, __LINE__), SDL_aligned_free(memory))
+#define SDL_LockMutex(mutex) (rt_check_violation(RT_VIOLATION_LOCK, __FILE__, __LINE__), SDL_LockMutex(mutex))
+#define SDL_LockAudioStream(stream) (rt_check_violation(RT_VIOLATION_LOCK, __FILE__, __LINE__), SDL_LockAudioStream(stream))
+#define SDL_WaitSemaphore(semaphore) (rt_check_violation(RT_VIOLATION_LOCK, __FILE__, __LINE__), SDL_WaitSemaphore(semaphore))
+#define SDL_WaitCondition(condition, mutex) (rt_check_violation(RT_VIOLATION_LOCK, __FILE__, __LINE__), SDL_WaitCondition(condition, mutex))
+#define SDL_Delay(ms) (rt_check_violation(RT_VIOLATION_LOCK, __FILE__, __LINE__), SDL_Delay(ms))
+#define SDL_Log(...) (rt_check_violation(RT_VIOLATION_LOG, __FILE__, __LINE__), SDL_Log(__VA_ARGS__))
+#define printf(...) (rt_check_violation(RT_VIOLATION_LOG, __FILE__, __LINE__), printf(__VA_ARGS__))
+
+#else
+
+void rt_check_init(void) {}
+
+void rt_audio_enter(void) {
+    rt_flush_denormals();
+}
+
+void rt_audio_exit(const char *file, int line) {
+    (void) file;
+    (void) line;
+}
+
+void rt_check_report(void) {}
+
+#endif
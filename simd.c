@@ -0,0 +1,37 @@
+/*
+    Portable SIMD on top of the GCC/Clang vector extensions, compiles to SSE on x86
+    and NEON on ARM without intrinsics. Loads and stores are unaligned.
+*/
+#include <string.h>
+
+#define SIMD_WIDTH 4
+
+typedef float f32x4 __attribute__((vector_size(16)));
+typedef int i32x4 __attribute__((vector_size(16)));
+
+f32x4 simd_load(const float *p) {
+    f32x4 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+void simd_store(float *p, f32x4 v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+f32x4 simd_set1(float x) {
+    return (f32x4){x, x, x, x};
+}
+
+float simd_sum(f32x4 v) {
+    return (v[0] + v[1]) + (v[2] + v[3]);
+}
+
+// dot product of two arrays, n must be a multiple of SIMD_WIDTH
+float simd_dot(const float *a, const float *b, int n) {
+    f32x4 acc = simd_set1(0.0f);
+    for (int i = 0; i < n; i += SIMD_WIDTH) {
+        acc += simd_load(a + i) * simd_load(b + i);
+    }
+    return simd_sum(acc);
+}
@@ -0,0 +1,253 @@
+/*
+    Standard MIDI File player, format 0 and 1. The file is memory-mapped and read lazily:
+    opening only walks the chunk headers, every track keeps a cursor and the next event
+    is the earliest one of all the tracks, so the merged stream is produced one event at
+    a time and nothing is materialized. Tempo changes are followed in merged order, which
+    keeps the tick to frame map exact across tracks.
+    smf_player_fill runs on the ui thread, it parses ahead of the engine and queues
+    channel messages with the frame they are due at. The audio thread delivers them at
+    that sample. Meta events other than tempo and end of track, and sysex, are skipped.
+*/
+#include <SDL3/SDL.h>
+#include <assert.h>
+
+#define SMF_TRACKS_MAX 64
+#define SMF_DEFAULT_TEMPO 500000 // microseconds per quarter note, 120 bpm
+#define SMF_LOOKAHEAD_SECONDS 0.5
+
+typedef struct {
+    const Uint8 *start; // first delta time
+    const Uint8 *end;
+    const Uint8 *pos; // next event, after its delta time
+    Uint64 tick; // of the next event
+    Uint8 running_status;
+    bool done;
+} SmfTrack;
+
+typedef struct {
+    MappedFile file;
+    int format;
+    int n_tracks;
+    int division; // ticks per quarter note, negative for SMPTE timing
+    SmfTrack tracks[SMF_TRACKS_MAX];
+    float sample_rate;
+
+    // tempo map so far, frames are relative to the start of the song
+    Uint64 tempo_tick;
+    double tempo_frame;
+    double frames_per_tick;
+
+    // playback
+    bool playing;
+    Uint64 start_frame; // engine frame of tick 0
+    MidiEvent pending; // parsed but not queued yet, the queue was full
+    bool has_pending;
+} SmfPlayer;
+
+Uint32 smf_read_be(const Uint8 *p, int bytes) {
+    Uint32 value = 0;
+    for (int i = 0; i < bytes; i++) value = value << 8 | p[i];
+    return value;
+}
+
+// variable length quantity, the track ends if it runs past the end
+Uint32 smf_read_vlq(SmfTrack *track) {
+    Uint32 value = 0;
+    for (int i = 0; i < 4; i++) {
+        if (track->pos >= track->end) {
+            track->done = true;
+            return 0;
+        }
+        const Uint8 byte = *track->pos++;
+        value = value << 7 | (byte & 0x7F);
+        if (!(byte & 0x80)) return value;
+    }
+    track->done = true;
+    return 0;
+}
+
+void smf_track_read_delta(SmfTrack *track) {
+    if (track->pos >= track->end) {
+        track->done = true;
+        return;
+    }
+    track->tick += smf_read_vlq(track);
+}
+
+void smf_set_tempo(SmfPlayer *player, Uint64 tick, Uint32 microseconds_per_quarter) {
+    if (player->division < 0) return; // SMPTE time does not follow the tempo
+    player->tempo_frame += (double) (tick - player->tempo_tick) * player->frames_per_tick;
+    player->tempo_tick = tick;
+    player->frames_per_tick = (double) microseconds_per_quarter * 1e-6 * player->sample_rate / player->division;
+}
+
+double smf_tick_to_frame(const SmfPlayer *player, Uint64 tick) {
+    return player->tempo_frame + (double) (tick - player->tempo_tick) * player->frames_per_tick;
+}
+
+// back to the first event of every track and the default tempo
+void smf_rewind(SmfPlayer *player) {
+    for (int i = 0; i < player->n_tracks; i++) {
+        SmfTrack *track = &player->tracks[i];
+        track->pos = track->start;
+        track->tick = 0;
+        track->running_status = 0;
+        track->done = false;
+        smf_track_read_delta(track);
+    }
+    player->tempo_tick = 0;
+    player->tempo_frame = 0.0;
+    if (player->division < 0) {
+        const int fps = -(Sint8) (player->division >> 8);
+        const int ticks_per_frame = player->division & 0xFF;
+        player->frames_per_tick = player->sample_rate / (double) (SDL_max(fps, 1) * SDL_max(ticks_per_frame, 1));
+    } else {
+        player->frames_per_tick = 0.0;
+        smf_set_tempo(player, 0, SMF_DEFAULT_TEMPO);
+    }
+    player->has_pending = false;
+}
+
+// n_tracks is 0 when the file could not be read or is not a MIDI file
+SmfPlayer smf_open(const char *path, float sample_rate) {
+    SmfPlayer player = {.file = mapped_file_open(path), .sample_rate = sample_rate};
+    const Uint8 *data = player.file.data;
+    const size_t size = player.file.size;
+    if (data == NULL || size < 14 || SDL_memcmp(data, "MThd", 4) != 0 || smf_read_be(data + 4, 4) < 6) {
+        SDL_Log("MIDI file %s: cannot read or not a MIDI file", path);
+        mapped_file_close(&player.file);
+        return player;
+    }
+    player.format = (int) smf_read_be(data + 8, 2);
+    const int declared = (int) smf_read_be(data + 10, 2);
+    const Uint32 division = smf_read_be(data + 12, 2);
+    player.division = division & 0x8000 ? (int) division - 0x10000 : (int) division;
+    if (player.format > 1 || player.division == 0) {
+        SDL_Log("MIDI file %s: format %d is not supported", path, player.format);
+        mapped_file_close(&player.file);
+        return player;
+    }
+
+    // only the chunk headers, unknown chunks are skipped
+    size_t offset = 8 + smf_read_be(data + 4, 4);
+    while (offset + 8 <= size && player.n_tracks < SMF_TRACKS_MAX && player.n_tracks < declared) {
+        const size_t length = smf_read_be(data + offset + 4, 4);
+        const size_t body = offset + 8;
+        if (SDL_memcmp(data + offset, "MTrk", 4) == 0) {
+            SmfTrack *track = &player.tracks[player.n_tracks++];
+            track->start = data + body;
+            track->end = data + SDL_min(body + length, size);
+        }
+        offset = body + length;
+    }
+    smf_rewind(&player);
+    return player;
+}
+
+void smf_close(SmfPlayer *player) {
+    mapped_file_close(&player->file);
+    *player = (SmfPlayer){0};
+}
+
+// the next channel message of the merged tracks, frame relative to the start. False at the end
+bool smf_next(SmfPlayer *player, MidiEvent *event) {
+    for (;;) {
+        // earliest track, ties go to the lower track so tempo in track 0 comes first
+        SmfTrack *track = NULL;
+        for (int i = 0; i < player->n_tracks; i++) {
+            SmfTrack *t = &player->tracks[i];
+            if (!t->done && (track == NULL || t->tick < track->tick)) {
+                track = t;
+            }
+        }
+        if (track == NULL) return false;
+        if (track->pos >= track->end) {
+            track->done = true;
+            continue;
+        }
+
+        Uint8 status = *track->pos;
+        if (status & 0x80) {
+            track->pos++;
+        } else if (track->running_status != 0) {
+            status = track->running_status;
+        } else {
+            track->done = true; // data without a status, corrupt
+            continue;
+        }
+
+        if (status == 0xFF) {
+            if (track->pos >= track->end) {
+                track->done = true;
+                continue;
+            }
+            const Uint8 type = *track->pos++;
+            const Uint32 length = smf_read_vlq(track);
+            if (track->done || length > (size_t) (track->end - track->pos)) {
+                track->done = true;
+                continue;
+            }
+            if (type == 0x51 && length == 3) {
+                smf_set_tempo(player, track->tick, smf_read_be(track->pos, 3));
+            }
+            track->pos += length;
+            if (type == 0x2F) {
+                track->done = true;
+                continue;
+            }
+            smf_track_read_delta(track);
+            continue;
+        }
+        if (status == 0xF0 || status == 0xF7) {
+            const Uint32 length = smf_read_vlq(track);
+            if (track->done || length > (size_t) (track->end - track->pos)) {
+                track->done = true;
+                continue;
+            }
+            track->pos += length;
+            track->running_status = 0;
+            smf_track_read_delta(track);
+            continue;
+        }
+
+        track->running_status = status;
+        const int type = status & 0xF0;
+        const int n_data = type == 0xC0 || type == 0xD0 ? 1 : 2;
+        if (track->end - track->pos < n_data) {
+            track->done = true;
+            continue;
+        }
+        const int data1 = track->pos[0];
+        const int data2 = n_data == 2 ? track->pos[1] : 0;
+        track->pos += n_data;
+        event->frame = (Uint64) smf_tick_to_frame(player, track->tick);
+        event->message = midi_message(status, data1, data2);
+        smf_track_read_delta(track);
+        return true;
+    }
+}
+
+// ui thread, tick 0 plays at start_frame of the engine
+void smf_player_start(SmfPlayer *player, Uint64 start_frame) {
+    smf_rewind(player);
+    player->start_frame = start_frame;
+    player->playing = player->n_tracks > 0;
+}
+
+// ui thread, queues the events due before until_frame, stops at the end of the song
+void smf_player_fill(SmfPlayer *player, MidiEventPush push, void *queue, Uint64 until_frame) {
+    while (player->playing) {
+        if (!player->has_pending) {
+            if (!smf_next(player, &player->pending)) {
+                player->playing = false;
+                return;
+            }
+            player->pending.frame += player->start_frame;
+            player->has_pending = true;
+        }
+        if (player->pending.frame >= until_frame || !push(queue, &player->pending)) {
+            return;
+        }
+        player->has_pending = false;
+    }
+}
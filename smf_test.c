@@ -0,0 +1,138 @@
+#include "greatest.h"
+#include "arena.c"
+#include "ring.c"
+#include "mapped_file.c"
+#include "midi_event.c"
+#include "smf.c"
+
+#define TEST_SAMPLE_RATE 48000.0f
+#define TEST_MIDI "smf_test.mid"
+
+// the queue of the engine is a ring of events
+static bool push_to_ring(void *ring, const MidiEvent *event) {
+    return ring_push(ring, event);
+}
+
+static void write_file(const Uint8 *data, size_t size) {
+    FILE *file = fopen(TEST_MIDI, "wb");
+    fwrite(data, 1, size, file);
+    fclose(file);
+}
+
+// format 1, 96 ticks per quarter. Track 0 has the tempo: 120 bpm, 240 bpm from tick 96.
+// Track 1 plays notes with running status, track 2 a CC at the same tick as a note of track 1
+static const Uint8 test_song[] = {
+    'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 3, 0, 96,
+    'M', 'T', 'r', 'k', 0, 0, 0, 18,
+    0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20, // 500000 us per quarter
+    0x60, 0xFF, 0x51, 0x03, 0x03, 0xD0, 0x90, // 250000 us per quarter at tick 96
+    0x00, 0xFF, 0x2F, 0x00,
+    'M', 'T', 'r', 'k', 0, 0, 0, 17,
+    0x00, 0x90, 60, 100, // tick 0
+    0x30, 60, 0, // tick 48, running status
+    0x30, 64, 90, // tick 96
+    0x60, 64, 0, // tick 192
+    0x00, 0xFF, 0x2F, 0x00,
+    'M', 'T', 'r', 'k', 0, 0, 0, 13,
+    0x60, 0xB0, 17, 64, // tick 96
+    0x00, 0xF0, 0x02, 0x01, 0xF7, // sysex, skipped
+    0x00, 0xFF, 0x2F, 0x00,
+};
+
+TEST smf_merges_tracks_in_time(void) {
+    write_file(test_song, sizeof(test_song));
+    SmfPlayer player = smf_open(TEST_MIDI, TEST_SAMPLE_RATE);
+    ASSERT_EQ(1, player.format);
+    ASSERT_EQ(3, player.n_tracks);
+
+    // 250 frames per tick at 120 bpm, 125 after the tempo change
+    const MidiEvent expected[] = {
+        {0, 0x643C90},
+        {12000, 0x003C90},
+        {24000, 0x5A4090},
+        {24000, 0x4011B0},
+        {36000, 0x004090},
+    };
+    MidiEvent event;
+    for (int i = 0; i < (int) SDL_arraysize(expected); i++) {
+        ASSERT(smf_next(&player, &event));
+        ASSERT_EQ(expected[i].frame, event.frame);
+        ASSERT_EQ_FMT(expected[i].message, event.message, "%06x");
+    }
+    ASSERT_FALSE(smf_next(&player, &event));
+    smf_close(&player);
+    remove(TEST_MIDI);
+    PASS();
+}
+
+TEST smf_player_fills_up_to_the_lookahead(void) {
+    write_file(test_song, sizeof(test_song));
+    SmfPlayer player = smf_open(TEST_MIDI, TEST_SAMPLE_RATE);
+    Arena arena = arena_init(ring_footprint(sizeof(MidiEvent), 4));
+    Ring ring = ring_init(&arena, sizeof(MidiEvent), 4);
+
+    smf_player_start(&player, 1000);
+    smf_player_fill(&player, push_to_ring, &ring, 25000);
+    ASSERT_EQ(2, ring_count(&ring));
+
+    // the ring holds 4, the fifth event waits for room
+    smf_player_fill(&player, push_to_ring, &ring, 100000);
+    ASSERT_EQ(4, ring_count(&ring));
+    ASSERT(player.playing);
+    MidiEvent event;
+    ASSERT(ring_pop(&ring, &event));
+    ASSERT_EQ(1000, event.frame);
+    smf_player_fill(&player, push_to_ring, &ring, 100000);
+    ASSERT_FALSE(player.playing);
+    MidiEvent last = {0};
+    while (ring_pop(&ring, &event)) last = event;
+    ASSERT_EQ(37000, last.frame);
+
+    // a restart plays it again from the new frame
+    smf_player_start(&player, 50000);
+    smf_player_fill(&player, push_to_ring, &ring, 100000);
+    ASSERT(ring_pop(&ring, &event));
+    ASSERT_EQ(50000, event.frame);
+
+    arena_free(&arena);
+    smf_close(&player);
+    remove(TEST_MIDI);
+    PASS();
+}
+
+TEST smf_rejects_bad_files(void) {
+    SmfPlayer player = smf_open("smf_test_missing.mid", TEST_SAMPLE_RATE);
+    ASSERT_EQ(0, player.n_tracks);
+
+    const Uint8 not_midi[] = {'R', 'I', 'F', 'F', 0, 0, 0, 6, 0, 1, 0, 1, 0, 96};
+    write_file(not_midi, sizeof(not_midi));
+    player = smf_open(TEST_MIDI, TEST_SAMPLE_RATE);
+    ASSERT_EQ(0, player.n_tracks);
+
+    // a track that claims more bytes than the file has ends where the file does
+    Uint8 truncated[sizeof(test_song)];
+    SDL_memcpy(truncated, test_song, sizeof(test_song));
+    truncated[14 + 7] = 0x7F;
+    write_file(truncated, 14 + 8 + 10);
+    player = smf_open(TEST_MIDI, TEST_SAMPLE_RATE);
+    ASSERT_EQ(1, player.n_tracks);
+    MidiEvent event;
+    ASSERT_FALSE(smf_next(&player, &event));
+    smf_close(&player);
+    remove(TEST_MIDI);
+    PASS();
+}
+
+SUITE(smf_suite) {
+    RUN_TEST(smf_merges_tracks_in_time);
+    RUN_TEST(smf_player_fills_up_to_the_lookahead);
+    RUN_TEST(smf_rejects_bad_files);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(smf_suite);
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,430 @@
+/*
+    The engine as a library, everything of the synth that makes the sound and none of SDL. The
+    engine sources are included here, this is its one translation unit: libsynth is this file
+    built with -DSYNTH_NO_SDL, the synth links it and adds the device, MIDI and ui around it.
+    synth_process takes the events of a block with the frame they are due at. It queues the
+    performance messages into the engine, which plays them at that sample, and stops rendering
+    at each control change to edit the patch and publish it from that frame on. A host with a
+    control thread queues timed events with synth_queue_event instead, the engine plays them
+    at their frame of its clock and hands the others back through synth_poll_messages.
+    A SynthPatch is the engine Patch as plain values, converted when it is handed in. The CC
+    map and the default patch live here, so the synth and every other host sound alike.
+*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // the POSIX calls of platform.h
+#endif
+#include "platform.h"
+#include <assert.h>
+#include "rtcheck.c"
+#include "trace.c"
+#include "simd.c"
+#include "fastmath.c"
+#include "arena.c"
+#include "ring.c"
+#include "midi_event.c"
+#include "oscillator.c"
+#include "note.c"
+#include "filter.c"
+#include "modulation.c"
+#include "patch.c"
+#include "oversampling.c"
+#include "voice.c"
+#include "fft.c"
+#include "convolution.c"
+#include "effects.c"
+#include "watchdog.c"
+#include "engine.c"
+#include "synth.h"
+
+// synth.h repeats the sizes and enums of the engine for hosts that do not see it, in the same order
+SDL_COMPILE_TIME_ASSERT(synth_channels, SYNTH_CHANNELS == ENGINE_CHANNELS);
+SDL_COMPILE_TIME_ASSERT(synth_block, SYNTH_BLOCK == ENGINE_BLOCK);
+SDL_COMPILE_TIME_ASSERT(synth_polyphony, SYNTH_POLYPHONY_DEFAULT == VOICES_MAX);
+SDL_COMPILE_TIME_ASSERT(synth_unison, SYNTH_UNISON_MAX == UNISON_MAX);
+SDL_COMPILE_TIME_ASSERT(synth_oversampling, SYNTH_OVERSAMPLING_MAX == OVERSAMPLING_MAX);
+SDL_COMPILE_TIME_ASSERT(synth_mod_slots, SYNTH_MOD_SLOTS == MOD_MATRIX_SLOTS_MAX);
+SDL_COMPILE_TIME_ASSERT(synth_quality_levels, SYNTH_QUALITY_LEVELS == QUALITY_LEVEL_COUNT);
+SDL_COMPILE_TIME_ASSERT(synth_effects, (int) SYNTH_EFFECT_COUNT == (int) EFFECT_COUNT);
+SDL_COMPILE_TIME_ASSERT(synth_waves, (int) SYNTH_WAVE_TRIANGLE == (int) WAVE_TRIANGLE);
+SDL_COMPILE_TIME_ASSERT(synth_filter_modes, (int) SYNTH_FILTER_COUNT == (int) FILTER_MODE_COUNT);
+SDL_COMPILE_TIME_ASSERT(synth_mod_sources, (int) SYNTH_MOD_SRC_COUNT == (int) MOD_SRC_COUNT);
+SDL_COMPILE_TIME_ASSERT(synth_mod_destinations, (int) SYNTH_MOD_DST_COUNT == (int) MOD_DST_COUNT);
+SDL_COMPILE_TIME_ASSERT(synth_patch_size, sizeof(SynthPatch) == 384); // the record of a patch bank
+
+struct SynthEngine {
+    Engine engine;
+    SynthPatch patch; // handed in or edited by the control changes, the engine renders a published copy
+    bool shed_load;
+};
+
+float map(const float v, const float v_min, const float v_max, const float d_min, const float d_max) {
+    const float slope = (d_max - d_min) / (v_max - v_min);
+    return d_min + slope * (v - v_min);
+}
+
+SynthPatch patch_to_synth(const Patch *patch, const char *name) {
+    SynthPatch synth_patch = {
+        .wave_type = patch->oscillator.wave_type,
+        .pulse_width = patch->oscillator.square_pulse_width,
+        .unison = (Uint32) patch->oscillator.unison,
+        .unison_detune = patch->oscillator.unison_detune,
+        .unison_spread = patch->oscillator.unison_spread,
+        .filter_mode = patch->filter.mode,
+        .cutoff = patch->filter.cutoff,
+        .resonance = patch->filter.resonance,
+        .env1 = {patch->env1.attack, patch->env1.decay, patch->env1.sustain, patch->env1.release},
+        .env2 = {patch->env2.attack, patch->env2.decay, patch->env2.sustain, patch->env2.release},
+        .volume = patch->volume,
+        .control_rate = (Uint32) patch->mod_matrix.control_rate,
+        .oversampling = (Uint32) patch->oversampling,
+    };
+    SDL_strlcpy(synth_patch.name, name, SYNTH_PATCH_NAME_MAX);
+    for (int i = 0; i < MOD_MATRIX_SLOTS_MAX; i++) {
+        const ModSlot *slot = &patch->mod_matrix.slots[i];
+        synth_patch.slots[i] = (SynthModSlot){slot->source, slot->via, slot->destination, slot->amount};
+    }
+    return synth_patch;
+}
+
+// out of range values fall back to the defaults of patch_init
+Patch patch_from_synth(const SynthPatch *synth_patch, float sample_rate) {
+    Patch patch = patch_init(sample_rate);
+    if (synth_patch->wave_type < (Uint32) SYNTH_WAVE_COUNT) {
+        patch.oscillator.wave_type = synth_patch->wave_type;
+    }
+    patch.oscillator.square_pulse_width = SDL_clamp(synth_patch->pulse_width, 0.0f, 1.0f);
+    patch.oscillator.unison = synth_patch->unison >= 1 && synth_patch->unison <= UNISON_MAX ? (int) synth_patch->unison : 1;
+    patch.oscillator.unison_detune = SDL_clamp(synth_patch->unison_detune, 0.0f, 1.0f);
+    patch.oscillator.unison_spread = SDL_clamp(synth_patch->unison_spread, 0.0f, 1.0f);
+    if (synth_patch->filter_mode < (Uint32) FILTER_MODE_COUNT) {
+        filter_set_mode(&patch.filter, synth_patch->filter_mode);
+    }
+    filter_set_cutoff(&patch.filter, synth_patch->cutoff);
+    filter_set_resonance(&patch.filter, synth_patch->resonance);
+    patch.env1 = envelope_init(synth_patch->env1[0], synth_patch->env1[1], synth_patch->env1[2], synth_patch->env1[3]);
+    patch.env2 = envelope_init(synth_patch->env2[0], synth_patch->env2[1], synth_patch->env2[2], synth_patch->env2[3]);
+    patch.volume = SDL_clamp(synth_patch->volume, 0.0f, 1.0f);
+    if (synth_patch->control_rate >= 1 && synth_patch->control_rate <= 1024) {
+        patch.mod_matrix = mod_matrix_init((int) synth_patch->control_rate);
+    }
+    if (synth_patch->oversampling == 1 || synth_patch->oversampling == 2 || synth_patch->oversampling == 4) {
+        patch.oversampling = (int) synth_patch->oversampling;
+    }
+    for (int i = 0; i < MOD_MATRIX_SLOTS_MAX; i++) {
+        const SynthModSlot *slot = &synth_patch->slots[i];
+        if (slot->source < (Uint32) MOD_SRC_COUNT && slot->via < (Uint32) MOD_SRC_COUNT && slot->destination < (Uint32) MOD_DST_COUNT) {
+            mod_matrix_set_slot(&patch.mod_matrix, i, slot->source, slot->via, slot->destination, slot->amount);
+        }
+    }
+    mod_matrix_compile(&patch.mod_matrix);
+    return patch;
+}
+
+SynthPatch synth_patch_init(void) {
+    const Patch init = patch_init(44100.0f); // the rate only sets up the filter, it is not part of a SynthPatch
+    return patch_to_synth(&init, "Init");
+}
+
+// the patch the synth starts with: oscillator, filter, envelopes and routing
+SynthPatch synth_patch_default(void) {
+    SynthPatch patch = synth_patch_init();
+    SDL_strlcpy(patch.name, "Default", sizeof(patch.name));
+    patch.slots[0] = (SynthModSlot){SYNTH_MOD_SRC_LFO1, SYNTH_MOD_SRC_MOD_WHEEL, SYNTH_MOD_DST_PITCH, 0.5f}; // vibrato
+    patch.slots[1] = (SynthModSlot){SYNTH_MOD_SRC_AFTERTOUCH, SYNTH_MOD_SRC_NONE, SYNTH_MOD_DST_CUTOFF, 2.0f};
+    return patch;
+}
+
+bool synth_patch_control_change(SynthPatch *patch, uint32_t message) {
+    if ((message & 0xF0) != 0xB0) {
+        return false;
+    }
+    const int cc_number = (int) ((message >> 8) & 0xFF);
+    const float cc_value = (float) ((message >> 16) & 0xFF);
+    bool patch_changed = false;
+
+    if (cc_number == 93) {
+        // knob 5
+        patch->pulse_width = map(cc_value, 0.0f, 127.0f, 0.0f, 1.0f);
+        patch_changed = true;
+    }
+
+    if (cc_number == 17) {
+        // fader 4
+        patch->volume = map(cc_value, 0.0f, 127.0f, 0.0f, 1.0f);
+        patch_changed = true;
+    }
+
+    if (cc_number == 18) {
+        // knob 6 - filter cutoff, exponential from 20 Hz to 20 kHz
+        const float octaves = map(cc_value, 0.0f, 127.0f, 0.0f, SDL_logf(FILTER_CUTOFF_MAX_HZ / FILTER_CUTOFF_MIN_HZ) / SDL_logf(2.0f));
+        patch->cutoff = SDL_clamp(FILTER_CUTOFF_MIN_HZ * fast_exp2(octaves), FILTER_CUTOFF_MIN_HZ, FILTER_CUTOFF_MAX_HZ);
+        patch_changed = true;
+    }
+
+    if (cc_number == 19) {
+        // knob 7 - filter resonance
+        patch->resonance = map(cc_value, 0.0f, 127.0f, 0.0f, 1.0f);
+        patch_changed = true;
+    }
+
+    if (cc_number == 20) {
+        // knob 8 - unison detune, up to a semitone
+        patch->unison_detune = map(cc_value, 0.0f, 127.0f, 0.0f, 1.0f);
+        patch_changed = true;
+    }
+    return patch_changed;
+}
+
+float synth_patch_wave(const SynthPatch *patch, float phase) {
+    Oscillator oscillator = oscillator_init(patch->wave_type < (Uint32) SYNTH_WAVE_COUNT ? patch->wave_type : WAVE_SINE);
+    oscillator.square_pulse_width = SDL_clamp(patch->pulse_width, 0.0f, 1.0f);
+    return oscillator_next_point(oscillator, 1.0f, phase);
+}
+
+bool synth_is_performance(uint32_t message) {
+    return midi_is_performance(message);
+}
+
+const char *synth_wave_to_str(uint32_t wave) {
+    return wave < (Uint32) SYNTH_WAVE_COUNT ? waves_type_to_str(wave) : "?";
+}
+
+const char *synth_filter_mode_to_str(uint32_t mode) {
+    return mode < (Uint32) SYNTH_FILTER_COUNT ? filter_mode_to_str(mode) : "?";
+}
+
+const char *synth_quality_level_to_str(int level) {
+    return quality_level_to_str(level);
+}
+
+SynthConfig synth_config_default(float sample_rate) {
+    return (SynthConfig) {
+        .sample_rate = sample_rate, .max_polyphony = VOICES_MAX, .max_delay_time = DELAY_MAX_SECONDS, .lock_memory = true,
+    };
+}
+
+SynthEngine *synth_create(const SynthConfig *config) {
+    assert(config->sample_rate > 0.0f && config->max_polyphony > 0);
+    SynthEngine *synth = SDL_calloc(1, sizeof(SynthEngine));
+    if (synth == NULL) {
+        return NULL;
+    }
+    // a copy of the response, cut and normalized for the convolution
+    ImpulseResponse impulse_response = {0};
+    if (config->impulse_response_left != NULL && config->impulse_response_length > 0) {
+        const int length = SDL_min(config->impulse_response_length, (int) (CONVOLUTION_MAX_SECONDS * config->sample_rate));
+        const bool mono = config->impulse_response_right == NULL || config->impulse_response_right == config->impulse_response_left;
+        impulse_response.left = SDL_malloc(length * sizeof(float));
+        impulse_response.right = mono ? impulse_response.left : SDL_malloc(length * sizeof(float));
+        if (impulse_response.left == NULL || impulse_response.right == NULL) {
+            SDL_free(impulse_response.left);
+            SDL_free(impulse_response.right);
+            SDL_free(synth);
+            return NULL;
+        }
+        impulse_response.length = length;
+        SDL_memcpy(impulse_response.left, config->impulse_response_left, length * sizeof(float));
+        if (!mono) {
+            SDL_memcpy(impulse_response.right, config->impulse_response_right, length * sizeof(float));
+        }
+        impulse_response_normalize(&impulse_response);
+    }
+
+    const EngineConfig engine_config = {
+        .max_polyphony = config->max_polyphony,
+        .max_delay_time = config->max_delay_time,
+        .impulse_response_length = impulse_response.length,
+        .worker_setup = {.function = config->worker_setup, .userdata = config->worker_userdata},
+        .lock_required = config->lock_memory,
+    };
+    synth->patch = synth_patch_default();
+    synth->shed_load = config->shed_load;
+    const Patch patch = patch_from_synth(&synth->patch, config->sample_rate);
+    const bool ready = engine_init(&synth->engine, engine_config, config->sample_rate, &impulse_response, &patch);
+    impulse_response_free(&impulse_response);
+    if (!ready) {
+        SDL_free(synth);
+        return NULL;
+    }
+    if (config->max_load > 0.0f) {
+        synth->engine.watchdog = watchdog_init(config->max_load);
+    }
+    return synth;
+}
+
+void synth_destroy(SynthEngine *synth) {
+    if (synth == NULL) return;
+    engine_free(&synth->engine);
+    SDL_free(synth);
+}
+
+void synth_reset(SynthEngine *synth) {
+    const Patch patch = patch_from_synth(&synth->patch, synth->engine.sample_rate);
+    engine_reset(&synth->engine, &patch);
+}
+
+int synth_process(SynthEngine *synth, float **out, int frames, const SynthEvent *events, int n_events) {
+    TRACE_SCOPE("synth_process");
+    Engine *engine = &synth->engine;
+    rt_flush_denormals();
+    const Uint64 start = SDL_GetPerformanceCounter();
+    if (SDL_GetAtomicInt(&engine->midi_flush)) {
+        engine_flush_midi(engine);
+        SDL_SetAtomicInt(&engine->midi_flush, 0);
+    }
+    const Uint64 first_frame = engine->frames;
+    int played = 0;
+    int e = 0;
+
+    for (int done = 0; done < frames;) {
+        // the performance events play at their sample from the queue of the engine, a control change splits the
+        // block and edits the patch at its frame, so the sound does not depend on the block size of the host
+        int end = SDL_min(frames, done + ENGINE_BLOCK);
+        for (; e < n_events && events[e].frame < end; e++) {
+            assert(events[e].frame >= done && (e == 0 || events[e].frame >= events[e - 1].frame));
+            if (!midi_is_performance(events[e].message)) {
+                if (events[e].frame > done) {
+                    end = events[e].frame;
+                    break;
+                }
+                if (synth_patch_control_change(&synth->patch, events[e].message)) {
+                    const Patch patch = patch_from_synth(&synth->patch, engine->sample_rate);
+                    patch_publish(&engine->patch_exchange, &patch);
+                }
+                played++;
+                continue;
+            }
+            const MidiEvent event = {.frame = first_frame + (Uint64) events[e].frame, .message = events[e].message};
+            if (ring_push(&engine->midi_to_audio, &event)) {
+                played++;
+            }
+        }
+
+        const int num_frames = end - done;
+        float samples[ENGINE_BLOCK * ENGINE_CHANNELS]; // interleaved
+        if (engine_idle(engine)) {
+            SDL_memset(samples, 0, sizeof(samples));
+            engine_advance(engine, num_frames);
+        } else {
+            engine_render(engine, samples, num_frames);
+        }
+        for (int f = 0; f < num_frames; f++) {
+            out[0][done + f] = samples[f * ENGINE_CHANNELS];
+            out[1][done + f] = samples[f * ENGINE_CHANNELS + 1];
+        }
+        done = end;
+    }
+    assert(e == n_events); // every event is within the block
+
+    if (synth->shed_load) {
+        watchdog_update(&engine->watchdog, start, SDL_GetPerformanceCounter(), frames, (int) engine->sample_rate);
+    }
+    return played;
+}
+
+uint64_t synth_frames(const SynthEngine *synth) {
+    return synth->engine.frames;
+}
+
+bool synth_idle(SynthEngine *synth) {
+    return engine_idle(&synth->engine);
+}
+
+bool synth_queue_event(SynthEngine *synth, uint64_t frame, uint32_t message) {
+    const MidiEvent event = {.frame = frame, .message = message};
+    return ring_push(&synth->engine.midi_to_audio, &event);
+}
+
+bool synth_events_queued(SynthEngine *synth) {
+    return ring_count(&synth->engine.midi_to_audio) > 0;
+}
+
+bool synth_play_live(SynthEngine *synth, uint32_t message) {
+    return engine_play_live(&synth->engine, message);
+}
+
+int synth_poll_messages(SynthEngine *synth, uint32_t *messages, int max) {
+    patch_reclaim(&synth->engine.patch_exchange);
+    int count = 0;
+    MidiEvent event;
+    while (count < max && ring_pop(&synth->engine.midi_to_ui, &event)) {
+        messages[count++] = event.message;
+    }
+    return count;
+}
+
+void synth_flush(SynthEngine *synth) {
+    SDL_SetAtomicInt(&synth->engine.midi_flush, 1);
+}
+
+bool synth_flushing(SynthEngine *synth) {
+    return SDL_GetAtomicInt(&synth->engine.midi_flush) != 0;
+}
+
+void synth_set_patch(SynthEngine *synth, const SynthPatch *patch) {
+    synth->patch = *patch;
+    const Patch engine_patch = patch_from_synth(patch, synth->engine.sample_rate);
+    patch_publish(&synth->engine.patch_exchange, &engine_patch);
+}
+
+void synth_set_oversampling(SynthEngine *synth, int factor) {
+    assert(factor == 1 || factor == 2 || factor == 4);
+    SynthPatch patch = synth->patch;
+    patch.oversampling = (Uint32) factor;
+    synth_set_patch(synth, &patch);
+}
+
+static const EffectType synth_effect_types[SYNTH_EFFECT_COUNT] = {
+    [SYNTH_EFFECT_CONVOLUTION] = EFFECT_CONVOLUTION,
+    [SYNTH_EFFECT_CHORUS] = EFFECT_CHORUS,
+    [SYNTH_EFFECT_DELAY] = EFFECT_DELAY,
+    [SYNTH_EFFECT_REVERB] = EFFECT_REVERB,
+};
+
+void synth_clear_effect(SynthEngine *synth, SynthEffect effect) {
+    assert(effect >= 0 && effect < SYNTH_EFFECT_COUNT);
+    effects_clear(&synth->engine.effects, synth_effect_types[effect]);
+}
+
+uint64_t synth_frame_clock(SynthEngine *synth, uint64_t seen) {
+    return engine_frame_clock(&synth->engine, seen);
+}
+
+int synth_active_voices(SynthEngine *synth) {
+    return SDL_GetAtomicInt(&synth->engine.voices_active);
+}
+
+void synth_get_stats(SynthEngine *synth, SynthStats *stats) {
+    const Watchdog *watchdog = &synth->engine.watchdog;
+    *stats = (SynthStats) {
+        .load = watchdog->load,
+        .load_peak = watchdog->load_peak,
+        .quality_level = watchdog->level,
+        .overruns = watchdog->overruns,
+        .restores = watchdog->restores,
+        .voices_stolen = watchdog->voices_stolen,
+        .events_late = synth->engine.events_late,
+        .last_note = synth->engine.last_note,
+    };
+    for (int level = 0; level < QUALITY_LEVEL_COUNT; level++) {
+        stats->degrades[level] = watchdog->degrades[level];
+    }
+}
+
+void synth_set_effect(SynthEngine *synth, SynthEffect effect, bool enabled) {
+    assert(effect >= 0 && effect < SYNTH_EFFECT_COUNT);
+    effects_set_enabled(&synth->engine.effects, synth_effect_types[effect], enabled);
+}
+
+bool synth_effect_enabled(SynthEngine *synth, SynthEffect effect) {
+    assert(effect >= 0 && effect < SYNTH_EFFECT_COUNT);
+    return synth->engine.effects.enabled[synth_effect_types[effect]];
+}
+
+void synth_set_polyphony(SynthEngine *synth, int polyphony) {
+    voice_pool_set_polyphony(&synth->engine.voice_pool, polyphony);
+}
+
+int synth_polyphony(SynthEngine *synth) {
+    return synth->engine.voice_pool.polyphony;
+}
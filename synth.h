@@ -0,0 +1,234 @@
+/*
+    libsynth, the engine of the synth without SDL, for hosts of their own. The synth itself is
+    one of them, main.c drives the engine through nothing but this file.
+    A SynthEngine is opaque and holds all of its state, a process runs as many as it wants and
+    separate engines share nothing.
+    One thread renders an engine with synth_process, the render thread: an audio callback or
+    the thread of an offline render. A host with a user interface drives it from one other
+    thread, the control thread, that never waits for the render thread: it queues timed and
+    live events, hands in the patch, takes back the control messages that came due and reads
+    the clock and the counters. Each function says which thread it is for. The setters that
+    say nothing and synth_reset are called while synth_process does not run, a host with an
+    audio callback holds the lock of its stream around them.
+    Build it with make libsynth and link libsynth.a with -lm -lpthread. Only the synth_ names
+    are global in it, so the engine cannot clash with the functions of the host.
+*/
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SYNTH_CHANNELS 2 // out of synth_process, left and right
+#define SYNTH_BLOCK 128 // frames the engine renders at a time, synth_process takes any count
+#define SYNTH_POLYPHONY_DEFAULT 16 // max_polyphony of synth_config_default
+#define SYNTH_UNISON_MAX 16
+#define SYNTH_OVERSAMPLING_MAX 4
+#define SYNTH_MOD_SLOTS 16
+#define SYNTH_PATCH_NAME_MAX 32
+#define SYNTH_QUALITY_LEVELS 5 // full quality and the four steps the load shedding takes down
+
+typedef struct SynthEngine SynthEngine;
+
+// a MIDI channel message packed like PmMessage: status, data1 << 8, data2 << 16. Notes, mod wheel,
+// pressure and all notes off play the engine, the control changes of the synth edit its patch and
+// everything else is ignored
+typedef struct {
+    int frame; // of the block passed to synth_process
+    uint32_t message;
+} SynthEvent;
+
+typedef struct {
+    float sample_rate;
+    int max_polyphony;
+    float max_delay_time; // seconds
+    // the impulse response of the convolution effect, copied, normalized and cut at 10 seconds. NULL for none
+    const float *impulse_response_left;
+    const float *impulse_response_right; // the same as left for a mono response
+    int impulse_response_length; // samples at sample_rate
+    bool shed_load; // lower the quality when a block takes close to its duration, for real-time hosts
+    float max_load; // the fraction of the duration of a block that sheds load, 0 for the default of 0.75
+    // called on the worker thread of the convolution when it starts, for the host to give it the scheduling it
+    // wants. NULL leaves it an ordinary thread
+    void (*worker_setup)(void *userdata);
+    void *worker_userdata;
+    // synth_create fails when the memory of the engine cannot be locked (RLIMIT_MEMLOCK), rather than play from
+    // memory that may be paged out. Off, it is prefaulted only
+    bool lock_memory;
+} SynthConfig;
+
+typedef enum {
+    SYNTH_EFFECT_CONVOLUTION,
+    SYNTH_EFFECT_CHORUS,
+    SYNTH_EFFECT_DELAY,
+    SYNTH_EFFECT_REVERB,
+    SYNTH_EFFECT_COUNT,
+} SynthEffect;
+
+typedef enum {
+    SYNTH_WAVE_SINE,
+    SYNTH_WAVE_SQUARE,
+    SYNTH_WAVE_SAW,
+    SYNTH_WAVE_TRIANGLE,
+    SYNTH_WAVE_COUNT,
+} SynthWave;
+
+typedef enum {
+    SYNTH_FILTER_LOWPASS, // 4 cascaded one-poles, no resonance
+    SYNTH_FILTER_LADDER, // 4-pole ladder with resonance
+    SYNTH_FILTER_SVF_LOWPASS,
+    SYNTH_FILTER_SVF_BANDPASS,
+    SYNTH_FILTER_SVF_HIGHPASS,
+    SYNTH_FILTER_SVF_NOTCH,
+    SYNTH_FILTER_COUNT,
+} SynthFilterMode;
+
+typedef enum {
+    SYNTH_MOD_SRC_NONE,
+    SYNTH_MOD_SRC_LFO1,
+    SYNTH_MOD_SRC_LFO2,
+    SYNTH_MOD_SRC_ENV1,
+    SYNTH_MOD_SRC_ENV2,
+    SYNTH_MOD_SRC_VELOCITY,
+    SYNTH_MOD_SRC_MOD_WHEEL,
+    SYNTH_MOD_SRC_AFTERTOUCH,
+    SYNTH_MOD_SRC_COUNT,
+} SynthModSource;
+
+typedef enum {
+    SYNTH_MOD_DST_PITCH, // amount in semitones
+    SYNTH_MOD_DST_CUTOFF, // amount in octaves
+    SYNTH_MOD_DST_PULSE_WIDTH,
+    SYNTH_MOD_DST_AMPLITUDE,
+    SYNTH_MOD_DST_COUNT,
+} SynthModDestination;
+
+typedef struct {
+    uint32_t source; // SynthModSource
+    uint32_t via; // scales the source, SYNTH_MOD_SRC_NONE to use the source alone
+    uint32_t destination; // SynthModDestination
+    float amount;
+} SynthModSlot;
+
+// a patch as plain values of fixed width, it is also the record of a program in a patch bank file. Values out of
+// range play as those of synth_patch_init
+typedef struct {
+    char name[SYNTH_PATCH_NAME_MAX]; // nul terminated
+    uint32_t wave_type; // SynthWave
+    float pulse_width;
+    uint32_t unison; // stacked copies, 1 to SYNTH_UNISON_MAX
+    float unison_detune; // semitones between the lowest and the highest copy
+    float unison_spread; // stereo width
+    uint32_t filter_mode; // SynthFilterMode
+    float cutoff; // Hz
+    float resonance;
+    float env1[4]; // attack, decay, sustain, release. The amplitude envelope
+    float env2[4];
+    float volume;
+    uint32_t control_rate; // samples between two evaluations of the modulation
+    SynthModSlot slots[SYNTH_MOD_SLOTS];
+    uint32_t oversampling; // of the voices, 1, 2 or 4. 0 in banks written before it, loads as 1
+    uint8_t reserved[20];
+} SynthPatch;
+
+// the load shedding and the timing of the events, for display
+typedef struct {
+    float load; // of the last synth_process, a fraction of the duration of its frames
+    float load_peak; // decays slowly
+    int quality_level; // 0 is full quality
+    uint64_t overruns; // calls that took longer than the duration of their frames
+    uint64_t degrades[SYNTH_QUALITY_LEVELS]; // times each level was entered from above
+    uint64_t restores;
+    uint64_t voices_stolen;
+    uint64_t events_late; // queued events played after the frame they were due at
+    int last_note; // of the latest note on
+} SynthStats;
+
+// the default polyphony and delay time at sample_rate, no impulse response, no load shedding, no worker setup
+// and locked memory
+SynthConfig synth_config_default(float sample_rate);
+
+// the engine plays the default patch with every effect off. NULL when the memory cannot be had or locked
+SynthEngine *synth_create(const SynthConfig *config);
+void synth_destroy(SynthEngine *synth);
+
+// plays as synth_create left it, with the patch it has now: silent, every effect off and the clock at 0
+void synth_reset(SynthEngine *synth);
+
+// render thread. Renders frames of out[0] and out[1], playing the events at their frame. The events are in frame
+// order and within the block. Returns how many were played, fewer when more notes arrive at once than the engine
+// queues. Control changes among them edit the patch like synth_set_patch: a host with a control thread queues its
+// events there instead of passing them here
+int synth_process(SynthEngine *synth, float **out, int frames, const SynthEvent *events, int n_events);
+
+// render thread, the frames rendered so far, the clock of synth_queue_event
+uint64_t synth_frames(const SynthEngine *synth);
+
+// render thread, no voice sounds, the tails of the effects have died out and no event is queued: until the next
+// event the output is silence
+bool synth_idle(SynthEngine *synth);
+
+// control thread, a message played at frame of the clock of the engine, in the order they are queued. Those that
+// do not play the engine come back from synth_poll_messages when they are due. False when the queue is full
+bool synth_queue_event(SynthEngine *synth, uint64_t frame, uint32_t message);
+
+// control thread, whether queued events have not played yet
+bool synth_events_queued(SynthEngine *synth);
+
+// control thread, a performance message, see synth_is_performance, played at the start of the next block. False
+// when the queue is full
+bool synth_play_live(SynthEngine *synth, uint32_t message);
+
+// control thread, up to max of the queued messages that came due and do not play the engine, oldest first. Control
+// and program changes, the host applies them to its patch and hands it in again. Returns the count. It also takes
+// back the patches the engine is done with, a host calls it regularly even without queued events: a patch handed
+// in may wait for it
+int synth_poll_messages(SynthEngine *synth, uint32_t *messages, int max);
+
+// control thread. The next block drops the queued events and releases the voices, synth_flushing until then
+void synth_flush(SynthEngine *synth);
+bool synth_flushing(SynthEngine *synth);
+
+// control thread, the patch plays from the next block on. New notes start with it, the sounding ones follow it
+void synth_set_patch(SynthEngine *synth, const SynthPatch *patch);
+void synth_set_oversampling(SynthEngine *synth, int factor); // 1, 2 or 4, of the patch synth_set_patch handed in
+
+// control thread while the effect is off. Silences it ahead of synth_set_effect, which then leaves it as it is
+// and takes no time
+void synth_clear_effect(SynthEngine *synth, SynthEffect effect);
+
+// any thread. The frames rendered so far without a lock, counted on from seen, the clock this thread got last: it
+// looks at least once every 2^32 frames
+uint64_t synth_frame_clock(SynthEngine *synth, uint64_t seen);
+
+// any thread, the voices that sounded at the end of the last block
+int synth_active_voices(SynthEngine *synth);
+
+// any thread. Written by the render thread and read without a lock, each counter may be a block older than another
+void synth_get_stats(SynthEngine *synth, SynthStats *stats);
+
+// the setters, and the getters from the thread that sets
+void synth_set_effect(SynthEngine *synth, SynthEffect effect, bool enabled);
+bool synth_effect_enabled(SynthEngine *synth, SynthEffect effect);
+void synth_set_polyphony(SynthEngine *synth, int polyphony); // 1 to max_polyphony
+int synth_polyphony(SynthEngine *synth);
+
+// patches, without an engine. synth_patch_init is the plain sine every program of a bank starts from, the default
+// patch adds vibrato on the mod wheel and pressure on the cutoff
+SynthPatch synth_patch_init(void);
+SynthPatch synth_patch_default(void);
+
+// the control changes of the controller the synth was made with. Returns whether the patch changed
+bool synth_patch_control_change(SynthPatch *patch, uint32_t message);
+
+// one period of the oscillator of the patch at phase 0 to 1, from -1 to 1, for displays
+float synth_patch_wave(const SynthPatch *patch, float phase);
+
+// notes, mod wheel, all notes off and pressure play the engine, everything else edits the patch
+bool synth_is_performance(uint32_t message);
+
+const char *synth_wave_to_str(uint32_t wave);
+const char *synth_filter_mode_to_str(uint32_t mode);
+const char *synth_quality_level_to_str(int level);
+
+#endif
@@ -0,0 +1,256 @@
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "greatest.h"
+#include "synth.h"
+
+// linked with libsynth.a, -lm and -lpthread only: the engine must build and play without SDL
+
+#define TEST_SAMPLE_RATE 44100.0f
+#define TEST_FRAMES 32768 // longer than the release of the default patch
+
+// built with AddressSanitizer: an allocation too large for the machine returns NULL, as it would without it
+const char *__asan_default_options(void) {
+    return "allocator_may_return_null=1";
+}
+
+static float left_a[TEST_FRAMES];
+static float right_a[TEST_FRAMES];
+static float left_b[TEST_FRAMES];
+static float right_b[TEST_FRAMES];
+
+static uint32_t message(int status, int data1, int data2) {
+    return (uint32_t) status | (uint32_t) data1 << 8 | (uint32_t) data2 << 16;
+}
+
+static float peak(const float *x, int n) {
+    float peak = 0.0f;
+    for (int i = 0; i < n; i++) {
+        peak = fmaxf(peak, fabsf(x[i]));
+    }
+    return peak;
+}
+
+// the events of the whole render that fall in [start, start + frames), made relative to the block
+static int block_events(const SynthEvent *all, int n_all, int start, int frames, SynthEvent *block) {
+    int n = 0;
+    for (int e = 0; e < n_all; e++) {
+        if (all[e].frame >= start && all[e].frame < start + frames) {
+            block[n] = all[e];
+            block[n].frame -= start;
+            n++;
+        }
+    }
+    return n;
+}
+
+TEST synth_output_ignores_block_sizes(void) {
+    // two engines rendered in turn, one in blocks of the engine and one in odd sizes, sound the same
+    const SynthEvent events[] = {
+        {0, message(0x90, 57, 100)}, {1000, message(0x90, 64, 90)}, {1500, message(0xB0, 18, 40)},
+        {3001, message(0x80, 57, 0)}, {5000, message(0x80, 64, 0)},
+    };
+    const int n_events = (int) (sizeof(events) / sizeof(events[0]));
+    const SynthConfig config = synth_config_default(TEST_SAMPLE_RATE);
+    SynthEngine *a = synth_create(&config);
+    SynthEngine *b = synth_create(&config);
+    ASSERT(a != NULL && b != NULL);
+    synth_set_effect(a, SYNTH_EFFECT_CHORUS, true);
+    synth_set_effect(b, SYNTH_EFFECT_CHORUS, true);
+
+    // up to the end of the releases: a voice goes to sleep at the end of the block its tail fades out in
+    const int total = 12288;
+    SynthEvent block[sizeof(events) / sizeof(events[0])];
+    int start_b = 0;
+    srand(5);
+    for (int start = 0; start < total; start += 128) {
+        float *out_a[] = {left_a + start, right_a + start};
+        int n = block_events(events, n_events, start, 128, block);
+        ASSERT_EQ(n, synth_process(a, out_a, 128, block, n));
+        while (start_b < start + 128) {
+            const int size = rand() % 300 + 1;
+            const int frames = size < total - start_b ? size : total - start_b;
+            float *out_b[] = {left_b + start_b, right_b + start_b};
+            n = block_events(events, n_events, start_b, frames, block);
+            ASSERT_EQ(n, synth_process(b, out_b, frames, block, n));
+            start_b += frames;
+        }
+    }
+    synth_destroy(a);
+    synth_destroy(b);
+    ASSERT(peak(left_a, total) > 0.01f);
+    ASSERT_MEM_EQ(left_a, left_b, total * sizeof(float));
+    ASSERT_MEM_EQ(right_a, right_b, total * sizeof(float));
+    PASS();
+}
+
+TEST synth_note_sounds_until_released(void) {
+    const SynthConfig config = synth_config_default(TEST_SAMPLE_RATE);
+    SynthEngine *synth = synth_create(&config);
+    ASSERT(synth != NULL);
+    float *out[] = {left_a, right_a};
+
+    // silent before the note, sounding from its frame on
+    const SynthEvent note_on = {100, message(0x90, 69, 127)};
+    synth_process(synth, out, 1024, &note_on, 1);
+    ASSERT_EQ(0.0f, peak(left_a, 100));
+    ASSERT(peak(left_a + 100, 924) > 0.01f);
+
+    // released, the voice rings out and the engine goes quiet
+    const SynthEvent note_off = {0, message(0x80, 69, 0)};
+    synth_process(synth, out, TEST_FRAMES, &note_off, 1);
+    ASSERT_EQ(0.0f, peak(left_a + TEST_FRAMES - 1024, 1024));
+    synth_destroy(synth);
+    PASS();
+}
+
+TEST synth_control_change_edits_the_patch(void) {
+    // fader 4 at 0 turns the volume down from the next block on, the note is still held
+    const SynthConfig config = synth_config_default(TEST_SAMPLE_RATE);
+    SynthEngine *synth = synth_create(&config);
+    ASSERT(synth != NULL);
+    float *out[] = {left_a, right_a};
+    const SynthEvent events[] = {{0, message(0x90, 69, 127)}, {512, message(0xB0, 17, 0)}};
+    synth_process(synth, out, 2048, events, 2);
+    ASSERT(peak(left_a, 512) > 0.01f);
+    ASSERT_EQ(0.0f, peak(left_a + 1024, 1024));
+    synth_destroy(synth);
+    PASS();
+}
+
+TEST synth_engines_are_independent(void) {
+    // a note on one engine is not heard on the other
+    const SynthConfig config = synth_config_default(TEST_SAMPLE_RATE);
+    SynthEngine *playing = synth_create(&config);
+    SynthEngine *quiet = synth_create(&config);
+    ASSERT(playing != NULL && quiet != NULL);
+    float *out_a[] = {left_a, right_a};
+    float *out_b[] = {left_b, right_b};
+    const SynthEvent note_on = {0, message(0x90, 60, 127)};
+    synth_process(playing, out_a, 1024, &note_on, 1);
+    synth_process(quiet, out_b, 1024, NULL, 0);
+    ASSERT(peak(left_a, 1024) > 0.01f);
+    ASSERT_EQ(0.0f, peak(left_b, 1024));
+    synth_destroy(playing);
+    synth_destroy(quiet);
+    PASS();
+}
+
+TEST synth_queued_events_play_at_their_frame(void) {
+    // a control thread queues on the clock of the engine, the control change comes back once it is due
+    const SynthConfig config = synth_config_default(TEST_SAMPLE_RATE);
+    SynthEngine *synth = synth_create(&config);
+    ASSERT(synth != NULL);
+    float *out[] = {left_a, right_a};
+    ASSERT(synth_queue_event(synth, 300, message(0x90, 69, 127)));
+    ASSERT(synth_queue_event(synth, 700, message(0xB0, 17, 64)));
+    ASSERT(synth_events_queued(synth));
+
+    uint32_t messages[4];
+    synth_process(synth, out, 512, NULL, 0);
+    ASSERT_EQ(0.0f, peak(left_a, 300));
+    ASSERT(peak(left_a + 300, 212) > 0.01f);
+    ASSERT_EQ(0, synth_poll_messages(synth, messages, 4));
+    synth_process(synth, out, 512, NULL, 0);
+    ASSERT_EQ(1, synth_poll_messages(synth, messages, 4));
+    ASSERT_EQ(message(0xB0, 17, 64), messages[0]);
+    ASSERT_FALSE(synth_events_queued(synth));
+    ASSERT_EQ(1024, synth_frames(synth));
+    ASSERT_EQ(1024, synth_frame_clock(synth, 0));
+
+    // a flush drops what is still queued at the next block
+    ASSERT(synth_queue_event(synth, 5000, message(0x90, 72, 127)));
+    synth_flush(synth);
+    ASSERT(synth_flushing(synth));
+    synth_process(synth, out, 128, NULL, 0);
+    ASSERT_FALSE(synth_flushing(synth));
+    ASSERT_FALSE(synth_events_queued(synth));
+    synth_destroy(synth);
+    PASS();
+}
+
+TEST synth_counts_voices_and_notes(void) {
+    const SynthConfig config = synth_config_default(TEST_SAMPLE_RATE);
+    SynthEngine *synth = synth_create(&config);
+    ASSERT(synth != NULL);
+    float *out[] = {left_a, right_a};
+    ASSERT(synth_play_live(synth, message(0x90, 60, 100)));
+    ASSERT(synth_play_live(synth, message(0x90, 64, 100)));
+    synth_process(synth, out, 128, NULL, 0);
+    ASSERT_EQ(2, synth_active_voices(synth));
+    SynthStats stats;
+    synth_get_stats(synth, &stats);
+    ASSERT_EQ(64, stats.last_note);
+    ASSERT_EQ(0, stats.quality_level);
+    ASSERT_EQ(0, (int) stats.events_late);
+
+    // mono steals the second voice, the releases ring out and the engine is idle
+    synth_set_polyphony(synth, 1);
+    ASSERT_EQ(1, synth_polyphony(synth));
+    synth_process(synth, out, 128, NULL, 0);
+    ASSERT(synth_active_voices(synth) <= 1);
+    const SynthEvent notes_off[] = {{0, message(0x80, 60, 0)}, {0, message(0x80, 64, 0)}};
+    synth_process(synth, out, TEST_FRAMES, notes_off, 2);
+    ASSERT_EQ(0, synth_active_voices(synth));
+    ASSERT(synth_idle(synth));
+    synth_destroy(synth);
+    PASS();
+}
+
+TEST synth_patch_is_handed_in(void) {
+    // a patch at volume 0 is silent, the control change of the volume fader turns it up again
+    const SynthConfig config = synth_config_default(TEST_SAMPLE_RATE);
+    SynthEngine *synth = synth_create(&config);
+    ASSERT(synth != NULL);
+    float *out[] = {left_a, right_a};
+    SynthPatch patch = synth_patch_default();
+    patch.volume = 0.0f;
+    synth_set_patch(synth, &patch);
+    ASSERT(synth_play_live(synth, message(0x90, 69, 127)));
+    synth_process(synth, out, 1024, NULL, 0);
+    ASSERT_EQ(0.0f, peak(left_a, 1024));
+
+    ASSERT(synth_patch_control_change(&patch, message(0xB0, 17, 127)));
+    ASSERT_FALSE(synth_patch_control_change(&patch, message(0x90, 17, 127)));
+    ASSERT_EQ(1.0f, patch.volume);
+    synth_set_patch(synth, &patch);
+    synth_process(synth, out, 1024, NULL, 0);
+    ASSERT(peak(left_a + 128, 896) > 0.01f);
+    ASSERT_EQ(0, synth_poll_messages(synth, (uint32_t[1]){0}, 1));
+    synth_destroy(synth);
+    PASS();
+}
+
+TEST synth_create_fails_without_memory(void) {
+    // terabytes of voices cannot be had, the engine is not made and nothing is left allocated
+    SynthConfig config = synth_config_default(TEST_SAMPLE_RATE);
+    config.max_polyphony = INT_MAX;
+    ASSERT_EQ(NULL, synth_create(&config));
+
+    // the same with an impulse response to copy
+    const float impulse_response[] = {1.0f, 0.5f, 0.25f};
+    config.impulse_response_left = impulse_response;
+    config.impulse_response_length = 3;
+    ASSERT_EQ(NULL, synth_create(&config));
+    PASS();
+}
+
+SUITE(synth_suite) {
+    RUN_TEST(synth_output_ignores_block_sizes);
+    RUN_TEST(synth_note_sounds_until_released);
+    RUN_TEST(synth_control_change_edits_the_patch);
+    RUN_TEST(synth_engines_are_independent);
+    RUN_TEST(synth_queued_events_play_at_their_frame);
+    RUN_TEST(synth_counts_voices_and_notes);
+    RUN_TEST(synth_patch_is_handed_in);
+    RUN_TEST(synth_create_fails_without_memory);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(synth_suite);
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,187 @@
+/*
+    Trace recorder, to see the audio, MIDI, ui and worker threads on one timeline.
+    Built with -DTRACE, TRACE_SCOPE(name) records the time from where it is declared to the
+    end of the enclosing block. Every thread writes into its own buffer, so recording
+    takes no lock: two timestamp reads and a store, the buffer overwrites its oldest
+    events and always holds the latest ones. trace_dump writes all the buffers as Chrome
+    trace-event JSON, which the trace viewer of a browser (chrome://tracing or Perfetto)
+    opens. Timestamps are the TSC on x86 and the performance counter elsewhere.
+    Without -DTRACE the macros are empty and nothing is recorded.
+    The name of a scope must be a string literal, only the pointer is stored.
+*/
+#include "platform.h"
+#include <stdio.h>
+
+#ifdef TRACE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define TRACE_THREADS_MAX 8
+#define TRACE_EVENTS_PER_THREAD 16384 // a power of two, a few seconds of the busiest thread
+
+typedef struct {
+    const char *name;
+    Uint64 start;
+    Uint64 end;
+} TraceEvent;
+
+typedef struct {
+    const char *thread_name;
+    TraceEvent *events;
+    SDL_AtomicInt written; // events recorded, only the owning thread writes
+} TraceBuffer;
+
+TraceEvent *trace_memory = NULL;
+TraceBuffer trace_buffers[TRACE_THREADS_MAX];
+SDL_AtomicInt trace_threads; // buffers claimed
+Uint64 trace_start_ticks; // timestamp and performance counter at trace_init, to convert ticks to time
+Uint64 trace_start_counter;
+__thread TraceBuffer *trace_buffer = NULL;
+__thread bool trace_buffer_claimed = false; // tried, the buffer stays NULL when they were all taken
+
+Uint64 trace_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return SDL_GetPerformanceCounter();
+#endif
+}
+
+// before any thread records, the buffers are allocated and prefaulted here so recording never faults a page in
+void trace_init(void) {
+    const size_t size = (size_t) TRACE_THREADS_MAX * TRACE_EVENTS_PER_THREAD * sizeof(TraceEvent);
+    trace_memory = SDL_malloc(size);
+    SDL_memset(trace_memory, 0, size);
+    for (int i = 0; i < TRACE_THREADS_MAX; i++) {
+        trace_buffers[i].events = trace_memory + (size_t) i * TRACE_EVENTS_PER_THREAD;
+    }
+    trace_start_ticks = trace_now();
+    trace_start_counter = SDL_GetPerformanceCounter();
+}
+
+// the buffer of the calling thread, claimed on its first event. NULL when they are all taken
+TraceBuffer *trace_thread_buffer(void) {
+    if (!trace_buffer_claimed && trace_memory != NULL) {
+        trace_buffer_claimed = true;
+        const int index = SDL_AddAtomicInt(&trace_threads, 1);
+        if (index < TRACE_THREADS_MAX) {
+            trace_buffer = &trace_buffers[index];
+        }
+    }
+    return trace_buffer;
+}
+
+// names the calling thread in the trace, the name must outlive the trace
+void trace_thread(const char *name) {
+    TraceBuffer *buffer = trace_thread_buffer();
+    if (buffer != NULL) {
+        buffer->thread_name = name;
+    }
+}
+
+void trace_record(const char *name, Uint64 start, Uint64 end) {
+    TraceBuffer *buffer = trace_thread_buffer();
+    if (buffer == NULL) return;
+    // only this thread writes the count, a release barrier and a plain store publish the event
+    const Uint32 written = (Uint32) buffer->written.value;
+    buffer->events[written & (TRACE_EVENTS_PER_THREAD - 1)] = (TraceEvent){.name = name, .start = start, .end = end};
+    SDL_MemoryBarrierRelease();
+    buffer->written.value = (int) (written + 1);
+}
+
+typedef struct {
+    const char *name;
+    Uint64 start;
+} TraceScope;
+
+TraceScope trace_scope_begin(const char *name) {
+    return (TraceScope){.name = name, .start = trace_now()};
+}
+
+void trace_scope_end(TraceScope *scope) {
+    trace_record(scope->name, scope->start, trace_now());
+}
+
+// copies the events of a buffer while its thread keeps recording. The ones the thread overwrote during the
+// copy, and the one it may be writing, are left out. Returns the index of the first valid copy
+Uint32 trace_snapshot(TraceBuffer *buffer, TraceEvent *copy, int *count) {
+    const Uint32 written = (Uint32) SDL_GetAtomicInt(&buffer->written);
+    const Uint32 available = SDL_min(written, (Uint32) TRACE_EVENTS_PER_THREAD);
+    const Uint32 first = written - available;
+    for (Uint32 i = first; i != written; i++) {
+        copy[i - first] = buffer->events[i & (TRACE_EVENTS_PER_THREAD - 1)];
+    }
+    const Uint32 behind = (Uint32) SDL_GetAtomicInt(&buffer->written) - first + 1;
+    const Uint32 lost = SDL_min(behind > TRACE_EVENTS_PER_THREAD ? behind - TRACE_EVENTS_PER_THREAD : 0, available);
+    *count = (int) (available - lost);
+    return lost;
+}
+
+// ui thread, the trace so far as Chrome trace-event JSON. Recording goes on while it is written
+bool trace_dump(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        SDL_Log("Trace %s: cannot write", path);
+        return false;
+    }
+    const double seconds = (double) (SDL_GetPerformanceCounter() - trace_start_counter) / (double) SDL_GetPerformanceFrequency();
+    const double ticks_per_us = seconds > 0.0 ? (double) (trace_now() - trace_start_ticks) / (seconds * 1e6) : 1.0;
+
+    TraceEvent *copy = SDL_malloc(TRACE_EVENTS_PER_THREAD * sizeof(TraceEvent));
+    const int threads = SDL_min(SDL_GetAtomicInt(&trace_threads), TRACE_THREADS_MAX);
+    int total = 0;
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (int t = 0; t < threads; t++) {
+        TraceBuffer *buffer = &trace_buffers[t];
+        fprintf(
+            file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+            t > 0 ? ",\n" : "", t, buffer->thread_name ? buffer->thread_name : "thread"
+        );
+        int count;
+        const Uint32 first = trace_snapshot(buffer, copy, &count);
+        for (int i = 0; i < count; i++) {
+            const TraceEvent *event = &copy[first + (Uint32) i];
+            fprintf(
+                file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                event->name, t, (double) (event->start - trace_start_ticks) / ticks_per_us,
+                (double) (event->end - event->start) / ticks_per_us
+            );
+        }
+        total += count;
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    SDL_free(copy);
+    SDL_Log("Trace %s: %d events of %d threads", path, total, threads);
+    return true;
+}
+
+// after every thread that records has stopped
+void trace_free(void) {
+    SDL_free(trace_memory);
+    trace_memory = NULL;
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) \
+    TraceScope TRACE_CONCAT(trace_scope_, __LINE__) __attribute__((cleanup(trace_scope_end))) = trace_scope_begin(name)
+#define TRACE_THREAD(name) trace_thread(name)
+
+#else
+
+void trace_init(void) {}
+
+bool trace_dump(const char *path) {
+    SDL_Log("Trace %s: not recorded, build with -DTRACE (make trace)", path);
+    return false;
+}
+
+void trace_free(void) {}
+
+#define TRACE_SCOPE(name)
+#define TRACE_THREAD(name)
+
+#endif
@@ -0,0 +1,92 @@
+#define TRACE
+#include "greatest.h"
+#include "trace.c"
+
+#define TEST_TRACE "trace_test.json"
+#define TEST_OVERHEAD_SCOPES 1000000
+
+static int SDLCALL record_worker(void *data) {
+    const int n = *(int *) data;
+    TRACE_THREAD("worker");
+    for (int i = 0; i < n; i++) {
+        TRACE_SCOPE(i % 2 ? "odd" : "even");
+    }
+    return 0;
+}
+
+static int count_occurrences(const char *text, const char *pattern) {
+    int count = 0;
+    for (const char *p = SDL_strstr(text, pattern); p != NULL; p = SDL_strstr(p + 1, pattern)) count++;
+    return count;
+}
+
+TEST trace_dumps_every_thread(void) {
+    TRACE_THREAD("main");
+    {
+        TRACE_SCOPE("outer");
+        TRACE_SCOPE("inner");
+    }
+    int n = 3;
+    SDL_Thread *worker = SDL_CreateThread(record_worker, "worker", &n);
+    SDL_WaitThread(worker, NULL);
+
+    ASSERT(trace_dump(TEST_TRACE));
+    size_t size;
+    char *json = SDL_LoadFile(TEST_TRACE, &size);
+    ASSERT(json != NULL);
+    ASSERT(SDL_strstr(json, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"main\"}}"));
+    ASSERT(SDL_strstr(json, "\"args\": {\"name\": \"worker\"}"));
+    ASSERT_EQ(2, count_occurrences(json, "\"name\": \"even\""));
+    ASSERT_EQ(1, count_occurrences(json, "\"name\": \"odd\""));
+    ASSERT_EQ(5, count_occurrences(json, "\"ph\": \"X\""));
+    SDL_free(json);
+    remove(TEST_TRACE);
+    PASS();
+}
+
+TEST trace_keeps_the_latest_events(void) {
+    int n = TRACE_EVENTS_PER_THREAD + 100;
+    SDL_Thread *worker = SDL_CreateThread(record_worker, "worker", &n);
+    SDL_WaitThread(worker, NULL);
+
+    TraceBuffer *buffer = &trace_buffers[SDL_GetAtomicInt(&trace_threads) - 1];
+    ASSERT_EQ(n, SDL_GetAtomicInt(&buffer->written));
+    TraceEvent *copy = SDL_malloc(TRACE_EVENTS_PER_THREAD * sizeof(TraceEvent));
+    int count;
+    const Uint32 first = trace_snapshot(buffer, copy, &count);
+
+    // a full buffer leaves out its oldest slot, the thread could be writing it
+    ASSERT_EQ(TRACE_EVENTS_PER_THREAD - 1, count);
+    ASSERT_STR_EQ((n - 1) % 2 ? "odd" : "even", copy[first + count - 1].name);
+    for (int i = 1; i < count; i++) {
+        ASSERT(copy[first + i].start >= copy[first + i - 1].end);
+    }
+    SDL_free(copy);
+    PASS();
+}
+
+// not a pass or fail, the cost of a scope on this machine
+TEST trace_scope_overhead(void) {
+    const Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < TEST_OVERHEAD_SCOPES; i++) {
+        TRACE_SCOPE("overhead");
+    }
+    const double seconds = (double) (SDL_GetPerformanceCounter() - start) / (double) SDL_GetPerformanceFrequency();
+    printf("trace scope: %.1f ns\n", seconds * 1e9 / TEST_OVERHEAD_SCOPES);
+    PASS();
+}
+
+SUITE(trace_suite) {
+    RUN_TEST(trace_dumps_every_thread);
+    RUN_TEST(trace_keeps_the_latest_events);
+    RUN_TEST(trace_scope_overhead);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    trace_init();
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(trace_suite);
+    GREATEST_MAIN_END();
+}
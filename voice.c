@@ -0,0 +1,266 @@
+/*
+    Voices, each one plays a note with its own oscillator phases, filters and envelopes.
+    The patch (oscillator, filter, envelopes, modulation routing) is shared by all of them.
+    With polyphony 1 the pool is monophonic with last note priority, as before.
+    A released voice keeps playing through the release of its envelopes, then its filters
+    ring out. It goes idle once the envelopes are done and output and filter states are
+    below VOICE_SILENCE_THRESHOLD.
+*/
+#include "platform.h"
+#include <assert.h>
+
+#define VOICES_MAX 16 // default for the size of the pool
+#define VOICE_SILENCE_THRESHOLD 1e-5f // -100 dB
+
+typedef struct {
+    bool active; // rendering, held or ringing out
+    bool gate; // the key is held
+    MidiNote midi_note;
+    float freq;
+    float velocity; // from 0.0 to 1.0
+    Uint64 started; // note on order, the oldest voice is stolen first
+
+    float phase; // phase without unison
+    Unison unison;
+    // the right filter is only used when unison spreads the voice in stereo
+    Filter filter_left;
+    Filter filter_right;
+    ModVoiceSources mod_sources;
+    ModState mod;
+} Voice;
+
+typedef struct {
+    Voice *voices; // voices_max of them, in the arena
+    int voices_max;
+    int polyphony; // 1 to voices_max
+    Uint64 notes_started;
+    uint32_t seed;
+} VoicePool;
+
+size_t voice_pool_footprint(int voices_max) {
+    return arena_align(voices_max * sizeof(Voice));
+}
+
+// not while rendering, every voice silent and the pool as voice_pool_init made it
+void voice_pool_reset(VoicePool *pool) {
+    SDL_memset(pool->voices, 0, pool->voices_max * sizeof(Voice));
+    pool->polyphony = pool->voices_max;
+    pool->notes_started = 0;
+    pool->seed = 0x9e3779b9;
+}
+
+VoicePool voice_pool_init(Arena *arena, int voices_max) {
+    assert(voices_max >= 1);
+    VoicePool pool = {
+        .voices = arena_alloc(arena, voices_max * sizeof(Voice)),
+        .voices_max = voices_max,
+    };
+    voice_pool_reset(&pool);
+    return pool;
+}
+
+// values holds the shared sources, the voice is modulated from its first sample
+void voice_start(VoicePool *pool, Voice *voice, const PressedNote note, const Patch *patch, float values[MOD_SRC_COUNT]) {
+    voice->active = true;
+    voice->gate = true;
+    voice->midi_note = note.midi_note;
+    voice->freq = note.freq;
+    voice->velocity = note.velocity;
+    voice->started = pool->notes_started++;
+    voice->phase = 0.0f;
+    voice->unison = unison_init(&patch->oscillator, &pool->seed);
+    voice->filter_left = patch->filter;
+    voice->filter_right = patch->filter;
+    filter_reset(&voice->filter_left);
+    filter_reset(&voice->filter_right);
+    voice->mod_sources = mod_voice_sources_init(note.velocity);
+    envelope_copy_settings(&voice->mod_sources.env1, &patch->env1);
+    envelope_copy_settings(&voice->mod_sources.env2, &patch->env2);
+    mod_voice_sources_gate_on(&voice->mod_sources);
+    mod_voice_sources_next(&voice->mod_sources, 0.0f, values);
+    voice->mod = mod_state_start(&patch->mod_matrix, values);
+}
+
+// legato, change the note without restarting phases or envelopes
+void voice_retarget(Voice *voice, const PressedNote note) {
+    voice->midi_note = note.midi_note;
+    voice->freq = note.freq;
+    voice->velocity = note.velocity;
+    voice->mod_sources.velocity = note.velocity;
+}
+
+// key released, the envelopes release and the filter tails ring out
+void voice_release(Voice *voice) {
+    voice->gate = false;
+    mod_voice_sources_gate_off(&voice->mod_sources);
+}
+
+// silent or stolen, the filter states are zeroed so nothing decays into denormals
+void voice_sleep(Voice *voice) {
+    voice->active = false;
+    voice->gate = false;
+    filter_reset(&voice->filter_left);
+    filter_reset(&voice->filter_right);
+}
+
+// values holds the shared sources of the current control block
+void voice_pool_note_on(VoicePool *pool, const PressedNote note, const Patch *patch, float values[MOD_SRC_COUNT]) {
+    if (pool->polyphony == 1) {
+        Voice *voice = &pool->voices[0];
+        if (voice->gate) {
+            voice_retarget(voice, note);
+        } else {
+            voice_start(pool, voice, note, patch, values);
+        }
+        return;
+    }
+
+    // a free voice, or steal the oldest one, ringing out voices first
+    Voice *chosen = &pool->voices[0];
+    for (int i = 0; i < pool->polyphony; i++) {
+        Voice *voice = &pool->voices[i];
+        if (!voice->active) {
+            chosen = voice;
+            break;
+        }
+        if (voice->gate != chosen->gate ? !voice->gate : voice->started < chosen->started) {
+            chosen = voice;
+        }
+    }
+    voice_start(pool, chosen, note, patch, values);
+}
+
+// held is the note a monophonic pool falls back to, NULL when no other note is held
+void voice_pool_note_off(VoicePool *pool, MidiNote midi_note, const PressedNote *held) {
+    for (int i = 0; i < pool->polyphony; i++) {
+        Voice *voice = &pool->voices[i];
+        if (!voice->gate || voice->midi_note != midi_note) {
+            continue;
+        }
+        if (pool->polyphony == 1 && held != NULL) {
+            voice_retarget(voice, *held);
+        } else {
+            voice_release(voice);
+        }
+    }
+}
+
+// all notes off, every held voice rings out
+void voice_pool_release_all(VoicePool *pool) {
+    for (int i = 0; i < pool->voices_max; i++) {
+        if (pool->voices[i].gate) {
+            voice_release(&pool->voices[i]);
+        }
+    }
+}
+
+void voice_pool_set_polyphony(VoicePool *pool, int polyphony) {
+    pool->polyphony = SDL_clamp(polyphony, 1, pool->voices_max);
+    for (int i = pool->polyphony; i < pool->voices_max; i++) {
+        if (pool->voices[i].active) {
+            voice_sleep(&pool->voices[i]);
+        }
+    }
+}
+
+// ringing out voices count as silent
+float voice_level(const Voice *voice) {
+    return voice->gate ? voice->velocity * voice->mod.current[MOD_DST_AMPLITUDE] : 0.0f;
+}
+
+// stop the quietest voices until at most limit are active, returns how many were stopped
+int voice_pool_limit(VoicePool *pool, int limit) {
+    int stolen = 0;
+    for (;;) {
+        Voice *quietest = NULL;
+        int active = 0;
+        for (int i = 0; i < pool->voices_max; i++) {
+            Voice *voice = &pool->voices[i];
+            if (!voice->active) continue;
+            active++;
+            if (quietest == NULL || voice_level(voice) < voice_level(quietest)) {
+                quietest = voice;
+            }
+        }
+        if (active <= limit) return stolen;
+        voice_sleep(quietest);
+        stolen++;
+    }
+}
+
+int voice_pool_active_count(const VoicePool *pool) {
+    int count = 0;
+    for (int i = 0; i < pool->voices_max; i++) {
+        count += pool->voices[i].active;
+    }
+    return count;
+}
+
+// start of a control block, values already holds the shared sources
+void voice_control(Voice *voice, const Patch *patch, float values[MOD_SRC_COUNT], float dt) {
+    envelope_copy_settings(&voice->mod_sources.env1, &patch->env1);
+    envelope_copy_settings(&voice->mod_sources.env2, &patch->env2);
+    mod_voice_sources_next(&voice->mod_sources, dt, values);
+    mod_matrix_evaluate(&patch->mod_matrix, &voice->mod, values);
+    filter_copy_settings(&voice->filter_left, &patch->filter);
+    filter_copy_settings(&voice->filter_right, &patch->filter);
+    filter_flush_denormals(&voice->filter_left);
+    filter_flush_denormals(&voice->filter_right);
+}
+
+// render n device samples and add them to left and right, which hold n * oversampling samples.
+// A released voice goes to sleep once its envelopes are idle and it is silent.
+void voice_render(
+    Voice *voice,
+    const Oscillator *oscillator,
+    float amplitude,
+    float phase_scale,
+    int oversampling,
+    float *left,
+    float *right,
+    int n
+) {
+    if (!unison_is_configured(&voice->unison, oscillator)) {
+        unison_configure(&voice->unison, oscillator);
+    }
+    const bool stereo = oscillator->unison > 1 && oscillator->unison_spread > 0.0f;
+    float tail_peak = 0.0f;
+
+    for (int i = 0; i < n; i++) {
+        mod_state_next(&voice->mod);
+        Oscillator modulated = *oscillator;
+        modulated.square_pulse_width = SDL_clamp(
+            oscillator->square_pulse_width + voice->mod.current[MOD_DST_PULSE_WIDTH], 0.0f, 1.0f
+        );
+        filter_set_modulation(&voice->filter_left, voice->mod.current[MOD_DST_CUTOFF]);
+        filter_set_modulation(&voice->filter_right, voice->mod.current[MOD_DST_CUTOFF]);
+
+        const float voice_amplitude = amplitude * voice->velocity * voice->mod.current[MOD_DST_AMPLITUDE];
+        const float phase_step = voice->freq * voice->mod.current[MOD_DST_PITCH] * phase_scale;
+
+        for (int k = 0; k < oversampling; k++) {
+            const int index = i * oversampling + k;
+            float sample_left;
+            float sample_right;
+            if (modulated.unison <= 1) {
+                sample_left = filter_process(&voice->filter_left, oscillator_next_point(modulated, voice_amplitude, voice->phase));
+                sample_right = sample_left;
+                voice->phase += phase_step;
+                if (voice->phase >= 1.0f) voice->phase -= 1.0f;
+            } else {
+                unison_next_point(&voice->unison, &modulated, voice_amplitude, phase_step, &sample_left, &sample_right);
+                sample_left = filter_process(&voice->filter_left, sample_left);
+                sample_right = stereo ? filter_process(&voice->filter_right, sample_right) : sample_left;
+            }
+            left[index] += sample_left;
+            right[index] += sample_right;
+            tail_peak = SDL_max(tail_peak, SDL_max(SDL_fabsf(sample_left), SDL_fabsf(sample_right)));
+        }
+    }
+
+    if (!voice->gate && mod_voice_sources_idle(&voice->mod_sources) && tail_peak < VOICE_SILENCE_THRESHOLD
+        && filter_state_level(&voice->filter_left) < VOICE_SILENCE_THRESHOLD
+        && filter_state_level(&voice->filter_right) < VOICE_SILENCE_THRESHOLD) {
+        voice_sleep(voice);
+    }
+}
@@ -0,0 +1,133 @@
+/*
+    Deadline watchdog. audio_callback measures how long it took against the time the
+    frames it rendered last, the load. Above degrade_load the quality drops one level,
+    below restore_load for restore_callbacks callbacks in a row it comes back one level.
+    Levels are cumulative, each one keeps the savings of the ones before.
+    Everything here runs on the audio thread, the ui only reads the counters.
+*/
+#include "platform.h"
+
+#define WATCHDOG_DEGRADE_LOAD 0.75f
+#define WATCHDOG_RESTORE_LOAD 0.4f
+#define WATCHDOG_RESTORE_CALLBACKS 200 // a few seconds with small buffers
+#define WATCHDOG_COOLDOWN_CALLBACKS 8 // let a level take effect before judging it
+
+typedef enum {
+    QUALITY_FULL,
+    QUALITY_FEWER_VOICES, // the quietest voices are stolen down to 3/4 of the polyphony
+    QUALITY_NO_OVERSAMPLING,
+    QUALITY_LESS_UNISON, // at most 2 copies
+    QUALITY_CHEAP_KERNELS, // half the polyphony, ladder as svf, coarser filter coefficients
+    QUALITY_LEVEL_COUNT,
+} QualityLevel;
+
+char *quality_level_to_str(QualityLevel level) {
+    switch (level) {
+        case QUALITY_FULL:
+            return "FULL";
+        case QUALITY_FEWER_VOICES:
+            return "FEWER VOICES";
+        case QUALITY_NO_OVERSAMPLING:
+            return "NO OS";
+        case QUALITY_LESS_UNISON:
+            return "LESS UNISON";
+        case QUALITY_CHEAP_KERNELS:
+            return "CHEAP";
+        default:
+            return "?";
+    }
+}
+
+typedef struct {
+    float degrade_load; // fraction of the deadline
+    float restore_load;
+    int restore_callbacks;
+
+    QualityLevel level;
+    float load; // of the last callback
+    float load_peak; // decays slowly, for display
+    int calm; // callbacks in a row under restore_load
+    int cooldown;
+
+    // metrics
+    Uint64 overruns; // callbacks that took longer than their deadline
+    Uint64 degrades[QUALITY_LEVEL_COUNT]; // times each level was entered from above
+    Uint64 restores;
+    Uint64 voices_stolen;
+} Watchdog;
+
+Watchdog watchdog_init(float degrade_load) {
+    Watchdog watchdog = {
+        .degrade_load = degrade_load,
+        .restore_load = SDL_min(WATCHDOG_RESTORE_LOAD, 0.5f * degrade_load),
+        .restore_callbacks = WATCHDOG_RESTORE_CALLBACKS,
+        .level = QUALITY_FULL,
+    };
+    return watchdog;
+}
+
+// ticks from SDL_GetPerformanceCounter, frames is what the callback rendered
+void watchdog_update(Watchdog *watchdog, Uint64 start, Uint64 end, int frames, int sample_rate) {
+    if (frames <= 0) return;
+    const double elapsed = (double) (end - start) / (double) SDL_GetPerformanceFrequency();
+    const double deadline = (double) frames / (double) sample_rate;
+    watchdog->load = (float) (elapsed / deadline);
+    watchdog->load_peak = SDL_max(watchdog->load, watchdog->load_peak * 0.995f);
+    watchdog->overruns += watchdog->load > 1.0f;
+
+    if (watchdog->cooldown > 0) {
+        watchdog->cooldown--;
+        return;
+    }
+    if (watchdog->load > watchdog->degrade_load) {
+        watchdog->calm = 0;
+        if (watchdog->level < QUALITY_LEVEL_COUNT - 1) {
+            watchdog->level++;
+            watchdog->degrades[watchdog->level]++;
+            watchdog->cooldown = WATCHDOG_COOLDOWN_CALLBACKS;
+        }
+    } else if (watchdog->load < watchdog->restore_load) {
+        if (++watchdog->calm >= watchdog->restore_callbacks && watchdog->level > QUALITY_FULL) {
+            watchdog->level--;
+            watchdog->restores++;
+            watchdog->calm = 0;
+            watchdog->cooldown = WATCHDOG_COOLDOWN_CALLBACKS;
+        }
+    } else {
+        watchdog->calm = 0;
+    }
+}
+
+int watchdog_voice_limit(const Watchdog *watchdog, int polyphony) {
+    if (watchdog->level >= QUALITY_CHEAP_KERNELS) return SDL_max(1, polyphony / 2);
+    if (watchdog->level >= QUALITY_FEWER_VOICES) return SDL_max(1, polyphony * 3 / 4);
+    return polyphony;
+}
+
+int watchdog_oversampling(const Watchdog *watchdog, int oversampling) {
+    return watchdog->level >= QUALITY_NO_OVERSAMPLING ? 1 : oversampling;
+}
+
+// the patch as rendered at the current level
+void watchdog_degrade_patch(const Watchdog *watchdog, Patch *patch) {
+    if (watchdog->level >= QUALITY_LESS_UNISON) {
+        patch->oscillator.unison = SDL_min(patch->oscillator.unison, 2);
+    }
+    if (watchdog->level >= QUALITY_CHEAP_KERNELS) {
+        if (patch->filter.mode == FILTER_MODE_LADDER) {
+            patch->filter.mode = FILTER_MODE_SVF_LOWPASS;
+        }
+        patch->filter.coefficient_threshold = FILTER_COEFFICIENT_THRESHOLD_CHEAP;
+    }
+}
+
+void watchdog_report(const Watchdog *watchdog) {
+    SDL_Log(
+        "Watchdog: %llu overruns, %llu restores, %llu voices stolen, peak load %.0f%%",
+        (unsigned long long) watchdog->overruns, (unsigned long long) watchdog->restores,
+        (unsigned long long) watchdog->voices_stolen, watchdog->load_peak * 100.0f
+    );
+    for (int level = QUALITY_FULL + 1; level < QUALITY_LEVEL_COUNT; level++) {
+        SDL_Log("  degraded to %s %llu times", quality_level_to_str(level), (unsigned long long) watchdog->degrades[level]);
+    }
+}
@@ -0,0 +1,85 @@
+/*
+    WAV files of 32-bit float samples, interleaved, the format the engine renders. The header
+    is the extensible-free form for IEEE float: RIFF, an 18 byte fmt chunk, the fact chunk
+    with the frame count, then the data chunk. Everything is little endian.
+    wav_write writes a whole buffer at once. A file written a block at a time starts with the
+    header of an empty file and gets the real one written over it when done, wav_header
+    builds both.
+*/
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include <stdio.h>
+
+#define WAV_HEADER_SIZE 58
+#define WAV_FORMAT_FLOAT 3
+#define WAV_DATA_MAX (0xFFFFFFFFu - WAV_HEADER_SIZE) // bytes of samples, the RIFF size must fit in 32 bits
+
+void wav_write_le16(Uint8 *p, Uint16 value) {
+    p[0] = (Uint8) value;
+    p[1] = (Uint8) (value >> 8);
+}
+
+void wav_write_le32(Uint8 *p, Uint32 value) {
+    for (int i = 0; i < 4; i++) p[i] = (Uint8) (value >> (8 * i));
+}
+
+// the header of a file with frames of channels samples each
+void wav_header(Uint8 header[WAV_HEADER_SIZE], int channels, int sample_rate, Uint32 frames) {
+    const Uint32 block_align = (Uint32) channels * sizeof(float);
+    const Uint32 data_size = frames * block_align;
+    assert(data_size / block_align == frames && data_size <= WAV_DATA_MAX);
+    SDL_memcpy(header, "RIFF", 4);
+    wav_write_le32(header + 4, WAV_HEADER_SIZE - 8 + data_size);
+    SDL_memcpy(header + 8, "WAVEfmt ", 8);
+    wav_write_le32(header + 16, 18);
+    wav_write_le16(header + 20, WAV_FORMAT_FLOAT);
+    wav_write_le16(header + 22, (Uint16) channels);
+    wav_write_le32(header + 24, (Uint32) sample_rate);
+    wav_write_le32(header + 28, (Uint32) sample_rate * block_align);
+    wav_write_le16(header + 32, (Uint16) block_align);
+    wav_write_le16(header + 34, 32);
+    wav_write_le16(header + 36, 0); // no extension
+    SDL_memcpy(header + 38, "fact", 4);
+    wav_write_le32(header + 42, 4);
+    wav_write_le32(header + 46, frames);
+    SDL_memcpy(header + 50, "data", 4);
+    wav_write_le32(header + 54, data_size);
+}
+
+// count samples in the byte order of the file, returns whether all of them were written
+bool wav_write_samples(FILE *file, const float *samples, size_t count) {
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+    return fwrite(samples, sizeof(float), count, file) == count;
+#else
+    Uint8 bytes[1024 * sizeof(float)];
+    for (size_t done = 0; done < count;) {
+        const size_t n = SDL_min(count - done, (size_t) 1024);
+        for (size_t i = 0; i < n; i++) {
+            Uint32 bits;
+            SDL_memcpy(&bits, &samples[done + i], sizeof(bits));
+            wav_write_le32(bytes + i * sizeof(float), bits);
+        }
+        if (fwrite(bytes, sizeof(float), n, file) != n) return false;
+        done += n;
+    }
+    return true;
+#endif
+}
+
+// interleaved samples, frames of channels each. False when the file cannot be written
+bool wav_write(const char *path, const float *samples, int channels, int sample_rate, Uint32 frames) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        SDL_Log("WAV %s: cannot write", path);
+        return false;
+    }
+    Uint8 header[WAV_HEADER_SIZE];
+    wav_header(header, channels, sample_rate, frames);
+    bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    written = written && wav_write_samples(file, samples, (size_t) frames * (size_t) channels);
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        SDL_Log("WAV %s: write failed", path);
+    }
+    return written;
+}
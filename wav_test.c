@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include "greatest.h"
+#include "wav.c"
+
+#define TEST_WAV "wav_test.wav"
+
+static Uint32 read_le32(const Uint8 *p) {
+    return (Uint32) p[0] | (Uint32) p[1] << 8 | (Uint32) p[2] << 16 | (Uint32) p[3] << 24;
+}
+
+static Uint16 read_le16(const Uint8 *p) {
+    return (Uint16) (p[0] | p[1] << 8);
+}
+
+TEST wav_header_describes_float_stereo(void) {
+    Uint8 header[WAV_HEADER_SIZE];
+    wav_header(header, 2, 48000, 1000);
+    ASSERT_MEM_EQ("RIFF", header, 4);
+    ASSERT_EQ(WAV_HEADER_SIZE - 8 + 8000, read_le32(header + 4));
+    ASSERT_MEM_EQ("WAVEfmt ", header + 8, 8);
+    ASSERT_EQ(WAV_FORMAT_FLOAT, read_le16(header + 20));
+    ASSERT_EQ(2, read_le16(header + 22));
+    ASSERT_EQ(48000, read_le32(header + 24));
+    ASSERT_EQ(48000 * 8, read_le32(header + 28));
+    ASSERT_EQ(8, read_le16(header + 32));
+    ASSERT_EQ(32, read_le16(header + 34));
+    ASSERT_MEM_EQ("fact", header + 38, 4);
+    ASSERT_EQ(1000, read_le32(header + 46));
+    ASSERT_MEM_EQ("data", header + 50, 4);
+    ASSERT_EQ(8000, read_le32(header + 54));
+    PASS();
+}
+
+TEST wav_write_stores_the_samples(void) {
+    float samples[64 * 2];
+    for (int i = 0; i < 64 * 2; i++) {
+        samples[i] = (float) i / 128.0f - 0.5f;
+    }
+    ASSERT(wav_write(TEST_WAV, samples, 2, 44100, 64));
+
+    Uint8 bytes[WAV_HEADER_SIZE + sizeof(samples) + 1];
+    FILE *file = fopen(TEST_WAV, "rb");
+    ASSERT(file != NULL);
+    const size_t size = fread(bytes, 1, sizeof(bytes), file);
+    fclose(file);
+    remove(TEST_WAV);
+    ASSERT_EQ(WAV_HEADER_SIZE + sizeof(samples), size);
+    ASSERT_EQ(size - 8, read_le32(bytes + 4));
+    for (int i = 0; i < 64 * 2; i++) {
+        const Uint32 bits = read_le32(bytes + WAV_HEADER_SIZE + i * 4);
+        float sample;
+        SDL_memcpy(&sample, &bits, sizeof(sample));
+        ASSERT_EQ(samples[i], sample);
+    }
+    PASS();
+}
+
+TEST wav_write_fails_without_a_directory(void) {
+    const float samples[2] = {0};
+    ASSERT_FALSE(wav_write("no/such/directory/test.wav", samples, 2, 44100, 1));
+    PASS();
+}
+
+SUITE(wav_suite) {
+    RUN_TEST(wav_header_describes_float_stereo);
+    RUN_TEST(wav_write_stores_the_samples);
+    RUN_TEST(wav_write_fails_without_a_directory);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+    GREATEST_MAIN_BEGIN();
+    RUN_SUITE(wav_suite);
+    GREATEST_MAIN_END();
+}